@@ -292,7 +292,8 @@ edit_actions_update (GimpActionGroup *group,
             children = TRUE;
         }
 
-      undo_enabled = gimp_image_undo_is_enabled (image);
+      undo_enabled = (gimp_image_undo_is_enabled (image) &&
+                      ! gimp_image_undo_is_blocked (image));
 
       if (undo_enabled)
         {
@@ -203,14 +203,16 @@ typedef struct _GimpTagged          GimpTagged;      /* dummy typedef */
 
 /*  non-object types  */
 
-typedef struct _GimpBoundSeg        GimpBoundSeg;
-typedef struct _GimpCoords          GimpCoords;
-typedef struct _GimpGradientSegment GimpGradientSegment;
-typedef struct _GimpPaletteEntry    GimpPaletteEntry;
-typedef struct _GimpSamplePoint     GimpSamplePoint;
-typedef struct _GimpScanConvert     GimpScanConvert;
-typedef struct _GimpTempBuf         GimpTempBuf;
-typedef         guint32             GimpTattoo;
+typedef struct _GimpBoundSeg          GimpBoundSeg;
+typedef struct _GimpCoords            GimpCoords;
+typedef struct _GimpDrawableHistogram GimpDrawableHistogram;
+typedef struct _GimpGradientSegment   GimpGradientSegment;
+typedef struct _GimpPaletteEntry      GimpPaletteEntry;
+typedef struct _GimpSamplePoint       GimpSamplePoint;
+typedef struct _GimpScanConvert       GimpScanConvert;
+typedef struct _GimpTempBuf           GimpTempBuf;
+typedef struct _GimpUndoSwapBuffer    GimpUndoSwapBuffer;
+typedef         guint32               GimpTattoo;
 
 /* The following hack is made so that we can reuse the definition
  * the cairo definition of cairo_path_t without having to translate
@@ -0,0 +1,695 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-undo-swap.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gegl.h>
+
+#include "libgimpconfig/gimpconfig.h"
+
+#include "core-types.h"
+
+#include "config/gimpgeglconfig.h"
+
+#include "gimp.h"
+#include "gimp-undo-swap.h"
+#include "gimp-utils.h"
+
+#include "gimp-intl.h"
+
+
+/*  the number of rows which are compressed in one go  */
+#define BAND_HEIGHT  64
+
+/*  the minimal amount of output space offered to the converter  */
+#define CHUNK_SIZE   (64 * 1024)
+
+
+/*  A GimpUndoSwapBuffer holds the pixels of a buffer, zlib compressed,
+ *  either in memory or in the undo swap file.  Each row is stored as
+ *  the difference of every byte to the same byte of the previous pixel,
+ *  which makes smooth image data compress a lot better.
+ */
+struct _GimpUndoSwapBuffer
+{
+  GeglRectangle  extent;
+  const Babl    *format;
+
+  GBytes        *data;    /*  the compressed pixels, while in memory  */
+  goffset        offset;  /*  their location in the swap file, else   */
+  gsize          size;
+};
+
+typedef struct
+{
+  goffset  offset;
+  gsize    size;
+} GimpUndoSwapHole;
+
+
+/*  local function prototypes  */
+
+static void       gimp_undo_swap_filter   (guchar        *data,
+                                           gint           rows,
+                                           gint           stride,
+                                           gint           bpp);
+static void       gimp_undo_swap_unfilter (guchar        *data,
+                                           gint           rows,
+                                           gint           stride,
+                                           gint           bpp);
+static gboolean   gimp_undo_swap_compress (GConverter    *converter,
+                                           const guchar  *data,
+                                           gsize          size,
+                                           gboolean       last,
+                                           GByteArray    *array);
+
+static gboolean   gimp_undo_swap_open     (void);
+static goffset    gimp_undo_swap_alloc    (gsize          size);
+static void       gimp_undo_swap_release  (goffset        offset,
+                                           gsize          size);
+static GBytes   * gimp_undo_swap_read     (goffset        offset,
+                                           gsize          size,
+                                           GError       **error);
+
+
+/*  local variables  */
+
+static Gimp          *undo_swap_gimp   = NULL;
+static GFile         *undo_swap_file   = NULL;
+static GFileIOStream *undo_swap_stream = NULL;
+static GList         *undo_swap_holes  = NULL;  /*  sorted by offset  */
+static goffset        undo_swap_size   = 0;
+static gboolean       undo_swap_failed = FALSE;
+
+
+/*  public functions  */
+
+void
+gimp_undo_swap_init (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  /*  the swap file is created lazily, when the first buffer is
+   *  spilled, so the configured swap path is known by then
+   */
+  undo_swap_gimp = gimp;
+}
+
+void
+gimp_undo_swap_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  if (undo_swap_stream)
+    {
+      g_io_stream_close (G_IO_STREAM (undo_swap_stream), NULL, NULL);
+      g_clear_object (&undo_swap_stream);
+
+      g_file_delete (undo_swap_file, NULL, NULL);
+    }
+
+  g_clear_object (&undo_swap_file);
+
+  g_list_free_full (undo_swap_holes, g_free);
+  undo_swap_holes = NULL;
+  undo_swap_size  = 0;
+
+  undo_swap_gimp = NULL;
+}
+
+/**
+ * gimp_undo_swap_buffer_new:
+ * @buffer: a #GeglBuffer
+ *
+ * Compresses the pixels of @buffer into memory.  @buffer is not
+ * referenced and can be dropped afterwards.
+ *
+ * Return value: the compressed pixels, or %NULL on error.
+ **/
+GimpUndoSwapBuffer *
+gimp_undo_swap_buffer_new (GeglBuffer *buffer)
+{
+  GimpUndoSwapBuffer *swap;
+  GConverter         *compressor;
+  GByteArray         *array;
+  guchar             *band;
+  gint                bpp;
+  gint                stride;
+  gint                y;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+
+  swap = g_slice_new0 (GimpUndoSwapBuffer);
+
+  swap->extent = *gegl_buffer_get_extent (buffer);
+  swap->format = gegl_buffer_get_format (buffer);
+  swap->offset = -1;
+
+  bpp    = babl_format_get_bytes_per_pixel (swap->format);
+  stride = bpp * swap->extent.width;
+
+  compressor =
+    G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+  array      = g_byte_array_new ();
+  band       = g_malloc (stride * MIN (swap->extent.height, BAND_HEIGHT));
+
+  for (y = 0; y < swap->extent.height; y += BAND_HEIGHT)
+    {
+      gint rows = MIN (BAND_HEIGHT, swap->extent.height - y);
+
+      gegl_buffer_get (buffer,
+                       GEGL_RECTANGLE (swap->extent.x, swap->extent.y + y,
+                                       swap->extent.width, rows),
+                       1.0, swap->format, band,
+                       stride, GEGL_ABYSS_NONE);
+
+      gimp_undo_swap_filter (band, rows, stride, bpp);
+
+      if (! gimp_undo_swap_compress (compressor, band, rows * stride,
+                                     y + rows == swap->extent.height,
+                                     array))
+        {
+          g_byte_array_free (array, TRUE);
+          array = NULL;
+
+          break;
+        }
+    }
+
+  g_free (band);
+  g_object_unref (compressor);
+
+  if (! array)
+    {
+      g_slice_free (GimpUndoSwapBuffer, swap);
+
+      return NULL;
+    }
+
+  swap->size = array->len;
+  swap->data = g_byte_array_free_to_bytes (array);
+
+  return swap;
+}
+
+void
+gimp_undo_swap_buffer_free (GimpUndoSwapBuffer *swap)
+{
+  g_return_if_fail (swap != NULL);
+
+  if (swap->data)
+    g_bytes_unref (swap->data);
+  else
+    gimp_undo_swap_release (swap->offset, swap->size);
+
+  g_slice_free (GimpUndoSwapBuffer, swap);
+}
+
+/**
+ * gimp_undo_swap_buffer_spill:
+ * @swap: a #GimpUndoSwapBuffer
+ *
+ * Moves the compressed pixels of @swap from memory to the undo swap
+ * file.  If the swap file can't be used, @swap stays in memory.
+ *
+ * Return value: %TRUE if @swap is now on disk.
+ **/
+gboolean
+gimp_undo_swap_buffer_spill (GimpUndoSwapBuffer *swap)
+{
+  GOutputStream *output;
+  goffset        offset;
+  GError        *error = NULL;
+
+  g_return_val_if_fail (swap != NULL, FALSE);
+
+  if (! swap->data)
+    return TRUE;
+
+  if (! gimp_undo_swap_open ())
+    return FALSE;
+
+  offset = gimp_undo_swap_alloc (swap->size);
+  output = g_io_stream_get_output_stream (G_IO_STREAM (undo_swap_stream));
+
+  if (! g_seekable_seek (G_SEEKABLE (undo_swap_stream),
+                         offset, G_SEEK_SET, NULL, &error) ||
+      ! g_output_stream_write_all (output,
+                                   g_bytes_get_data (swap->data, NULL),
+                                   swap->size, NULL, NULL, &error))
+    {
+      gimp_message (undo_swap_gimp, NULL, GIMP_MESSAGE_WARNING,
+                    _("Failed to write to the undo swap file, undo "
+                      "history is kept in memory: %s"),
+                    error->message);
+      g_clear_error (&error);
+
+      gimp_undo_swap_release (offset, swap->size);
+
+      /*  most likely the disk is full, keep everything in memory  */
+      undo_swap_failed = TRUE;
+
+      return FALSE;
+    }
+
+  g_bytes_unref (swap->data);
+  swap->data   = NULL;
+  swap->offset = offset;
+
+  return TRUE;
+}
+
+gboolean
+gimp_undo_swap_buffer_is_spilled (GimpUndoSwapBuffer *swap)
+{
+  g_return_val_if_fail (swap != NULL, FALSE);
+
+  return swap->data == NULL;
+}
+
+/**
+ * gimp_undo_swap_buffer_restore:
+ * @swap: a #GimpUndoSwapBuffer
+ *
+ * Decompresses @swap, reading it back from the swap file if needed.
+ * @swap itself is left untouched, so restoring can be retried after
+ * an error.
+ *
+ * Return value: a new #GeglBuffer with the original pixels, or %NULL
+ *               on error, in which case @error is set.
+ **/
+GeglBuffer *
+gimp_undo_swap_buffer_restore (GimpUndoSwapBuffer  *swap,
+                               GError             **error)
+{
+  GeglBuffer   *buffer;
+  GConverter   *decompressor;
+  GBytes       *bytes;
+  const guchar *data;
+  gsize         size;
+  guchar       *band;
+  gint          bpp;
+  gint          stride;
+  gsize         filled = 0;
+  gint          y      = 0;
+
+  g_return_val_if_fail (swap != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (swap->data)
+    bytes = g_bytes_ref (swap->data);
+  else
+    bytes = gimp_undo_swap_read (swap->offset, swap->size, error);
+
+  if (! bytes)
+    return NULL;
+
+  data = g_bytes_get_data (bytes, &size);
+
+  bpp    = babl_format_get_bytes_per_pixel (swap->format);
+  stride = bpp * swap->extent.width;
+
+  buffer       = gegl_buffer_new (&swap->extent, swap->format);
+  decompressor =
+    G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  band         = g_malloc (stride * MIN (swap->extent.height, BAND_HEIGHT));
+
+  while (y < swap->extent.height)
+    {
+      gint              rows      = MIN (BAND_HEIGHT, swap->extent.height - y);
+      gsize             band_size = (gsize) rows * stride;
+      GConverterResult  result;
+      gsize             bytes_read    = 0;
+      gsize             bytes_written = 0;
+
+      result = g_converter_convert (decompressor,
+                                    data, size,
+                                    band + filled, band_size - filled,
+                                    G_CONVERTER_INPUT_AT_END,
+                                    &bytes_read, &bytes_written, error);
+
+      if (result == G_CONVERTER_ERROR)
+        {
+          g_prefix_error (error, _("Failed to decompress undo data: "));
+
+          g_clear_object (&buffer);
+          break;
+        }
+
+      data   += bytes_read;
+      size   -= bytes_read;
+      filled += bytes_written;
+
+      if (filled == band_size)
+        {
+          gimp_undo_swap_unfilter (band, rows, stride, bpp);
+
+          gegl_buffer_set (buffer,
+                           GEGL_RECTANGLE (swap->extent.x, swap->extent.y + y,
+                                           swap->extent.width, rows),
+                           0, swap->format, band, stride);
+
+          y      += rows;
+          filled  = 0;
+        }
+      else if (result == G_CONVERTER_FINISHED ||
+               (bytes_read == 0 && bytes_written == 0))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                               _("Failed to decompress undo data: "
+                                 "data is truncated"));
+
+          g_clear_object (&buffer);
+          break;
+        }
+    }
+
+  g_free (band);
+  g_object_unref (decompressor);
+  g_bytes_unref (bytes);
+
+  return buffer;
+}
+
+gint64
+gimp_undo_swap_buffer_get_memsize (GimpUndoSwapBuffer *swap)
+{
+  g_return_val_if_fail (swap != NULL, 0);
+
+  return sizeof (GimpUndoSwapBuffer) + (swap->data ? swap->size : 0);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_undo_swap_filter (guchar *data,
+                       gint    rows,
+                       gint    stride,
+                       gint    bpp)
+{
+  gint y;
+
+  for (y = 0; y < rows; y++)
+    {
+      guchar *row = data + (gsize) y * stride;
+      gint    i;
+
+      for (i = stride - 1; i >= bpp; i--)
+        row[i] -= row[i - bpp];
+    }
+}
+
+static void
+gimp_undo_swap_unfilter (guchar *data,
+                         gint    rows,
+                         gint    stride,
+                         gint    bpp)
+{
+  gint y;
+
+  for (y = 0; y < rows; y++)
+    {
+      guchar *row = data + (gsize) y * stride;
+      gint    i;
+
+      for (i = bpp; i < stride; i++)
+        row[i] += row[i - bpp];
+    }
+}
+
+static gboolean
+gimp_undo_swap_compress (GConverter   *converter,
+                         const guchar *data,
+                         gsize         size,
+                         gboolean      last,
+                         GByteArray   *array)
+{
+  GConverterFlags flags = last ? G_CONVERTER_INPUT_AT_END : 0;
+  gsize           space = MAX (size / 2, CHUNK_SIZE);
+
+  while (size > 0 || last)
+    {
+      GConverterResult  result;
+      guint             len           = array->len;
+      gsize             bytes_read    = 0;
+      gsize             bytes_written = 0;
+      GError           *error         = NULL;
+
+      g_byte_array_set_size (array, len + space);
+
+      result = g_converter_convert (converter,
+                                    data, size,
+                                    array->data + len, space,
+                                    flags,
+                                    &bytes_read, &bytes_written, &error);
+
+      g_byte_array_set_size (array, len + bytes_written);
+
+      if (result == G_CONVERTER_ERROR)
+        {
+          if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
+            {
+              g_clear_error (&error);
+
+              space *= 2;
+              continue;
+            }
+
+          g_warning ("Failed to compress undo data: %s", error->message);
+          g_clear_error (&error);
+
+          return FALSE;
+        }
+
+      data += bytes_read;
+      size -= bytes_read;
+
+      if (result == G_CONVERTER_FINISHED)
+        break;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gimp_undo_swap_open (void)
+{
+  GimpGeglConfig *config;
+  gchar          *path = NULL;
+  gchar          *basename;
+  GFile          *dir;
+  GError         *error = NULL;
+
+  if (undo_swap_stream)
+    return TRUE;
+
+  if (undo_swap_failed || ! undo_swap_gimp)
+    return FALSE;
+
+  config = GIMP_GEGL_CONFIG (undo_swap_gimp->config);
+
+  if (config->swap_path)
+    path = gimp_config_path_expand (config->swap_path, TRUE, NULL);
+
+  if (! path)
+    path = g_strdup (g_get_tmp_dir ());
+
+  basename = g_strdup_printf ("gimp-undo-swap-%d", gimp_get_pid ());
+
+  dir = g_file_new_for_path (path);
+  undo_swap_file = g_file_get_child (dir, basename);
+  g_object_unref (dir);
+
+  g_free (basename);
+  g_free (path);
+
+  undo_swap_stream = g_file_replace_readwrite (undo_swap_file,
+                                               NULL, FALSE,
+                                               G_FILE_CREATE_PRIVATE,
+                                               NULL, &error);
+
+  if (! undo_swap_stream)
+    {
+      gimp_message (undo_swap_gimp, NULL, GIMP_MESSAGE_WARNING,
+                    _("Failed to create the undo swap file, undo "
+                      "history is kept in memory: %s"),
+                    error->message);
+      g_clear_error (&error);
+
+      g_clear_object (&undo_swap_file);
+      undo_swap_failed = TRUE;
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static goffset
+gimp_undo_swap_alloc (gsize size)
+{
+  GList   *list;
+  goffset  offset;
+
+  /*  first fit  */
+  for (list = undo_swap_holes; list; list = g_list_next (list))
+    {
+      GimpUndoSwapHole *hole = list->data;
+
+      if (hole->size >= size)
+        {
+          offset = hole->offset;
+
+          hole->offset += size;
+          hole->size   -= size;
+
+          if (hole->size == 0)
+            {
+              g_free (hole);
+              undo_swap_holes = g_list_delete_link (undo_swap_holes, list);
+            }
+
+          return offset;
+        }
+    }
+
+  offset = undo_swap_size;
+
+  undo_swap_size += size;
+
+  return offset;
+}
+
+static void
+gimp_undo_swap_release (goffset offset,
+                        gsize   size)
+{
+  GimpUndoSwapHole *hole = NULL;
+  GList            *prev = NULL;
+  GList            *next;
+  GList            *link = NULL;
+
+  if (! undo_swap_stream || size == 0)
+    return;
+
+  for (next = undo_swap_holes; next; next = g_list_next (next))
+    {
+      if (((GimpUndoSwapHole *) next->data)->offset > offset)
+        break;
+
+      prev = next;
+    }
+
+  if (prev)
+    {
+      GimpUndoSwapHole *prev_hole = prev->data;
+
+      if (prev_hole->offset + prev_hole->size == offset)
+        {
+          prev_hole->size += size;
+
+          hole = prev_hole;
+          link = prev;
+        }
+    }
+
+  if (! hole)
+    {
+      hole = g_new (GimpUndoSwapHole, 1);
+
+      hole->offset = offset;
+      hole->size   = size;
+
+      undo_swap_holes = g_list_insert_before (undo_swap_holes, next, hole);
+
+      link = next ? next->prev : g_list_last (undo_swap_holes);
+    }
+
+  if (next)
+    {
+      GimpUndoSwapHole *next_hole = next->data;
+
+      if (hole->offset + hole->size == next_hole->offset)
+        {
+          hole->size += next_hole->size;
+
+          g_free (next_hole);
+          undo_swap_holes = g_list_delete_link (undo_swap_holes, next);
+        }
+    }
+
+  /*  give trailing free space back to the file system  */
+  if (hole->offset + hole->size == undo_swap_size)
+    {
+      undo_swap_size = hole->offset;
+
+      g_free (hole);
+      undo_swap_holes = g_list_delete_link (undo_swap_holes, link);
+
+      g_seekable_truncate (G_SEEKABLE (undo_swap_stream), undo_swap_size,
+                           NULL, NULL);
+    }
+}
+
+static GBytes *
+gimp_undo_swap_read (goffset   offset,
+                     gsize     size,
+                     GError  **error)
+{
+  GInputStream *input;
+  guchar       *data;
+  gsize         bytes_read = 0;
+
+  if (! undo_swap_stream)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                           _("The undo swap file is not open"));
+      return NULL;
+    }
+
+  input = g_io_stream_get_input_stream (G_IO_STREAM (undo_swap_stream));
+  data  = g_malloc (size);
+
+  if (! g_seekable_seek (G_SEEKABLE (undo_swap_stream),
+                         offset, G_SEEK_SET, NULL, error) ||
+      ! g_input_stream_read_all (input, data, size,
+                                 &bytes_read, NULL, error))
+    {
+      g_prefix_error (error, _("Failed to read from the undo swap file: "));
+
+      g_free (data);
+
+      return NULL;
+    }
+
+  if (bytes_read != size)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                           _("Failed to read from the undo swap file: "
+                             "unexpected end of file"));
+
+      g_free (data);
+
+      return NULL;
+    }
+
+  return g_bytes_new_take (data, size);
+}
@@ -0,0 +1,39 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-undo-swap.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_UNDO_SWAP_H__
+#define __GIMP_UNDO_SWAP_H__
+
+
+void                 gimp_undo_swap_init               (Gimp               *gimp);
+void                 gimp_undo_swap_exit               (Gimp               *gimp);
+
+GimpUndoSwapBuffer * gimp_undo_swap_buffer_new         (GeglBuffer         *buffer);
+void                 gimp_undo_swap_buffer_free        (GimpUndoSwapBuffer *swap);
+
+gboolean             gimp_undo_swap_buffer_spill       (GimpUndoSwapBuffer *swap);
+gboolean             gimp_undo_swap_buffer_is_spilled  (GimpUndoSwapBuffer *swap);
+
+GeglBuffer         * gimp_undo_swap_buffer_restore     (GimpUndoSwapBuffer  *swap,
+                                                        GError             **error);
+
+gint64               gimp_undo_swap_buffer_get_memsize (GimpUndoSwapBuffer *swap);
+
+
+#endif /* __GIMP_UNDO_SWAP_H__ */
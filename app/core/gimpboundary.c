@@ -52,6 +52,18 @@ struct _GimpBoundary
   gint          max_empty_segs;
 };
 
+typedef struct
+{
+  const GimpBoundSeg *segs;
+
+  /*  chains of segment end points, entry 2 * i is the (x1, y1) point
+   *  of segment i, entry 2 * i + 1 its (x2, y2) point
+   */
+  gint               *heads;
+  gint               *next;
+  guint               mask;
+} SegmentHash;
+
 
 /*  local function prototypes  */
 
@@ -66,6 +78,9 @@ static void           gimp_boundary_add_seg    (GimpBoundary        *bounrady,
                                                 gint                 y2,
                                                 gboolean             open);
 
+static gint           find_run_length          (const gfloat        *data,
+                                                gint                 n_pixels,
+                                                gfloat               threshold);
 static void           find_empty_segs          (const GeglRectangle *region,
                                                 const gfloat        *line_data,
                                                 gint                 scanline,
@@ -91,6 +106,24 @@ static void           make_horiz_segs          (GimpBoundary        *boundary,
                                                 gint                 empty[],
                                                 gint                 num_empty,
                                                 gint                 top);
+static void           boundary_get_scan_range  (const GeglRectangle *region,
+                                                GimpBoundaryType     type,
+                                                gint                 y1,
+                                                gint                 y2,
+                                                gint                *start,
+                                                gint                *end);
+static void           generate_boundary_rows   (GimpBoundary        *boundary,
+                                                GeglBuffer          *buffer,
+                                                const GeglRectangle *region,
+                                                const Babl          *format,
+                                                GimpBoundaryType     type,
+                                                gint                 x1,
+                                                gint                 y1,
+                                                gint                 x2,
+                                                gint                 y2,
+                                                gfloat               threshold,
+                                                gint                 start,
+                                                gint                 end);
 static GimpBoundary * generate_boundary        (GeglBuffer          *buffer,
                                                 const GeglRectangle *region,
                                                 const Babl          *format,
@@ -101,26 +134,13 @@ static GimpBoundary * generate_boundary        (GeglBuffer          *buffer,
                                                 gint                 y2,
                                                 gfloat               threshold);
 
-static gint       cmp_segptr_xy1_addr     (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-static gint       cmp_segptr_xy2_addr     (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-
-static gint       cmp_segptr_xy1          (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-static gint       cmp_segptr_xy2          (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-
-static const GimpBoundSeg * find_segment  (const GimpBoundSeg **segs_by_xy1,
-                                           const GimpBoundSeg **segs_by_xy2,
-                                           gint                 num_segs,
-                                           gint                 x,
-                                           gint                 y);
-
-static const GimpBoundSeg * find_segment_with_func (const GimpBoundSeg **segs,
-                                                    gint                 num_segs,
-                                                    const GimpBoundSeg  *search_seg,
-                                                    GCompareFunc         cmp_func);
+static void       segment_hash_init   (SegmentHash         *hash,
+                                       const GimpBoundSeg  *segs,
+                                       gint                 num_segs);
+static void       segment_hash_free   (SegmentHash         *hash);
+static const GimpBoundSeg * segment_hash_find (SegmentHash *hash,
+                                               gint         x,
+                                               gint         y);
 
 static void       simplify_subdivide  (const GimpBoundSeg  *segs,
                                        gint                 start_idx,
@@ -191,6 +211,165 @@ gimp_boundary_find (GeglBuffer          *buffer,
   return gimp_boundary_free (boundary, FALSE);
 }
 
+/**
+ * gimp_boundary_update:
+ * @segs:         the boundary segments of the mask before it changed
+ * @num_segs:     number of segments in @segs
+ * @buffer:       a #GeglBuffer
+ * @region:       the region of @buffer to analyze, or %NULL
+ * @format:       a #Babl float format representing the component to analyze
+ * @type:         type of bounds
+ * @x1:           left side of bounds
+ * @y1:           top side of bounds
+ * @x2:           right side of bounds
+ * @y2:           botton side of bounds
+ * @threshold:    pixel value of boundary line
+ * @changed:      the area of @buffer which changed since @segs were found
+ * @num_new_segs: number of returned #GimpBoundSeg's
+ *
+ * This function returns the same segments as gimp_boundary_find()
+ * would return for the changed @buffer, but only scans the rows of
+ * @changed.  @segs must have been returned by gimp_boundary_find() or
+ * gimp_boundary_update() for the same @region, @format, @type, bounds
+ * and @threshold.
+ *
+ * Return value: the new boundary array.
+ **/
+GimpBoundSeg *
+gimp_boundary_update (const GimpBoundSeg  *segs,
+                      gint                 num_segs,
+                      GeglBuffer          *buffer,
+                      const GeglRectangle *region,
+                      const Babl          *format,
+                      GimpBoundaryType     type,
+                      gint                 x1,
+                      gint                 y1,
+                      gint                 x2,
+                      gint                 y2,
+                      gfloat               threshold,
+                      const GeglRectangle *changed,
+                      gint                *num_new_segs)
+{
+  GimpBoundary  *band;
+  GimpBoundary  *boundary;
+  GimpBoundSeg  *horiz_segs;
+  gint           n_horiz_segs;
+  GeglRectangle  rect = { 0, };
+  gint          *offsets;
+  gint           n_keys;
+  gint           start, end;
+  gint           band_start, band_end;
+  gint           i;
+
+  g_return_val_if_fail ((segs == NULL && num_segs == 0) ||
+                        (segs != NULL && num_segs >= 0), NULL);
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (babl_format_get_bytes_per_pixel (format) ==
+                        sizeof (gfloat), NULL);
+  g_return_val_if_fail (changed != NULL, NULL);
+  g_return_val_if_fail (num_new_segs != NULL, NULL);
+
+  if (region)
+    {
+      rect = *region;
+    }
+  else
+    {
+      rect.width  = gegl_buffer_get_width  (buffer);
+      rect.height = gegl_buffer_get_height (buffer);
+    }
+
+  boundary_get_scan_range (&rect, type, y1, y2, &start, &end);
+
+  /*  the horizontal segments on line y separate rows y - 1 and y, so
+   *  the lines from the top of the changed area to its bottom need
+   *  to be found again
+   */
+  band_start = MAX (changed->y, start);
+  band_end   = MIN (changed->y + changed->height, end);
+
+  band = gimp_boundary_new (&rect);
+
+  if (changed->width > 0 && band_start <= band_end)
+    {
+      generate_boundary_rows (band, buffer, &rect, format, type,
+                              x1, y1, x2, y2, threshold,
+                              MAX (band_start - 1, start),
+                              MIN (band_end + 1,   end));
+    }
+  else
+    {
+      band_start = G_MAXINT;
+      band_end   = G_MININT;
+    }
+
+  /*  collect the horizontal segments, old ones outside the changed
+   *  lines and new ones inside, in the order generate_boundary()
+   *  produces them: by line, the bottom edges of the row above
+   *  before the top edges of the row below
+   */
+  n_keys  = 2 * (end - start + 1);
+  offsets = g_new0 (gint, n_keys + 1);
+
+#define HORIZ_SEG_KEY(seg) \
+  (2 * ((seg)->y1 - start) + ((seg)->open ? 1 : 0))
+
+#define IS_HORIZ_SEG(seg, in_band)               \
+  ((seg)->y1 == (seg)->y2                     && \
+   (seg)->x1 != (seg)->x2                     && \
+   (seg)->y1 >= start && (seg)->y1 <= end     && \
+   ((seg)->y1 >= band_start &&                   \
+    (seg)->y1 <= band_end) == (in_band))
+
+  for (i = 0; i < num_segs; i++)
+    if (IS_HORIZ_SEG (&segs[i], FALSE))
+      offsets[HORIZ_SEG_KEY (&segs[i]) + 1]++;
+
+  for (i = 0; i < band->num_segs; i++)
+    if (IS_HORIZ_SEG (&band->segs[i], TRUE))
+      offsets[HORIZ_SEG_KEY (&band->segs[i]) + 1]++;
+
+  for (i = 0; i < n_keys; i++)
+    offsets[i + 1] += offsets[i];
+
+  n_horiz_segs = offsets[n_keys];
+  horiz_segs   = g_new (GimpBoundSeg, n_horiz_segs);
+
+  for (i = 0; i < num_segs; i++)
+    if (IS_HORIZ_SEG (&segs[i], FALSE))
+      horiz_segs[offsets[HORIZ_SEG_KEY (&segs[i])]++] = segs[i];
+
+  for (i = 0; i < band->num_segs; i++)
+    if (IS_HORIZ_SEG (&band->segs[i], TRUE))
+      horiz_segs[offsets[HORIZ_SEG_KEY (&band->segs[i])]++] = band->segs[i];
+
+#undef IS_HORIZ_SEG
+#undef HORIZ_SEG_KEY
+
+  gimp_boundary_free (band, TRUE);
+
+  /*  the vertical segments are determined by the horizontal ones,
+   *  replay them to close the outline again
+   */
+  boundary = gimp_boundary_new (&rect);
+
+  for (i = 0; i < n_horiz_segs; i++)
+    {
+      process_horiz_seg (boundary,
+                         horiz_segs[i].x1, horiz_segs[i].y1,
+                         horiz_segs[i].x2, horiz_segs[i].y2,
+                         horiz_segs[i].open);
+    }
+
+  g_free (horiz_segs);
+  g_free (offsets);
+
+  *num_new_segs = boundary->num_segs;
+
+  return gimp_boundary_free (boundary, FALSE);
+}
+
 /**
  * gimp_boundary_sort:
  * @segs:       unsorted input segs.
@@ -209,12 +388,11 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
                     gint                num_segs,
                     gint               *num_groups)
 {
-  GimpBoundary        *boundary;
-  const GimpBoundSeg **segs_ptrs_by_xy1;
-  const GimpBoundSeg **segs_ptrs_by_xy2;
-  gint                 index;
-  gint                 x, y;
-  gint                 startx, starty;
+  GimpBoundary *boundary;
+  SegmentHash   hash;
+  gint          index;
+  gint          x, y;
+  gint          startx, starty;
 
   g_return_val_if_fail ((segs == NULL && num_segs == 0) ||
                         (segs != NULL && num_segs >  0), NULL);
@@ -225,26 +403,14 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
   if (num_segs == 0)
     return NULL;
 
-  /* prepare arrays with GimpBoundSeg pointers sorted by xy1 and xy2
-   * accordingly
-   */
-  segs_ptrs_by_xy1 = g_new (const GimpBoundSeg *, num_segs);
-  segs_ptrs_by_xy2 = g_new (const GimpBoundSeg *, num_segs);
-
-  for (index = 0; index < num_segs; index++)
-    {
-      segs_ptrs_by_xy1[index] = segs + index;
-      segs_ptrs_by_xy2[index] = segs + index;
-    }
-
-  qsort (segs_ptrs_by_xy1, num_segs, sizeof (GimpBoundSeg *),
-         (GCompareFunc) cmp_segptr_xy1_addr);
-  qsort (segs_ptrs_by_xy2, num_segs, sizeof (GimpBoundSeg *),
-         (GCompareFunc) cmp_segptr_xy2_addr);
-
   for (index = 0; index < num_segs; index++)
     ((GimpBoundSeg *) segs)[index].visited = FALSE;
 
+  /*  hash the segments by their end points, so joining them takes
+   *  constant time per segment
+   */
+  segment_hash_init (&hash, segs, num_segs);
+
   boundary = gimp_boundary_new (NULL);
 
   for (index = 0; index < num_segs; index++)
@@ -266,8 +432,7 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
       x = segs[index].x2;
       y = segs[index].y2;
 
-      while ((cur_seg = find_segment (segs_ptrs_by_xy1, segs_ptrs_by_xy2,
-                                      num_segs, x, y)) != NULL)
+      while ((cur_seg = segment_hash_find (&hash, x, y)) != NULL)
         {
           /*  make sure ordering is correct  */
           if (x == cur_seg->x1 && y == cur_seg->y1)
@@ -300,8 +465,7 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
       gimp_boundary_add_seg (boundary, -1, -1, -1, -1, 0);
   }
 
-  g_free (segs_ptrs_by_xy1);
-  g_free (segs_ptrs_by_xy2);
+  segment_hash_free (&hash);
 
   return gimp_boundary_free (boundary, FALSE);
 }
@@ -486,6 +650,59 @@ gimp_boundary_add_seg (GimpBoundary *boundary,
   boundary->num_segs ++;
 }
 
+static inline guint32
+pixel_bits (const gfloat *pixel)
+{
+  guint32 bits;
+
+  memcpy (&bits, pixel, sizeof (bits));
+
+  return bits;
+}
+
+/*  returns the length of the run of pixels at the start of @data
+ *  which lie on the same side of @threshold as the first one
+ */
+static gint
+find_run_length (const gfloat *data,
+                 gint          n_pixels,
+                 gfloat        threshold)
+{
+  gboolean inside = (data[0] > threshold);
+  gint     i      = 1;
+
+  while (i < n_pixels)
+    {
+      guint32 bits  = pixel_bits (data + i - 1);
+      guint64 bits2 = ((guint64) bits << 32) | bits;
+
+      /*  masks mostly consist of long runs of identical values, skip
+       *  over them two pixels at a time without looking at the values
+       */
+      while (i + 2 <= n_pixels)
+        {
+          guint64 word;
+
+          memcpy (&word, data + i, sizeof (word));
+
+          if (word != bits2)
+            break;
+
+          i += 2;
+        }
+
+      while (i < n_pixels && pixel_bits (data + i) == bits)
+        i++;
+
+      if (i == n_pixels || (data[i] > threshold) != inside)
+        break;
+
+      i++;
+    }
+
+  return i;
+}
+
 static void
 find_empty_segs (const GeglRectangle *region,
                  const gfloat        *line_data,
@@ -500,12 +717,12 @@ find_empty_segs (const GeglRectangle *region,
                  gint                 y2,
                  gfloat               threshold)
 {
-  gint start = 0;
-  gint end   = 0;
-  gint endx  = 0;
-  gint last  = -1;
-  gint l_num_empty;
-  gint x;
+  gint     start = 0;
+  gint     end   = 0;
+  gint     last  = -1;
+  gboolean hole  = FALSE;
+  gint     l_num_empty;
+  gint     x;
 
   *num_empty = 0;
 
@@ -532,65 +749,42 @@ find_empty_segs (const GeglRectangle *region,
     {
       start = region->x;
       end   = region->x + region->width;
-      if (scanline < y1 || scanline >= y2)
-        x2 = -1;
+
+      /*  pixels inside the bounds count as empty  */
+      hole = (scanline >= y1 && scanline < y2 && x2 > x1);
     }
 
   empty_segs[(*num_empty)++] = 0;
 
   l_num_empty = *num_empty;
 
-  endx = end;
-
-  line_data += start;
-
   for (x = start; x < end;)
     {
-      if (type == GIMP_BOUNDARY_IGNORE_BOUNDS && (endx > x1 || x < x2))
+      gint val;
+      gint run_end;
+
+      if (hole && x >= x1 && x < x2)
         {
-          for (; x < endx; x++)
-            {
-              gint val;
-
-              if (*line_data > threshold)
-                {
-                  if (x >= x1 && x < x2)
-                    val = -1;
-                  else
-                    val = 1;
-                }
-              else
-                {
-                  val = -1;
-                }
-
-              line_data++;
-
-              if (last != val)
-                empty_segs[l_num_empty++] = x;
-
-              last = val;
-            }
+          val     = -1;
+          run_end = MIN (x2, end);
         }
       else
         {
-          for (; x < endx; x++)
-            {
-              gint val;
+          gint limit = end;
 
-              if (*line_data > threshold)
-                val = 1;
-              else
-                val = -1;
+          if (hole && x < x1)
+            limit = MIN (x1, end);
 
-              line_data++;
+          val     = line_data[x] > threshold ? 1 : -1;
+          run_end = x + find_run_length (line_data + x,
+                                         limit - x, threshold);
+        }
 
-              if (last != val)
-                empty_segs[l_num_empty++] = x;
+      if (last != val)
+        empty_segs[l_num_empty++] = x;
 
-              last = val;
-            }
-        }
+      last = val;
+      x    = run_end;
     }
 
   *num_empty = l_num_empty;
@@ -663,52 +857,71 @@ make_horiz_segs (GimpBoundary *boundary,
     }
 }
 
-static GimpBoundary *
-generate_boundary (GeglBuffer          *buffer,
-                   const GeglRectangle *region,
-                   const Babl          *format,
-                   GimpBoundaryType     type,
-                   gint                 x1,
-                   gint                 y1,
-                   gint                 x2,
-                   gint                 y2,
-                   gfloat               threshold)
+static void
+boundary_get_scan_range (const GeglRectangle *region,
+                         GimpBoundaryType     type,
+                         gint                 y1,
+                         gint                 y2,
+                         gint                *start,
+                         gint                *end)
+{
+  *start = 0;
+  *end   = 0;
+
+  if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
+    {
+      *start = y1;
+      *end   = y2;
+    }
+  else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
+    {
+      *start = region->y;
+      *end   = region->y + region->height;
+    }
+}
+
+static void
+generate_boundary_rows (GimpBoundary        *boundary,
+                        GeglBuffer          *buffer,
+                        const GeglRectangle *region,
+                        const Babl          *format,
+                        GimpBoundaryType     type,
+                        gint                 x1,
+                        gint                 y1,
+                        gint                 x2,
+                        gint                 y2,
+                        gfloat               threshold,
+                        gint                 start,
+                        gint                 end)
 {
-  GimpBoundary  *boundary;
   GeglRectangle  line_rect = { 0, };
   gfloat        *line_data;
+  gint           scan_start, scan_end;
   gint           scanline;
   gint           i;
-  gint           start, end;
   gint          *tmp_segs;
 
   gint          num_empty_n = 0;
   gint          num_empty_c = 0;
   gint          num_empty_l = 0;
 
-  boundary = gimp_boundary_new (region);
+  boundary_get_scan_range (region, type, y1, y2, &scan_start, &scan_end);
 
   line_rect.width  = gegl_buffer_get_width (buffer);
   line_rect.height = 1;
 
   line_data = g_alloca (sizeof (gfloat) * line_rect.width);
 
-  start = 0;
-  end   = 0;
-
-  if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
-    {
-      start = y1;
-      end   = y2;
-    }
-  else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
+  /*  Find the empty segments for the previous and current scanlines  */
+  if (start - 1 >= scan_start)
     {
-      start = region->y;
-      end   = region->y + region->height;
+      line_rect.y = start - 1;
+      gegl_buffer_get (buffer, &line_rect, 1.0, format,
+                       line_data, GEGL_AUTO_ROWSTRIDE,
+                       GEGL_ABYSS_NONE);
     }
 
-  /*  Find the empty segments for the previous and current scanlines  */
-  find_empty_segs (region, NULL,
+  find_empty_segs (region, start - 1 >= scan_start ? line_data : NULL,
                    start - 1, boundary->empty_segs_l,
                    boundary->max_empty_segs, &num_empty_l,
                    type, x1, y1, x2, y2,
@@ -729,7 +942,7 @@ generate_boundary (GeglBuffer          *buffer,
     {
       /*  find the empty segment list for the next scanline  */
       line_rect.y = scanline + 1;
-      if (scanline + 1 == end)
+      if (scanline + 1 == scan_end)
         line_data = NULL;
       else
         gegl_buffer_get (buffer, &line_rect, 1.0, format,
@@ -765,176 +978,130 @@ generate_boundary (GeglBuffer          *buffer,
       num_empty_c            = num_empty_n;
       boundary->empty_segs_n = tmp_segs;
     }
+}
+
+static GimpBoundary *
+generate_boundary (GeglBuffer          *buffer,
+                   const GeglRectangle *region,
+                   const Babl          *format,
+                   GimpBoundaryType     type,
+                   gint                 x1,
+                   gint                 y1,
+                   gint                 x2,
+                   gint                 y2,
+                   gfloat               threshold)
+{
+  GimpBoundary *boundary;
+  gint          start, end;
+
+  boundary = gimp_boundary_new (region);
+
+  boundary_get_scan_range (region, type, y1, y2, &start, &end);
+
+  generate_boundary_rows (boundary, buffer, region, format, type,
+                          x1, y1, x2, y2, threshold,
+                          start, end);
 
   return boundary;
 }
 
-/*  sorting utility functions  */
 
-static inline gint
-cmp_xy (const gint ax,
-        const gint ay,
-        const gint bx,
-        const gint by)
+/*  joining utility functions  */
+
+static inline guint
+segment_hash_key (gint x,
+                  gint y)
 {
-  if (ay < by)
-    {
-      return -1;
-    }
-  else if (ay > by)
-    {
-      return 1;
-    }
-  else if (ax < bx)
-    {
-      return -1;
-    }
-  else if (ax > bx)
-    {
-      return 1;
-    }
-  else
-    {
-      return 0;
-    }
+  return ((guint) x * 73856093u) ^ ((guint) y * 19349663u);
 }
 
-
-/*
- * Compares (x1, y1) pairs in specified segments, using their addresses if
- * (x1, y1) pairs are equal.
- */
-static gint
-cmp_segptr_xy1_addr (const GimpBoundSeg **seg_ptr_a,
-                     const GimpBoundSeg **seg_ptr_b)
+static void
+segment_hash_init (SegmentHash        *hash,
+                   const GimpBoundSeg *segs,
+                   gint                num_segs)
 {
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
+  gint index;
 
-  gint result = cmp_xy (seg_a->x1, seg_a->y1, seg_b->x1, seg_b->y1);
+  hash->segs = segs;
+  hash->mask = 1;
 
-  if (result == 0)
-    {
-      if (seg_a < seg_b)
-        result = -1;
-      else if (seg_a > seg_b)
-        result = 1;
-    }
+  while (hash->mask < 2 * (guint) num_segs)
+    hash->mask <<= 1;
 
-  return result;
-}
+  hash->heads = g_new (gint, hash->mask);
+  hash->next  = g_new (gint, 2 * num_segs);
 
-/*
- * Compares (x2, y2) pairs in specified segments, using their addresses if
- * (x2, y2) pairs are equal.
- */
-static gint
-cmp_segptr_xy2_addr (const GimpBoundSeg **seg_ptr_a,
-                     const GimpBoundSeg **seg_ptr_b)
-{
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
+  hash->mask--;
 
-  gint result = cmp_xy (seg_a->x2, seg_a->y2, seg_b->x2, seg_b->y2);
+  memset (hash->heads, -1, sizeof (gint) * (hash->mask + 1));
 
-  if (result == 0)
+  /*  insert the segments back to front, so that each chain lists its
+   *  entries in ascending segment order
+   */
+  for (index = num_segs - 1; index >= 0; index--)
     {
-      if (seg_a < seg_b)
-        result = -1;
-      else if (seg_a > seg_b)
-        result = 1;
-    }
+      const GimpBoundSeg *seg = &segs[index];
+      gint                entry;
+      guint               bucket;
 
-  return result;
-}
+      entry  = 2 * index + 1;
+      bucket = segment_hash_key (seg->x2, seg->y2) & hash->mask;
 
+      hash->next[entry]   = hash->heads[bucket];
+      hash->heads[bucket] = entry;
 
-/*
- * Compares (x1, y1) pairs in specified segments.
- */
-static gint
-cmp_segptr_xy1 (const GimpBoundSeg **seg_ptr_a,
-                const GimpBoundSeg **seg_ptr_b)
-{
-  const GimpBoundSeg *seg_a = *seg_ptr_a, *seg_b = *seg_ptr_b;
+      entry  = 2 * index;
+      bucket = segment_hash_key (seg->x1, seg->y1) & hash->mask;
 
-  return cmp_xy (seg_a->x1, seg_a->y1, seg_b->x1, seg_b->y1);
+      hash->next[entry]   = hash->heads[bucket];
+      hash->heads[bucket] = entry;
+    }
 }
 
-/*
- * Compares (x2, y2) pairs in specified segments.
- */
-static gint
-cmp_segptr_xy2 (const GimpBoundSeg **seg_ptr_a,
-                const GimpBoundSeg **seg_ptr_b)
+static void
+segment_hash_free (SegmentHash *hash)
 {
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
-
-  return cmp_xy (seg_a->x2, seg_a->y2, seg_b->x2, seg_b->y2);
+  g_free (hash->heads);
+  g_free (hash->next);
 }
 
-
+/*  returns the non-visited segment with the smallest address which
+ *  has an end point at (x, y)
+ */
 static const GimpBoundSeg *
-find_segment (const GimpBoundSeg **segs_by_xy1,
-              const GimpBoundSeg **segs_by_xy2,
-              gint                 num_segs,
-              gint                 x,
-              gint                 y)
+segment_hash_find (SegmentHash *hash,
+                   gint         x,
+                   gint         y)
 {
-  const GimpBoundSeg *segptr_xy1;
-  const GimpBoundSeg *segptr_xy2;
-  GimpBoundSeg        search_seg;
-
-  search_seg.x1 = search_seg.x2 = x;
-  search_seg.y1 = search_seg.y2 = y;
-
-  segptr_xy1 = find_segment_with_func (segs_by_xy1, num_segs, &search_seg,
-                                       (GCompareFunc) cmp_segptr_xy1);
-  segptr_xy2 = find_segment_with_func (segs_by_xy2, num_segs, &search_seg,
-                                       (GCompareFunc) cmp_segptr_xy2);
-
-  /* return segment with smaller address */
-  if (segptr_xy1 != NULL && segptr_xy2 != NULL)
-    return MIN(segptr_xy1, segptr_xy2);
-  else if (segptr_xy1 != NULL)
-    return segptr_xy1;
-  else if (segptr_xy2 != NULL)
-    return segptr_xy2;
+  gint *prev;
+  gint  entry;
 
-  return NULL;
-}
+  prev = &hash->heads[segment_hash_key (x, y) & hash->mask];
 
+  while ((entry = *prev) >= 0)
+    {
+      const GimpBoundSeg *seg = &hash->segs[entry / 2];
 
-static const GimpBoundSeg *
-find_segment_with_func (const GimpBoundSeg **segs,
-                        gint                 num_segs,
-                        const GimpBoundSeg  *search_seg,
-                        GCompareFunc         cmp_func)
-{
-  const GimpBoundSeg **seg;
-  const GimpBoundSeg *found_seg = NULL;
+      if (seg->visited)
+        {
+          /*  visited segments are never looked up again, unlink them
+           *  to keep the chains short
+           */
+          *prev = hash->next[entry];
+          continue;
+        }
 
-  seg = bsearch (&search_seg, segs, num_segs, sizeof (GimpBoundSeg *), cmp_func);
+      /*  the chains are in ascending segment order, so the first
+       *  match is the one with the smallest address
+       */
+      if ((entry & 1) ? (seg->x2 == x && seg->y2 == y) :
+                        (seg->x1 == x && seg->y1 == y))
+        return seg;
 
-  if (seg != NULL)
-    {
-      /* find first matching segment */
-      while (seg > segs && cmp_func (seg - 1, &search_seg) == 0)
-        seg--;
-
-      /* find first non-visited segment */
-      while (seg != segs + num_segs && cmp_func (seg, &search_seg) == 0)
-        if (!(*seg)->visited)
-          {
-            found_seg = *seg;
-            break;
-          }
-        else
-          seg++;
+      prev = &hash->next[entry];
     }
 
-    return found_seg;
+  return NULL;
 }
 
 
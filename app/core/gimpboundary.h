@@ -51,6 +51,19 @@ GimpBoundSeg * gimp_boundary_find      (GeglBuffer          *buffer,
                                         gint                 y2,
                                         gfloat               threshold,
                                         gint                *num_segs);
+GimpBoundSeg * gimp_boundary_update    (const GimpBoundSeg  *segs,
+                                        gint                 num_segs,
+                                        GeglBuffer          *buffer,
+                                        const GeglRectangle *region,
+                                        const Babl          *format,
+                                        GimpBoundaryType     type,
+                                        gint                 x1,
+                                        gint                 y1,
+                                        gint                 x2,
+                                        gint                 y2,
+                                        gfloat               threshold,
+                                        const GeglRectangle *changed,
+                                        gint                *num_new_segs);
 GimpBoundSeg * gimp_boundary_sort      (const GimpBoundSeg  *segs,
                                         gint                 num_segs,
                                         gint                *num_groups);
@@ -93,6 +93,12 @@ static gboolean      gimp_brush_real_want_null_motion (GimpBrush            *bru
 
 static gchar       * gimp_brush_get_checksum          (GimpTagged           *tagged);
 
+static void          gimp_brush_quantize_transform    (GimpBrush            *brush,
+                                                       gdouble              *scale,
+                                                       gdouble              *aspect_ratio,
+                                                       gdouble              *angle,
+                                                       gdouble              *hardness);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpBrush, gimp_brush, GIMP_TYPE_DATA,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_TAGGED,
@@ -427,13 +433,18 @@ static void
 gimp_brush_real_begin_use (GimpBrush *brush)
 {
   brush->priv->mask_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'M', 'm');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GimpBrushCacheMemsizeFunc) gimp_temp_buf_get_memsize,
+                          'M', 'm');
 
   brush->priv->pixmap_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'P', 'p');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GimpBrushCacheMemsizeFunc) gimp_temp_buf_get_memsize,
+                          'P', 'p');
 
   brush->priv->boundary_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, 'B', 'b');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, NULL,
+                          'B', 'b');
 }
 
 static void
@@ -498,6 +509,43 @@ gimp_brush_get_checksum (GimpTagged *tagged)
   return checksum_string;
 }
 
+/*  pressure and tilt dynamics vary the transform continuously, so
+ *  hardly two dabs would ever share a cached mask.  Snap the transform
+ *  to steps which move the brush's outline by at most a quarter pixel,
+ *  and the brush caches can serve the dabs of a stroke instead.
+ */
+static void
+gimp_brush_quantize_transform (GimpBrush *brush,
+                               gdouble   *scale,
+                               gdouble   *aspect_ratio,
+                               gdouble   *angle,
+                               gdouble   *hardness)
+{
+  gint    size = MAX (gimp_temp_buf_get_width  (brush->priv->mask),
+                      gimp_temp_buf_get_height (brush->priv->mask));
+  gdouble scaled_size;
+  gdouble steps;
+
+  steps  = 4.0 * size;
+  *scale = MAX (RINT (*scale * steps), 1.0) / steps;
+
+  scaled_size = MAX (*scale * size, 1.0);
+
+  /*  the angle is in turns, keep the steps a multiple of 8 so the
+   *  right angles stay exact
+   */
+  steps  = 8.0 * ceil (G_PI * scaled_size / 2.0);
+  *angle = RINT (*angle * steps) / steps;
+
+  /*  an aspect ratio of 20 scales the short side to zero  */
+  steps         = ceil (scaled_size / 5.0);
+  *aspect_ratio = RINT (*aspect_ratio * steps) / steps;
+
+  if (hardness)
+    *hardness = RINT (*hardness * 256.0) / 256.0;
+}
+
+
 /*  public functions  */
 
 GimpData *
@@ -594,6 +642,9 @@ gimp_brush_transform_size (GimpBrush     *brush,
   g_return_if_fail (width != NULL);
   g_return_if_fail (height != NULL);
 
+  gimp_brush_quantize_transform (brush,
+                                 &scale, &aspect_ratio, &angle, NULL);
+
   if (scale        == 1.0 &&
       aspect_ratio == 0.0 &&
       ((angle == 0.0) || (angle == 0.5) || (angle == 1.0)))
@@ -623,6 +674,9 @@ gimp_brush_transform_mask (GimpBrush *brush,
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
 
+  gimp_brush_quantize_transform (brush,
+                                 &scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              &width, &height);
@@ -673,6 +727,9 @@ gimp_brush_transform_pixmap (GimpBrush *brush,
   g_return_val_if_fail (brush->priv->pixmap != NULL, NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
 
+  gimp_brush_quantize_transform (brush,
+                                 &scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              &width, &height);
@@ -724,6 +781,9 @@ gimp_brush_transform_boundary (GimpBrush *brush,
   g_return_val_if_fail (width != NULL, NULL);
   g_return_val_if_fail (height != NULL, NULL);
 
+  gimp_brush_quantize_transform (brush,
+                                 &scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              width, height);
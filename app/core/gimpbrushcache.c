@@ -24,29 +24,61 @@
 
 #include "core-types.h"
 
+#include "gimp-memsize.h"
 #include "gimpbrushcache.h"
 
 #include "gimp-log.h"
 #include "gimp-intl.h"
 
 
+/*  the cache keeps the most recently used transformed brushes, so
+ *  dynamics which keep returning to the same quantized parameters
+ *  (see gimp_brush_transform_mask()) don't regenerate them
+ */
+#define MAX_CACHED_UNITS   32
+#define MAX_CACHED_MEMSIZE (16 * 1024 * 1024)
+
+
 enum
 {
   PROP_0,
-  PROP_DATA_DESTROY
+  PROP_DATA_DESTROY,
+  PROP_DATA_MEMSIZE
 };
 
 
-static void   gimp_brush_cache_constructed  (GObject      *object);
-static void   gimp_brush_cache_finalize     (GObject      *object);
-static void   gimp_brush_cache_set_property (GObject      *object,
-                                             guint         property_id,
-                                             const GValue *value,
-                                             GParamSpec   *pspec);
-static void   gimp_brush_cache_get_property (GObject      *object,
-                                             guint         property_id,
-                                             GValue       *value,
-                                             GParamSpec   *pspec);
+typedef struct _GimpBrushCacheUnit GimpBrushCacheUnit;
+
+struct _GimpBrushCacheUnit
+{
+  gpointer  data;
+  gsize     memsize;
+
+  gint      width;
+  gint      height;
+  gdouble   scale;
+  gdouble   aspect_ratio;
+  gdouble   angle;
+  gdouble   hardness;
+};
+
+
+static void   gimp_brush_cache_constructed  (GObject        *object);
+static void   gimp_brush_cache_finalize     (GObject        *object);
+static void   gimp_brush_cache_set_property (GObject        *object,
+                                             guint           property_id,
+                                             const GValue   *value,
+                                             GParamSpec     *pspec);
+static void   gimp_brush_cache_get_property (GObject        *object,
+                                             guint           property_id,
+                                             GValue         *value,
+                                             GParamSpec     *pspec);
+
+static gint64 gimp_brush_cache_get_memsize  (GimpObject     *object,
+                                             gint64         *gui_size);
+
+static void   gimp_brush_cache_remove_link  (GimpBrushCache *cache,
+                                             GList          *link);
 
 
 G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
@@ -57,18 +89,27 @@ G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 static void
 gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 {
-  GObjectClass  *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass    *object_class      = G_OBJECT_CLASS (klass);
+  GimpObjectClass *gimp_object_class = GIMP_OBJECT_CLASS (klass);
+
+  object_class->constructed      = gimp_brush_cache_constructed;
+  object_class->finalize         = gimp_brush_cache_finalize;
+  object_class->set_property     = gimp_brush_cache_set_property;
+  object_class->get_property     = gimp_brush_cache_get_property;
 
-  object_class->constructed  = gimp_brush_cache_constructed;
-  object_class->finalize     = gimp_brush_cache_finalize;
-  object_class->set_property = gimp_brush_cache_set_property;
-  object_class->get_property = gimp_brush_cache_get_property;
+  gimp_object_class->get_memsize = gimp_brush_cache_get_memsize;
 
   g_object_class_install_property (object_class, PROP_DATA_DESTROY,
                                    g_param_spec_pointer ("data-destroy",
                                                          NULL, NULL,
                                                          GIMP_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_DATA_MEMSIZE,
+                                   g_param_spec_pointer ("data-memsize",
+                                                         NULL, NULL,
+                                                         GIMP_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
@@ -91,11 +132,7 @@ gimp_brush_cache_finalize (GObject *object)
 {
   GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  gimp_brush_cache_clear (cache);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -114,6 +151,10 @@ gimp_brush_cache_set_property (GObject      *object,
       cache->data_destroy = g_value_get_pointer (value);
       break;
 
+    case PROP_DATA_MEMSIZE:
+      cache->data_memsize = g_value_get_pointer (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -134,19 +175,39 @@ gimp_brush_cache_get_property (GObject    *object,
       g_value_set_pointer (value, cache->data_destroy);
       break;
 
+    case PROP_DATA_MEMSIZE:
+      g_value_set_pointer (value, cache->data_memsize);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
     }
 }
 
+static gint64
+gimp_brush_cache_get_memsize (GimpObject *object,
+                              gint64     *gui_size)
+{
+  GimpBrushCache *cache   = GIMP_BRUSH_CACHE (object);
+  gint64          memsize = 0;
+
+  memsize += gimp_g_list_get_memsize (cache->cached_units,
+                                      sizeof (GimpBrushCacheUnit));
+  memsize += cache->cached_memsize;
+
+  return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                  gui_size);
+}
+
 
 /*  public functions  */
 
 GimpBrushCache *
-gimp_brush_cache_new (GDestroyNotify  data_destroy,
-                      gchar           debug_hit,
-                      gchar           debug_miss)
+gimp_brush_cache_new (GDestroyNotify            data_destroy,
+                      GimpBrushCacheMemsizeFunc data_memsize,
+                      gchar                     debug_hit,
+                      gchar                     debug_miss)
 {
   GimpBrushCache *cache;
 
@@ -154,6 +215,7 @@ gimp_brush_cache_new (GDestroyNotify  data_destroy,
 
   cache =  g_object_new (GIMP_TYPE_BRUSH_CACHE,
                          "data-destroy", data_destroy,
+                         "data-memsize", data_memsize,
                          NULL);
 
   cache->debug_hit  = debug_hit;
@@ -167,11 +229,8 @@ gimp_brush_cache_clear (GimpBrushCache *cache)
 {
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  while (cache->cached_units)
+    gimp_brush_cache_remove_link (cache, cache->cached_units);
 }
 
 gconstpointer
@@ -183,20 +242,35 @@ gimp_brush_cache_get (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GList *list;
+
   g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), NULL);
 
-  if (cache->last_data                         &&
-      cache->last_width        == width        &&
-      cache->last_height       == height       &&
-      cache->last_scale        == scale        &&
-      cache->last_aspect_ratio == aspect_ratio &&
-      cache->last_angle        == angle        &&
-      cache->last_hardness     == hardness)
+  for (list = cache->cached_units; list; list = g_list_next (list))
     {
-      if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
-        g_printerr ("%c", cache->debug_hit);
-
-      return (gconstpointer) cache->last_data;
+      GimpBrushCacheUnit *unit = list->data;
+
+      if (unit->width        == width        &&
+          unit->height       == height       &&
+          unit->scale        == scale        &&
+          unit->aspect_ratio == aspect_ratio &&
+          unit->angle        == angle        &&
+          unit->hardness     == hardness)
+        {
+          if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+            g_printerr ("%c", cache->debug_hit);
+
+          /*  move the unit to the front, it's the most recently used  */
+          if (list != cache->cached_units)
+            {
+              cache->cached_units = g_list_remove_link (cache->cached_units,
+                                                        list);
+              cache->cached_units = g_list_concat (list,
+                                                   cache->cached_units);
+            }
+
+          return (gconstpointer) unit->data;
+        }
     }
 
   if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
@@ -215,20 +289,56 @@ gimp_brush_cache_add (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheUnit *unit;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
   g_return_if_fail (data != NULL);
 
-  if (data == cache->last_data)
+  if (cache->cached_units &&
+      ((GimpBrushCacheUnit *) cache->cached_units->data)->data == data)
     return;
 
-  if (cache->last_data)
-    cache->data_destroy (cache->last_data);
+  unit = g_slice_new (GimpBrushCacheUnit);
+
+  unit->data         = data;
+  unit->memsize      = cache->data_memsize ? cache->data_memsize (data) : 0;
+  unit->width        = width;
+  unit->height       = height;
+  unit->scale        = scale;
+  unit->aspect_ratio = aspect_ratio;
+  unit->angle        = angle;
+  unit->hardness     = hardness;
+
+  cache->cached_units    = g_list_prepend (cache->cached_units, unit);
+  cache->n_cached_units += 1;
+  cache->cached_memsize += unit->memsize;
+
+  /*  drop the least recently used units, but always keep the new
+   *  one, callers use it right away
+   */
+  while (cache->n_cached_units > 1 &&
+         (cache->n_cached_units > MAX_CACHED_UNITS ||
+          cache->cached_memsize > MAX_CACHED_MEMSIZE))
+    {
+      gimp_brush_cache_remove_link (cache, g_list_last (cache->cached_units));
+    }
+}
+
+
+/*  private functions  */
+
+static void
+gimp_brush_cache_remove_link (GimpBrushCache *cache,
+                              GList          *link)
+{
+  GimpBrushCacheUnit *unit = link->data;
+
+  cache->cached_units = g_list_delete_link (cache->cached_units, link);
+
+  cache->n_cached_units -= 1;
+  cache->cached_memsize -= unit->memsize;
+
+  cache->data_destroy (unit->data);
 
-  cache->last_data         = data;
-  cache->last_width        = width;
-  cache->last_height       = height;
-  cache->last_scale        = scale;
-  cache->last_aspect_ratio = aspect_ratio;
-  cache->last_angle        = angle;
-  cache->last_hardness     = hardness;
+  g_slice_free (GimpBrushCacheUnit, unit);
 }
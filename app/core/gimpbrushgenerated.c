@@ -27,6 +27,8 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-parallel.h"
+
 #include "gimpbrush-private.h"
 #include "gimpbrushgenerated.h"
 #include "gimpbrushgenerated-load.h"
@@ -36,7 +38,8 @@
 #include "gimp-intl.h"
 
 
-#define OVERSAMPLING 4
+#define OVERSAMPLING        4
+#define BRUSH_CALC_MIN_AREA (64 * 64)
 
 
 enum
@@ -51,6 +54,24 @@ enum
 };
 
 
+typedef struct
+{
+  GimpBrushGeneratedShape  shape;
+  gfloat                   radius;
+  gint                     spikes;
+  gfloat                   aspect_ratio;
+  gdouble                  c;
+  gdouble                  s;
+  gdouble                  spike_c[11]; /* spikes / 2 + 1, spikes <= 20 */
+  gdouble                  spike_s[11];
+  guchar                  *lookup;
+  guchar                  *centerp;
+  gint                     width;
+  gint                     half_width;
+  gint                     y_start;
+} BrushCalcContext;
+
+
 /*  local function prototypes  */
 
 static void          gimp_brush_generated_set_property  (GObject      *object,
@@ -78,6 +99,9 @@ static GimpTempBuf * gimp_brush_generated_transform_mask(GimpBrush    *gbrush,
                                                          gdouble       angle,
                                                          gdouble       hardness);
 
+static void          gimp_brush_generated_calc_rows     (gsize                    offset,
+                                                         gsize                    size,
+                                                         BrushCalcContext        *ctx);
 static GimpTempBuf * gimp_brush_generated_calc          (GimpBrushGenerated      *brush,
                                                          GimpBrushGeneratedShape  shape,
                                                          gfloat                   radius,
@@ -443,107 +467,160 @@ gimp_brush_generated_calc_lut (gdouble radius,
   return lookup;
 }
 
-static GimpTempBuf *
-gimp_brush_generated_calc (GimpBrushGenerated      *brush,
-                           GimpBrushGeneratedShape  shape,
-                           gfloat                   radius,
-                           gint                     spikes,
-                           gfloat                   hardness,
-                           gfloat                   aspect_ratio,
-                           gfloat                   angle,
-                           GimpVector2             *xaxis,
-                           GimpVector2             *yaxis)
+static void
+gimp_brush_generated_calc_rows (gsize             offset,
+                                gsize             size,
+                                BrushCalcContext *ctx)
 {
-  guchar      *centerp;
-  guchar      *lookup;
-  guchar       a;
-  gint         x, y;
-  gdouble      c, s, cs, ss;
-  GimpVector2  x_axis;
-  GimpVector2  y_axis;
-  GimpTempBuf *mask;
-  gint         width;
-  gint         height;
-  gint         half_width;
-  gint         half_height;
-
-  gimp_brush_generated_get_size (brush,
-                                 shape,
-                                 radius,
-                                 spikes,
-                                 hardness,
-                                 aspect_ratio,
-                                 angle,
-                                 &width, &height,
-                                 &s, &c, &x_axis, &y_axis);
-
-  mask = gimp_temp_buf_new (width, height,
-                            babl_format ("Y u8"));
+  const gdouble r1    = ctx->radius + 1;
+  const gdouble r1_sq = SQR (r1);
+  const gint    hw    = ctx->half_width;
+  gsize         row;
 
-  half_width  = width  / 2;
-  half_height = height / 2;
-
-  centerp = gimp_temp_buf_get_data (mask) +
-            half_height * width + half_width;
-
-  lookup = gimp_brush_generated_calc_lut (radius, hardness);
-
-  cs = cos (- 2 * G_PI / spikes);
-  ss = sin (- 2 * G_PI / spikes);
-
-  /* for an even number of spikes compute one half and mirror it */
-  for (y = ((spikes % 2) ? -half_height : 0); y <= half_height; y++)
+  for (row = offset; row < offset + size; row++)
     {
-      for (x = -half_width; x <= half_width; x++)
+      gint     y    = ctx->y_start + (gint) row;
+      guchar  *dest = ctx->centerp + y * ctx->width;
+      gdouble  tx0  = - ctx->c * hw - ctx->s * y;
+      gdouble  ty0  = - ctx->s * hw + ctx->c * y;
+      gint     x;
+
+      for (x = -hw; x <= hw; x++)
         {
-          gdouble d  = 0;
-          gdouble tx = c * x - s * y;
-          gdouble ty = fabs (s * x + c * y);
+          gdouble tx = tx0 + ctx->c * (x + hw);
+          gdouble ty = fabs (ty0 + ctx->s * (x + hw));
+          gdouble d;
+          guchar  a  = 0;
 
-          if (spikes > 2)
+          if (ctx->spikes > 2)
             {
               gdouble angle = atan2 (ty, tx);
 
-              while (angle > G_PI / spikes)
+              /*  rotate into the first spike's sector in one step,
+               *  instead of one spike at a time
+               */
+              if (angle > G_PI / ctx->spikes)
                 {
+                  gint    k  = ceil ((angle - G_PI / ctx->spikes) /
+                                     (2 * G_PI / ctx->spikes));
                   gdouble sx = tx;
                   gdouble sy = ty;
 
-                  tx = cs * sx - ss * sy;
-                  ty = ss * sx + cs * sy;
+                  k = MIN (k, ctx->spikes / 2);
 
-                  angle -= 2 * G_PI / spikes;
+                  tx = ctx->spike_c[k] * sx - ctx->spike_s[k] * sy;
+                  ty = ctx->spike_s[k] * sx + ctx->spike_c[k] * sy;
                 }
             }
 
-          ty *= aspect_ratio;
+          ty *= ctx->aspect_ratio;
 
-          switch (shape)
+          switch (ctx->shape)
             {
             case GIMP_BRUSH_GENERATED_CIRCLE:
-              d = sqrt (SQR (tx) + SQR (ty));
+              /*  most of a rotated or elongated brush's bounding box
+               *  is empty, don't take the square root there
+               */
+              d = SQR (tx) + SQR (ty);
+
+              if (d < r1_sq)
+                a = ctx->lookup[(gint) RINT (sqrt (d) * OVERSAMPLING)];
               break;
+
             case GIMP_BRUSH_GENERATED_SQUARE:
               d = MAX (fabs (tx), fabs (ty));
+
+              if (d < r1)
+                a = ctx->lookup[(gint) RINT (d * OVERSAMPLING)];
               break;
+
             case GIMP_BRUSH_GENERATED_DIAMOND:
               d = fabs (tx) + fabs (ty);
+
+              if (d < r1)
+                a = ctx->lookup[(gint) RINT (d * OVERSAMPLING)];
               break;
             }
 
-          if (d < radius + 1)
-            a = lookup[(gint) RINT (d * OVERSAMPLING)];
-          else
-            a = 0;
-
-          centerp[y * width + x] = a;
+          dest[x] = a;
 
-          if (spikes % 2 == 0)
-            centerp[-1 * y * width - x] = a;
+          if (ctx->spikes % 2 == 0)
+            dest[-2 * y * ctx->width - x] = a;
         }
     }
+}
+
+static GimpTempBuf *
+gimp_brush_generated_calc (GimpBrushGenerated      *brush,
+                           GimpBrushGeneratedShape  shape,
+                           gfloat                   radius,
+                           gint                     spikes,
+                           gfloat                   hardness,
+                           gfloat                   aspect_ratio,
+                           gfloat                   angle,
+                           GimpVector2             *xaxis,
+                           GimpVector2             *yaxis)
+{
+  BrushCalcContext  ctx;
+  gdouble           c, s;
+  GimpVector2       x_axis;
+  GimpVector2       y_axis;
+  GimpTempBuf      *mask;
+  gint              width;
+  gint              height;
+  gint              n_rows;
+  gint              k;
+
+  gimp_brush_generated_get_size (brush,
+                                 shape,
+                                 radius,
+                                 spikes,
+                                 hardness,
+                                 aspect_ratio,
+                                 angle,
+                                 &width, &height,
+                                 &s, &c, &x_axis, &y_axis);
+
+  mask = gimp_temp_buf_new (width, height,
+                            babl_format ("Y u8"));
+
+  ctx.shape        = shape;
+  ctx.radius       = radius;
+  ctx.spikes       = spikes;
+  ctx.aspect_ratio = aspect_ratio;
+  ctx.c            = c;
+  ctx.s            = s;
+  ctx.width        = width;
+  ctx.half_width   = width  / 2;
+  ctx.centerp      = gimp_temp_buf_get_data (mask) +
+                     (height / 2) * width + ctx.half_width;
+  ctx.lookup       = gimp_brush_generated_calc_lut (radius, hardness);
+
+  for (k = 0; k <= spikes / 2; k++)
+    {
+      ctx.spike_c[k] = cos (- 2 * G_PI * k / spikes);
+      ctx.spike_s[k] = sin (- 2 * G_PI * k / spikes);
+    }
+
+  /* for an even number of spikes compute one half and mirror it */
+  if (spikes % 2)
+    {
+      ctx.y_start = -(height / 2);
+      n_rows      = 2 * (height / 2) + 1;
+    }
+  else
+    {
+      ctx.y_start = 0;
+      n_rows      = height / 2 + 1;
+    }
+
+  gimp_parallel_distribute_range (n_rows,
+                                  MAX (BRUSH_CALC_MIN_AREA / width, 1),
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_brush_generated_calc_rows,
+                                  &ctx);
 
-  g_free (lookup);
+  g_free (ctx.lookup);
 
   if (xaxis)
     *xaxis = x_axis;
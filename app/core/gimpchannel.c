@@ -224,6 +224,13 @@ static void       gimp_channel_real_shrink   (GimpChannel         *channel,
                                               gboolean             edge_lock,
                                               gboolean             push_undo);
 
+static void       gimp_channel_invalidate_boundary_area
+                                             (GimpChannel         *channel,
+                                              gint                 x,
+                                              gint                 y,
+                                              gint                 width,
+                                              gint                 height);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpChannel, gimp_channel, GIMP_TYPE_DRAWABLE,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_PICKABLE,
@@ -342,6 +349,10 @@ gimp_channel_init (GimpChannel *channel)
   channel->y1             = 0;
   channel->x2             = 0;
   channel->y2             = 0;
+
+  gegl_rectangle_set (&channel->boundary_region,  0, 0, 0, 0);
+  gegl_rectangle_set (&channel->boundary_bounds,  0, 0, 0, 0);
+  gegl_rectangle_set (&channel->boundary_changed, 0, 0, 0, 0);
 }
 
 static void
@@ -934,7 +945,12 @@ gimp_channel_convert_type (GimpDrawable      *drawable,
 static void
 gimp_channel_invalidate_boundary (GimpDrawable *drawable)
 {
-  GIMP_CHANNEL (drawable)->boundary_known = FALSE;
+  GimpChannel *channel = GIMP_CHANNEL (drawable);
+
+  channel->boundary_known = FALSE;
+
+  gegl_rectangle_set (&channel->boundary_region,  0, 0, 0, 0);
+  gegl_rectangle_set (&channel->boundary_changed, 0, 0, 0, 0);
 }
 
 static void
@@ -965,7 +981,10 @@ gimp_channel_apply_buffer (GimpDrawable         *drawable,
                            gint                  base_x,
                            gint                  base_y)
 {
-  gimp_drawable_invalidate_boundary (drawable);
+  gimp_channel_invalidate_boundary_area (GIMP_CHANNEL (drawable),
+                                         base_x, base_y,
+                                         buffer_region->width,
+                                         buffer_region->height);
 
   GIMP_DRAWABLE_CLASS (parent_class)->apply_buffer (drawable, buffer,
                                                     buffer_region,
@@ -989,7 +1008,10 @@ gimp_channel_replace_buffer (GimpDrawable        *drawable,
                              gint                 x,
                              gint                 y)
 {
-  gimp_drawable_invalidate_boundary (drawable);
+  gimp_channel_invalidate_boundary_area (GIMP_CHANNEL (drawable),
+                                         x, y,
+                                         buffer_region->width,
+                                         buffer_region->height);
 
   GIMP_DRAWABLE_CLASS (parent_class)->replace_buffer (drawable, buffer,
                                                       buffer_region,
@@ -1039,7 +1061,10 @@ gimp_channel_swap_pixels (GimpDrawable *drawable,
                           gint          x,
                           gint          y)
 {
-  gimp_drawable_invalidate_boundary (drawable);
+  gimp_channel_invalidate_boundary_area (GIMP_CHANNEL (drawable),
+                                         x, y,
+                                         gegl_buffer_get_width  (buffer),
+                                         gegl_buffer_get_height (buffer));
 
   GIMP_DRAWABLE_CLASS (parent_class)->swap_pixels (drawable, buffer, x, y);
 
@@ -1086,28 +1111,55 @@ gimp_channel_real_boundary (GimpChannel         *channel,
 {
   if (! channel->boundary_known)
     {
-      gint x3, y3, x4, y4;
-
-      /* free the out of date boundary segments */
-      g_free (channel->segs_in);
-      g_free (channel->segs_out);
+      GimpBoundSeg  *old_segs_in      = channel->segs_in;
+      GimpBoundSeg  *old_segs_out     = channel->segs_out;
+      gint           old_num_segs_in  = channel->num_segs_in;
+      gint           old_num_segs_out = channel->num_segs_out;
+      GeglRectangle  bounds           = { x1, y1, x2 - x1, y2 - y1 };
+      gint           x3, y3, x4, y4;
 
       if (gimp_item_bounds (GIMP_ITEM (channel), &x3, &y3, &x4, &y4))
         {
           GeglBuffer    *buffer;
           GeglRectangle  rect = { x3, y3, x4, y4 };
+          gboolean       update;
 
           x4 += x3;
           y4 += y3;
 
           buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
 
-          channel->segs_out = gimp_boundary_find (buffer, &rect,
-                                                  babl_format ("Y float"),
-                                                  GIMP_BOUNDARY_IGNORE_BOUNDS,
-                                                  x1, y1, x2, y2,
-                                                  GIMP_BOUNDARY_HALF_WAY,
-                                                  &channel->num_segs_out);
+          /*  if only a part of the mask was painted since the boundary
+           *  was found, and the boundary's region and bounds are still
+           *  the same, only the rows of that part need to be scanned again
+           */
+          update = (channel->boundary_changed.width  > 0 &&
+                    channel->boundary_changed.height > 0 &&
+                    gegl_rectangle_equal (&rect,   &channel->boundary_region) &&
+                    gegl_rectangle_equal (&bounds, &channel->boundary_bounds));
+
+          if (update)
+            channel->segs_out =
+              gimp_boundary_update (old_segs_out, old_num_segs_out,
+                                    buffer, &rect,
+                                    babl_format ("Y float"),
+                                    GIMP_BOUNDARY_IGNORE_BOUNDS,
+                                    x1, y1, x2, y2,
+                                    GIMP_BOUNDARY_HALF_WAY,
+                                    &channel->boundary_changed,
+                                    &channel->num_segs_out);
+          else
+            channel->segs_out =
+              gimp_boundary_find (buffer, &rect,
+                                  babl_format ("Y float"),
+                                  GIMP_BOUNDARY_IGNORE_BOUNDS,
+                                  x1, y1, x2, y2,
+                                  GIMP_BOUNDARY_HALF_WAY,
+                                  &channel->num_segs_out);
+
+          channel->boundary_region = rect;
+          channel->boundary_bounds = bounds;
+
           x1 = MAX (x1, x3);
           y1 = MAX (y1, y3);
           x2 = MIN (x2, x4);
@@ -1115,12 +1167,24 @@ gimp_channel_real_boundary (GimpChannel         *channel,
 
           if (x2 > x1 && y2 > y1)
             {
-              channel->segs_in = gimp_boundary_find (buffer, NULL,
-                                                     babl_format ("Y float"),
-                                                     GIMP_BOUNDARY_WITHIN_BOUNDS,
-                                                     x1, y1, x2, y2,
-                                                     GIMP_BOUNDARY_HALF_WAY,
-                                                     &channel->num_segs_in);
+              if (update)
+                channel->segs_in =
+                  gimp_boundary_update (old_segs_in, old_num_segs_in,
+                                        buffer, NULL,
+                                        babl_format ("Y float"),
+                                        GIMP_BOUNDARY_WITHIN_BOUNDS,
+                                        x1, y1, x2, y2,
+                                        GIMP_BOUNDARY_HALF_WAY,
+                                        &channel->boundary_changed,
+                                        &channel->num_segs_in);
+              else
+                channel->segs_in =
+                  gimp_boundary_find (buffer, NULL,
+                                      babl_format ("Y float"),
+                                      GIMP_BOUNDARY_WITHIN_BOUNDS,
+                                      x1, y1, x2, y2,
+                                      GIMP_BOUNDARY_HALF_WAY,
+                                      &channel->num_segs_in);
             }
           else
             {
@@ -1134,8 +1198,16 @@ gimp_channel_real_boundary (GimpChannel         *channel,
           channel->segs_out     = NULL;
           channel->num_segs_in  = 0;
           channel->num_segs_out = 0;
+
+          gegl_rectangle_set (&channel->boundary_region, 0, 0, 0, 0);
         }
 
+      /* free the out of date boundary segments */
+      g_free (old_segs_in);
+      g_free (old_segs_out);
+
+      gegl_rectangle_set (&channel->boundary_changed, 0, 0, 0, 0);
+
       channel->boundary_known = TRUE;
     }
 
@@ -1178,6 +1250,9 @@ gimp_channel_real_is_empty (GimpChannel *channel)
   channel->x2             = gimp_item_get_width  (GIMP_ITEM (channel));
   channel->y2             = gimp_item_get_height (GIMP_ITEM (channel));
 
+  gegl_rectangle_set (&channel->boundary_region,  0, 0, 0, 0);
+  gegl_rectangle_set (&channel->boundary_changed, 0, 0, 0, 0);
+
   return TRUE;
 }
 
@@ -1542,6 +1617,31 @@ gimp_channel_real_shrink (GimpChannel *channel,
                         gimp_item_get_height (GIMP_ITEM (channel)));
 }
 
+static void
+gimp_channel_invalidate_boundary_area (GimpChannel *channel,
+                                       gint         x,
+                                       gint         y,
+                                       gint         width,
+                                       gint         height)
+{
+  GeglRectangle region  = channel->boundary_region;
+  GeglRectangle changed = channel->boundary_changed;
+  GeglRectangle area    = { x, y, width, height };
+
+  gimp_drawable_invalidate_boundary (GIMP_DRAWABLE (channel));
+
+  /*  remember which part of the mask changed, so the out of date
+   *  boundary can be updated instead of found again
+   */
+  if (region.width > 0 && region.height > 0)
+    {
+      channel->boundary_region = region;
+
+      gegl_rectangle_bounding_box (&channel->boundary_changed,
+                                   &changed, &area);
+    }
+}
+
 
 /*  public functions  */
 
@@ -49,6 +49,9 @@ struct _GimpChannel
   GimpBoundSeg *segs_out;          /*  outline of selected region     */
   gint          num_segs_in;       /*  number of lines in boundary    */
   gint          num_segs_out;      /*  number of lines in boundary    */
+  GeglRectangle boundary_region;   /*  mask bounds it was found in    */
+  GeglRectangle boundary_bounds;   /*  bounds it was found within     */
+  GeglRectangle boundary_changed;  /*  area changed since then        */
   gboolean      empty;             /*  is the region empty?           */
   gboolean      bounds_known;      /*  recalculate the bounds?        */
   gint          x1, y1;            /*  coordinates for bounding box   */
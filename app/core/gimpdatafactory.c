@@ -32,6 +32,8 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-parallel.h"
+
 #include "gimp.h"
 #include "gimp-utils.h"
 #include "gimpcontext.h"
@@ -53,6 +55,32 @@ typedef void (* GimpDataForeachFunc) (GimpDataFactory *factory,
                                       gpointer         user_data);
 
 
+/*  A data file found while scanning the data path; files are collected
+ *  first, parsed (in parallel where the loader allows it) and then
+ *  added to the container in the order they were found.
+ */
+typedef struct
+{
+  const GimpDataFactoryLoaderEntry *loader;
+  GFile                            *file;
+  guint64                           mtime;
+  GFile                            *top_directory;
+  gboolean                          dir_writable;
+
+  GList                            *cached_data;
+  gboolean                          loaded;
+  GList                            *data_list;
+  GError                           *error;
+} GimpDataFactoryLoadItem;
+
+typedef struct
+{
+  GimpContext  *context;
+  GPtrArray    *items;
+  gint          next_item;
+} GimpDataFactoryLoadData;
+
+
 struct _GimpDataFactoryPriv
 {
   Gimp                             *gimp;
@@ -89,18 +117,19 @@ static GFile * gimp_data_factory_get_save_dir   (GimpDataFactory     *factory,
                                                  GError             **error);
 
 static void    gimp_data_factory_load_directory (GimpDataFactory     *factory,
-                                                 GimpContext         *context,
                                                  GHashTable          *cache,
+                                                 GPtrArray           *items,
                                                  gboolean             dir_writable,
                                                  GFile               *directory,
                                                  GFile               *top_directory);
-static void    gimp_data_factory_load_data      (GimpDataFactory     *factory,
-                                                 GimpContext         *context,
-                                                 GHashTable          *cache,
-                                                 gboolean             dir_writable,
-                                                 GFile               *file,
-                                                 guint64              mtime,
-                                                 GFile               *top_directory);
+static void    gimp_data_factory_load_item_free (GimpDataFactoryLoadItem *item);
+static void    gimp_data_factory_load_parallel  (gint                 i,
+                                                 gint                 n,
+                                                 gpointer             user_data);
+static void    gimp_data_factory_load_data      (GimpDataFactoryLoadItem *item,
+                                                 GimpContext         *context);
+static void    gimp_data_factory_add_data       (GimpDataFactory     *factory,
+                                                 GimpDataFactoryLoadItem *item);
 
 
 G_DEFINE_TYPE (GimpDataFactory, gimp_data_factory, GIMP_TYPE_OBJECT)
@@ -341,11 +370,15 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
                              GimpContext     *context,
                              GHashTable      *cache)
 {
-  gchar *p;
-  gchar *wp;
-  GList *path;
-  GList *writable_path;
-  GList *list;
+  GimpDataFactoryLoadData  data;
+  GPtrArray               *items;
+  gchar                   *p;
+  gchar                   *wp;
+  GList                   *path;
+  GList                   *writable_path;
+  GList                   *list;
+  gint                     n_threaded = 0;
+  guint                    i;
 
   g_object_get (factory->priv->gimp->config,
                 factory->priv->path_property_name,     &p,
@@ -358,6 +391,9 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
   g_free (p);
   g_free (wp);
 
+  items = g_ptr_array_new_with_free_func (
+    (GDestroyNotify) gimp_data_factory_load_item_free);
+
   for (list = path; list; list = g_list_next (list))
     {
       gboolean dir_writable = FALSE;
@@ -366,7 +402,7 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
                               (GCompareFunc) gimp_file_compare))
         dir_writable = TRUE;
 
-      gimp_data_factory_load_directory (factory, context, cache,
+      gimp_data_factory_load_directory (factory, cache, items,
                                         dir_writable,
                                         list->data,
                                         list->data);
@@ -374,6 +410,43 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
 
   g_list_free_full (path, (GDestroyNotify) g_object_unref);
   g_list_free_full (writable_path, (GDestroyNotify) g_object_unref);
+
+  for (i = 0; i < items->len; i++)
+    {
+      GimpDataFactoryLoadItem *item = g_ptr_array_index (items, i);
+
+      if (! item->cached_data && item->loader->thread_safe)
+        n_threaded++;
+    }
+
+  /*  parse everything the loaders allow on the worker threads, the
+   *  files are handed out one by one since their sizes vary wildly
+   */
+  if (n_threaded > 1)
+    {
+      data.context   = context;
+      data.items     = items;
+      data.next_item = 0;
+
+      gimp_parallel_distribute (MIN (n_threaded, GIMP_PARALLEL_MAX_THREADS),
+                                gimp_data_factory_load_parallel,
+                                &data);
+    }
+
+  /*  parse the rest and add everything in the order it was found, so
+   *  the result doesn't depend on which thread finished first
+   */
+  for (i = 0; i < items->len; i++)
+    {
+      GimpDataFactoryLoadItem *item = g_ptr_array_index (items, i);
+
+      if (! item->cached_data && ! item->loaded)
+        gimp_data_factory_load_data (item, context);
+
+      gimp_data_factory_add_data (factory, item);
+    }
+
+  g_ptr_array_free (items, TRUE);
 }
 
 void
@@ -797,8 +870,8 @@ gimp_data_factory_get_save_dir (GimpDataFactory  *factory,
 
 static void
 gimp_data_factory_load_directory (GimpDataFactory *factory,
-                                  GimpContext     *context,
                                   GHashTable      *cache,
+                                  GPtrArray       *items,
                                   gboolean         dir_writable,
                                   GFile           *directory,
                                   GFile           *top_directory)
@@ -833,22 +906,65 @@ gimp_data_factory_load_directory (GimpDataFactory *factory,
 
           if (file_type == G_FILE_TYPE_DIRECTORY)
             {
-              gimp_data_factory_load_directory (factory, context, cache,
+              gimp_data_factory_load_directory (factory, cache, items,
                                                 dir_writable,
                                                 child,
                                                 top_directory);
             }
           else if (file_type == G_FILE_TYPE_REGULAR)
             {
-              guint64 mtime;
+              const GimpDataFactoryLoaderEntry *loader = NULL;
+              guint64                           mtime;
+              gint                              i;
 
               mtime = g_file_info_get_attribute_uint64 (info,
                                                         G_FILE_ATTRIBUTE_TIME_MODIFIED);
 
-              gimp_data_factory_load_data (factory, context, cache,
-                                           dir_writable,
-                                           child, mtime,
-                                           top_directory);
+              for (i = 0; i < factory->priv->n_loader_entries; i++)
+                {
+                  const GimpDataFactoryLoaderEntry *entry;
+
+                  entry = &factory->priv->loader_entries[i];
+
+                  /* a loder matches if its extension matches, or if it
+                   * doesn't have an extension, which is the case for the
+                   * fallback loader, which must be last in the loader
+                   * array
+                   */
+                  if (! entry->extension ||
+                      gimp_file_has_extension (child, entry->extension))
+                    {
+                      loader = entry;
+                      break;
+                    }
+                }
+
+              if (loader)
+                {
+                  GimpDataFactoryLoadItem *item;
+
+                  item = g_slice_new0 (GimpDataFactoryLoadItem);
+
+                  item->loader        = loader;
+                  item->file          = g_object_ref (child);
+                  item->mtime         = mtime;
+                  item->top_directory = g_object_ref (top_directory);
+                  item->dir_writable  = dir_writable;
+
+                  if (cache)
+                    {
+                      GList *cached_data = g_hash_table_lookup (cache, child);
+
+                      if (cached_data &&
+                          gimp_data_get_mtime (cached_data->data) != 0 &&
+                          gimp_data_get_mtime (cached_data->data) == mtime)
+                        {
+                          item->cached_data = cached_data;
+                        }
+                    }
+
+                  g_ptr_array_add (items, item);
+                }
             }
 
           g_object_unref (child);
@@ -860,60 +976,51 @@ gimp_data_factory_load_directory (GimpDataFactory *factory,
 }
 
 static void
-gimp_data_factory_load_data (GimpDataFactory *factory,
-                             GimpContext     *context,
-                             GHashTable      *cache,
-                             gboolean         dir_writable,
-                             GFile           *file,
-                             guint64          mtime,
-                             GFile           *top_directory)
-{
-  const GimpDataFactoryLoaderEntry *loader    = NULL;
-  GList                            *data_list = NULL;
-  GInputStream                     *input;
-  gint                              i;
-  GError                           *error = NULL;
-
-  for (i = 0; i < factory->priv->n_loader_entries; i++)
-    {
-      loader = &factory->priv->loader_entries[i];
-
-      /* a loder matches if its extension matches, or if it doesn't
-       * have an extension, which is the case for the fallback loader,
-       * which must be last in the loader array
-       */
-      if (! loader->extension ||
-          gimp_file_has_extension (file, loader->extension))
-        {
-          goto insert;
-        }
-    }
+gimp_data_factory_load_item_free (GimpDataFactoryLoadItem *item)
+{
+  g_list_free_full (item->data_list, (GDestroyNotify) g_object_unref);
+  g_clear_error (&item->error);
 
-  return;
+  g_object_unref (item->file);
+  g_object_unref (item->top_directory);
 
- insert:
-  if (cache)
-    {
-      GList *cached_data = g_hash_table_lookup (cache, file);
+  g_slice_free (GimpDataFactoryLoadItem, item);
+}
 
-      if (cached_data &&
-          gimp_data_get_mtime (cached_data->data) != 0 &&
-          gimp_data_get_mtime (cached_data->data) == mtime)
-        {
-          GList *list;
+static void
+gimp_data_factory_load_parallel (gint     i,
+                                 gint     n,
+                                 gpointer user_data)
+{
+  GimpDataFactoryLoadData *data = user_data;
+  gint                     index;
 
-          for (list = cached_data; list; list = g_list_next (list))
-            gimp_container_add (factory->priv->container, list->data);
+  while ((index = g_atomic_int_add (&data->next_item, 1)) <
+         (gint) data->items->len)
+    {
+      GimpDataFactoryLoadItem *item = g_ptr_array_index (data->items, index);
 
-          return;
-        }
+      if (! item->cached_data && item->loader->thread_safe)
+        gimp_data_factory_load_data (item, data->context);
     }
+}
+
+/*  called from worker threads, must not touch the factory or
+ *  anything else that is shared
+ */
+static void
+gimp_data_factory_load_data (GimpDataFactoryLoadItem *item,
+                             GimpContext             *context)
+{
+  GFile        *file  = item->file;
+  GInputStream *input;
+  GError       *error = NULL;
 
   input = G_INPUT_STREAM (g_file_read (file, NULL, &error));
 
   if (input)
     {
-      data_list = loader->load_func (context, file, input, &error);
+      item->data_list = item->loader->load_func (context, file, input, &error);
 
       if (error)
         {
@@ -921,7 +1028,7 @@ gimp_data_factory_load_data (GimpDataFactory *factory,
                           _("Error loading '%s': "),
                           gimp_file_get_utf8_name (file));
         }
-      else if (! data_list)
+      else if (! item->data_list)
         {
           g_set_error (&error, GIMP_DATA_ERROR, GIMP_DATA_ERROR_READ,
                        _("Error loading '%s'"),
@@ -937,7 +1044,27 @@ gimp_data_factory_load_data (GimpDataFactory *factory,
                       gimp_file_get_utf8_name (file));
     }
 
-  if (G_LIKELY (data_list))
+  item->error  = error;
+  item->loaded = TRUE;
+}
+
+static void
+gimp_data_factory_add_data (GimpDataFactory         *factory,
+                            GimpDataFactoryLoadItem *item)
+{
+  GFile *file = item->file;
+
+  if (item->cached_data)
+    {
+      GList *list;
+
+      for (list = item->cached_data; list; list = g_list_next (list))
+        gimp_container_add (factory->priv->container, list->data);
+
+      return;
+    }
+
+  if (G_LIKELY (item->data_list))
     {
       GList    *list;
       gchar    *uri;
@@ -954,16 +1081,17 @@ gimp_data_factory_load_data (GimpDataFactory *factory,
       /* obsolete files are immutable, don't check their writability */
       if (! obsolete)
         {
-          deletable = (g_list_length (data_list) == 1 && dir_writable);
-          writable  = (deletable && loader->writable);
+          deletable = (g_list_length (item->data_list) == 1 &&
+                       item->dir_writable);
+          writable  = (deletable && item->loader->writable);
         }
 
-      for (list = data_list; list; list = g_list_next (list))
+      for (list = item->data_list; list; list = g_list_next (list))
         {
           GimpData *data = list->data;
 
           gimp_data_set_file (data, file, writable, deletable);
-          gimp_data_set_mtime (data, mtime);
+          gimp_data_set_mtime (data, item->mtime);
           gimp_data_clean (data);
 
           if (obsolete)
@@ -973,26 +1101,21 @@ gimp_data_factory_load_data (GimpDataFactory *factory,
             }
           else
             {
-              gimp_data_set_folder_tags (data, top_directory);
+              gimp_data_set_folder_tags (data, item->top_directory);
 
               gimp_container_add (factory->priv->container,
                                   GIMP_OBJECT (data));
             }
-
-          g_object_unref (data);
         }
-
-      g_list_free (data_list);
     }
 
   /*  not else { ... } because loader->load_func() can return a list
    *  of data objects *and* an error message if loading failed after
    *  something was already loaded
    */
-  if (G_UNLIKELY (error))
+  if (G_UNLIKELY (item->error))
     {
       gimp_message (factory->priv->gimp, NULL, GIMP_MESSAGE_ERROR,
-                    _("Failed to load data:\n\n%s"), error->message);
-      g_clear_error (&error);
+                    _("Failed to load data:\n\n%s"), item->error->message);
     }
 }
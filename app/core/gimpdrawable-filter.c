@@ -101,13 +101,17 @@ gimp_drawable_merge_filter (GimpDrawable *drawable,
                                 &rect.x, &rect.y,
                                 &rect.width, &rect.height))
     {
-      GimpImage      *image = gimp_item_get_image (GIMP_ITEM (drawable));
+      GimpItem       *item  = GIMP_ITEM (drawable);
+      GimpImage      *image = gimp_item_get_image (item);
       GeglBuffer     *undo_buffer;
       GimpApplicator *applicator;
       GeglBuffer     *apply_buffer = NULL;
       GeglBuffer     *cache        = NULL;
       GeglRectangle  *rects        = NULL;
       gint            n_rects      = 0;
+      gboolean        locked       = FALSE;
+      gint            filter_index = -1;
+      gboolean        applied;
 
       undo_buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
                                                      rect.width, rect.height),
@@ -163,13 +167,59 @@ gimp_drawable_merge_filter (GimpDrawable *drawable,
 
       gimp_projection_stop_rendering (gimp_image_get_projection (image));
 
-      if (gimp_gegl_apply_cached_operation (gimp_drawable_get_buffer (drawable),
-                                            progress, undo_desc,
-                                            gimp_filter_get_node (filter),
-                                            gimp_drawable_get_buffer (drawable),
-                                            &rect,
-                                            cache, rects, n_rects,
-                                            cancellable))
+      if (cancellable)
+        {
+          /*  events are processed while the filter is rendered in the
+           *  background, don't let them change the drawable, or pop
+           *  the undo history from under it.  Other edits of the
+           *  image are still recorded as usual.
+           */
+          locked = (gimp_item_can_lock_content (item) &&
+                    ! gimp_item_get_lock_content (item));
+
+          if (locked)
+            gimp_item_set_lock_content (item, TRUE, FALSE);
+
+          gimp_image_undo_block (image);
+
+          /*  the filter's node is rendered on another thread, take it
+           *  out of the drawable's graph, so the projection, which is
+           *  rendered on this thread meanwhile, doesn't process it too
+           */
+          if (gimp_drawable_has_filter (drawable, filter))
+            {
+              filter_index =
+                gimp_container_get_child_index (drawable->private->filter_stack,
+                                                GIMP_OBJECT (filter));
+
+              gimp_drawable_remove_filter (drawable, filter);
+            }
+        }
+
+      applied = gimp_gegl_apply_cached_operation (gimp_drawable_get_buffer (drawable),
+                                                  progress, undo_desc,
+                                                  gimp_filter_get_node (filter),
+                                                  gimp_drawable_get_buffer (drawable),
+                                                  &rect,
+                                                  cache, rects, n_rects,
+                                                  cancellable);
+
+      if (cancellable)
+        {
+          if (filter_index >= 0)
+            {
+              gimp_drawable_add_filter (drawable, filter);
+              gimp_container_reorder (drawable->private->filter_stack,
+                                      GIMP_OBJECT (filter), filter_index);
+            }
+
+          gimp_image_undo_unblock (image);
+
+          if (locked)
+            gimp_item_set_lock_content (item, FALSE, FALSE);
+        }
+
+      if (applied && gimp_item_is_attached (item))
         {
           /*  finished successfully  */
 
@@ -195,7 +245,9 @@ gimp_drawable_merge_filter (GimpDrawable *drawable,
         }
       else
         {
-          /*  canceled by the user  */
+          /*  canceled by the user, or the drawable was removed
+           *  meanwhile
+           */
 
           gegl_buffer_copy (undo_buffer,
                             GEGL_RECTANGLE (0, 0, rect.width, rect.height),
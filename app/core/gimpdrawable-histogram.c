@@ -25,6 +25,7 @@
 #include "core-types.h"
 
 #include "gegl/gimp-gegl-nodes.h"
+#include "gegl/gimp-parallel.h"
 
 #include "gimpchannel.h"
 #include "gimpdrawable-histogram.h"
@@ -32,18 +33,415 @@
 #include "gimpimage.h"
 
 
+/*  the quick histogram is calculated from the mipmap level at which
+ *  the drawable's masked area has no more than this many pixels
+ */
+#define QUICK_HISTOGRAM_MAX_AREA  (512 * 512)
+#define QUICK_HISTOGRAM_MAX_LEVEL 7
+
+#define REFINE_KEY "gimp-drawable-histogram-refine"
+
+/*  the number of pixels the refinement processes per idle iteration  */
+#define REFINE_CHUNK_AREA (512 * 512)
+
+/*  the size of the cells a GimpDrawableHistogram keeps partial
+ *  histograms of
+ */
+#define CELL_SIZE 512
+
+
+typedef struct
+{
+  GimpDrawable  *drawable;
+  GimpImage     *image;
+  GimpHistogram *histogram;
+  GimpHistogram *partial;
+  GimpHistogram *chunk;
+  GeglRectangle  area;
+  gint           y;
+  guint          idle_id;
+} HistogramRefine;
+
+struct _GimpDrawableHistogram
+{
+  GimpDrawable   *drawable;
+  GimpImage      *image;
+  GimpHistogram  *histogram;
+
+  GeglRectangle   area;
+  const Babl     *format;
+  gint            n_cols;
+  gint            n_rows;
+  GimpHistogram **cells;
+  gboolean       *dirty;
+};
+
+typedef struct
+{
+  GimpDrawableHistogram *dh;
+  GeglBuffer            *buffer;
+  GeglBuffer            *mask;
+  gint                   mask_off_x;
+  gint                   mask_off_y;
+  const gint            *indices;
+} CellContext;
+
+
+/*  local function prototypes  */
+
+static void     gimp_drawable_calculate_histogram_level
+                                         (GimpDrawable          *drawable,
+                                          GimpHistogram         *histogram,
+                                          gint                   level);
+
+static gboolean gimp_drawable_histogram_refine
+                                         (HistogramRefine       *refine);
+static void     gimp_drawable_histogram_refine_restart
+                                         (HistogramRefine       *refine);
+static void     gimp_drawable_histogram_refine_free
+                                         (HistogramRefine       *refine);
+
+static void     gimp_drawable_histogram_drawable_update
+                                         (GimpDrawable          *drawable,
+                                          gint                   x,
+                                          gint                   y,
+                                          gint                   width,
+                                          gint                   height,
+                                          GimpDrawableHistogram *dh);
+static void     gimp_drawable_histogram_mask_changed
+                                         (GimpImage             *image,
+                                          GimpDrawableHistogram *dh);
+static void     gimp_drawable_histogram_clear_cells
+                                         (GimpDrawableHistogram *dh);
+static void     gimp_drawable_histogram_calc_cells
+                                         (gsize                  offset,
+                                          gsize                  size,
+                                          CellContext           *context);
+
+
+/*  public functions  */
+
 void
 gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
                                    GimpHistogram *histogram)
 {
-  GimpImage   *image;
-  GimpChannel *mask;
-  gint         x, y, width, height;
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
+  g_return_if_fail (histogram != NULL);
+
+  /*  a full calculation supersedes any pending refinement  */
+  g_object_set_data (G_OBJECT (histogram), REFINE_KEY, NULL);
+
+  gimp_drawable_calculate_histogram_level (drawable, histogram, 0);
+}
+
+/**
+ * gimp_drawable_calculate_histogram_quick:
+ * @drawable:  a #GimpDrawable
+ * @histogram: the #GimpHistogram to calculate
+ *
+ * Calculates an approximate histogram of @drawable from one of its
+ * lower mipmap levels, which is cheap regardless of the drawable's
+ * size, and schedules an idle refinement which replaces it with the
+ * full resolution histogram.  The refinement processes the drawable
+ * in bounded chunks, one per idle iteration, and starts over when the
+ * drawable or the selection change.  Use this when the histogram is
+ * needed right away, for example when a tool dialog is opened.
+ **/
+void
+gimp_drawable_calculate_histogram_quick (GimpDrawable  *drawable,
+                                         GimpHistogram *histogram)
+{
+  HistogramRefine *refine;
+  gboolean         gamma_correct;
+  gint             x, y, width, height;
+  gint             level = 0;
 
   g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
   g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
   g_return_if_fail (histogram != NULL);
 
+  g_object_set_data (G_OBJECT (histogram), REFINE_KEY, NULL);
+
+  if (! gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height))
+    return;
+
+  while (level < QUICK_HISTOGRAM_MAX_LEVEL &&
+         (gint64) (width >> level) * (height >> level) >
+         QUICK_HISTOGRAM_MAX_AREA)
+    {
+      level++;
+    }
+
+  gimp_drawable_calculate_histogram_level (drawable, histogram, level);
+
+  if (level == 0)
+    return;
+
+  gamma_correct = gimp_histogram_get_gamma_correct (histogram);
+
+  refine = g_slice_new0 (HistogramRefine);
+
+  refine->drawable  = drawable;
+  refine->image     = gimp_item_get_image (GIMP_ITEM (drawable));
+  refine->histogram = histogram;
+  refine->partial   = gimp_histogram_new (gamma_correct);
+  refine->chunk     = gimp_histogram_new (gamma_correct);
+
+  g_object_add_weak_pointer (G_OBJECT (refine->drawable),
+                             (gpointer) &refine->drawable);
+  g_object_add_weak_pointer (G_OBJECT (refine->image),
+                             (gpointer) &refine->image);
+
+  /*  a refinement of stale pixels is useless, start over  */
+  g_signal_connect_swapped (refine->drawable, "update",
+                            G_CALLBACK (gimp_drawable_histogram_refine_restart),
+                            refine);
+  g_signal_connect_swapped (refine->image, "mask-changed",
+                            G_CALLBACK (gimp_drawable_histogram_refine_restart),
+                            refine);
+
+  gimp_drawable_histogram_refine_restart (refine);
+
+  /*  the refinement goes away with the histogram  */
+  g_object_set_data_full (G_OBJECT (histogram), REFINE_KEY, refine,
+                          (GDestroyNotify)
+                          gimp_drawable_histogram_refine_free);
+}
+
+/**
+ * gimp_drawable_histogram_new:
+ * @drawable:  a #GimpDrawable
+ * @histogram: the #GimpHistogram to keep up to date
+ *
+ * Creates a helper which keeps @histogram up to date with @drawable
+ * incrementally.  It splits the drawable into cells of CELL_SIZE
+ * pixels, and keeps a partial histogram of each of them.  The cells
+ * touched by the drawable's "update" signal are marked dirty, and
+ * gimp_drawable_histogram_update() then only subtracts their stale
+ * counts from @histogram and adds the new ones, instead of reading
+ * the entire drawable again.
+ *
+ * Return value: a new #GimpDrawableHistogram
+ **/
+GimpDrawableHistogram *
+gimp_drawable_histogram_new (GimpDrawable  *drawable,
+                             GimpHistogram *histogram)
+{
+  GimpDrawableHistogram *dh;
+
+  g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
+  g_return_val_if_fail (GIMP_IS_HISTOGRAM (histogram), NULL);
+
+  dh = g_slice_new0 (GimpDrawableHistogram);
+
+  dh->drawable  = g_object_ref (drawable);
+  dh->image     = g_object_ref (gimp_item_get_image (GIMP_ITEM (drawable)));
+  dh->histogram = g_object_ref (histogram);
+
+  g_signal_connect (dh->drawable, "update",
+                    G_CALLBACK (gimp_drawable_histogram_drawable_update),
+                    dh);
+  g_signal_connect (dh->image, "mask-changed",
+                    G_CALLBACK (gimp_drawable_histogram_mask_changed),
+                    dh);
+
+  return dh;
+}
+
+void
+gimp_drawable_histogram_free (GimpDrawableHistogram *dh)
+{
+  g_return_if_fail (dh != NULL);
+
+  g_signal_handlers_disconnect_by_func (dh->drawable,
+                                        gimp_drawable_histogram_drawable_update,
+                                        dh);
+  g_signal_handlers_disconnect_by_func (dh->image,
+                                        gimp_drawable_histogram_mask_changed,
+                                        dh);
+
+  gimp_drawable_histogram_clear_cells (dh);
+
+  g_object_unref (dh->drawable);
+  g_object_unref (dh->image);
+  g_object_unref (dh->histogram);
+
+  g_slice_free (GimpDrawableHistogram, dh);
+}
+
+/**
+ * gimp_drawable_histogram_invalidate:
+ * @dh:   a #GimpDrawableHistogram
+ * @rect: the area to invalidate, in drawable coordinates, or %NULL
+ *
+ * Marks the cells intersecting @rect dirty, or all cells if @rect is
+ * %NULL.  Changes to the drawable's pixels and to the selection are
+ * tracked automatically, this is only needed when something else
+ * affects the histogram.
+ **/
+void
+gimp_drawable_histogram_invalidate (GimpDrawableHistogram *dh,
+                                    const GeglRectangle   *rect)
+{
+  GeglRectangle dirty;
+  gint          col1, col2;
+  gint          row1, row2;
+  gint          row, col;
+
+  g_return_if_fail (dh != NULL);
+
+  if (! dh->cells)
+    return;
+
+  if (! rect)
+    {
+      gimp_drawable_histogram_clear_cells (dh);
+      return;
+    }
+
+  if (! gegl_rectangle_intersect (&dirty, rect, &dh->area))
+    return;
+
+  col1 = (dirty.x - dh->area.x) / CELL_SIZE;
+  row1 = (dirty.y - dh->area.y) / CELL_SIZE;
+  col2 = (dirty.x + dirty.width  - 1 - dh->area.x) / CELL_SIZE;
+  row2 = (dirty.y + dirty.height - 1 - dh->area.y) / CELL_SIZE;
+
+  for (row = row1; row <= row2; row++)
+    for (col = col1; col <= col2; col++)
+      dh->dirty[row * dh->n_cols + col] = TRUE;
+}
+
+/**
+ * gimp_drawable_histogram_update:
+ * @dh: a #GimpDrawableHistogram
+ *
+ * Recalculates the dirty cells, in parallel, and updates the
+ * histogram passed to gimp_drawable_histogram_new() accordingly.
+ **/
+void
+gimp_drawable_histogram_update (GimpDrawableHistogram *dh)
+{
+  GimpChannel   *mask;
+  CellContext    context;
+  GeglRectangle  area;
+  gint          *indices;
+  gint           n_cells;
+  gint           n_dirty = 0;
+  gboolean       gamma_correct;
+  gint           i;
+
+  g_return_if_fail (dh != NULL);
+
+  if (! gimp_item_is_attached (GIMP_ITEM (dh->drawable)) ||
+      ! gimp_item_mask_intersect (GIMP_ITEM (dh->drawable),
+                                  &area.x, &area.y,
+                                  &area.width, &area.height))
+    {
+      gimp_drawable_histogram_clear_cells (dh);
+      gimp_histogram_clear_values (dh->histogram);
+
+      return;
+    }
+
+  /*  start over when the area or the format change, the first would
+   *  move the cells, the second changes the number of bins
+   */
+  if (dh->cells &&
+      (! gegl_rectangle_equal (&area, &dh->area) ||
+       dh->format != gimp_drawable_get_format (dh->drawable)))
+    {
+      gimp_drawable_histogram_clear_cells (dh);
+    }
+
+  if (! dh->cells)
+    {
+      dh->area   = area;
+      dh->format = gimp_drawable_get_format (dh->drawable);
+      dh->n_cols = (area.width  + CELL_SIZE - 1) / CELL_SIZE;
+      dh->n_rows = (area.height + CELL_SIZE - 1) / CELL_SIZE;
+
+      n_cells = dh->n_cols * dh->n_rows;
+
+      dh->cells = g_new (GimpHistogram *, n_cells);
+      dh->dirty = g_new (gboolean, n_cells);
+
+      gamma_correct = gimp_histogram_get_gamma_correct (dh->histogram);
+
+      for (i = 0; i < n_cells; i++)
+        {
+          dh->cells[i] = gimp_histogram_new (gamma_correct);
+          dh->dirty[i] = TRUE;
+        }
+
+      gimp_histogram_clear_values (dh->histogram);
+    }
+
+  n_cells = dh->n_cols * dh->n_rows;
+  indices = g_new (gint, n_cells);
+
+  for (i = 0; i < n_cells; i++)
+    {
+      if (dh->dirty[i])
+        indices[n_dirty++] = i;
+    }
+
+  if (n_dirty == 0)
+    {
+      g_free (indices);
+      return;
+    }
+
+  mask = gimp_image_get_mask (dh->image);
+
+  context.dh      = dh;
+  context.buffer  = gimp_drawable_get_buffer (dh->drawable);
+  context.mask    = NULL;
+  context.indices = indices;
+
+  if (! gimp_channel_is_empty (mask))
+    {
+      context.mask = gimp_drawable_get_buffer (GIMP_DRAWABLE (mask));
+
+      gimp_item_get_offset (GIMP_ITEM (dh->drawable),
+                            &context.mask_off_x, &context.mask_off_y);
+    }
+
+  g_object_freeze_notify (G_OBJECT (dh->histogram));
+
+  for (i = 0; i < n_dirty; i++)
+    gimp_histogram_add (dh->histogram, dh->cells[indices[i]], -1.0);
+
+  gimp_parallel_distribute_range (n_dirty, 1,
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_drawable_histogram_calc_cells,
+                                  &context);
+
+  for (i = 0; i < n_dirty; i++)
+    {
+      gimp_histogram_add (dh->histogram, dh->cells[indices[i]], 1.0);
+
+      dh->dirty[indices[i]] = FALSE;
+    }
+
+  g_object_thaw_notify (G_OBJECT (dh->histogram));
+
+  g_free (indices);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_drawable_calculate_histogram_level (GimpDrawable  *drawable,
+                                         GimpHistogram *histogram,
+                                         gint           level)
+{
+  GimpImage   *image;
+  GimpChannel *mask;
+  gint         x, y, width, height;
+
   if (! gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height))
     return;
 
@@ -105,18 +503,225 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
 
           gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
 
-          gimp_histogram_calculate (histogram,
-                                    gimp_drawable_get_buffer (drawable),
-                                    GEGL_RECTANGLE (x, y, width, height),
-                                    gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
-                                    GEGL_RECTANGLE (x + off_x, y + off_y,
-                                                    width, height));
+          gimp_histogram_calculate_level (histogram,
+                                          gimp_drawable_get_buffer (drawable),
+                                          GEGL_RECTANGLE (x, y, width, height),
+                                          gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
+                                          GEGL_RECTANGLE (x + off_x, y + off_y,
+                                                          width, height),
+                                          level);
+        }
+      else
+        {
+          gimp_histogram_calculate_level (histogram,
+                                          gimp_drawable_get_buffer (drawable),
+                                          GEGL_RECTANGLE (x, y, width, height),
+                                          NULL, NULL,
+                                          level);
+        }
+    }
+}
+
+static gboolean
+gimp_drawable_histogram_refine (HistogramRefine *refine)
+{
+  GimpChannel   *mask;
+  GeglRectangle  rect;
+
+  if (! refine->drawable                                     ||
+      ! refine->image                                        ||
+      ! gimp_item_is_attached (GIMP_ITEM (refine->drawable)) ||
+      refine->area.width  <= 0                               ||
+      refine->area.height <= 0)
+    {
+      refine->idle_id = 0;
+
+      /*  frees @refine  */
+      g_object_set_data (G_OBJECT (refine->histogram), REFINE_KEY, NULL);
+
+      return G_SOURCE_REMOVE;
+    }
+
+  rect        = refine->area;
+  rect.y      = refine->y;
+  rect.height = MAX (REFINE_CHUNK_AREA / rect.width, 1);
+  rect.height = MIN (rect.height,
+                     refine->area.y + refine->area.height - rect.y);
+
+  mask = gimp_image_get_mask (refine->image);
+
+  if (! gimp_channel_is_empty (mask))
+    {
+      GeglRectangle mask_rect = rect;
+      gint          off_x, off_y;
+
+      gimp_item_get_offset (GIMP_ITEM (refine->drawable), &off_x, &off_y);
+
+      mask_rect.x += off_x;
+      mask_rect.y += off_y;
+
+      gimp_histogram_calculate (refine->chunk,
+                                gimp_drawable_get_buffer (refine->drawable),
+                                &rect,
+                                gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
+                                &mask_rect);
+    }
+  else
+    {
+      gimp_histogram_calculate (refine->chunk,
+                                gimp_drawable_get_buffer (refine->drawable),
+                                &rect,
+                                NULL, NULL);
+    }
+
+  gimp_histogram_add (refine->partial, refine->chunk, 1.0);
+
+  refine->y += rect.height;
+
+  if (refine->y < refine->area.y + refine->area.height)
+    return G_SOURCE_CONTINUE;
+
+  refine->idle_id = 0;
+
+  g_object_freeze_notify (G_OBJECT (refine->histogram));
+
+  gimp_histogram_clear_values (refine->histogram);
+  gimp_histogram_add (refine->histogram, refine->partial, 1.0);
+
+  g_object_thaw_notify (G_OBJECT (refine->histogram));
+
+  /*  frees @refine  */
+  g_object_set_data (G_OBJECT (refine->histogram), REFINE_KEY, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gimp_drawable_histogram_refine_restart (HistogramRefine *refine)
+{
+  gimp_histogram_clear_values (refine->partial);
+
+  if (! refine->drawable                                     ||
+      ! gimp_item_is_attached (GIMP_ITEM (refine->drawable)) ||
+      ! gimp_item_mask_intersect (GIMP_ITEM (refine->drawable),
+                                  &refine->area.x, &refine->area.y,
+                                  &refine->area.width, &refine->area.height))
+    {
+      /*  nothing to refine, the next idle iteration gives up  */
+      refine->area.width  = 0;
+      refine->area.height = 0;
+    }
+
+  refine->y = refine->area.y;
+
+  if (! refine->idle_id)
+    refine->idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                       (GSourceFunc)
+                                       gimp_drawable_histogram_refine,
+                                       refine, NULL);
+}
+
+static void
+gimp_drawable_histogram_refine_free (HistogramRefine *refine)
+{
+  if (refine->idle_id)
+    g_source_remove (refine->idle_id);
+
+  if (refine->drawable)
+    {
+      g_signal_handlers_disconnect_by_func (refine->drawable,
+                                            gimp_drawable_histogram_refine_restart,
+                                            refine);
+      g_object_remove_weak_pointer (G_OBJECT (refine->drawable),
+                                    (gpointer) &refine->drawable);
+    }
+
+  if (refine->image)
+    {
+      g_signal_handlers_disconnect_by_func (refine->image,
+                                            gimp_drawable_histogram_refine_restart,
+                                            refine);
+      g_object_remove_weak_pointer (G_OBJECT (refine->image),
+                                    (gpointer) &refine->image);
+    }
+
+  g_object_unref (refine->partial);
+  g_object_unref (refine->chunk);
+
+  g_slice_free (HistogramRefine, refine);
+}
+
+static void
+gimp_drawable_histogram_drawable_update (GimpDrawable          *drawable,
+                                         gint                   x,
+                                         gint                   y,
+                                         gint                   width,
+                                         gint                   height,
+                                         GimpDrawableHistogram *dh)
+{
+  gimp_drawable_histogram_invalidate (dh,
+                                      GEGL_RECTANGLE (x, y, width, height));
+}
+
+static void
+gimp_drawable_histogram_mask_changed (GimpImage             *image,
+                                      GimpDrawableHistogram *dh)
+{
+  gimp_drawable_histogram_invalidate (dh, NULL);
+}
+
+static void
+gimp_drawable_histogram_clear_cells (GimpDrawableHistogram *dh)
+{
+  if (dh->cells)
+    {
+      gint n_cells = dh->n_cols * dh->n_rows;
+      gint i;
+
+      for (i = 0; i < n_cells; i++)
+        g_object_unref (dh->cells[i]);
+
+      g_free (dh->cells);
+      dh->cells = NULL;
+
+      g_free (dh->dirty);
+      dh->dirty = NULL;
+    }
+}
+
+static void
+gimp_drawable_histogram_calc_cells (gsize        offset,
+                                    gsize        size,
+                                    CellContext *context)
+{
+  GimpDrawableHistogram *dh = context->dh;
+  gsize                  i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      gint          index = context->indices[i];
+      GeglRectangle cell;
+
+      cell.x      = dh->area.x + (index % dh->n_cols) * CELL_SIZE;
+      cell.y      = dh->area.y + (index / dh->n_cols) * CELL_SIZE;
+      cell.width  = MIN (CELL_SIZE, dh->area.x + dh->area.width  - cell.x);
+      cell.height = MIN (CELL_SIZE, dh->area.y + dh->area.height - cell.y);
+
+      if (context->mask)
+        {
+          GeglRectangle mask_cell = cell;
+
+          mask_cell.x += context->mask_off_x;
+          mask_cell.y += context->mask_off_y;
+
+          gimp_histogram_calculate (dh->cells[index],
+                                    context->buffer, &cell,
+                                    context->mask, &mask_cell);
         }
       else
         {
-          gimp_histogram_calculate (histogram,
-                                    gimp_drawable_get_buffer (drawable),
-                                    GEGL_RECTANGLE (x, y, width, height),
+          gimp_histogram_calculate (dh->cells[index],
+                                    context->buffer, &cell,
                                     NULL, NULL);
         }
     }
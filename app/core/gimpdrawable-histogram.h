@@ -21,8 +21,18 @@
 #define __GIMP_DRAWABLE_HISTOGRAM_H__
 
 
-void   gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
-                                          GimpHistogram *histogram);
+void   gimp_drawable_calculate_histogram       (GimpDrawable  *drawable,
+                                                GimpHistogram *histogram);
+void   gimp_drawable_calculate_histogram_quick (GimpDrawable  *drawable,
+                                                GimpHistogram *histogram);
+
+GimpDrawableHistogram *
+       gimp_drawable_histogram_new        (GimpDrawable          *drawable,
+                                           GimpHistogram         *histogram);
+void   gimp_drawable_histogram_free       (GimpDrawableHistogram *dh);
+void   gimp_drawable_histogram_invalidate (GimpDrawableHistogram *dh,
+                                           const GeglRectangle   *rect);
+void   gimp_drawable_histogram_update     (GimpDrawableHistogram *dh);
 
 
 #endif /* __GIMP_HISTOGRAM_H__ */
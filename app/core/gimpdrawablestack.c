@@ -27,9 +27,19 @@
 
 #include "gimpdrawable.h"
 #include "gimpdrawablestack.h"
+#include "gimplayer.h"
 #include "gimpmarshal.h"
 
 
+/*  the number of consecutive updates of the same drawable after which
+ *  the composites of the unchanged drawables around it are cached
+ */
+#define GIMP_DRAWABLE_STACK_ISOLATE_UPDATES 3
+
+/*  the minimal number of drawables for which isolating one pays off  */
+#define GIMP_DRAWABLE_STACK_ISOLATE_MIN_CHILDREN 3
+
+
 enum
 {
   UPDATE,
@@ -39,29 +49,38 @@ enum
 
 /*  local function prototypes  */
 
-static void   gimp_drawable_stack_constructed      (GObject           *object);
-
-static void   gimp_drawable_stack_add              (GimpContainer     *container,
-                                                    GimpObject        *object);
-static void   gimp_drawable_stack_remove           (GimpContainer     *container,
-                                                    GimpObject        *object);
-static void   gimp_drawable_stack_reorder          (GimpContainer     *container,
-                                                    GimpObject        *object,
-                                                    gint               new_index);
-
-static void   gimp_drawable_stack_update           (GimpDrawableStack *stack,
-                                                    gint               x,
-                                                    gint               y,
-                                                    gint               width,
-                                                    gint               height);
-static void   gimp_drawable_stack_drawable_update  (GimpItem          *item,
-                                                    gint               x,
-                                                    gint               y,
-                                                    gint               width,
-                                                    gint               height,
-                                                    GimpDrawableStack *stack);
-static void   gimp_drawable_stack_drawable_visible (GimpItem          *item,
-                                                    GimpDrawableStack *stack);
+static void     gimp_drawable_stack_constructed      (GObject           *object);
+
+static void     gimp_drawable_stack_add              (GimpContainer     *container,
+                                                      GimpObject        *object);
+static void     gimp_drawable_stack_remove           (GimpContainer     *container,
+                                                      GimpObject        *object);
+static void     gimp_drawable_stack_reorder          (GimpContainer     *container,
+                                                      GimpObject        *object,
+                                                      gint               new_index);
+
+static void     gimp_drawable_stack_update           (GimpDrawableStack *stack,
+                                                      gint               x,
+                                                      gint               y,
+                                                      gint               width,
+                                                      gint               height);
+static void     gimp_drawable_stack_drawable_update  (GimpItem          *item,
+                                                      gint               x,
+                                                      gint               y,
+                                                      gint               width,
+                                                      gint               height,
+                                                      GimpDrawableStack *stack);
+static void     gimp_drawable_stack_drawable_visible (GimpItem          *item,
+                                                      GimpDrawableStack *stack);
+
+static void     gimp_drawable_stack_track_update     (GimpDrawableStack *stack,
+                                                      GimpDrawable      *drawable);
+static gboolean gimp_drawable_stack_get_above_linear (GimpDrawableStack *stack,
+                                                      gint               index,
+                                                      gboolean          *linear);
+static void     gimp_drawable_stack_isolate          (GimpDrawableStack *stack,
+                                                      GimpDrawable      *drawable);
+static void     gimp_drawable_stack_unisolate        (GimpDrawableStack *stack);
 
 
 G_DEFINE_TYPE (GimpDrawableStack, gimp_drawable_stack, GIMP_TYPE_ITEM_STACK)
@@ -126,6 +145,8 @@ gimp_drawable_stack_add (GimpContainer *container,
 {
   GimpDrawableStack *stack = GIMP_DRAWABLE_STACK (container);
 
+  gimp_drawable_stack_unisolate (stack);
+
   GIMP_CONTAINER_CLASS (parent_class)->add (container, object);
 
   if (gimp_item_get_visible (GIMP_ITEM (object)))
@@ -138,6 +159,11 @@ gimp_drawable_stack_remove (GimpContainer *container,
 {
   GimpDrawableStack *stack = GIMP_DRAWABLE_STACK (container);
 
+  gimp_drawable_stack_unisolate (stack);
+
+  if (stack->dirty_drawable == GIMP_DRAWABLE (object))
+    stack->dirty_drawable = NULL;
+
   GIMP_CONTAINER_CLASS (parent_class)->remove (container, object);
 
   if (gimp_item_get_visible (GIMP_ITEM (object)))
@@ -151,6 +177,8 @@ gimp_drawable_stack_reorder (GimpContainer *container,
 {
   GimpDrawableStack *stack  = GIMP_DRAWABLE_STACK (container);
 
+  gimp_drawable_stack_unisolate (stack);
+
   GIMP_CONTAINER_CLASS (parent_class)->reorder (container, object, new_index);
 
   if (gimp_item_get_visible (GIMP_ITEM (object)))
@@ -199,6 +227,8 @@ gimp_drawable_stack_drawable_update (GimpItem          *item,
       gint offset_x;
       gint offset_y;
 
+      gimp_drawable_stack_track_update (stack, GIMP_DRAWABLE (item));
+
       gimp_item_get_offset (item, &offset_x, &offset_y);
 
       gimp_drawable_stack_update (stack,
@@ -214,6 +244,9 @@ gimp_drawable_stack_drawable_visible (GimpItem          *item,
   gint offset_x;
   gint offset_y;
 
+  gimp_drawable_stack_unisolate (stack);
+  stack->dirty_drawable = NULL;
+
   gimp_item_get_offset (item, &offset_x, &offset_y);
 
   gimp_drawable_stack_update (stack,
@@ -221,3 +254,227 @@ gimp_drawable_stack_drawable_visible (GimpItem          *item,
                               gimp_item_get_width  (item),
                               gimp_item_get_height (item));
 }
+
+/*  Per-child dirty tracking: when the same drawable is updated several
+ *  times in a row (typically while painting on it), the composite of
+ *  the drawables below it, and, if all drawables above it are composited
+ *  in normal mode, the composite of the drawables above it are cached,
+ *  so re-rendering blends only three inputs instead of walking the
+ *  whole stack.  Any update of another drawable, and any change of the
+ *  stack's structure, restores the plain chain.
+ */
+static void
+gimp_drawable_stack_track_update (GimpDrawableStack *stack,
+                                  GimpDrawable      *drawable)
+{
+  GimpContainer *container = GIMP_CONTAINER (stack);
+
+  if (drawable != stack->dirty_drawable)
+    {
+      gimp_drawable_stack_unisolate (stack);
+
+      stack->dirty_drawable  = drawable;
+      stack->n_dirty_updates = 0;
+    }
+
+  if (stack->isolated_drawable                                           ||
+      ++stack->n_dirty_updates < GIMP_DRAWABLE_STACK_ISOLATE_UPDATES     ||
+      ! GIMP_FILTER_STACK (stack)->graph                                 ||
+      ! GIMP_IS_LAYER (drawable)                                         ||
+      gimp_layer_is_floating_sel (GIMP_LAYER (drawable))                 ||
+      gimp_container_get_n_children (container) <
+      GIMP_DRAWABLE_STACK_ISOLATE_MIN_CHILDREN)
+    {
+      return;
+    }
+
+  gimp_drawable_stack_isolate (stack, drawable);
+}
+
+/*  returns TRUE if the visible layers above @index can be composited
+ *  separately, i.e. if they all use normal mode (which is associative)
+ *  in the same color space, and there is at least one of them
+ */
+static gboolean
+gimp_drawable_stack_get_above_linear (GimpDrawableStack *stack,
+                                      gint               index,
+                                      gboolean          *linear)
+{
+  GimpContainer *container = GIMP_CONTAINER (stack);
+  gboolean       found     = FALSE;
+  gint           i;
+
+  for (i = 0; i < index; i++)
+    {
+      GimpLayer *layer = (GimpLayer *)
+        gimp_container_get_child_by_index (container, i);
+      gboolean   layer_linear;
+
+      if (! GIMP_IS_LAYER (layer) || gimp_layer_is_floating_sel (layer))
+        return FALSE;
+
+      if (! gimp_item_get_visible (GIMP_ITEM (layer)))
+        continue;
+
+      if (layer->mask && layer->show_mask)
+        {
+          layer_linear = TRUE;
+        }
+      else
+        {
+          if (gimp_layer_get_mode (layer) != GIMP_NORMAL_MODE)
+            return FALSE;
+
+          layer_linear = gimp_drawable_get_linear (GIMP_DRAWABLE (layer));
+        }
+
+      if (found && layer_linear != *linear)
+        return FALSE;
+
+      *linear = layer_linear;
+      found   = TRUE;
+    }
+
+  return found;
+}
+
+static void
+gimp_drawable_stack_isolate (GimpDrawableStack *stack,
+                             GimpDrawable      *drawable)
+{
+  GimpContainer *container = GIMP_CONTAINER (stack);
+  GeglNode      *graph     = GIMP_FILTER_STACK (stack)->graph;
+  GeglNode      *node;
+  gboolean       linear    = FALSE;
+  gint           n_children;
+  gint           index;
+
+  n_children = gimp_container_get_n_children (container);
+  index      = gimp_container_get_child_index (container,
+                                               GIMP_OBJECT (drawable));
+
+  node = gimp_filter_get_node (GIMP_FILTER (drawable));
+
+  if (index < n_children - 1)
+    {
+      GimpFilter *filter_below = (GimpFilter *)
+        gimp_container_get_child_by_index (container, index + 1);
+
+      stack->below_cache = gegl_node_new_child (graph,
+                                                "operation", "gegl:cache",
+                                                NULL);
+
+      gegl_node_connect_to (gimp_filter_get_node (filter_below), "output",
+                            stack->below_cache,                  "input");
+      gegl_node_connect_to (stack->below_cache,                  "output",
+                            node,                                "input");
+    }
+
+  if (gimp_drawable_stack_get_above_linear (stack, index, &linear))
+    {
+      GimpFilter *filter_above = (GimpFilter *)
+        gimp_container_get_child_by_index (container, index - 1);
+      GimpFilter *filter_top   = (GimpFilter *)
+        gimp_container_get_child_by_index (container, 0);
+      GeglNode   *output;
+      GeglBuffer *empty;
+
+      output = gegl_node_get_output_proxy (graph, "output");
+
+      /*  an empty buffer is transparent everywhere, and unlike
+       *  gegl:color it doesn't make the bounding box infinite
+       */
+      empty = gegl_buffer_new (GEGL_RECTANGLE (0, 0, 0, 0),
+                               babl_format ("RGBA float"));
+
+      stack->above_source = gegl_node_new_child (graph,
+                                                 "operation", "gegl:buffer-source",
+                                                 "buffer",    empty,
+                                                 NULL);
+      g_object_unref (empty);
+
+      stack->above_cache = gegl_node_new_child (graph,
+                                                "operation", "gegl:cache",
+                                                NULL);
+
+      stack->above_composite = gegl_node_new_child (graph,
+                                                    "operation", "gimp:normal-mode",
+                                                    "linear",    linear,
+                                                    "opacity",   1.0,
+                                                    NULL);
+
+      gegl_node_connect_to (stack->above_source,              "output",
+                            gimp_filter_get_node (filter_above), "input");
+      gegl_node_connect_to (gimp_filter_get_node (filter_top),   "output",
+                            stack->above_cache,                  "input");
+
+      gegl_node_connect_to (node,                   "output",
+                            stack->above_composite, "input");
+      gegl_node_connect_to (stack->above_cache,     "output",
+                            stack->above_composite, "aux");
+      gegl_node_connect_to (stack->above_composite, "output",
+                            output,                 "input");
+    }
+
+  stack->isolated_drawable = drawable;
+}
+
+static void
+gimp_drawable_stack_unisolate (GimpDrawableStack *stack)
+{
+  GimpContainer *container = GIMP_CONTAINER (stack);
+  GeglNode      *graph     = GIMP_FILTER_STACK (stack)->graph;
+  GeglNode      *node;
+  gint           index;
+
+  if (! stack->isolated_drawable)
+    return;
+
+  index = gimp_container_get_child_index (container,
+                                          GIMP_OBJECT (stack->isolated_drawable));
+
+  node = gimp_filter_get_node (GIMP_FILTER (stack->isolated_drawable));
+
+  if (stack->below_cache)
+    {
+      GimpFilter *filter_below = (GimpFilter *)
+        gimp_container_get_child_by_index (container, index + 1);
+
+      gegl_node_connect_to (gimp_filter_get_node (filter_below), "output",
+                            node,                                "input");
+
+      gegl_node_disconnect (stack->below_cache, "input");
+      gegl_node_remove_child (graph, stack->below_cache);
+      stack->below_cache = NULL;
+    }
+
+  if (stack->above_composite)
+    {
+      GimpFilter *filter_above = (GimpFilter *)
+        gimp_container_get_child_by_index (container, index - 1);
+      GimpFilter *filter_top   = (GimpFilter *)
+        gimp_container_get_child_by_index (container, 0);
+      GeglNode   *output;
+
+      output = gegl_node_get_output_proxy (graph, "output");
+
+      gegl_node_connect_to (node,                                "output",
+                            gimp_filter_get_node (filter_above), "input");
+      gegl_node_connect_to (gimp_filter_get_node (filter_top),   "output",
+                            output,                              "input");
+
+      gegl_node_disconnect (stack->above_composite, "input");
+      gegl_node_disconnect (stack->above_composite, "aux");
+      gegl_node_disconnect (stack->above_cache,     "input");
+
+      gegl_node_remove_child (graph, stack->above_composite);
+      gegl_node_remove_child (graph, stack->above_cache);
+      gegl_node_remove_child (graph, stack->above_source);
+
+      stack->above_composite = NULL;
+      stack->above_cache     = NULL;
+      stack->above_source    = NULL;
+    }
+
+  stack->isolated_drawable = NULL;
+}
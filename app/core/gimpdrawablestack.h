@@ -36,6 +36,17 @@ typedef struct _GimpDrawableStackClass GimpDrawableStackClass;
 struct _GimpDrawableStack
 {
   GimpItemStack  parent_instance;
+
+  /*  the drawable which emitted the last updates, and how many  */
+  GimpDrawable  *dirty_drawable;
+  gint           n_dirty_updates;
+
+  /*  the drawable whose unchanged surroundings are cached  */
+  GimpDrawable  *isolated_drawable;
+  GeglNode      *below_cache;
+  GeglNode      *above_source;
+  GeglNode      *above_cache;
+  GeglNode      *above_composite;
 };
 
 struct _GimpDrawableStackClass
@@ -25,6 +25,7 @@
 #include "core-types.h"
 
 #include "gimp-memsize.h"
+#include "gimp-undo-swap.h"
 #include "gimpimage.h"
 #include "gimpdrawable.h"
 #include "gimpdrawableundo.h"
@@ -176,6 +177,9 @@ gimp_drawable_undo_get_memsize (GimpObject *object,
 
   memsize += gimp_gegl_buffer_get_memsize (drawable_undo->buffer);
 
+  if (drawable_undo->swap_buffer)
+    memsize += gimp_undo_swap_buffer_get_memsize (drawable_undo->swap_buffer);
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -187,12 +191,18 @@ gimp_drawable_undo_pop (GimpUndo            *undo,
 {
   GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (undo);
 
+  /*  gimp_image_undo_pop_stack() restores compacted pixels before
+   *  it pops anything, so a step whose pixels are lost stays where it is
+   */
+  g_return_if_fail (drawable_undo->swap_buffer == NULL);
+
   GIMP_UNDO_CLASS (parent_class)->pop (undo, undo_mode, accum);
 
-  gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
-                             drawable_undo->buffer,
-                             drawable_undo->x,
-                             drawable_undo->y);
+  if (drawable_undo->buffer)
+    gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
+                               drawable_undo->buffer,
+                               drawable_undo->x,
+                               drawable_undo->y);
 }
 
 static void
@@ -207,6 +217,12 @@ gimp_drawable_undo_free (GimpUndo     *undo,
       drawable_undo->buffer = NULL;
     }
 
+  if (drawable_undo->swap_buffer)
+    {
+      gimp_undo_swap_buffer_free (drawable_undo->swap_buffer);
+      drawable_undo->swap_buffer = NULL;
+    }
+
   if (drawable_undo->applied_buffer)
     {
       g_object_unref (drawable_undo->applied_buffer);
@@ -215,3 +231,90 @@ gimp_drawable_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+
+/*  public functions  */
+
+/**
+ * gimp_drawable_undo_compact:
+ * @undo:  a #GimpDrawableUndo
+ * @spill: whether to move the compressed pixels to disk
+ *
+ * Compresses the pixels of an undo step which is no longer at the top
+ * of the undo stack, and optionally moves them to the undo swap file.
+ * They are restored when the step is popped.
+ *
+ * Return value: %TRUE if anything was done.
+ **/
+gboolean
+gimp_drawable_undo_compact (GimpDrawableUndo *undo,
+                            gboolean          spill)
+{
+  gboolean compacted = FALSE;
+
+  g_return_val_if_fail (GIMP_IS_DRAWABLE_UNDO (undo), FALSE);
+
+  /*  only the top undo step can be faded  */
+  if (undo->applied_buffer)
+    {
+      g_object_unref (undo->applied_buffer);
+      undo->applied_buffer = NULL;
+
+      compacted = TRUE;
+    }
+
+  if (undo->buffer)
+    {
+      undo->swap_buffer = gimp_undo_swap_buffer_new (undo->buffer);
+
+      if (! undo->swap_buffer)
+        return compacted;
+
+      g_object_unref (undo->buffer);
+      undo->buffer = NULL;
+
+      return TRUE;
+    }
+
+  if (spill && undo->swap_buffer &&
+      ! gimp_undo_swap_buffer_is_spilled (undo->swap_buffer))
+    {
+      if (gimp_undo_swap_buffer_spill (undo->swap_buffer))
+        compacted = TRUE;
+    }
+
+  return compacted;
+}
+
+/**
+ * gimp_drawable_undo_restore:
+ * @undo:  a #GimpDrawableUndo
+ * @error: return location for an error
+ *
+ * Restores the pixels of an undo step which were compacted by
+ * gimp_drawable_undo_compact().  On failure, the compressed pixels are
+ * kept, so a later attempt can try again.
+ *
+ * Return value: %TRUE if the undo step's pixels are available.
+ **/
+gboolean
+gimp_drawable_undo_restore (GimpDrawableUndo  *undo,
+                            GError           **error)
+{
+  g_return_val_if_fail (GIMP_IS_DRAWABLE_UNDO (undo), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (undo->swap_buffer)
+    {
+      undo->buffer = gimp_undo_swap_buffer_restore (undo->swap_buffer,
+                                                    error);
+
+      if (! undo->buffer)
+        return FALSE;
+
+      gimp_undo_swap_buffer_free (undo->swap_buffer);
+      undo->swap_buffer = NULL;
+    }
+
+  return TRUE;
+}
@@ -36,9 +36,10 @@ struct _GimpDrawableUndo
 {
   GimpItemUndo  parent_instance;
 
-  GeglBuffer   *buffer;
-  gint          x;
-  gint          y;
+  GeglBuffer         *buffer;
+  GimpUndoSwapBuffer *swap_buffer;  /*  compressed buffer, if compacted  */
+  gint                x;
+  gint                y;
 
   /* stuff for "Fade" */
   GeglBuffer           *applied_buffer;
@@ -52,7 +53,12 @@ struct _GimpDrawableUndoClass
 };
 
 
-GType   gimp_drawable_undo_get_type (void) G_GNUC_CONST;
+GType      gimp_drawable_undo_get_type (void) G_GNUC_CONST;
+
+gboolean   gimp_drawable_undo_compact  (GimpDrawableUndo  *undo,
+                                        gboolean           spill);
+gboolean   gimp_drawable_undo_restore  (GimpDrawableUndo  *undo,
+                                        GError           **error);
 
 
 #endif /* __GIMP_DRAWABLE_UNDO_H__ */
@@ -28,10 +28,19 @@
 #include "core-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-parallel.h"
 
 #include "gimphistogram.h"
 
 
+/*  the minimal number of pixels a thread calculates a partial
+ *  histogram of
+ */
+#define HISTOGRAM_MIN_AREA  (128 * 128)
+
+#define HISTOGRAM_MAX_LEVEL 8
+
+
 enum
 {
   PROP_0,
@@ -48,6 +57,21 @@ struct _GimpHistogramPrivate
   gdouble *values;
 };
 
+typedef struct
+{
+  GimpHistogram *histogram;
+  GeglBuffer    *buffer;
+  GeglRectangle  buffer_rect;
+  GeglBuffer    *mask;
+  gint           mask_offset_x;
+  gint           mask_offset_y;
+  const Babl    *format;
+  gint           n_components;
+  gint           level;
+  gdouble        weight;
+  GMutex         mutex;
+} CalculateContext;
+
 
 /*  local function prototypes  */
 
@@ -68,6 +92,9 @@ static void     gimp_histogram_alloc_values (GimpHistogram *histogram,
                                              gint           n_components,
                                              gint           n_bins);
 
+static void     gimp_histogram_calc_area    (const GeglRectangle *area,
+                                             CalculateContext    *context);
+
 
 G_DEFINE_TYPE (GimpHistogram, gimp_histogram, GIMP_TYPE_OBJECT)
 
@@ -195,6 +222,14 @@ gimp_histogram_new (gboolean gamma_correct)
   return histogram;
 }
 
+gboolean
+gimp_histogram_get_gamma_correct (GimpHistogram *histogram)
+{
+  g_return_val_if_fail (GIMP_IS_HISTOGRAM (histogram), FALSE);
+
+  return histogram->priv->gamma_correct;
+}
+
 /**
  * gimp_histogram_duplicate:
  * @histogram: a %GimpHistogram
@@ -229,16 +264,43 @@ gimp_histogram_calculate (GimpHistogram       *histogram,
                           const GeglRectangle *buffer_rect,
                           GeglBuffer          *mask,
                           const GeglRectangle *mask_rect)
+{
+  gimp_histogram_calculate_level (histogram, buffer, buffer_rect,
+                                  mask, mask_rect, 0);
+}
+
+/**
+ * gimp_histogram_calculate_level:
+ * @histogram:   a %GimpHistogram
+ * @buffer:      the buffer to calculate the histogram of
+ * @buffer_rect: the area of @buffer, in level 0 coordinates
+ * @mask:        an optional mask buffer
+ * @mask_rect:   the area of @mask, of the same size as @buffer_rect
+ * @level:       the mipmap level to read @buffer and @mask from
+ *
+ * Like gimp_histogram_calculate(), but reads the pixels from the given
+ * mipmap level of @buffer.  Each pixel is counted 4^@level times, so
+ * the result approximates the full resolution histogram and can be
+ * used in its place until that has been calculated.
+ **/
+void
+gimp_histogram_calculate_level (GimpHistogram       *histogram,
+                                GeglBuffer          *buffer,
+                                const GeglRectangle *buffer_rect,
+                                GeglBuffer          *mask,
+                                const GeglRectangle *mask_rect,
+                                gint                 level)
 {
   GimpHistogramPrivate *priv;
-  GeglBufferIterator   *iter;
+  CalculateContext      context;
   const Babl           *format;
-  gint                  n_components;
   gint                  n_bins;
 
   g_return_if_fail (GIMP_IS_HISTOGRAM (histogram));
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
   g_return_if_fail (buffer_rect != NULL);
+  g_return_if_fail (mask == NULL || mask_rect != NULL);
+  g_return_if_fail (level >= 0 && level < HISTOGRAM_MAX_LEVEL);
 
   priv = histogram->priv;
 
@@ -310,171 +372,97 @@ gimp_histogram_calculate (GimpHistogram       *histogram,
         }
     }
 
-  n_components = babl_format_get_n_components (format);
-
   g_object_freeze_notify (G_OBJECT (histogram));
 
-  gimp_histogram_alloc_values (histogram, n_components, n_bins);
-
-  iter = gegl_buffer_iterator_new (buffer, buffer_rect, 0, format,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+  gimp_histogram_alloc_values (histogram,
+                               babl_format_get_n_components (format),
+                               n_bins);
+
+  context.histogram    = histogram;
+  context.buffer       = buffer;
+  context.mask         = mask;
+  context.format       = format;
+  context.n_components = babl_format_get_n_components (format);
+  context.level        = level;
+  context.weight       = (gdouble) (1 << (2 * level));
+
+  /*  the area at @level, rounded outwards  */
+  context.buffer_rect.x      = buffer_rect->x >> level;
+  context.buffer_rect.y      = buffer_rect->y >> level;
+  context.buffer_rect.width  = ((buffer_rect->x + buffer_rect->width +
+                                 (1 << level) - 1) >> level) -
+                               context.buffer_rect.x;
+  context.buffer_rect.height = ((buffer_rect->y + buffer_rect->height +
+                                 (1 << level) - 1) >> level) -
+                               context.buffer_rect.y;
 
   if (mask)
-    gegl_buffer_iterator_add (iter, mask, mask_rect, 0,
-                              babl_format ("Y float"),
-                              GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-
-#define VALUE(c,i) (priv->values[(c) * priv->n_bins + \
-                                 (gint) (CLAMP ((i), 0.0, 1.0) * \
-                                         (priv->n_bins - 0.0001))])
-
-  while (gegl_buffer_iterator_next (iter))
     {
-      const gfloat *data   = iter->data[0];
-      gint          length = iter->length;
-      gfloat        max;
-
-      if (mask)
-        {
-          const gfloat *mask_data = iter->data[1];
-
-          switch (n_components)
-            {
-            case 1:
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (0, data[0]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 2:
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[1];
-
-                  VALUE (0, data[0]) += weight * masked;
-                  VALUE (1, data[1]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (1, data[0]) += masked;
-                  VALUE (2, data[1]) += masked;
-                  VALUE (3, data[2]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 4: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[3];
-
-                  VALUE (1, data[0]) += weight * masked;
-                  VALUE (2, data[1]) += weight * masked;
-                  VALUE (3, data[2]) += weight * masked;
-                  VALUE (4, data[3]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += weight * masked;
+      context.mask_offset_x = (mask_rect->x >> level) - context.buffer_rect.x;
+      context.mask_offset_y = (mask_rect->y >> level) - context.buffer_rect.y;
+    }
 
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-            }
-        }
-      else /* no mask */
-        {
-          switch (n_components)
-            {
-            case 1:
-              while (length--)
-                {
-                  VALUE (0, data[0]) += 1.0;
+  g_mutex_init (&context.mutex);
 
-                  data += n_components;
-                }
-              break;
+  gimp_parallel_distribute_area (&context.buffer_rect, HISTOGRAM_MIN_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 gimp_histogram_calc_area,
+                                 &context);
 
-            case 2:
-              while (length--)
-                {
-                  const gdouble weight = data[1];
+  g_mutex_clear (&context.mutex);
 
-                  VALUE (0, data[0]) += weight;
-                  VALUE (1, data[1]) += 1.0;
+  g_object_notify (G_OBJECT (histogram), "values");
 
-                  data += n_components;
-                }
-              break;
+  g_object_thaw_notify (G_OBJECT (histogram));
+}
 
-            case 3: /* calculate separate value values */
-              while (length--)
-                {
-                  VALUE (1, data[0]) += 1.0;
-                  VALUE (2, data[1]) += 1.0;
-                  VALUE (3, data[2]) += 1.0;
+/**
+ * gimp_histogram_add:
+ * @histogram: a %GimpHistogram
+ * @addend:    the %GimpHistogram to add to @histogram
+ * @factor:    the factor to multiply @addend's values with
+ *
+ * Adds @factor times the values of @addend to @histogram; use a
+ * @factor of -1.0 to subtract them.  If @histogram has no values, or
+ * a different number of channels or bins than @addend, it is reset to
+ * zero first.
+ **/
+void
+gimp_histogram_add (GimpHistogram *histogram,
+                    GimpHistogram *addend,
+                    gdouble        factor)
+{
+  GimpHistogramPrivate *priv;
+  gint                  n_values;
+  gint                  i;
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  g_return_if_fail (GIMP_IS_HISTOGRAM (histogram));
+  g_return_if_fail (GIMP_IS_HISTOGRAM (addend));
 
-                  VALUE (0, max) += 1.0;
+  priv = histogram->priv;
 
-                  data += n_components;
-                }
-              break;
+  if (! addend->priv->values)
+    return;
 
-            case 4: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble weight = data[3];
+  g_object_freeze_notify (G_OBJECT (histogram));
 
-                  VALUE (1, data[0]) += weight;
-                  VALUE (2, data[1]) += weight;
-                  VALUE (3, data[2]) += weight;
-                  VALUE (4, data[3]) += 1.0;
+  if (! priv->values                                 ||
+      priv->n_channels != addend->priv->n_channels   ||
+      priv->n_bins     != addend->priv->n_bins)
+    {
+      gimp_histogram_alloc_values (histogram,
+                                   addend->priv->n_channels - 1,
+                                   addend->priv->n_bins);
+    }
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  n_values = priv->n_channels * priv->n_bins;
 
-                  VALUE (0, max) += weight;
-
-                  data += n_components;
-                }
-              break;
-            }
-        }
-    }
+  for (i = 0; i < n_values; i++)
+    priv->values[i] += factor * addend->priv->values[i];
 
   g_object_notify (G_OBJECT (histogram), "values");
 
   g_object_thaw_notify (G_OBJECT (histogram));
-
-#undef VALUE
 }
 
 void
@@ -949,3 +937,195 @@ gimp_histogram_alloc_values (GimpHistogram *histogram,
               priv->n_channels * priv->n_bins * sizeof (gdouble));
     }
 }
+
+static void
+gimp_histogram_calc_area (const GeglRectangle *area,
+                          CalculateContext    *context)
+{
+  GimpHistogramPrivate *priv         = context->histogram->priv;
+  gint                  n_components = context->n_components;
+  gint                  n_bins       = priv->n_bins;
+  gint                  n_values     = priv->n_channels * n_bins;
+  GeglBufferIterator   *iter;
+  gdouble              *values;
+  gint                  i;
+
+  /*  every part accumulates into its own array, they are summed up
+   *  once the part is done, so the inner loops need no locking
+   */
+  values = g_new0 (gdouble, n_values);
+
+  iter = gegl_buffer_iterator_new (context->buffer, area, context->level,
+                                   context->format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  if (context->mask)
+    {
+      GeglRectangle mask_area = *area;
+
+      mask_area.x += context->mask_offset_x;
+      mask_area.y += context->mask_offset_y;
+
+      gegl_buffer_iterator_add (iter, context->mask, &mask_area,
+                                context->level,
+                                babl_format ("Y float"),
+                                GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+    }
+
+#define VALUE(c,i) (values[(c) * n_bins + \
+                           (gint) (CLAMP ((i), 0.0, 1.0) * \
+                                   (n_bins - 0.0001))])
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data   = iter->data[0];
+      gint          length = iter->length;
+      gfloat        max;
+
+      if (context->mask)
+        {
+          const gfloat *mask_data = iter->data[1];
+
+          switch (n_components)
+            {
+            case 1:
+              while (length--)
+                {
+                  const gdouble masked = *mask_data;
+
+                  VALUE (0, data[0]) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 2:
+              while (length--)
+                {
+                  const gdouble masked = *mask_data;
+                  const gdouble weight = data[1];
+
+                  VALUE (0, data[0]) += weight * masked;
+                  VALUE (1, data[1]) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 3: /* calculate separate value values */
+              while (length--)
+                {
+                  const gdouble masked = *mask_data;
+
+                  VALUE (1, data[0]) += masked;
+                  VALUE (2, data[1]) += masked;
+                  VALUE (3, data[2]) += masked;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 4: /* calculate separate value values */
+              while (length--)
+                {
+                  const gdouble masked = *mask_data;
+                  const gdouble weight = data[3];
+
+                  VALUE (1, data[0]) += weight * masked;
+                  VALUE (2, data[1]) += weight * masked;
+                  VALUE (3, data[2]) += weight * masked;
+                  VALUE (4, data[3]) += masked;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += weight * masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+            }
+        }
+      else /* no mask */
+        {
+          switch (n_components)
+            {
+            case 1:
+              while (length--)
+                {
+                  VALUE (0, data[0]) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 2:
+              while (length--)
+                {
+                  const gdouble weight = data[1];
+
+                  VALUE (0, data[0]) += weight;
+                  VALUE (1, data[1]) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 3: /* calculate separate value values */
+              while (length--)
+                {
+                  VALUE (1, data[0]) += 1.0;
+                  VALUE (2, data[1]) += 1.0;
+                  VALUE (3, data[2]) += 1.0;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 4: /* calculate separate value values */
+              while (length--)
+                {
+                  const gdouble weight = data[3];
+
+                  VALUE (1, data[0]) += weight;
+                  VALUE (2, data[1]) += weight;
+                  VALUE (3, data[2]) += weight;
+                  VALUE (4, data[3]) += 1.0;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += weight;
+
+                  data += n_components;
+                }
+              break;
+            }
+        }
+    }
+
+#undef VALUE
+
+  g_mutex_lock (&context->mutex);
+
+  for (i = 0; i < n_values; i++)
+    priv->values[i] += values[i] * context->weight;
+
+  g_mutex_unlock (&context->mutex);
+
+  g_free (values);
+}
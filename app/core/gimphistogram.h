@@ -52,6 +52,9 @@ GType           gimp_histogram_get_type      (void) G_GNUC_CONST;
 
 GimpHistogram * gimp_histogram_new           (gboolean              gamma_correct);
 
+gboolean        gimp_histogram_get_gamma_correct
+                                             (GimpHistogram        *histogram);
+
 GimpHistogram * gimp_histogram_duplicate     (GimpHistogram        *histogram);
 
 void            gimp_histogram_calculate     (GimpHistogram        *histogram,
@@ -59,6 +62,17 @@ void            gimp_histogram_calculate     (GimpHistogram        *histogram,
                                               const GeglRectangle  *buffer_rect,
                                               GeglBuffer           *mask,
                                               const GeglRectangle  *mask_rect);
+void            gimp_histogram_calculate_level
+                                             (GimpHistogram        *histogram,
+                                              GeglBuffer           *buffer,
+                                              const GeglRectangle  *buffer_rect,
+                                              GeglBuffer           *mask,
+                                              const GeglRectangle  *mask_rect,
+                                              gint                  level);
+
+void            gimp_histogram_add           (GimpHistogram        *histogram,
+                                              GimpHistogram        *addend,
+                                              gdouble               factor);
 
 void            gimp_histogram_clear_values  (GimpHistogram        *histogram);
 
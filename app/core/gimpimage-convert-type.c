@@ -142,6 +142,7 @@
 #include "core-types.h"
 
 #include "gegl/gimp-gegl-utils.h"
+#include "gegl/gimp-parallel.h"
 
 #include "gimp.h"
 #include "gimpcontainer.h"
@@ -188,6 +189,18 @@
 #define G_SCALE 24              /*  scale G (a*) distances by this much  */
 #define B_SCALE 26              /*  and B (b*) by this much              */
 
+/* the maximal number of threads building an RGB histogram; all but
+   the first one need a partial histogram of their own */
+#define QUANTIZE_MAX_PARTS 8
+
+/* the minimal number of pixels a thread builds a gray histogram of */
+#define QUANTIZE_MIN_AREA  (128 * 128)
+
+/* the FS dither functions stream layers through in bands of rows which
+   take at most this many bytes, and have at most this many rows */
+#define FS_DITHER_BAND_SIZE       (1 << 20)
+#define FS_DITHER_MAX_BAND_HEIGHT 64
+
 
 typedef struct _Color Color;
 typedef struct _QuantizeObj QuantizeObj;
@@ -469,6 +482,7 @@ struct _QuantizeObj
   Color clin[256];                  /* .. converted back to linear space */
   gulong index_used_count[256];     /* how many times an index was used */
   CFHistogram histogram;            /* holds the histogram               */
+  gsize       histogram_size;       /* .. the number of its cells        */
 
   gboolean want_alpha_dither;
   int      error_freedom;           /* 0=much bleed, 1=controlled bleed */
@@ -476,6 +490,20 @@ struct _QuantizeObj
   GimpProgress *progress;
   gint          nth_layer;
   gint          n_layers;
+
+  GimpPalette  *custom_palette;     /* the palette for custompal_pass1   */
+
+  /*  the colors found while building the histogram, as long as there
+   *  are no more than the desired number
+   */
+  guchar        found_cols[MAXNUMCOLORS][3];
+  gint          num_found_cols;
+  gboolean      needs_quantize;
+
+  /*  histograms of the parts built by other threads than the calling
+   *  one, added to the histogram after the last layer
+   */
+  CFHistogram   partial_histograms[QUANTIZE_MAX_PARTS];
 };
 
 typedef struct
@@ -503,13 +531,41 @@ typedef struct
 
 } box, *boxptr;
 
+typedef struct
+{
+  QuantizeObj   *quantobj;
+  GeglBuffer    *buffer;
+  const Babl    *format;
+  gint           offsetx;
+  gint           offsety;
+  gboolean       alpha_dither;
+  gint           col_limit;
+  gint           needs_quantize;
+  GimpProgress  *progress;
+  gint           nth_layer;
+  gint           n_layers;
+
+  gint           n_parts;
+  guchar         found_cols[QUANTIZE_MAX_PARTS][MAXNUMCOLORS][3];
+  gint           n_found_cols[QUANTIZE_MAX_PARTS];
+
+  GMutex         mutex;
+} GenerateHistogramContext;
+
+typedef struct
+{
+  QuantizeObj   *quantobjs;
+  GimpLayer    **layers;
+  GeglBuffer   **new_buffers;
+} SecondPassContext;
+
 
 static void zero_histogram_gray     (CFHistogram   histogram);
 static void zero_histogram_rgb      (CFHistogram   histogram);
-static void generate_histogram_gray (CFHistogram   hostogram,
+static void generate_histogram_gray (QuantizeObj  *quantobj,
                                      GimpLayer    *layer,
                                      gboolean      alpha_dither);
-static void generate_histogram_rgb  (CFHistogram   histogram,
+static void generate_histogram_rgb  (QuantizeObj  *quantobj,
                                      GimpLayer    *layer,
                                      gint          col_limit,
                                      gboolean      alpha_dither,
@@ -517,10 +573,34 @@ static void generate_histogram_rgb  (CFHistogram   histogram,
                                      gint          nth_layer,
                                      gint          n_layers);
 
+static void generate_histogram_gray_area
+                                    (const GeglRectangle      *area,
+                                     GenerateHistogramContext *context);
+static void generate_histogram_rgb_part
+                                    (gint                      i,
+                                     gint                      n,
+                                     GenerateHistogramContext *context);
+static void merge_partial_histograms
+                                    (QuantizeObj              *quantobj);
+static void merge_partial_histograms_range
+                                    (gsize                     offset,
+                                     gsize                     size,
+                                     QuantizeObj              *quantobj);
+
+static void second_pass_layers      (QuantizeObj  *quantobj,
+                                     GimpLayer   **layers,
+                                     GeglBuffer  **new_buffers,
+                                     gint          n_layers);
+static void second_pass_layers_range
+                                    (gsize              offset,
+                                     gsize              size,
+                                     SecondPassContext *context);
+
 static QuantizeObj * initialize_median_cut (GimpImageBaseType      old_type,
                                             gint                   num_cols,
                                             GimpConvertDitherType  dither_type,
                                             GimpConvertPaletteType palette_type,
+                                            GimpPalette           *custom_palette,
                                             gboolean               alpha_dither,
                                             GimpProgress          *progress);
 
@@ -530,13 +610,6 @@ static void          compute_color_lin8    (QuantizeObj           *quantobj,
                                             const int              icolor);
 
 
-static guchar    found_cols[MAXNUMCOLORS][3];
-static gint      num_found_cols;
-static gboolean  needs_quantize;
-
-static GimpPalette *theCustomPalette = NULL;
-
-
 /**********************************************************/
 typedef struct
 {
@@ -730,8 +803,16 @@ color_quicksort (const void *c1,
     return -1;
   else if (v1 > v2)
     return 1;
+
+  /*  order colors of the same luminance too, so the colormap doesn't
+   *  depend on the order in which the colors were found
+   */
+  if (color1->red != color2->red)
+    return color1->red - color2->red;
+  else if (color1->green != color2->green)
+    return color1->green - color2->green;
   else
-    return 0;
+    return color1->blue - color2->blue;
 }
 
 gboolean
@@ -750,12 +831,16 @@ gimp_image_convert_type (GimpImage               *image,
                          GimpProgress            *progress,
                          GError                 **error)
 {
-  QuantizeObj       *quantobj = NULL;
+  QuantizeObj       *quantobj      = NULL;
   GimpImageBaseType  old_type;
   GList             *all_layers;
   GList             *list;
-  const gchar       *undo_desc = NULL;
+  const gchar       *undo_desc     = NULL;
   gint               nth_layer, n_layers;
+  GimpLayer        **batch_layers  = NULL;
+  GeglBuffer       **batch_buffers = NULL;
+  gint               n_batch       = 0;
+  gint               max_batch     = 0;
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), FALSE);
   g_return_val_if_fail (new_type != gimp_image_get_base_type (image), FALSE);
@@ -781,8 +866,6 @@ gimp_image_convert_type (GimpImage               *image,
         }
     }
 
-  theCustomPalette = custom_palette;
-
   gimp_set_busy (image->gimp);
 
   all_layers = gimp_image_get_layer_list (image);
@@ -840,8 +923,8 @@ gimp_image_convert_type (GimpImage               *image,
         }
 
       quantobj = initialize_median_cut (old_type, num_cols, dither,
-                                        palette_type, alpha_dither,
-                                        progress);
+                                        palette_type, custom_palette,
+                                        alpha_dither, progress);
 
       if (palette_type == GIMP_MAKE_PALETTE)
         {
@@ -854,8 +937,8 @@ gimp_image_convert_type (GimpImage               *image,
            *  the image than the user actually asked for.  In that
            *  case, we don't need to quantize or color-dither.
            */
-          needs_quantize = FALSE;
-          num_found_cols = 0;
+          quantobj->needs_quantize = FALSE;
+          quantobj->num_found_cols = 0;
 
           /*  Build the histogram  */
           for (list = all_layers, nth_layer = 0;
@@ -865,10 +948,10 @@ gimp_image_convert_type (GimpImage               *image,
               GimpLayer *layer = list->data;
 
               if (old_type == GIMP_GRAY)
-                generate_histogram_gray (quantobj->histogram,
+                generate_histogram_gray (quantobj,
                                          layer, alpha_dither);
               else
-                generate_histogram_rgb (quantobj->histogram,
+                generate_histogram_rgb (quantobj,
                                         layer, num_cols, alpha_dither,
                                         progress, nth_layer, n_layers);
 
@@ -877,14 +960,17 @@ gimp_image_convert_type (GimpImage               *image,
                *  by the user.
                */
             }
+
+          if (old_type != GIMP_GRAY)
+            merge_partial_histograms (quantobj);
         }
 
       if (progress)
         gimp_progress_set_text_literal (progress,
                                         _("Converting to indexed colors (stage 2)"));
 
-      if (old_type == GIMP_RGB &&
-          ! needs_quantize     &&
+      if (old_type == GIMP_RGB       &&
+          ! quantobj->needs_quantize &&
           palette_type == GIMP_MAKE_PALETTE)
         {
           /* If this is an RGB image, and the user wanted a custom-built
@@ -897,21 +983,25 @@ gimp_image_convert_type (GimpImage               *image,
            *  no-dither remapper.
            */
 
-          quantobj->delete_func (quantobj);
+          QuantizeObj *old_quantobj = quantobj;
+
           quantobj = initialize_median_cut (old_type, num_cols,
                                             GIMP_NODESTRUCT_DITHER,
                                             palette_type,
+                                            custom_palette,
                                             alpha_dither,
                                             progress);
           /* We can skip the first pass (palette creation) */
 
-          quantobj->actual_number_of_colors = num_found_cols;
-          for (i = 0; i < num_found_cols; i++)
+          quantobj->actual_number_of_colors = old_quantobj->num_found_cols;
+          for (i = 0; i < old_quantobj->num_found_cols; i++)
             {
-              quantobj->cmap[i].red = found_cols[i][0];
-              quantobj->cmap[i].green = found_cols[i][1];
-              quantobj->cmap[i].blue = found_cols[i][2];
+              quantobj->cmap[i].red = old_quantobj->found_cols[i][0];
+              quantobj->cmap[i].green = old_quantobj->found_cols[i][1];
+              quantobj->cmap[i].blue = old_quantobj->found_cols[i][2];
             }
+
+          old_quantobj->delete_func (old_quantobj);
         }
       else
         {
@@ -967,9 +1057,17 @@ gimp_image_convert_type (GimpImage               *image,
       break;
     }
 
-  /*  Convert all layers  */
+  /*  Convert all layers, the quantized ones in batches of as many
+   *  layers as there are threads
+   */
   if (quantobj)
-    quantobj->n_layers = n_layers;
+    {
+      quantobj->n_layers = n_layers;
+
+      max_batch     = gimp_parallel_get_n_threads ();
+      batch_layers  = g_new (GimpLayer *,  max_batch);
+      batch_buffers = g_new (GeglBuffer *, max_batch);
+    }
 
   for (list = all_layers, nth_layer = 0;
        list;
@@ -1011,14 +1109,28 @@ gimp_image_convert_type (GimpImage               *image,
                                                           has_alpha));
 
           quantobj->nth_layer = nth_layer;
-          quantobj->second_pass (quantobj, layer, new_buffer);
 
-          gimp_drawable_set_buffer (GIMP_DRAWABLE (layer), TRUE, NULL,
-                                    new_buffer);
-          g_object_unref (new_buffer);
+          batch_layers[n_batch]  = layer;
+          batch_buffers[n_batch] = new_buffer;
+          n_batch++;
+
+          if (n_batch == max_batch)
+            {
+              second_pass_layers (quantobj,
+                                  batch_layers, batch_buffers, n_batch);
+              n_batch = 0;
+            }
         }
       else
         {
+          /*  keep the order in which the layers are converted  */
+          if (n_batch > 0)
+            {
+              second_pass_layers (quantobj,
+                                  batch_layers, batch_buffers, n_batch);
+              n_batch = 0;
+            }
+
           gimp_drawable_convert_type (GIMP_DRAWABLE (layer), image, new_type,
                                       gimp_drawable_get_precision (GIMP_DRAWABLE (layer)),
                                       0, 0, FALSE,
@@ -1026,6 +1138,12 @@ gimp_image_convert_type (GimpImage               *image,
         }
     }
 
+  if (n_batch > 0)
+    second_pass_layers (quantobj, batch_layers, batch_buffers, n_batch);
+
+  g_free (batch_layers);
+  g_free (batch_buffers);
+
   /*  Set the final palette on the image  */
   switch (new_type)
     {
@@ -1131,25 +1249,49 @@ zero_histogram_rgb (CFHistogram histogram)
 
 
 static void
-generate_histogram_gray (CFHistogram  histogram,
+generate_histogram_gray (QuantizeObj *quantobj,
                          GimpLayer   *layer,
                          gboolean     alpha_dither)
 {
-  GeglBufferIterator *iter;
-  const Babl         *format;
-  gint                bpp;
-  gboolean            has_alpha;
+  GenerateHistogramContext context;
+  const Babl              *format;
 
   format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
 
   g_return_if_fail (format == babl_format ("Y' u8") ||
                     format == babl_format ("Y'A u8"));
 
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
+  context.quantobj     = quantobj;
+  context.buffer       = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  context.format       = format;
+  context.alpha_dither = alpha_dither;
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
+  g_mutex_init (&context.mutex);
+
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (context.buffer),
+                                 QUANTIZE_MIN_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 generate_histogram_gray_area,
+                                 &context);
+
+  g_mutex_clear (&context.mutex);
+}
+
+static void
+generate_histogram_gray_area (const GeglRectangle      *area,
+                              GenerateHistogramContext *context)
+{
+  GeglBufferIterator *iter;
+  ColorFreq           histogram[256] = { 0, };
+  gint                bpp;
+  gboolean            has_alpha;
+  gint                i;
+
+  bpp       = babl_format_get_bytes_per_pixel (context->format);
+  has_alpha = babl_format_has_alpha (context->format);
+
+  iter = gegl_buffer_iterator_new (context->buffer,
+                                   area, 0, context->format,
                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -1177,11 +1319,17 @@ generate_histogram_gray (CFHistogram  histogram,
             }
         }
     }
-}
 
+  g_mutex_lock (&context->mutex);
+
+  for (i = 0; i < 256; i++)
+    context->quantobj->histogram[i] += histogram[i];
+
+  g_mutex_unlock (&context->mutex);
+}
 
 static void
-generate_histogram_rgb (CFHistogram   histogram,
+generate_histogram_rgb (QuantizeObj  *quantobj,
                         GimpLayer    *layer,
                         gint          col_limit,
                         gboolean      alpha_dither,
@@ -1189,42 +1337,142 @@ generate_histogram_rgb (CFHistogram   histogram,
                         gint          nth_layer,
                         gint          n_layers)
 {
+  GenerateHistogramContext context;
+  const Babl              *format;
+  gint                     i, j, k;
+
+  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+
+  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
+                    format == babl_format ("R'G'B'A u8"));
+
+  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+
+  context.quantobj       = quantobj;
+  context.buffer         = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  context.format         = format;
+  context.alpha_dither   = alpha_dither;
+  context.col_limit      = col_limit;
+  context.needs_quantize = quantobj->needs_quantize;
+  context.progress       = progress;
+  context.nth_layer      = nth_layer;
+  context.n_layers       = n_layers;
+
+  gimp_item_get_offset (GIMP_ITEM (layer),
+                        &context.offsetx, &context.offsety);
+
+  if (progress)
+    gimp_progress_set_value (progress, 0.0);
+
+  gimp_parallel_distribute (QUANTIZE_MAX_PARTS,
+                            (GimpParallelDistributeFunc)
+                            generate_histogram_rgb_part,
+                            &context);
+
+  /*  add the colors the parts found to the ones of the previous
+   *  layers, as long as there are no more than we are allowed
+   */
+  quantobj->needs_quantize = context.needs_quantize;
+
+  for (i = 0; i < context.n_parts && ! quantobj->needs_quantize; i++)
+    {
+      for (j = 0; j < context.n_found_cols[i]; j++)
+        {
+          const guchar *color = context.found_cols[i][j];
+
+          for (k = 0; k < quantobj->num_found_cols; k++)
+            {
+              if (color[0] == quantobj->found_cols[k][0] &&
+                  color[1] == quantobj->found_cols[k][1] &&
+                  color[2] == quantobj->found_cols[k][2])
+                break;
+            }
+
+          if (k < quantobj->num_found_cols)
+            continue;
+
+          if (quantobj->num_found_cols == col_limit)
+            {
+              quantobj->needs_quantize = TRUE;
+              break;
+            }
+
+          quantobj->found_cols[k][0] = color[0];
+          quantobj->found_cols[k][1] = color[1];
+          quantobj->found_cols[k][2] = color[2];
+
+          quantobj->num_found_cols++;
+        }
+    }
+
+/*  g_print ("O: col_limit = %d, nfc = %d\n", col_limit, num_found_cols);*/
+}
+
+static void
+generate_histogram_rgb_part (gint                      i,
+                             gint                      n,
+                             GenerateHistogramContext *context)
+{
+  QuantizeObj        *quantobj     = context->quantobj;
+  gboolean            alpha_dither = context->alpha_dither;
+  gint                col_limit    = context->col_limit;
+  guchar            (*found_cols)[3];
+  gint                num_found_cols = 0;
+  gboolean            needs_quantize;
+  CFHistogram         histogram;
   GeglBufferIterator *iter;
-  const Babl         *format;
+  GeglRectangle       area;
   GeglRectangle      *roi;
   ColorFreq          *colfreq;
   gint                nfc_iter;
   gint                row, col, coledge;
-  gint                offsetx, offsety;
-  glong               layer_size;
   glong               total_size = 0;
   gint                count      = 0;
   gint                bpp;
   gboolean            has_alpha;
 
-  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+  if (i == 0)
+    context->n_parts = n;
 
-  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
-                    format == babl_format ("R'G'B'A u8"));
+  /*  the calling thread runs part 0 and counts into the real
+   *  histogram, the other parts count into partial histograms which
+   *  are summed up after the last layer
+   */
+  if (i == 0)
+    {
+      histogram = quantobj->histogram;
+    }
+  else
+    {
+      if (! quantobj->partial_histograms[i])
+        quantobj->partial_histograms[i] =
+          g_new0 (ColorFreq, HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
 
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
+      histogram = quantobj->partial_histograms[i];
+    }
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  found_cols = context->found_cols[i];
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
+  area = *gegl_buffer_get_extent (context->buffer);
 
-  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+  area.y      = area.y + (area.height * i) / n;
+  area.height = (area.height * (i + 1)) / n - (area.height * i) / n;
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
+  context->n_found_cols[i] = 0;
+
+  if (area.height <= 0)
+    return;
+
+  bpp       = babl_format_get_bytes_per_pixel (context->format);
+  has_alpha = babl_format_has_alpha (context->format);
+
+  needs_quantize = g_atomic_int_get (&context->needs_quantize);
+
+  iter = gegl_buffer_iterator_new (context->buffer,
+                                   &area, 0, context->format,
                                    GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
-  if (progress)
-    gimp_progress_set_value (progress, 0.0);
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *data   = iter->data[0];
@@ -1234,6 +1482,10 @@ generate_histogram_rgb (CFHistogram   histogram,
 
       /* g_printerr (" [%d,%d - %d,%d]", srcPR.x, src_roi->y, offsetx, offsety); */
 
+      /*  another part may have found too many colors meanwhile  */
+      if (! needs_quantize)
+        needs_quantize = g_atomic_int_get (&context->needs_quantize);
+
       if (needs_quantize)
         {
           if (alpha_dither)
@@ -1241,9 +1493,9 @@ generate_histogram_rgb (CFHistogram   histogram,
               /* if alpha-dithering,
                  we need to be deterministic w.r.t. offsets */
 
-              col = roi->x + offsetx;
+              col = roi->x + context->offsetx;
               coledge = col + roi->width;
-              row = roi->y + offsety;
+              row = roi->y + context->offsety;
 
               while (length--)
                 {
@@ -1266,7 +1518,7 @@ generate_histogram_rgb (CFHistogram   histogram,
                   col++;
                   if (col == coledge)
                     {
-                      col = roi->x + offsetx;
+                      col = roi->x + context->offsetx;
                       row++;
                     }
 
@@ -1294,9 +1546,9 @@ generate_histogram_rgb (CFHistogram   histogram,
       else
         {
           /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
-          col = roi->x + offsetx;
+          col = roi->x + context->offsetx;
           coledge = col + roi->width;
-          row = roi->y + offsety;
+          row = roi->y + context->offsety;
 
           while (length--)
             {
@@ -1337,7 +1589,7 @@ generate_histogram_rgb (CFHistogram   histogram,
                             goto already_found;
                         }
 
-                      /* Color was not in the table of
+                      /* Color was not in this part's table of
                        * existing colors
                        */
 
@@ -1351,6 +1603,7 @@ generate_histogram_rgb (CFHistogram   histogram,
                            *  quantizing at a later stage.
                            */
                           needs_quantize = TRUE;
+                          g_atomic_int_set (&context->needs_quantize, TRUE);
                           /* g_print ("\nmax colors exceeded - needs quantize.\n");*/
                           goto already_found;
                         }
@@ -1369,7 +1622,7 @@ generate_histogram_rgb (CFHistogram   histogram,
               col++;
               if (col == coledge)
                 {
-                  col = roi->x + offsetx;
+                  col = roi->x + context->offsetx;
                   row++;
                 }
 
@@ -1377,13 +1630,54 @@ generate_histogram_rgb (CFHistogram   histogram,
             }
         }
 
-      if (progress && (count % 16 == 0))
-        gimp_progress_set_value (progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
+      /*  only the calling thread may report progress  */
+      if (i == 0 && context->progress && (count % 16 == 0))
+        gimp_progress_set_value (context->progress,
+                                 (context->nth_layer +
+                                  ((gdouble) total_size) /
+                                  (area.width * area.height)) /
+                                 (gdouble) context->n_layers);
     }
 
-/*  g_print ("O: col_limit = %d, nfc = %d\n", col_limit, num_found_cols);*/
+  context->n_found_cols[i] = MIN (num_found_cols, col_limit);
+}
+
+static void
+merge_partial_histograms (QuantizeObj *quantobj)
+{
+  gint i;
+
+  gimp_parallel_distribute_range (HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS,
+                                  HIST_G_ELEMS * HIST_B_ELEMS,
+                                  (GimpParallelDistributeRangeFunc)
+                                  merge_partial_histograms_range,
+                                  quantobj);
+
+  for (i = 0; i < QUANTIZE_MAX_PARTS; i++)
+    {
+      g_free (quantobj->partial_histograms[i]);
+      quantobj->partial_histograms[i] = NULL;
+    }
+}
+
+static void
+merge_partial_histograms_range (gsize        offset,
+                                gsize        size,
+                                QuantizeObj *quantobj)
+{
+  gint i;
+
+  for (i = 0; i < QUANTIZE_MAX_PARTS; i++)
+    {
+      const ColorFreq *partial = quantobj->partial_histograms[i];
+      gsize            j;
+
+      if (! partial)
+        continue;
+
+      for (j = offset; j < offset + size; j++)
+        quantobj->histogram[j] += partial[j];
+    }
 }
 
 
@@ -2803,11 +3097,7 @@ custompal_pass1 (QuantizeObj *quantobj)
   gint   i;
   GList *list;
 
-  /* fprintf(stderr,
-             "custompal_pass1: using (theCustomPalette %s) from (file %s)\n",
-             theCustomPalette->name, theCustomPalette->filename); */
-
-  for (i = 0, list = gimp_palette_get_colors (theCustomPalette);
+  for (i = 0, list = gimp_palette_get_colors (quantobj->custom_palette);
        list;
        i++, list = g_list_next (list))
     {
@@ -3663,6 +3953,19 @@ init_error_limit (const int error_freedom)
  * Perform floyd-steinberg dithering.
  */
 
+/*  returns the number of rows the FS dither functions read and write
+ *  at once, so that a band of pixels takes no more than
+ *  FS_DITHER_BAND_SIZE bytes, regardless of the layer's size
+ */
+static gint
+fs_dither_band_height (gint width,
+                       gint bpp)
+{
+  gint band_height = FS_DITHER_BAND_SIZE / MAX (width * bpp, 1);
+
+  return CLAMP (band_height, 1, FS_DITHER_MAX_BAND_HEIGHT);
+}
+
 static void
 median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
                                  GimpLayer   *layer,
@@ -3681,6 +3984,9 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
   gint          src_bpp;
   gint          dest_bpp;
   guchar       *src_buf, *dest_buf;
+  gint          band_height;
+  gint          band_row;
+  gint          band_rows = 0;
   gint         *next_row, *prev_row;
   gint         *nr, *pr;
   gint         *tmp;
@@ -3714,8 +4020,11 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
   error_limiter = init_error_limit (quantobj->error_freedom);
   range_limiter = range_array + 256;
 
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
+  /*  stream the layer through in bands of a few rows  */
+  band_height = fs_dither_band_height (width, MAX (src_bpp, dest_bpp));
+
+  src_buf  = g_malloc (width * band_height * src_bpp);
+  dest_buf = g_malloc (width * band_height * dest_bpp);
 
   next_row = g_new (gint, width + 2);
   prev_row = g_new0 (gint, width + 2);
@@ -3732,12 +4041,20 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
       const guchar *src;
       guchar       *dest;
 
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      band_row = row % band_height;
 
-      src  = src_buf;
-      dest = dest_buf;
+      if (band_row == 0)
+        {
+          band_rows = MIN (band_height, height - row);
+
+          gegl_buffer_get (src_buffer,
+                           GEGL_RECTANGLE (0, row, width, band_rows),
+                           1.0, NULL, src_buf,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
+
+      src  = src_buf  + band_row * width * src_bpp;
+      dest = dest_buf + band_row * width * dest_bpp;
 
       nr = next_row;
       pr = prev_row + 1;
@@ -3872,9 +4189,11 @@ median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
 
       odd_row = !odd_row;
 
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
+      if (band_row == band_rows - 1)
+        gegl_buffer_set (new_buffer,
+                         GEGL_RECTANGLE (0, row - band_row, width, band_rows),
+                         0, NULL, dest_buf,
+                         GEGL_AUTO_ROWSTRIDE);
     }
 
   g_free (error_limiter - 255); /* good lord. */
@@ -3933,6 +4252,9 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
   gint          src_bpp;
   gint          dest_bpp;
   guchar       *src_buf, *dest_buf;
+  gint          band_height;
+  gint          band_row;
+  gint          band_rows = 0;
   gint         *red_n_row, *red_p_row;
   gint         *grn_n_row, *grn_p_row;
   gint         *blu_n_row, *blu_p_row;
@@ -3998,8 +4320,11 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
       global_bmin = MIN(global_bmin, quantobj->clin[index].blue);
     }
 
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
+  /*  stream the layer through in bands of a few rows  */
+  band_height = fs_dither_band_height (width, MAX (src_bpp, dest_bpp));
+
+  src_buf  = g_malloc (width * band_height * src_bpp);
+  dest_buf = g_malloc (width * band_height * dest_bpp);
 
   red_n_row = g_new (gint, width + 2);
   red_p_row = g_new0 (gint, width + 2);
@@ -4020,12 +4345,20 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
       const guchar *src;
       guchar       *dest;
 
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      band_row = row % band_height;
 
-      src  = src_buf;
-      dest = dest_buf;
+      if (band_row == 0)
+        {
+          band_rows = MIN (band_height, height - row);
+
+          gegl_buffer_get (src_buffer,
+                           GEGL_RECTANGLE (0, row, width, band_rows),
+                           1.0, NULL, src_buf,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
+
+      src  = src_buf  + band_row * width * src_bpp;
+      dest = dest_buf + band_row * width * dest_bpp;
 
       rnr = red_n_row;
       gnr = grn_n_row;
@@ -4269,9 +4602,11 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
 
       odd_row = !odd_row;
 
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
+      if (band_row == band_rows - 1)
+        gegl_buffer_set (new_buffer,
+                         GEGL_RECTANGLE (0, row - band_row, width, band_rows),
+                         0, NULL, dest_buf,
+                         GEGL_AUTO_ROWSTRIDE);
 
       if (quantobj->progress && (row % 16 == 0))
         gimp_progress_set_value (quantobj->progress,
@@ -4294,6 +4629,11 @@ median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
 static void
 delete_median_cut (QuantizeObj *quantobj)
 {
+  gint i;
+
+  for (i = 0; i < QUANTIZE_MAX_PARTS; i++)
+    g_free (quantobj->partial_histograms[i]);
+
   g_free (quantobj->histogram);
   g_free (quantobj);
 }
@@ -4327,6 +4667,93 @@ gimp_image_convert_type_set_dither_matrix (const guchar *matrix,
     }
 }
 
+static void
+second_pass_layers (QuantizeObj  *quantobj,
+                    GimpLayer   **layers,
+                    GeglBuffer  **new_buffers,
+                    gint          n_layers)
+{
+  gint i, j;
+
+  if (n_layers == 1)
+    {
+      quantobj->second_pass (quantobj, layers[0], new_buffers[0]);
+    }
+  else
+    {
+      SecondPassContext context;
+
+      /*  every layer is converted with a copy of the quantizer which
+       *  counts the index usage of that layer only, and doesn't report
+       *  progress, which only this thread may do.
+       *
+       *  The second pass uses the histogram as the inverse colormap
+       *  cache, which it fills while it goes, so each copy gets an
+       *  empty cache of its own.  A cache entry only ever gets the
+       *  index of the nearest color of its cell, so the result is the
+       *  same as with the shared one.
+       */
+      context.quantobjs   = g_new (QuantizeObj, n_layers);
+      context.layers      = layers;
+      context.new_buffers = new_buffers;
+
+      for (i = 0; i < n_layers; i++)
+        {
+          context.quantobjs[i]           = *quantobj;
+          context.quantobjs[i].progress  = NULL;
+          context.quantobjs[i].histogram = g_new0 (ColorFreq,
+                                                   quantobj->histogram_size);
+
+          memset (context.quantobjs[i].index_used_count, 0,
+                  sizeof (quantobj->index_used_count));
+        }
+
+      gimp_parallel_distribute_range (n_layers, 1,
+                                      (GimpParallelDistributeRangeFunc)
+                                      second_pass_layers_range,
+                                      &context);
+
+      for (i = 0; i < n_layers; i++)
+        {
+          for (j = 0; j < 256; j++)
+            quantobj->index_used_count[j] +=
+              context.quantobjs[i].index_used_count[j];
+
+          g_free (context.quantobjs[i].histogram);
+        }
+
+      g_free (context.quantobjs);
+
+      if (quantobj->progress)
+        gimp_progress_set_value (quantobj->progress,
+                                 (quantobj->nth_layer + 1) /
+                                 (gdouble) quantobj->n_layers);
+    }
+
+  for (i = 0; i < n_layers; i++)
+    {
+      gimp_drawable_set_buffer (GIMP_DRAWABLE (layers[i]), TRUE, NULL,
+                                new_buffers[i]);
+      g_object_unref (new_buffers[i]);
+    }
+}
+
+static void
+second_pass_layers_range (gsize              offset,
+                          gsize              size,
+                          SecondPassContext *context)
+{
+  gsize i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      QuantizeObj *quantobj = &context->quantobjs[i];
+
+      quantobj->second_pass (quantobj,
+                             context->layers[i], context->new_buffers[i]);
+    }
+}
+
 
 /**************************************************************/
 static QuantizeObj *
@@ -4334,23 +4761,26 @@ initialize_median_cut (GimpImageBaseType       type,
                        gint                    num_colors,
                        GimpConvertDitherType   dither_type,
                        GimpConvertPaletteType  palette_type,
+                       GimpPalette            *custom_palette,
                        gboolean                want_alpha_dither,
                        GimpProgress           *progress)
 {
   QuantizeObj *quantobj;
 
   /* Initialize the data structures */
-  quantobj = g_new (QuantizeObj, 1);
+  quantobj = g_new0 (QuantizeObj, 1);
 
   if (type == GIMP_GRAY && palette_type == GIMP_MAKE_PALETTE)
-    quantobj->histogram = g_new (ColorFreq, 256);
+    quantobj->histogram_size = 256;
   else
-    quantobj->histogram = g_new (ColorFreq,
-                                 HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
+    quantobj->histogram_size = HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS;
+
+  quantobj->histogram = g_new (ColorFreq, quantobj->histogram_size);
 
   quantobj->desired_number_of_colors = num_colors;
   quantobj->want_alpha_dither        = want_alpha_dither;
   quantobj->progress                 = progress;
+  quantobj->custom_palette           = custom_palette;
 
   switch (type)
     {
@@ -4365,7 +4795,7 @@ initialize_median_cut (GimpImageBaseType       type,
           break;
         case GIMP_CUSTOM_PALETTE:
           quantobj->first_pass = custompal_pass1;
-          needs_quantize=TRUE;
+          quantobj->needs_quantize = TRUE;
           break;
         case GIMP_MONO_PALETTE:
         default:
@@ -4437,11 +4867,11 @@ initialize_median_cut (GimpImageBaseType       type,
           break;
         case GIMP_WEB_PALETTE:
           quantobj->first_pass = webpal_pass1;
-          needs_quantize=TRUE;
+          quantobj->needs_quantize = TRUE;
           break;
         case GIMP_CUSTOM_PALETTE:
           quantobj->first_pass = custompal_pass1;
-          needs_quantize=TRUE;
+          quantobj->needs_quantize = TRUE;
           break;
         case GIMP_MONO_PALETTE:
         default:
@@ -80,6 +80,7 @@ struct _GimpImagePrivate
   gint               export_dirty;          /*  'dirty' but for export       */
 
   gint               undo_freeze_count;     /*  counts the _freeze's         */
+  gint               undo_block_count;      /*  counts the _block's          */
 
   gint               instance_count;        /*  number of instances          */
   gint               disp_count;            /*  number of displays           */
@@ -121,6 +122,7 @@ struct _GimpImagePrivate
   GimpUndoStack     *redo_stack;            /*  stack for redo operations    */
   gint               group_count;           /*  nested undo groups           */
   GimpUndoType       pushing_undo_group;    /*  undo group status flag       */
+  guint              undo_compact_idle_id;  /*  compresses old undo steps    */
 
   /*  Signal emission accumulator  */
   GimpImageFlushAccumulator  flush_accum;
@@ -34,16 +34,36 @@
 #include "gimplist.h"
 #include "gimpundostack.h"
 
+#include "gimp-intl.h"
+
+
+/*  the number of recent undo steps which are kept uncompressed, so
+ *  they can be undone (or faded) without delay
+ */
+#define UNDO_COMPRESS_DEPTH 2
+
+/*  the number of recent undo steps which are kept in memory, the
+ *  pixels of older drawable undo steps go to the undo swap file
+ */
+#define UNDO_SPILL_DEPTH    8
+
 
 /*  local function prototypes  */
 
-static void          gimp_image_undo_pop_stack       (GimpImage     *image,
+static gboolean      gimp_image_undo_pop_stack       (GimpImage     *image,
                                                       GimpUndoStack *undo_stack,
                                                       GimpUndoStack *redo_stack,
                                                       GimpUndoMode   undo_mode);
+static gboolean      gimp_image_undo_restore_undo    (GimpUndo      *undo,
+                                                      GError       **error);
 static void          gimp_image_undo_free_space      (GimpImage     *image);
 static void          gimp_image_undo_free_redo       (GimpImage     *image);
 
+static void          gimp_image_undo_compact_queue   (GimpImage     *image);
+static gboolean      gimp_image_undo_compact_idle    (GimpImage     *image);
+static gboolean      gimp_image_undo_compact_undo    (GimpUndo      *undo,
+                                                      gboolean       spill);
+
 static GimpDirtyMask gimp_image_undo_dirty_from_type (GimpUndoType   undo_type);
 
 
@@ -112,6 +132,44 @@ gimp_image_undo_thaw (GimpImage *image)
   return TRUE;
 }
 
+/**
+ * gimp_image_undo_block:
+ * @image: a #GimpImage
+ *
+ * Keeps the undo history of @image from being undone or redone, for
+ * example while a long running operation processes events.  Unlike
+ * gimp_image_undo_freeze(), new undo steps are still pushed.
+ **/
+void
+gimp_image_undo_block (GimpImage *image)
+{
+  g_return_if_fail (GIMP_IS_IMAGE (image));
+
+  GIMP_IMAGE_GET_PRIVATE (image)->undo_block_count++;
+}
+
+void
+gimp_image_undo_unblock (GimpImage *image)
+{
+  GimpImagePrivate *private;
+
+  g_return_if_fail (GIMP_IS_IMAGE (image));
+
+  private = GIMP_IMAGE_GET_PRIVATE (image);
+
+  g_return_if_fail (private->undo_block_count > 0);
+
+  private->undo_block_count--;
+}
+
+gboolean
+gimp_image_undo_is_blocked (const GimpImage *image)
+{
+  g_return_val_if_fail (GIMP_IS_IMAGE (image), FALSE);
+
+  return (GIMP_IMAGE_GET_PRIVATE (image)->undo_block_count > 0);
+}
+
 gboolean
 gimp_image_undo (GimpImage *image)
 {
@@ -124,12 +182,13 @@ gimp_image_undo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
-  gimp_image_undo_pop_stack (image,
-                             private->undo_stack,
-                             private->redo_stack,
-                             GIMP_UNDO_MODE_UNDO);
+  if (private->undo_block_count > 0)
+    return FALSE;
 
-  return TRUE;
+  return gimp_image_undo_pop_stack (image,
+                                    private->undo_stack,
+                                    private->redo_stack,
+                                    GIMP_UNDO_MODE_UNDO);
 }
 
 gboolean
@@ -144,12 +203,13 @@ gimp_image_redo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
-  gimp_image_undo_pop_stack (image,
-                             private->redo_stack,
-                             private->undo_stack,
-                             GIMP_UNDO_MODE_REDO);
+  if (private->undo_block_count > 0)
+    return FALSE;
 
-  return TRUE;
+  return gimp_image_undo_pop_stack (image,
+                                    private->redo_stack,
+                                    private->undo_stack,
+                                    GIMP_UNDO_MODE_REDO);
 }
 
 /*
@@ -169,15 +229,19 @@ gimp_image_strong_undo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
+  if (private->undo_block_count > 0)
+    return FALSE;
+
   undo = gimp_undo_stack_peek (private->undo_stack);
 
-  gimp_image_undo (image);
+  if (! gimp_image_undo (image))
+    return FALSE;
 
   while (gimp_undo_is_weak (undo))
     {
       undo = gimp_undo_stack_peek (private->undo_stack);
-      if (gimp_undo_is_weak (undo))
-        gimp_image_undo (image);
+      if (gimp_undo_is_weak (undo) && ! gimp_image_undo (image))
+        break;
     }
 
   return TRUE;
@@ -202,15 +266,19 @@ gimp_image_strong_redo (GimpImage *image)
   g_return_val_if_fail (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE,
                         FALSE);
 
+  if (private->undo_block_count > 0)
+    return FALSE;
+
   undo = gimp_undo_stack_peek (private->redo_stack);
 
-  gimp_image_redo (image);
+  if (! gimp_image_redo (image))
+    return FALSE;
 
   while (gimp_undo_is_weak (undo))
     {
       undo = gimp_undo_stack_peek (private->redo_stack);
-      if (gimp_undo_is_weak (undo))
-        gimp_image_redo (image);
+      if (gimp_undo_is_weak (undo) && ! gimp_image_redo (image))
+        break;
     }
 
   return TRUE;
@@ -347,6 +415,7 @@ gimp_image_undo_group_end (GimpImage *image)
                              gimp_undo_stack_peek (private->undo_stack));
 
       gimp_image_undo_free_space (image);
+      gimp_image_undo_compact_queue (image);
     }
 
   return TRUE;
@@ -409,6 +478,7 @@ gimp_image_undo_push (GimpImage     *image,
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_PUSHED, undo);
 
       gimp_image_undo_free_space (image);
+      gimp_image_undo_compact_queue (image);
 
       /*  freeing undo space may have freed the newly pushed undo  */
       if (gimp_undo_stack_peek (private->undo_stack) == undo)
@@ -485,7 +555,7 @@ gimp_image_undo_get_fadeable (GimpImage *image)
 
 /*  private functions  */
 
-static void
+static gboolean
 gimp_image_undo_pop_stack (GimpImage     *image,
                            GimpUndoStack *undo_stack,
                            GimpUndoStack *redo_stack,
@@ -493,6 +563,28 @@ gimp_image_undo_pop_stack (GimpImage     *image,
 {
   GimpUndo            *undo;
   GimpUndoAccumulator  accum = { 0, };
+  GError              *error = NULL;
+
+  undo = gimp_undo_stack_peek (undo_stack);
+
+  if (! undo)
+    return FALSE;
+
+  /*  restore compacted pixels before anything is popped, so a step
+   *  whose pixels can't be read back stays on its stack, instead of
+   *  being half applied, or moved to the other stack with the wrong
+   *  pixels
+   */
+  if (! gimp_image_undo_restore_undo (undo, &error))
+    {
+      gimp_message (image->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    _("Could not restore the pixels of '%s': %s"),
+                    gimp_object_get_name (undo),
+                    error->message);
+      g_clear_error (&error);
+
+      return FALSE;
+    }
 
   g_object_freeze_notify (G_OBJECT (image));
 
@@ -532,6 +624,32 @@ gimp_image_undo_pop_stack (GimpImage     *image,
     }
 
   g_object_thaw_notify (G_OBJECT (image));
+
+  return TRUE;
+}
+
+static gboolean
+gimp_image_undo_restore_undo (GimpUndo  *undo,
+                              GError   **error)
+{
+  if (GIMP_IS_UNDO_STACK (undo))
+    {
+      GList *list;
+
+      for (list = GIMP_LIST (GIMP_UNDO_STACK (undo)->undos)->list;
+           list;
+           list = g_list_next (list))
+        {
+          if (! gimp_image_undo_restore_undo (list->data, error))
+            return FALSE;
+        }
+    }
+  else if (GIMP_IS_DRAWABLE_UNDO (undo))
+    {
+      return gimp_drawable_undo_restore (GIMP_DRAWABLE_UNDO (undo), error);
+    }
+
+  return TRUE;
 }
 
 static void
@@ -627,6 +745,78 @@ gimp_image_undo_free_redo (GimpImage *image)
     }
 }
 
+/*  Compacts the pixel data of old undo steps, one drawable undo per
+ *  idle iteration, so a deep undo history costs much less memory and
+ *  undo_size allows for correspondingly more steps.  Undo groups which
+ *  are still being pushed are left alone, the idle is queued again
+ *  when they are closed.
+ */
+static void
+gimp_image_undo_compact_queue (GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+
+  if (! private->undo_compact_idle_id &&
+      gimp_undo_stack_get_depth (private->undo_stack) > UNDO_COMPRESS_DEPTH)
+    {
+      private->undo_compact_idle_id =
+        g_idle_add_full (G_PRIORITY_LOW,
+                         (GSourceFunc) gimp_image_undo_compact_idle,
+                         image, NULL);
+    }
+}
+
+static gboolean
+gimp_image_undo_compact_idle (GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+  GList            *list;
+  gint              depth;
+
+  if (private->pushing_undo_group == GIMP_UNDO_GROUP_NONE)
+    {
+      for (list = GIMP_LIST (private->undo_stack->undos)->list, depth = 0;
+           list;
+           list = g_list_next (list), depth++)
+        {
+          if (depth < UNDO_COMPRESS_DEPTH)
+            continue;
+
+          if (gimp_image_undo_compact_undo (list->data,
+                                            depth >= UNDO_SPILL_DEPTH))
+            return TRUE;
+        }
+    }
+
+  private->undo_compact_idle_id = 0;
+
+  return FALSE;
+}
+
+static gboolean
+gimp_image_undo_compact_undo (GimpUndo *undo,
+                              gboolean  spill)
+{
+  if (GIMP_IS_UNDO_STACK (undo))
+    {
+      GList *list;
+
+      for (list = GIMP_LIST (GIMP_UNDO_STACK (undo)->undos)->list;
+           list;
+           list = g_list_next (list))
+        {
+          if (gimp_image_undo_compact_undo (list->data, spill))
+            return TRUE;
+        }
+    }
+  else if (GIMP_IS_DRAWABLE_UNDO (undo))
+    {
+      return gimp_drawable_undo_compact (GIMP_DRAWABLE_UNDO (undo), spill);
+    }
+
+  return FALSE;
+}
+
 static GimpDirtyMask
 gimp_image_undo_dirty_from_type (GimpUndoType undo_type)
 {
@@ -25,6 +25,10 @@ gboolean        gimp_image_undo_disable         (GimpImage        *image);
 gboolean        gimp_image_undo_freeze          (GimpImage        *image);
 gboolean        gimp_image_undo_thaw            (GimpImage        *image);
 
+void            gimp_image_undo_block           (GimpImage        *image);
+void            gimp_image_undo_unblock         (GimpImage        *image);
+gboolean        gimp_image_undo_is_blocked      (const GimpImage  *image);
+
 gboolean        gimp_image_undo                 (GimpImage        *image);
 gboolean        gimp_image_redo                 (GimpImage        *image);
 
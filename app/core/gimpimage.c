@@ -1066,6 +1066,12 @@ gimp_image_finalize (GObject *object)
       private->sample_points = NULL;
     }
 
+  if (private->undo_compact_idle_id)
+    {
+      g_source_remove (private->undo_compact_idle_id);
+      private->undo_compact_idle_id = 0;
+    }
+
   if (private->undo_stack)
     {
       g_object_unref (private->undo_stack);
@@ -29,12 +29,14 @@
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gegl.h>
+#include <gegl-plugin.h> /* GEGL_IS_OPERATION_POINT_FILTER() */
 
 #include "libgimpbase/gimpbase.h"
 
 #include "core-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-gegl-utils.h"
 #include "gegl/gimpapplicator.h"
 
 #include "gimpchannel.h"
@@ -44,6 +46,17 @@
 #include "gimpmarshal.h"
 #include "gimpprogress.h"
 
+#include "gimp-priorities.h"
+
+
+/*  the coarsest proxy level, i.e. the largest downscaling by 2^level,
+ *  at which the preview of an expensive operation is rendered first
+ */
+#define PROXY_MAX_LEVEL    2
+
+/*  don't use a proxy level smaller than this many pixels  */
+#define PROXY_MIN_PIXELS   (256 * 256)
+
 
 enum
 {
@@ -74,6 +87,12 @@ struct _GimpImageMap
   GeglNode             *cast_before;
   GeglNode             *cast_after;
   GimpApplicator       *applicator;
+
+  GeglNode             *proxy_operation;
+  GeglNode             *proxy_scale_down;
+  GeglNode             *proxy_scale_up;
+  gint                  proxy_level;
+  guint                 proxy_idle_id;
 };
 
 
@@ -84,6 +103,12 @@ static void       gimp_image_map_sync_region     (GimpImageMap        *image_map
 static void       gimp_image_map_sync_mode       (GimpImageMap        *image_map);
 static void       gimp_image_map_sync_affect     (GimpImageMap        *image_map);
 static void       gimp_image_map_sync_gamma_hack (GimpImageMap        *image_map);
+static void       gimp_image_map_sync_proxy      (GimpImageMap        *image_map);
+
+static gint       gimp_image_map_get_proxy_level (GimpImageMap        *image_map);
+static void       gimp_image_map_set_proxy_level (GimpImageMap        *image_map,
+                                                  gint                 level);
+static gboolean   gimp_image_map_proxy_idle      (GimpImageMap        *image_map);
 
 static gboolean   gimp_image_map_is_filtering    (GimpImageMap        *image_map);
 static gboolean   gimp_image_map_add_filter      (GimpImageMap        *image_map);
@@ -135,6 +160,8 @@ gimp_image_map_dispose (GObject *object)
 {
   GimpImageMap *image_map = GIMP_IMAGE_MAP (object);
 
+  gimp_image_map_set_proxy_level (image_map, 0);
+
   if (image_map->drawable)
     {
       gimp_image_map_remove_filter (image_map);
@@ -343,6 +370,15 @@ gimp_image_map_apply (GimpImageMap        *image_map,
                                                    "operation", "gegl:nop",
                                                    NULL);
 
+      image_map->proxy_scale_down =
+        gegl_node_new_child (filter_node,
+                             "operation", "gegl:nop",
+                             NULL);
+      image_map->proxy_scale_up =
+        gegl_node_new_child (filter_node,
+                             "operation", "gegl:nop",
+                             NULL);
+
       gimp_image_map_sync_region (image_map);
       gimp_image_map_sync_mode (image_map);
       gimp_image_map_sync_gamma_hack (image_map);
@@ -390,6 +426,13 @@ gimp_image_map_apply (GimpImageMap        *image_map,
                                        -offset_x, -offset_y);
     }
 
+  /*  render an expensive operation on a downscaled proxy first, and
+   *  refine it to full resolution once that is on screen; this also
+   *  drops any refinement still pending for the previous parameters
+   */
+  gimp_image_map_set_proxy_level (image_map,
+                                  gimp_image_map_get_proxy_level (image_map));
+
   gimp_image_map_add_filter (image_map);
   gimp_image_map_update_drawable (image_map, &update_area);
 }
@@ -404,6 +447,9 @@ gimp_image_map_commit (GimpImageMap *image_map,
   g_return_val_if_fail (GIMP_IS_IMAGE_MAP (image_map), FALSE);
   g_return_val_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress), FALSE);
 
+  /*  always merge the full resolution result  */
+  gimp_image_map_set_proxy_level (image_map, 0);
+
   if (gimp_image_map_is_filtering (image_map))
     {
       success = gimp_drawable_merge_filter (image_map->drawable,
@@ -425,6 +471,8 @@ gimp_image_map_abort (GimpImageMap *image_map)
 {
   g_return_if_fail (GIMP_IS_IMAGE_MAP (image_map));
 
+  gimp_image_map_set_proxy_level (image_map, 0);
+
   if (gimp_image_map_remove_filter (image_map))
     {
       gimp_image_map_update_drawable (image_map, &image_map->filter_area);
@@ -549,6 +597,195 @@ gimp_image_map_sync_gamma_hack (GimpImageMap *image_map)
     }
 }
 
+static void
+gimp_image_map_sync_proxy (GimpImageMap *image_map)
+{
+  if (image_map->applicator)
+    {
+      if (image_map->proxy_level > 0)
+        {
+          GParamSpec **pspecs;
+          guint        n_pspecs;
+          gchar       *operation_name;
+          gdouble      scale = 1.0 / (1 << image_map->proxy_level);
+          guint        i;
+
+          gegl_node_get (image_map->operation,
+                         "operation", &operation_name,
+                         NULL);
+
+          if (! image_map->proxy_operation)
+            {
+              GeglNode *filter_node = gimp_filter_get_node (image_map->filter);
+
+              image_map->proxy_operation =
+                gegl_node_new_child (filter_node,
+                                     "operation", operation_name,
+                                     NULL);
+            }
+
+          /*  copy the operation's current parameters, scaling those
+           *  which are measured in pixels to the proxy's resolution
+           */
+          pspecs = gegl_operation_list_properties (operation_name, &n_pspecs);
+
+          for (i = 0; i < n_pspecs; i++)
+            {
+              GParamSpec *pspec = pspecs[i];
+              GValue      value = G_VALUE_INIT;
+
+              g_value_init (&value, pspec->value_type);
+
+              gegl_node_get_property (image_map->operation, pspec->name,
+                                      &value);
+
+              if (gimp_gegl_param_spec_has_key (pspec, "unit",
+                                                "pixel-distance") ||
+                  gimp_gegl_param_spec_has_key (pspec, "unit",
+                                                "pixel-coordinate"))
+                {
+                  if (G_VALUE_HOLDS_DOUBLE (&value))
+                    g_value_set_double (&value,
+                                        g_value_get_double (&value) * scale);
+                  else if (G_VALUE_HOLDS_INT (&value))
+                    g_value_set_int (&value,
+                                     RINT (g_value_get_int (&value) * scale));
+
+                  g_param_value_validate (pspec, &value);
+                }
+
+              gegl_node_set_property (image_map->proxy_operation, pspec->name,
+                                      &value);
+
+              g_value_unset (&value);
+            }
+
+          g_free (pspecs);
+          g_free (operation_name);
+
+          gegl_node_set (image_map->proxy_scale_down,
+                         "operation", "gegl:scale-ratio",
+                         "x",         scale,
+                         "y",         scale,
+                         NULL);
+
+          gegl_node_set (image_map->proxy_scale_up,
+                         "operation", "gegl:scale-ratio",
+                         "x",         1.0 / scale,
+                         "y",         1.0 / scale,
+                         NULL);
+
+          gegl_node_link_many (image_map->cast_before,
+                               image_map->proxy_scale_down,
+                               image_map->proxy_operation,
+                               image_map->proxy_scale_up,
+                               image_map->cast_after,
+                               NULL);
+        }
+      else if (image_map->proxy_operation)
+        {
+          GeglNode *filter_node = gimp_filter_get_node (image_map->filter);
+
+          gegl_node_link_many (image_map->cast_before,
+                               image_map->operation,
+                               image_map->cast_after,
+                               NULL);
+
+          gegl_node_remove_child (filter_node, image_map->proxy_operation);
+          image_map->proxy_operation = NULL;
+
+          gegl_node_set (image_map->proxy_scale_down,
+                         "operation", "gegl:nop",
+                         NULL);
+          gegl_node_set (image_map->proxy_scale_up,
+                         "operation", "gegl:nop",
+                         NULL);
+        }
+    }
+}
+
+/*  returns the proxy level to start previewing at, or 0 if the
+ *  operation is cheap or the filter area small enough to always
+ *  render it at full resolution
+ */
+static gint
+gimp_image_map_get_proxy_level (GimpImageMap *image_map)
+{
+  GeglOperation *operation;
+  gint64         n_pixels;
+  gint           level;
+
+  operation = gegl_node_get_gegl_operation (image_map->operation);
+
+  /*  graphs can't be duplicated, operations with aux inputs don't
+   *  have them on the duplicate, and point operations gain nothing
+   */
+  if (! operation                                         ||
+      ! gegl_node_has_pad (image_map->operation, "input") ||
+      gegl_node_has_pad (image_map->operation, "aux")     ||
+      GEGL_IS_OPERATION_POINT_FILTER (operation)          ||
+      GEGL_IS_OPERATION_POINT_COMPOSER (operation))
+    {
+      return 0;
+    }
+
+  n_pixels = (gint64) image_map->filter_area.width *
+             (gint64) image_map->filter_area.height;
+
+  for (level = PROXY_MAX_LEVEL; level > 0; level--)
+    {
+      if ((n_pixels >> (2 * level)) >= PROXY_MIN_PIXELS)
+        break;
+    }
+
+  return level;
+}
+
+static void
+gimp_image_map_set_proxy_level (GimpImageMap *image_map,
+                                gint          level)
+{
+  if (image_map->proxy_idle_id)
+    {
+      g_source_remove (image_map->proxy_idle_id);
+      image_map->proxy_idle_id = 0;
+    }
+
+  if (level != image_map->proxy_level || level > 0)
+    {
+      image_map->proxy_level = level;
+
+      gimp_image_map_sync_proxy (image_map);
+    }
+
+  /*  the refinement idle has a lower priority than the projection's
+   *  chunk renderer, so it only runs once the current level has been
+   *  rendered completely
+   */
+  if (image_map->proxy_level > 0)
+    {
+      image_map->proxy_idle_id =
+        g_idle_add_full (GIMP_PRIORITY_IMAGE_MAP_PROXY_IDLE,
+                         (GSourceFunc) gimp_image_map_proxy_idle,
+                         image_map, NULL);
+    }
+}
+
+static gboolean
+gimp_image_map_proxy_idle (GimpImageMap *image_map)
+{
+  image_map->proxy_idle_id = 0;
+
+  gimp_image_map_set_proxy_level (image_map, image_map->proxy_level - 1);
+
+  /*  the projection renders the refined result in chunks, leaving the
+   *  coarser one on the canvas until they are done
+   */
+  gimp_image_map_update_drawable (image_map, &image_map->filter_area);
+
+  return FALSE;
+}
+
 static gboolean
 gimp_image_map_is_filtering (GimpImageMap *image_map)
 {
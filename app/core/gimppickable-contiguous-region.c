@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <cairo.h>
 #include <gegl.h>
@@ -29,42 +30,78 @@
 #include "core-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-parallel.h"
 
 #include "gimp-utils.h" /* GIMP_TIMER */
 #include "gimppickable.h"
 #include "gimppickable-contiguous-region.h"
 
 
+/*  the size of the tiles the source is fetched in  */
+#define CONTIGUOUS_TILE_WIDTH      64
+#define CONTIGUOUS_TILE_HEIGHT     64
+
+/*  after this many tiles were fetched one by one, the rest is fetched
+ *  in blocks of CONTIGUOUS_BLOCK_SIZE x CONTIGUOUS_BLOCK_SIZE tiles,
+ *  in parallel
+ */
+#define CONTIGUOUS_BLOCK_THRESHOLD 16
+#define CONTIGUOUS_BLOCK_SIZE       8
+
+/*  the minimal number of pixels select by color processes per thread  */
+#define COLOR_REGION_MIN_AREA      (256 * 256)
+
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  GeglRectangle        extent;
+  gint                 width;
+  gint                 height;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  /*  the pixel differences of the fetched tiles, negated once the
+   *  pixels are part of the region
+   */
+  gfloat             **tiles;
+  gint                 n_tile_cols;
+  gint                 n_tile_rows;
+  gint                 n_fetched;
+} ContiguousRegion;
+
+typedef struct
+{
+  gint y;
+  gint start;
+  gint end;
+} ContiguousSpan;
+
+
 /*  local function prototypes  */
 
 static const Babl * choose_format         (GeglBuffer          *buffer,
                                            GimpSelectCriterion  select_criterion,
                                            gint                *n_components,
                                            gboolean            *has_alpha);
-static gfloat   pixel_difference          (const gfloat        *col1,
-                                           const gfloat        *col2,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gint                 width,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end,
-                                           gfloat              *row);
+static void     pixel_difference_row      (ContiguousRegion    *region,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 n_pixels);
+static void     find_color_region         (const GeglRectangle *area,
+                                           ContiguousRegion    *region);
+static gfloat * fetch_difference_tile     (ContiguousRegion    *region,
+                                           gint                 tile_col,
+                                           gint                 tile_row);
+static void     fetch_difference_tiles    (const GeglRectangle *area,
+                                           ContiguousRegion    *region);
 static void     find_contiguous_region    (GeglBuffer          *src_buffer,
                                            GeglBuffer          *mask_buffer,
                                            const Babl          *format,
@@ -161,13 +198,13 @@ gimp_pickable_contiguous_region_by_color (GimpPickable        *pickable,
    *  fuzzy_select.  Modify the pickable's mask to reflect the
    *  additional selection
    */
-  GeglBufferIterator *iter;
-  GeglBuffer         *src_buffer;
-  GeglBuffer         *mask_buffer;
-  const Babl         *format;
-  gint                n_components;
-  gboolean            has_alpha;
-  gfloat              start_col[MAX_CHANNELS];
+  ContiguousRegion  region = { 0, };
+  GeglBuffer       *src_buffer;
+  GeglBuffer       *mask_buffer;
+  const Babl       *format;
+  gint              n_components;
+  gboolean          has_alpha;
+  gfloat            start_col[MAX_CHANNELS];
 
   g_return_val_if_fail (GIMP_IS_PICKABLE (pickable), NULL);
   g_return_val_if_fail (color != NULL, NULL);
@@ -199,35 +236,24 @@ gimp_pickable_contiguous_region_by_color (GimpPickable        *pickable,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  iter = gegl_buffer_iterator_new (src_buffer,
-                                   NULL, 0, format,
-                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, mask_buffer,
-                            NULL, 0, babl_format ("Y float"),
-                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *src   = iter->data[0];
-      gfloat       *dest  = iter->data[1];
-      gint          count = iter->length;
-
-      while (count--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
-        }
-    }
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = start_col;
+
+  /*  split along the mask's tiles, so no tile is written concurrently  */
+  gimp_parallel_distribute_tiles (mask_buffer,
+                                  gegl_buffer_get_extent (src_buffer),
+                                  COLOR_REGION_MIN_AREA,
+                                  (GimpParallelDistributeAreaFunc)
+                                  find_color_region,
+                                  &region);
 
   return mask_buffer;
 }
@@ -278,207 +304,240 @@ choose_format (GeglBuffer          *buffer,
   return format;
 }
 
-static gfloat
-pixel_difference (const gfloat        *col1,
-                  const gfloat        *col2,
-                  gboolean             antialias,
-                  gfloat               threshold,
-                  gint                 n_components,
-                  gboolean             has_alpha,
-                  gboolean             select_transparent,
-                  GimpSelectCriterion  select_criterion)
+static void
+pixel_difference_row (ContiguousRegion *region,
+                      const gfloat     *src,
+                      gfloat           *dest,
+                      gint              n_pixels)
 {
-  gfloat max = 0.0;
-
-  /*  if there is an alpha channel, never select transparent regions  */
-  if (! select_transparent && has_alpha && col2[n_components - 1] == 0.0)
-    return 0.0;
-
-  if (select_transparent && has_alpha)
+  const gfloat *col          = region->col;
+  gint          n_components = region->n_components;
+  gint          alpha        = n_components - 1;
+  gfloat        threshold    = region->threshold;
+  gint          channel      = -1;
+  gint          i;
+
+  /*  first find the maximal difference of each pixel, with a separate
+   *  loop per criterion, so the compiler can vectorize each of them
+   */
+  if (region->select_transparent && region->has_alpha)
     {
-      max = fabs (col1[n_components - 1] - col2[n_components - 1]);
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = fabs (col[alpha] - src[i * n_components + alpha]);
     }
   else
     {
-      gfloat diff;
-      gint   b;
-
-      if (has_alpha)
-        n_components--;
-
-      switch (select_criterion)
+      switch (region->select_criterion)
         {
         case GIMP_SELECT_CRITERION_COMPOSITE:
-          for (b = 0; b < n_components; b++)
-            {
-              diff = fabs (col1[b] - col2[b]);
-              if (diff > max)
-                max = diff;
-            }
+          {
+            gint n_colors = region->has_alpha ? alpha : n_components;
+            gint b;
+
+            memset (dest, 0, n_pixels * sizeof (gfloat));
+
+            for (b = 0; b < n_colors; b++)
+              {
+                for (i = 0; i < n_pixels; i++)
+                  {
+                    gfloat diff = fabs (col[b] - src[i * n_components + b]);
+
+                    dest[i] = MAX (dest[i], diff);
+                  }
+              }
+          }
           break;
 
         case GIMP_SELECT_CRITERION_R:
-          max = fabs (col1[0] - col2[0]);
+          channel = 0;
           break;
 
         case GIMP_SELECT_CRITERION_G:
-          max = fabs (col1[1] - col2[1]);
+          channel = 1;
           break;
 
         case GIMP_SELECT_CRITERION_B:
-          max = fabs (col1[2] - col2[2]);
+          channel = 2;
           break;
 
         case GIMP_SELECT_CRITERION_H:
-          {
-            /* wrap around candidates for the actual distance */
-            gfloat dist1 = fabs (col1[0] - col2[0]);
-            gfloat dist2 = fabs (col1[0] - 1.0 - col2[0]);
-            gfloat dist3 = fabs (col1[0] - col2[0] + 1.0);
-
-            max = MIN (dist1, dist2);
-            if (max > dist3)
-              max = dist3;
-          }
+          for (i = 0; i < n_pixels; i++)
+            {
+              gfloat hue = src[i * n_components];
+
+              /* wrap around candidates for the actual distance */
+              gfloat dist1 = fabs (col[0] - hue);
+              gfloat dist2 = fabs (col[0] - 1.0 - hue);
+              gfloat dist3 = fabs (col[0] - hue + 1.0);
+
+              dest[i] = MIN (MIN (dist1, dist2), dist3);
+            }
           break;
 
         case GIMP_SELECT_CRITERION_S:
-          max = fabs (col1[1] - col2[1]);
+          channel = 1;
           break;
 
         case GIMP_SELECT_CRITERION_V:
-          max = fabs (col1[2] - col2[2]);
+          channel = 2;
           break;
         }
+
+      if (channel >= 0)
+        {
+          for (i = 0; i < n_pixels; i++)
+            dest[i] = fabs (col[channel] - src[i * n_components + channel]);
+        }
     }
 
-  if (antialias && threshold > 0.0)
+  /*  then map the differences to selection values  */
+  if (region->antialias && threshold > 0.0)
     {
-      gfloat aa = 1.5 - (max / threshold);
+      for (i = 0; i < n_pixels; i++)
+        {
+          gfloat aa = 1.5 - (dest[i] / threshold);
 
-      if (aa <= 0.0)
-        return 0.0;
-      else if (aa < 0.5)
-        return aa * 2.0;
-      else
-        return 1.0;
+          dest[i] = CLAMP (aa * 2.0, 0.0, 1.0);
+        }
     }
   else
     {
-      if (max > threshold)
-        return 0.0;
-      else
-        return 1.0;
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = dest[i] > threshold ? 0.0 : 1.0;
+    }
+
+  /*  if there is an alpha channel, never select transparent regions  */
+  if (! region->select_transparent && region->has_alpha)
+    {
+      for (i = 0; i < n_pixels; i++)
+        {
+          if (src[i * n_components + alpha] == 0.0)
+            dest[i] = 0.0;
+        }
     }
 }
 
-/* #define FETCH_ROW 1 */
-
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end,
-                         gfloat              *row)
+static void
+find_color_region (const GeglRectangle *area,
+                   ContiguousRegion    *region)
 {
-  gfloat *s;
-  gfloat  mask_row[width];
-  gfloat  diff;
-
-#ifdef FETCH_ROW
-  gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, initial_y, width, 1), 1.0,
-                   format,
-                   row, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-  s = row + initial_x * n_components;
-#else
-  s = g_alloca (n_components * sizeof (gfloat));
-
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#endif
-
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
+  GeglBufferIterator *iter;
 
-  /* check the starting pixel */
-  if (! diff)
-    return FALSE;
+  iter = gegl_buffer_iterator_new (region->src_buffer,
+                                   area, 0, region->format,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
 
-  mask_row[initial_x] = diff;
+  gegl_buffer_iterator_add (iter, region->mask_buffer,
+                            area, 0, babl_format ("Y float"),
+                            GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
 
-  *start = initial_x - 1;
-#ifdef FETCH_ROW
-  s = row + *start * n_components;
-#endif
+  while (gegl_buffer_iterator_next (iter))
+    {
+      /*  Find how closely the colors match  */
+      pixel_difference_row (region, iter->data[0], iter->data[1],
+                            iter->length);
+    }
+}
 
-  while (*start >= 0 && diff)
+static gfloat *
+fetch_difference_tile (ContiguousRegion *region,
+                       gint              tile_col,
+                       gint              tile_row)
+{
+  GeglRectangle  rect;
+  gfloat        *src;
+  gfloat        *tile;
+  gint           y;
+
+  rect.x      = tile_col * CONTIGUOUS_TILE_WIDTH;
+  rect.y      = tile_row * CONTIGUOUS_TILE_HEIGHT;
+  rect.width  = MIN (CONTIGUOUS_TILE_WIDTH,  region->width  - rect.x);
+  rect.height = MIN (CONTIGUOUS_TILE_HEIGHT, region->height - rect.y);
+
+  src  = g_new (gfloat, rect.width * rect.height * region->n_components);
+  tile = g_new (gfloat, CONTIGUOUS_TILE_WIDTH * CONTIGUOUS_TILE_HEIGHT);
+
+  gegl_buffer_get (region->src_buffer,
+                   GEGL_RECTANGLE (region->extent.x + rect.x,
+                                   region->extent.y + rect.y,
+                                   rect.width, rect.height),
+                   1.0, region->format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (y = 0; y < rect.height; y++)
     {
-#ifndef FETCH_ROW
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#endif
+      pixel_difference_row (region,
+                            src  + y * rect.width * region->n_components,
+                            tile + y * CONTIGUOUS_TILE_WIDTH,
+                            rect.width);
+    }
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+  g_free (src);
 
-      mask_row[*start] = diff;
+  return tile;
+}
 
-      if (diff)
-        {
-          (*start)--;
-#ifdef FETCH_ROW
-          s -= n_components;
-#endif
-        }
-    }
+static void
+fetch_difference_tiles (const GeglRectangle *area,
+                        ContiguousRegion    *region)
+{
+  gint tile_col;
+  gint tile_row;
+
+  for (tile_row = area->y; tile_row < area->y + area->height; tile_row++)
+    for (tile_col = area->x; tile_col < area->x + area->width; tile_col++)
+      {
+        gint i = tile_row * region->n_tile_cols + tile_col;
+
+        if (! region->tiles[i])
+          region->tiles[i] = fetch_difference_tile (region,
+                                                    tile_col, tile_row);
+      }
+}
 
-  diff = 1;
-  *end = initial_x + 1;
-#ifdef FETCH_ROW
-  s = row + *end * n_components;
-#endif
+static inline gfloat *
+get_difference_pixel (ContiguousRegion *region,
+                      gint              x,
+                      gint              y)
+{
+  gint    tile_col = x / CONTIGUOUS_TILE_WIDTH;
+  gint    tile_row = y / CONTIGUOUS_TILE_HEIGHT;
+  gfloat *tile     = region->tiles[tile_row * region->n_tile_cols + tile_col];
 
-  while (*end < width && diff)
+  if (G_UNLIKELY (! tile))
     {
-#ifndef FETCH_ROW
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#endif
+      if (region->n_fetched < CONTIGUOUS_BLOCK_THRESHOLD)
+        {
+          region->tiles[tile_row * region->n_tile_cols + tile_col] =
+            fetch_difference_tile (region, tile_col, tile_row);
+        }
+      else
+        {
+          GeglRectangle block;
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+          /*  the region is getting large, fetch the tiles around this
+           *  one in parallel
+           */
+          block.x      = tile_col - tile_col % CONTIGUOUS_BLOCK_SIZE;
+          block.y      = tile_row - tile_row % CONTIGUOUS_BLOCK_SIZE;
+          block.width  = MIN (CONTIGUOUS_BLOCK_SIZE,
+                              region->n_tile_cols - block.x);
+          block.height = MIN (CONTIGUOUS_BLOCK_SIZE,
+                              region->n_tile_rows - block.y);
+
+          gimp_parallel_distribute_area (&block, 1,
+                                         (GimpParallelDistributeAreaFunc)
+                                         fetch_difference_tiles,
+                                         region);
+        }
 
-      mask_row[*end] = diff;
+      region->n_fetched++;
 
-      if (diff)
-        {
-          (*end)++;
-#ifdef FETCH_ROW
-          s += n_components;
-#endif
-        }
+      tile = region->tiles[tile_row * region->n_tile_cols + tile_col];
     }
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
-
-  return TRUE;
+  return tile + (y % CONTIGUOUS_TILE_HEIGHT) * CONTIGUOUS_TILE_WIDTH +
+                (x % CONTIGUOUS_TILE_WIDTH);
 }
 
 static void
@@ -495,73 +554,149 @@ find_contiguous_region (GeglBuffer          *src_buffer,
                         gint                 y,
                         const gfloat        *col)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
-  gfloat *row = NULL;
+  ContiguousRegion  region;
+  GArray           *span_stack;
+  ContiguousSpan    span;
+  gint              n_tiles;
+  gint              i;
+
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.extent             = *gegl_buffer_get_extent (src_buffer);
+  region.width              = region.extent.width;
+  region.height             = region.extent.height;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = col;
+  region.n_fetched          = 0;
+
+  region.n_tile_cols = (region.width  + CONTIGUOUS_TILE_WIDTH  - 1) /
+                       CONTIGUOUS_TILE_WIDTH;
+  region.n_tile_rows = (region.height + CONTIGUOUS_TILE_HEIGHT - 1) /
+                       CONTIGUOUS_TILE_HEIGHT;
+
+  n_tiles = region.n_tile_cols * region.n_tile_rows;
+
+  region.tiles = g_new0 (gfloat *, n_tiles);
+
+  /*  from here on, coordinates are relative to the buffer's extent  */
+  x -= region.extent.x;
+  y -= region.extent.y;
+
+  span_stack = g_array_new (FALSE, FALSE, sizeof (ContiguousSpan));
+
+  span.y     = y;
+  span.start = x - 1;
+  span.end   = x + 1;
+
+  g_array_append_val (span_stack, span);
+
+  while (span_stack->len > 0)
+    {
+      span = g_array_index (span_stack, ContiguousSpan, span_stack->len - 1);
+      g_array_set_size (span_stack, span_stack->len - 1);
 
-#ifdef FETCH_ROW
-  row = g_new (gfloat, gegl_buffer_get_width (src_buffer) * n_components);
-#endif
+      y = span.y;
 
-  coord_stack = g_queue_new ();
+      for (x = span.start + 1; x < span.end; x++)
+        {
+          ContiguousSpan new_span;
+          gfloat        *pixel;
 
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
-   */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+          /*  pixels which are not part of the region have a difference
+           *  of zero, the ones already filled are negated
+           */
+          if (*get_difference_pixel (&region, x, y) <= 0.0)
+            continue;
 
-  do
-    {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+          new_span.start = x - 1;
 
-      for (x = start + 1; x < end; x++)
-        {
-          gfloat val;
+          while (new_span.start >= 0 &&
+                 *get_difference_pixel (&region, new_span.start, y) > 0.0)
+            {
+              new_span.start--;
+            }
 
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
-            continue;
+          new_span.end = x + 1;
 
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
-                                         &new_start, &new_end,
-                                         row))
-            continue;
+          while (new_span.end < region.width &&
+                 *get_difference_pixel (&region, new_span.end, y) > 0.0)
+            {
+              new_span.end++;
+            }
+
+          for (i = new_span.start + 1; i < new_span.end; i++)
+            {
+              pixel = get_difference_pixel (&region, i, y);
 
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+              *pixel = -*pixel;
+            }
+
+          if (y + 1 < region.height)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = y + 1;
+              g_array_append_val (span_stack, new_span);
             }
 
           if (y - 1 >= 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = y - 1;
+              g_array_append_val (span_stack, new_span);
             }
+
+          /*  the rest of the new span is filled already  */
+          x = new_span.end;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
 
-  g_queue_free (coord_stack);
+  g_array_free (span_stack, TRUE);
+
+  /*  write the filled pixels of all visited tiles to the mask  */
+  for (i = 0; i < n_tiles; i++)
+    {
+      gfloat        *tile = region.tiles[i];
+      GeglRectangle  rect;
+      gboolean       filled = FALSE;
+      gint           j;
+
+      if (! tile)
+        continue;
+
+      for (j = 0; j < CONTIGUOUS_TILE_WIDTH * CONTIGUOUS_TILE_HEIGHT; j++)
+        {
+          if (tile[j] < 0.0)
+            {
+              tile[j] = -tile[j];
+              filled  = TRUE;
+            }
+          else
+            {
+              tile[j] = 0.0;
+            }
+        }
+
+      if (filled)
+        {
+          rect.x      = (i % region.n_tile_cols) * CONTIGUOUS_TILE_WIDTH;
+          rect.y      = (i / region.n_tile_cols) * CONTIGUOUS_TILE_HEIGHT;
+          rect.width  = MIN (CONTIGUOUS_TILE_WIDTH,  region.width  - rect.x);
+          rect.height = MIN (CONTIGUOUS_TILE_HEIGHT, region.height - rect.y);
+
+          rect.x += region.extent.x;
+          rect.y += region.extent.y;
+
+          gegl_buffer_set (region.mask_buffer, &rect, 0,
+                           babl_format ("Y float"),
+                           tile, CONTIGUOUS_TILE_WIDTH * sizeof (gfloat));
+        }
+
+      g_free (tile);
+    }
 
-#ifdef FETCH_ROW
-  g_free (row);
-#endif
+  g_free (region.tiles);
 }
@@ -25,6 +25,7 @@
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
 
 #include "core-types.h"
 
@@ -44,15 +45,32 @@
 #include "gimp-priorities.h"
 
 
-/*  chunk size for one iteration of the chunk renderer  */
+/*  initial chunk size for one iteration of the chunk renderer  */
 static gint GIMP_PROJECTION_CHUNK_WIDTH  = 256;
 static gint GIMP_PROJECTION_CHUNK_HEIGHT = 128;
 
+/*  whether to size chunks from the measured render throughput, this
+ *  is disabled when a fixed size is set using the environment
+ */
+static gboolean GIMP_PROJECTION_CHUNK_ADAPTIVE = TRUE;
+
+/*  limits for adaptively sized chunks, they are always multiples
+ *  of GIMP_PROJECTION_CHUNK_STEP
+ */
+#define GIMP_PROJECTION_CHUNK_STEP     16
+#define GIMP_PROJECTION_CHUNK_MIN_SIZE 32
+#define GIMP_PROJECTION_CHUNK_MAX_SIZE 4096
+
 /*  how much time, in seconds, do we allow chunk rendering to take,
  *  aiming for 15fps
  */
 static gdouble GIMP_PROJECTION_CHUNK_TIME = 0.0666;
 
+/*  an adaptively sized iteration of the chunk renderer aims at taking
+ *  this fraction of GIMP_PROJECTION_CHUNK_TIME
+ */
+#define GIMP_PROJECTION_CHUNK_TIME_FRACTION 0.25
+
 
 enum
 {
@@ -80,6 +98,7 @@ struct _GimpProjectionChunkRender
 
   gint            work_x;
   gint            work_y;
+  gint            work_height;     /*  height of the current row      */
 
   cairo_region_t *update_region;   /*  flushed update region */
 };
@@ -91,10 +110,31 @@ struct _GimpProjectionPrivate
   GeglBuffer                *buffer;
   GimpTileHandlerValidate   *validate_handler;
 
+  /*  the lazily validated mipmap levels, index 0 is unused  */
+  GeglBuffer                *level_buffers[GIMP_PROJECTION_MAX_LEVEL + 1];
+  GimpTileHandlerValidate   *level_handlers[GIMP_PROJECTION_MAX_LEVEL + 1];
+
   cairo_region_t            *update_region;
   GimpProjectionChunkRender  chunk_render;
   cairo_rectangle_int_t      priority_rect;
 
+  /*  how many displays show each mipmap level, the chunk renderer
+   *  renders updates into all of them, or at full resolution if
+   *  there are none
+   */
+  gint                       level_users[GIMP_PROJECTION_MAX_LEVEL + 1];
+
+  gint                       chunk_width;
+  gint                       chunk_height;
+
+  /*  render statistics  */
+  gdouble                    pixels_per_second; /* smoothed throughput */
+  guint64                    n_pixels;
+  gdouble                    render_time;
+  gint                       n_chunks;
+  gint                       n_overruns;
+  gint                       latency_bins[GIMP_PROJECTION_N_LATENCY_BINS];
+
   gboolean                   invalidate_preview;
 };
 
@@ -144,7 +184,31 @@ static void        gimp_projection_chunk_render_stop     (GimpProjection  *proj)
 static gboolean    gimp_projection_chunk_render_callback (gpointer         data);
 static void        gimp_projection_chunk_render_init     (GimpProjection  *proj);
 static gboolean    gimp_projection_chunk_render_iteration(GimpProjection  *proj);
+static void        gimp_projection_chunk_render_get_grid (GimpProjection  *proj,
+                                                          gint            *grid_width,
+                                                          gint            *grid_height);
+static void        gimp_projection_chunk_render_get_chunk_size
+                                                         (GimpProjection  *proj,
+                                                          gint            *chunk_width,
+                                                          gint            *chunk_height);
 static gboolean    gimp_projection_chunk_render_next_area(GimpProjection  *proj);
+static void        gimp_projection_chunk_render_record   (GimpProjection  *proj,
+                                                          gint64           n_pixels,
+                                                          gint             n_chunks,
+                                                          gint64           elapsed);
+static void        gimp_projection_invalidate_area       (GimpProjection  *proj,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             w,
+                                                          gint             h);
+static gboolean    gimp_projection_is_render_level       (GimpProjection  *proj,
+                                                          gint             level);
+static void        gimp_projection_prepare_chunk         (GimpProjection  *proj,
+                                                          const GeglRectangle *chunk,
+                                                          GeglBuffer     **buffers);
+static void        gimp_projection_render_chunk          (GeglNode        *graph,
+                                                          GeglBuffer     **buffers,
+                                                          const GeglRectangle *chunk);
 static void        gimp_projection_paint_area            (GimpProjection  *proj,
                                                           gboolean         now,
                                                           gint             x,
@@ -218,8 +282,9 @@ gimp_projection_class_init (GimpProjectionClass *klass)
       if (width  > 0 && width  <= 8192 &&
           height > 0 && height <= 8192)
         {
-          GIMP_PROJECTION_CHUNK_WIDTH  = width;
-          GIMP_PROJECTION_CHUNK_HEIGHT = height;
+          GIMP_PROJECTION_CHUNK_WIDTH    = width;
+          GIMP_PROJECTION_CHUNK_HEIGHT   = height;
+          GIMP_PROJECTION_CHUNK_ADAPTIVE = FALSE;
         }
     }
 }
@@ -230,6 +295,9 @@ gimp_projection_init (GimpProjection *proj)
   proj->priv = G_TYPE_INSTANCE_GET_PRIVATE (proj,
                                             GIMP_TYPE_PROJECTION,
                                             GimpProjectionPrivate);
+
+  proj->priv->chunk_width  = GIMP_PROJECTION_CHUNK_WIDTH;
+  proj->priv->chunk_height = GIMP_PROJECTION_CHUNK_HEIGHT;
 }
 
 static void
@@ -296,9 +364,13 @@ gimp_projection_get_memsize (GimpObject *object,
 {
   GimpProjection *projection = GIMP_PROJECTION (object);
   gint64          memsize    = 0;
+  gint            level;
 
   memsize += gimp_gegl_pyramid_get_memsize (projection->priv->buffer);
 
+  for (level = 1; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    memsize += gimp_gegl_pyramid_get_memsize (projection->priv->level_buffers[level]);
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -512,6 +584,139 @@ gimp_projection_set_priority_rect (GimpProjection *proj,
     }
 }
 
+/**
+ * gimp_projection_add_priority_level:
+ * @proj:  a #GimpProjection
+ * @level: a mipmap level, as returned by gimp_projection_get_level()
+ *
+ * Makes the chunk renderer render updates into the mipmap level
+ * @level.  Every display showing the projection adds the level it
+ * reads from, so all of them are rendered directly; the levels no
+ * display shows are only invalidated, and validated on demand when
+ * they are read.  If no level was added, updates are rendered at
+ * full resolution.
+ *
+ * Each call must be balanced by gimp_projection_remove_priority_level().
+ **/
+void
+gimp_projection_add_priority_level (GimpProjection *proj,
+                                    gint            level)
+{
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+  g_return_if_fail (level >= 0 && level <= GIMP_PROJECTION_MAX_LEVEL);
+
+  proj->priv->level_users[level]++;
+}
+
+/**
+ * gimp_projection_remove_priority_level:
+ * @proj:  a #GimpProjection
+ * @level: a mipmap level previously passed to
+ *         gimp_projection_add_priority_level()
+ **/
+void
+gimp_projection_remove_priority_level (GimpProjection *proj,
+                                       gint            level)
+{
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+  g_return_if_fail (level >= 0 && level <= GIMP_PROJECTION_MAX_LEVEL);
+  g_return_if_fail (proj->priv->level_users[level] > 0);
+
+  proj->priv->level_users[level]--;
+}
+
+/**
+ * gimp_projection_get_level:
+ * @proj:    a #GimpProjection
+ * @scale_x: horizontal display scale
+ * @scale_y: vertical display scale
+ *
+ * Return value: the mipmap level which is best suited for displaying
+ *               the projection at the given scale, i.e. the highest
+ *               level which is not smaller than the displayed image.
+ **/
+gint
+gimp_projection_get_level (GimpProjection *proj,
+                           gdouble         scale_x,
+                           gdouble         scale_y)
+{
+  gdouble scale = MAX (scale_x, scale_y);
+  gint    level = 0;
+
+  g_return_val_if_fail (GIMP_IS_PROJECTION (proj), 0);
+
+  while (scale <= 0.5 && level < GIMP_PROJECTION_MAX_LEVEL)
+    {
+      scale *= 2.0;
+      level++;
+    }
+
+  return level;
+}
+
+/**
+ * gimp_projection_get_level_buffer:
+ * @proj:  a #GimpProjection
+ * @level: a mipmap level
+ *
+ * Returns a buffer containing the projection scaled down by a factor
+ * of 2^@level.  The buffer is created on first use, and its tiles are
+ * rendered on demand, directly at the reduced resolution.
+ *
+ * Return value: the buffer of mipmap level @level.
+ **/
+GeglBuffer *
+gimp_projection_get_level_buffer (GimpProjection *proj,
+                                  gint            level)
+{
+  g_return_val_if_fail (GIMP_IS_PROJECTION (proj), NULL);
+  g_return_val_if_fail (level >= 0 && level <= GIMP_PROJECTION_MAX_LEVEL,
+                        NULL);
+
+  /*  always create the full resolution buffer first, it sets up the
+   *  update machinery
+   */
+  gimp_projection_get_buffer (GIMP_PICKABLE (proj));
+
+  if (level == 0)
+    return proj->priv->buffer;
+
+  if (! proj->priv->level_buffers[level])
+    {
+      GimpTileHandlerValidate *handler;
+      GeglNode                *graph;
+      const Babl              *format;
+      gint                     width;
+      gint                     height;
+
+      graph  = gimp_projectable_get_graph (proj->priv->projectable);
+      format = gimp_projection_get_format (GIMP_PICKABLE (proj));
+      gimp_projectable_get_size (proj->priv->projectable, &width, &height);
+
+      width  = (width  + (1 << level) - 1) >> level;
+      height = (height + (1 << level) - 1) >> level;
+
+      proj->priv->level_buffers[level] =
+        gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height), format);
+
+      handler = GIMP_TILE_HANDLER_VALIDATE (gimp_tile_handler_validate_new (graph));
+
+      g_object_set (handler,
+                    "scale", 1.0 / (1 << level),
+                    NULL);
+
+      gimp_tile_handler_validate_assign (handler,
+                                         proj->priv->level_buffers[level]);
+
+      /*  nothing has been rendered at this level yet  */
+      gimp_tile_handler_validate_invalidate (handler, 0, 0, width, height);
+
+      proj->priv->level_handlers[level] = handler;
+    }
+
+  return proj->priv->level_buffers[level];
+}
+
 void
 gimp_projection_stop_rendering (GimpProjection *proj)
 {
@@ -587,12 +792,57 @@ gimp_projection_finish_draw (GimpProjection *proj)
     }
 }
 
+/**
+ * gimp_projection_get_stats:
+ * @proj:              a #GimpProjection
+ * @pixels_per_second: return location for the render throughput
+ * @n_chunks:          return location for the number of rendered chunks
+ * @n_overruns:        return location for the number of chunks which
+ *                     exceeded the chunk renderer's time budget
+ * @latency_bins:      return location for GIMP_PROJECTION_N_LATENCY_BINS
+ *                     chunk latency counts
+ *
+ * Returns the statistics collected by the chunk renderer. Bin 0 of
+ * @latency_bins counts iterations taking less than 1 ms, bin i counts
+ * iterations taking between 2^(i-1) and 2^i ms, and the last bin
+ * counts all slower ones.
+ **/
+void
+gimp_projection_get_stats (GimpProjection *proj,
+                           gdouble        *pixels_per_second,
+                           gint           *n_chunks,
+                           gint           *n_overruns,
+                           gint           *latency_bins)
+{
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+
+  if (pixels_per_second)
+    {
+      if (proj->priv->render_time > 0.0)
+        *pixels_per_second = proj->priv->n_pixels / proj->priv->render_time;
+      else
+        *pixels_per_second = 0.0;
+    }
+
+  if (n_chunks)
+    *n_chunks = proj->priv->n_chunks;
+
+  if (n_overruns)
+    *n_overruns = proj->priv->n_overruns;
+
+  if (latency_bins)
+    memcpy (latency_bins, proj->priv->latency_bins,
+            sizeof (proj->priv->latency_bins));
+}
+
 
 /*  private functions  */
 
 static void
 gimp_projection_free_buffer (GimpProjection  *proj)
 {
+  gint level;
+
   if (proj->priv->chunk_render.idle_id)
     gimp_projection_chunk_render_stop (proj);
 
@@ -623,6 +873,21 @@ gimp_projection_free_buffer (GimpProjection  *proj)
       g_object_unref (proj->priv->validate_handler);
       proj->priv->validate_handler = NULL;
     }
+
+  for (level = 1; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    {
+      if (proj->priv->level_buffers[level])
+        {
+          gegl_buffer_remove_handler (proj->priv->level_buffers[level],
+                                      proj->priv->level_handlers[level]);
+
+          g_object_unref (proj->priv->level_buffers[level]);
+          proj->priv->level_buffers[level] = NULL;
+
+          g_object_unref (proj->priv->level_handlers[level]);
+          proj->priv->level_handlers[level] = NULL;
+        }
+    }
 }
 
 static void
@@ -746,8 +1011,13 @@ gimp_projection_chunk_render_callback (gpointer data)
     }
   while (g_timer_elapsed (timer, NULL) < GIMP_PROJECTION_CHUNK_TIME);
 
-  GIMP_LOG (PROJECTION, "%d chunks in %f seconds\n",
-            chunks, g_timer_elapsed (timer, NULL));
+  GIMP_LOG (PROJECTION,
+            "%d chunks of %dx%d in %f seconds "
+            "(%.0f pixels/s, %d chunks total, %d overruns)\n",
+            chunks, proj->priv->chunk_width, proj->priv->chunk_height,
+            g_timer_elapsed (timer, NULL),
+            proj->priv->pixels_per_second,
+            proj->priv->n_chunks, proj->priv->n_overruns);
   g_timer_destroy (timer);
 
   return retval;
@@ -826,16 +1096,29 @@ gimp_projection_chunk_render_iteration (GimpProjection *proj)
   gint                       work_y       = chunk_render->work_y;
   gint                       work_w;
   gint                       work_h;
+  gint64                     start_time;
+
+  gimp_projection_chunk_render_get_chunk_size (proj, &work_w, &work_h);
 
-  work_w = MIN (GIMP_PROJECTION_CHUNK_WIDTH,
-                chunk_render->x + chunk_render->width - work_x);
+  /*  the chunk size adapts after every chunk, but all chunks of a row
+   *  must have the same height, or the next row would skip or repeat
+   *  lines.  latch the height when a row starts.
+   */
+  if (work_x == chunk_render->x)
+    chunk_render->work_height = work_h;
 
-  work_h = MIN (GIMP_PROJECTION_CHUNK_HEIGHT,
+  work_w = MIN (work_w, chunk_render->x + chunk_render->width  - work_x);
+  work_h = MIN (chunk_render->work_height,
                 chunk_render->y + chunk_render->height - work_y);
 
+  start_time = g_get_monotonic_time ();
+
   gimp_projection_paint_area (proj, TRUE /* sic! */,
                               work_x, work_y, work_w, work_h);
 
+  gimp_projection_chunk_render_record (proj, (gint64) work_w * work_h, 1,
+                                       g_get_monotonic_time () - start_time);
+
   chunk_render->work_x += work_w;
 
   if (chunk_render->work_x >= chunk_render->x + chunk_render->width)
@@ -868,12 +1151,56 @@ gimp_projection_chunk_render_iteration (GimpProjection *proj)
   return TRUE;
 }
 
+/* Returns the size of the grid the chunk renderer aligns its areas
+ * and chunks to, in full resolution coordinates.  Chunks aligned to
+ * this grid cover whole pixels of all mipmap levels that are rendered.
+ */
+static void
+gimp_projection_chunk_render_get_grid (GimpProjection *proj,
+                                       gint           *grid_width,
+                                       gint           *grid_height)
+{
+  gint level;
+
+  *grid_width  = 1;
+  *grid_height = 1;
+
+  for (level = 0; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    {
+      if (gimp_projection_is_render_level (proj, level))
+        {
+          *grid_width  = MAX (*grid_width,  1 << level);
+          *grid_height = MAX (*grid_height, 1 << level);
+        }
+    }
+}
+
+/* Returns the size of the next chunk, which is the adaptive chunk
+ * size rounded to the grid.  Areas start on the grid, see next_area(),
+ * so chunks which are multiples of the grid size stay on it.
+ */
+static void
+gimp_projection_chunk_render_get_chunk_size (GimpProjection *proj,
+                                             gint           *chunk_width,
+                                             gint           *chunk_height)
+{
+  gint grid_width;
+  gint grid_height;
+
+  gimp_projection_chunk_render_get_grid (proj, &grid_width, &grid_height);
+
+  *chunk_width  = MAX (proj->priv->chunk_width  / grid_width,  1) * grid_width;
+  *chunk_height = MAX (proj->priv->chunk_height / grid_height, 1) * grid_height;
+}
+
 static gboolean
 gimp_projection_chunk_render_next_area (GimpProjection *proj)
 {
   GimpProjectionChunkRender *chunk_render = &proj->priv->chunk_render;
   cairo_region_t            *next_region;
   cairo_rectangle_int_t      rect;
+  gint                       grid_width;
+  gint                       grid_height;
 
   if (! chunk_render->update_region)
     return FALSE;
@@ -896,6 +1223,35 @@ gimp_projection_chunk_render_next_area (GimpProjection *proj)
 
   cairo_region_destroy (next_region);
 
+  gimp_projection_chunk_render_get_grid (proj, &grid_width, &grid_height);
+
+  if (grid_width > 1 || grid_height > 1)
+    {
+      gint width, height;
+      gint x1, y1, x2, y2;
+
+      /*  snap the area outwards to the grid, and take all of it off
+       *  the update region, so chunks of different areas never share
+       *  a level pixel either
+       */
+      gimp_projectable_get_size (proj->priv->projectable, &width, &height);
+
+      x1 = rect.x / grid_width  * grid_width;
+      y1 = rect.y / grid_height * grid_height;
+      x2 = rect.x + rect.width;
+      y2 = rect.y + rect.height;
+
+      x2 = MIN ((x2 + grid_width  - 1) / grid_width  * grid_width,
+                MAX (x2, width));
+      y2 = MIN ((y2 + grid_height - 1) / grid_height * grid_height,
+                MAX (y2, height));
+
+      rect.x      = x1;
+      rect.y      = y1;
+      rect.width  = x2 - x1;
+      rect.height = y2 - y1;
+    }
+
   cairo_region_subtract_rectangle (chunk_render->update_region, &rect);
 
   if (cairo_region_is_empty (chunk_render->update_region))
@@ -915,6 +1271,230 @@ gimp_projection_chunk_render_next_area (GimpProjection *proj)
   return TRUE;
 }
 
+/* Accounts an iteration of the chunk renderer, which rendered
+ * @n_pixels in @n_chunks chunks within @elapsed microseconds, and
+ * resizes the chunks so the next iteration takes about
+ * GIMP_PROJECTION_CHUNK_TIME_FRACTION of the time budget.
+ */
+static void
+gimp_projection_chunk_render_record (GimpProjection *proj,
+                                     gint64          n_pixels,
+                                     gint            n_chunks,
+                                     gint64          elapsed)
+{
+  GimpProjectionPrivate *priv    = proj->priv;
+  gdouble                seconds = elapsed / (gdouble) G_USEC_PER_SEC;
+  gint64                 msecs;
+  gint                   bin     = 0;
+
+  priv->n_pixels    += n_pixels;
+  priv->render_time += seconds;
+  priv->n_chunks    += n_chunks;
+
+  for (msecs = elapsed / 1000;
+       msecs > 0 && bin < GIMP_PROJECTION_N_LATENCY_BINS - 1;
+       msecs >>= 1)
+    {
+      bin++;
+    }
+
+  priv->latency_bins[bin]++;
+
+  if (seconds > GIMP_PROJECTION_CHUNK_TIME)
+    priv->n_overruns++;
+
+  if (n_pixels > 0 && elapsed > 0)
+    {
+      gdouble pixels_per_second = n_pixels / seconds;
+
+      if (priv->pixels_per_second > 0.0)
+        priv->pixels_per_second = (0.75 * priv->pixels_per_second +
+                                   0.25 * pixels_per_second);
+      else
+        priv->pixels_per_second = pixels_per_second;
+
+      if (GIMP_PROJECTION_CHUNK_ADAPTIVE)
+        {
+          gdouble area;
+          gint    width;
+          gint    height;
+
+          area = (priv->pixels_per_second *
+                  GIMP_PROJECTION_CHUNK_TIME *
+                  GIMP_PROJECTION_CHUNK_TIME_FRACTION);
+
+          /*  keep the 2:1 aspect ratio of the default chunk size  */
+          width  = ROUND (sqrt (2.0 * area) / GIMP_PROJECTION_CHUNK_STEP);
+          width  = CLAMP (width * GIMP_PROJECTION_CHUNK_STEP,
+                          GIMP_PROJECTION_CHUNK_MIN_SIZE,
+                          GIMP_PROJECTION_CHUNK_MAX_SIZE);
+
+          height = ROUND (area / width / GIMP_PROJECTION_CHUNK_STEP);
+          height = CLAMP (height * GIMP_PROJECTION_CHUNK_STEP,
+                          GIMP_PROJECTION_CHUNK_MIN_SIZE,
+                          GIMP_PROJECTION_CHUNK_MAX_SIZE);
+
+          priv->chunk_width  = width;
+          priv->chunk_height = height;
+        }
+    }
+}
+
+/* Converts @rect to the coordinates of mipmap level @level, rounding
+ * outwards.  Rects whose edges are multiples of 2^@level, like the
+ * chunk renderer's chunks, map to level rects which don't overlap.
+ */
+static void
+gimp_projection_rect_to_level (const GeglRectangle *rect,
+                               gint                 level,
+                               GeglRectangle       *level_rect)
+{
+  gint x1 = rect->x >> level;
+  gint y1 = rect->y >> level;
+  gint x2 = (rect->x + rect->width  + (1 << level) - 1) >> level;
+  gint y2 = (rect->y + rect->height + (1 << level) - 1) >> level;
+
+  gegl_rectangle_set (level_rect, x1, y1, x2 - x1, y2 - y1);
+}
+
+/* Marks the area as dirty at full resolution and in all existing
+ * mipmap levels.
+ */
+static void
+gimp_projection_invalidate_area (GimpProjection *proj,
+                                 gint            x,
+                                 gint            y,
+                                 gint            w,
+                                 gint            h)
+{
+  gint level;
+
+  if (proj->priv->validate_handler)
+    gimp_tile_handler_validate_invalidate (proj->priv->validate_handler,
+                                           x, y, w, h);
+
+  for (level = 1; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    {
+      if (proj->priv->level_handlers[level])
+        {
+          GeglRectangle rect;
+
+          gimp_projection_rect_to_level (GEGL_RECTANGLE (x, y, w, h), level,
+                                         &rect);
+
+          gimp_tile_handler_validate_invalidate (proj->priv->level_handlers[level],
+                                                 rect.x, rect.y,
+                                                 rect.width, rect.height);
+        }
+    }
+}
+
+/* Returns whether updates are rendered directly into mipmap level
+ * @level, see gimp_projection_add_priority_level().
+ */
+static gboolean
+gimp_projection_is_render_level (GimpProjection *proj,
+                                 gint            level)
+{
+  gint i;
+
+  if (proj->priv->level_users[level] > 0)
+    return TRUE;
+
+  if (level > 0)
+    return FALSE;
+
+  /*  render at full resolution if no display asked for a level  */
+  for (i = 1; i <= GIMP_PROJECTION_MAX_LEVEL; i++)
+    if (proj->priv->level_users[i] > 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Looks up the buffers @chunk is to be rendered to, which are those
+ * of the levels displays are reading from, and marks the area there
+ * as valid because it is rendered right away.  On return, @buffers
+ * contains the buffer of each such level, and NULL for the others.
+ */
+static void
+gimp_projection_prepare_chunk (GimpProjection       *proj,
+                               const GeglRectangle  *chunk,
+                               GeglBuffer          **buffers)
+{
+  gint level;
+
+  for (level = 0; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    {
+      GimpTileHandlerValidate *handler;
+      GeglRectangle            rect;
+
+      if (! gimp_projection_is_render_level (proj, level))
+        {
+          buffers[level] = NULL;
+          continue;
+        }
+
+      buffers[level] = gimp_projection_get_level_buffer (proj, level);
+
+      if (level > 0)
+        handler = proj->priv->level_handlers[level];
+      else
+        handler = proj->priv->validate_handler;
+
+      gimp_projection_rect_to_level (chunk, level, &rect);
+
+      if (handler)
+        gimp_tile_handler_validate_undo_invalidate (handler,
+                                                    rect.x, rect.y,
+                                                    rect.width, rect.height);
+    }
+}
+
+/* Renders @chunk into each of @buffers, at the buffer's mipmap level.
+ * The buffers have to be set up by gimp_projection_prepare_chunk().
+ */
+static void
+gimp_projection_render_chunk (GeglNode             *graph,
+                              GeglBuffer          **buffers,
+                              const GeglRectangle  *chunk)
+{
+  gint level;
+
+  for (level = 0; level <= GIMP_PROJECTION_MAX_LEVEL; level++)
+    {
+      GeglBuffer    *buffer = buffers[level];
+      GeglRectangle  rect;
+
+      if (! buffer)
+        continue;
+
+      gimp_projection_rect_to_level (chunk, level, &rect);
+
+      if (level == 0)
+        {
+          gegl_node_blit_buffer (graph, buffer, &rect);
+        }
+      else
+        {
+          GeglBufferIterator *iter;
+          const Babl         *format = gegl_buffer_get_format (buffer);
+          gint                bpp    = babl_format_get_bytes_per_pixel (format);
+          gdouble             scale  = 1.0 / (1 << level);
+
+          iter = gegl_buffer_iterator_new (buffer, &rect, 0, format,
+                                           GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
+
+          while (gegl_buffer_iterator_next (iter))
+            {
+              gegl_node_blit (graph, scale, &iter->roi[0], format,
+                              iter->data[0], iter->roi[0].width * bpp,
+                              GEGL_BLIT_DEFAULT);
+            }
+        }
+    }
+}
+
 static void
 gimp_projection_paint_area (GimpProjection *proj,
                             gboolean        now,
@@ -933,19 +1513,18 @@ gimp_projection_paint_area (GimpProjection *proj,
                                 0, 0, width, height,
                                 &x, &y, &w, &h))
     {
-      if (proj->priv->validate_handler)
-        gimp_tile_handler_validate_invalidate (proj->priv->validate_handler,
-                                               x, y, w, h);
+      gimp_projection_invalidate_area (proj, x, y, w, h);
+
       if (now)
         {
-          GeglNode *graph = gimp_projectable_get_graph (proj->priv->projectable);
+          GeglNode   *graph = gimp_projectable_get_graph (proj->priv->projectable);
+          GeglBuffer *buffers[GIMP_PROJECTION_MAX_LEVEL + 1];
 
-          if (proj->priv->validate_handler)
-            gimp_tile_handler_validate_undo_invalidate (proj->priv->validate_handler,
-                                                        x, y, w, h);
+          gimp_projection_prepare_chunk (proj, GEGL_RECTANGLE (x, y, w, h),
+                                         buffers);
 
-          gegl_node_blit_buffer (graph, proj->priv->buffer,
-                                 GEGL_RECTANGLE (x, y, w, h));
+          gimp_projection_render_chunk (graph, buffers,
+                                        GEGL_RECTANGLE (x, y, w, h));
         }
 
       /*  add the projectable's offsets because the list of update areas
@@ -22,6 +22,13 @@
 #include "gimpobject.h"
 
 
+/*  the number of bins in the chunk latency histogram  */
+#define GIMP_PROJECTION_N_LATENCY_BINS 10
+
+/*  the smallest mipmap level is scaled down by 2^GIMP_PROJECTION_MAX_LEVEL  */
+#define GIMP_PROJECTION_MAX_LEVEL 6
+
+
 #define GIMP_TYPE_PROJECTION            (gimp_projection_get_type ())
 #define GIMP_PROJECTION(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_PROJECTION, GimpProjection))
 #define GIMP_PROJECTION_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GIMP_TYPE_PROJECTION, GimpProjectionClass))
@@ -53,26 +60,44 @@ struct _GimpProjectionClass
 };
 
 
-GType            gimp_projection_get_type          (void) G_GNUC_CONST;
+GType            gimp_projection_get_type           (void) G_GNUC_CONST;
+
+GimpProjection * gimp_projection_new                (GimpProjectable   *projectable);
+
+void             gimp_projection_set_priority_rect  (GimpProjection    *proj,
+                                                     gint               x,
+                                                     gint               y,
+                                                     gint               width,
+                                                     gint               height);
+
+void             gimp_projection_add_priority_level (GimpProjection    *proj,
+                                                     gint               level);
+void             gimp_projection_remove_priority_level
+                                                    (GimpProjection    *proj,
+                                                     gint               level);
 
-GimpProjection * gimp_projection_new               (GimpProjectable   *projectable);
+gint             gimp_projection_get_level          (GimpProjection    *proj,
+                                                     gdouble            scale_x,
+                                                     gdouble            scale_y);
+GeglBuffer     * gimp_projection_get_level_buffer   (GimpProjection    *proj,
+                                                     gint               level);
 
-void             gimp_projection_set_priority_rect (GimpProjection    *proj,
-                                                    gint               x,
-                                                    gint               y,
-                                                    gint               width,
-                                                    gint               height);
+void             gimp_projection_stop_rendering     (GimpProjection    *proj);
 
-void             gimp_projection_stop_rendering    (GimpProjection    *proj);
+void             gimp_projection_flush              (GimpProjection    *proj);
+void             gimp_projection_flush_now          (GimpProjection    *proj);
+void             gimp_projection_finish_draw        (GimpProjection    *proj);
 
-void             gimp_projection_flush             (GimpProjection    *proj);
-void             gimp_projection_flush_now         (GimpProjection    *proj);
-void             gimp_projection_finish_draw       (GimpProjection    *proj);
+void             gimp_projection_get_stats          (GimpProjection    *proj,
+                                                     gdouble           *pixels_per_second,
+                                                     gint              *n_chunks,
+                                                     gint              *n_overruns,
+                                                     gint              *latency_bins);
 
-gint64           gimp_projection_estimate_memsize  (GimpImageBaseType  type,
-                                                    GimpComponentType  component_type,
-                                                    gint               width,
-                                                    gint               height);
+gint64           gimp_projection_estimate_memsize   (GimpImageBaseType  type,
+                                                     GimpComponentType  component_type,
+                                                     gint               width,
+                                                     gint               height);
 
 
 #endif /*  __GIMP_PROJECTION_H__  */
@@ -29,10 +29,27 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-parallel.h"
+
 #include "gimpbezierdesc.h"
 #include "gimpscanconvert.h"
 
 
+/*  the minimal area rendered by a single thread  */
+#define SCAN_CONVERT_MIN_AREA   (128 * 128)
+
+/*  the number of pixels whose coverage is accumulated before it is
+ *  written to the buffer
+ */
+#define SCAN_CONVERT_BAND_SIZE  (1 << 18)
+
+/*  the number of sub-scanlines sampled per row when antialiasing  */
+#define SCAN_CONVERT_SUBSAMPLES 16
+
+/*  the maximal distance of a flattened curve from the real one  */
+#define SCAN_CONVERT_TOLERANCE  0.1
+
+
 struct _GimpScanConvert
 {
   gdouble         ratio_xy;
@@ -55,6 +72,66 @@ struct _GimpScanConvert
   GArray         *path_data;
 };
 
+typedef struct
+{
+  gdouble  x0;                  /*  x at the top end of the edge    */
+  gdouble  y0;                  /*  top end of the edge             */
+  gdouble  y1;                  /*  bottom end of the edge          */
+  gdouble  dxdy;
+} ScanEdge;
+
+typedef struct
+{
+  const ScanEdge *edge;
+  gdouble         x;
+} ScanActiveEdge;
+
+typedef struct
+{
+  GimpScanConvert *sc;
+  GeglBuffer      *buffer;
+  gint             off_x;
+  gint             off_y;
+  gboolean         replace;
+  gboolean         antialias;
+  gdouble          value;
+
+  /*  fill only, sorted by y0  */
+  ScanEdge        *edges;
+  gint             n_edges;
+
+  /*  stroke only  */
+  GeglRectangle    extents;
+} ScanRenderContext;
+
+
+/*  local function prototypes  */
+
+static void       gimp_scan_convert_setup_stroke  (GimpScanConvert     *sc,
+                                                   cairo_t             *cr);
+static void       gimp_scan_convert_add_edge      (GArray              *edges,
+                                                   gdouble              x0,
+                                                   gdouble              y0,
+                                                   gdouble              x1,
+                                                   gdouble              y1);
+static void       gimp_scan_convert_flatten_curve (GArray              *edges,
+                                                   const GimpVector2   *p0,
+                                                   const GimpVector2   *p1,
+                                                   const GimpVector2   *p2,
+                                                   const GimpVector2   *p3,
+                                                   gint                 depth);
+static ScanEdge * gimp_scan_convert_get_edges     (GimpScanConvert     *sc,
+                                                   gdouble              off_x,
+                                                   gdouble              off_y,
+                                                   gint                *n_edges);
+static gint       gimp_scan_convert_edge_cmp      (const ScanEdge      *edge1,
+                                                   const ScanEdge      *edge2);
+
+static void       gimp_scan_convert_fill_area     (const GeglRectangle *area,
+                                                   ScanRenderContext   *context);
+static void       gimp_scan_convert_stroke_area   (const GeglRectangle *area,
+                                                   ScanRenderContext   *context);
+
 
 /*  public functions  */
 
@@ -450,30 +527,517 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
                                gboolean         antialias,
                                gdouble          value)
 {
-  const Babl         *format;
-  GeglBufferIterator *iter;
-  GeglRectangle      *roi;
-  cairo_t            *cr;
-  cairo_surface_t    *surface;
-  cairo_path_t        path;
-  gint                bpp;
-  gint                x, y;
-  gint                width, height;
+  ScanRenderContext context = { 0, };
+  GeglRectangle     rect;
 
   g_return_if_fail (sc != NULL);
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
 
-  x      = 0;
-  y      = 0;
-  width  = gegl_buffer_get_width  (buffer);
-  height = gegl_buffer_get_height (buffer);
+  rect.x      = 0;
+  rect.y      = 0;
+  rect.width  = gegl_buffer_get_width  (buffer);
+  rect.height = gegl_buffer_get_height (buffer);
 
-  if (sc->clip && ! gimp_rectangle_intersect (x, y, width, height,
+  if (sc->clip && ! gimp_rectangle_intersect (rect.x, rect.y,
+                                              rect.width, rect.height,
                                               sc->clip_x, sc->clip_y,
                                               sc->clip_w, sc->clip_h,
-                                              &x, &y, &width, &height))
+                                              &rect.x, &rect.y,
+                                              &rect.width, &rect.height))
     return;
 
+  context.sc        = sc;
+  context.buffer    = buffer;
+  context.off_x     = off_x;
+  context.off_y     = off_y;
+  context.replace   = replace;
+  context.antialias = antialias;
+  context.value     = value;
+
+  /*  the areas are split along the tiles of @buffer, since they are
+   *  written to concurrently
+   */
+  if (sc->do_stroke)
+    {
+      cairo_surface_t *surface;
+      cairo_t         *cr;
+      cairo_path_t     path;
+      gdouble          x1, y1, x2, y2;
+
+      /*  cairo strokes the whole path for every tile, so find the
+       *  extents of the stroke once and skip the tiles outside of it
+       */
+      path.status   = CAIRO_STATUS_SUCCESS;
+      path.data     = (cairo_path_data_t *) sc->path_data->data;
+      path.num_data = sc->path_data->len;
+
+      surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 1, 1);
+      cr = cairo_create (surface);
+
+      cairo_append_path (cr, &path);
+      gimp_scan_convert_setup_stroke (sc, cr);
+      cairo_stroke_extents (cr, &x1, &y1, &x2, &y2);
+      cairo_user_to_device (cr, &x1, &y1);
+      cairo_user_to_device (cr, &x2, &y2);
+
+      cairo_destroy (cr);
+      cairo_surface_destroy (surface);
+
+      context.extents.x      = floor (x1) - off_x - 1;
+      context.extents.y      = floor (y1) - off_y - 1;
+      context.extents.width  = ceil (x2) - floor (x1) + 2;
+      context.extents.height = ceil (y2) - floor (y1) + 2;
+
+      gimp_parallel_distribute_tiles (buffer, &rect, SCAN_CONVERT_MIN_AREA,
+                                      (GimpParallelDistributeAreaFunc)
+                                      gimp_scan_convert_stroke_area,
+                                      &context);
+    }
+  else
+    {
+      context.edges = gimp_scan_convert_get_edges (sc, off_x, off_y,
+                                                   &context.n_edges);
+
+      gimp_parallel_distribute_tiles (buffer, &rect, SCAN_CONVERT_MIN_AREA,
+                                      (GimpParallelDistributeAreaFunc)
+                                      gimp_scan_convert_fill_area,
+                                      &context);
+
+      g_free (context.edges);
+    }
+}
+
+
+/*  private functions  */
+
+static void
+gimp_scan_convert_setup_stroke (GimpScanConvert *sc,
+                                cairo_t         *cr)
+{
+  cairo_set_miter_limit (cr, sc->miter);
+
+  cairo_set_line_cap (cr,
+                      sc->cap == GIMP_CAP_BUTT ? CAIRO_LINE_CAP_BUTT :
+                      sc->cap == GIMP_CAP_ROUND ? CAIRO_LINE_CAP_ROUND :
+                      CAIRO_LINE_CAP_SQUARE);
+  cairo_set_line_join (cr,
+                       sc->join == GIMP_JOIN_MITER ? CAIRO_LINE_JOIN_MITER :
+                       sc->join == GIMP_JOIN_ROUND ? CAIRO_LINE_JOIN_ROUND :
+                       CAIRO_LINE_JOIN_BEVEL);
+
+  cairo_set_line_width (cr, sc->width);
+
+  if (sc->dash_info)
+    cairo_set_dash (cr,
+                    (double *) sc->dash_info->data,
+                    sc->dash_info->len,
+                    sc->dash_offset);
+
+  cairo_scale (cr, 1.0, sc->ratio_xy);
+}
+
+static void
+gimp_scan_convert_add_edge (GArray  *edges,
+                            gdouble  x0,
+                            gdouble  y0,
+                            gdouble  x1,
+                            gdouble  y1)
+{
+  ScanEdge edge;
+
+  /*  horizontal edges never cross a scanline  */
+  if (y0 == y1)
+    return;
+
+  if (y0 > y1)
+    {
+      gdouble tmp;
+
+      tmp = x0; x0 = x1; x1 = tmp;
+      tmp = y0; y0 = y1; y1 = tmp;
+    }
+
+  edge.x0   = x0;
+  edge.y0   = y0;
+  edge.y1   = y1;
+  edge.dxdy = (x1 - x0) / (y1 - y0);
+
+  g_array_append_val (edges, edge);
+}
+
+static void
+gimp_scan_convert_flatten_curve (GArray            *edges,
+                                 const GimpVector2 *p0,
+                                 const GimpVector2 *p1,
+                                 const GimpVector2 *p2,
+                                 const GimpVector2 *p3,
+                                 gint               depth)
+{
+  GimpVector2 p01, p12, p23;
+  GimpVector2 p012, p123;
+  GimpVector2 p0123;
+  gdouble     dx = p3->x - p0->x;
+  gdouble     dy = p3->y - p0->y;
+  gdouble     length2 = SQR (dx) + SQR (dy);
+  gboolean    flat;
+
+  if (length2 > 0.0)
+    {
+      /*  the distances of the control points from the chord, times
+       *  the chord's length
+       */
+      gdouble d1 = fabs ((p1->x - p0->x) * dy - (p1->y - p0->y) * dx);
+      gdouble d2 = fabs ((p2->x - p0->x) * dy - (p2->y - p0->y) * dx);
+
+      flat = SQR (d1 + d2) <= SQR (SCAN_CONVERT_TOLERANCE) * length2;
+    }
+  else
+    {
+      flat = (SQR (p1->x - p0->x) + SQR (p1->y - p0->y) <=
+              SQR (SCAN_CONVERT_TOLERANCE) &&
+              SQR (p2->x - p0->x) + SQR (p2->y - p0->y) <=
+              SQR (SCAN_CONVERT_TOLERANCE));
+    }
+
+  if (flat || depth == 0)
+    {
+      gimp_scan_convert_add_edge (edges, p0->x, p0->y, p3->x, p3->y);
+      return;
+    }
+
+  gimp_vector2_set (&p01,   (p0->x + p1->x) / 2.0,   (p0->y + p1->y) / 2.0);
+  gimp_vector2_set (&p12,   (p1->x + p2->x) / 2.0,   (p1->y + p2->y) / 2.0);
+  gimp_vector2_set (&p23,   (p2->x + p3->x) / 2.0,   (p2->y + p3->y) / 2.0);
+  gimp_vector2_set (&p012,  (p01.x + p12.x) / 2.0,   (p01.y + p12.y) / 2.0);
+  gimp_vector2_set (&p123,  (p12.x + p23.x) / 2.0,   (p12.y + p23.y) / 2.0);
+  gimp_vector2_set (&p0123, (p012.x + p123.x) / 2.0, (p012.y + p123.y) / 2.0);
+
+  gimp_scan_convert_flatten_curve (edges, p0, &p01, &p012, &p0123,
+                                   depth - 1);
+  gimp_scan_convert_flatten_curve (edges, &p0123, &p123, &p23, p3,
+                                   depth - 1);
+}
+
+/*  converts the path to a list of edges in buffer coordinates, sorted
+ *  by their top ends; every sub-path is implicitly closed, like cairo
+ *  does when filling
+ */
+static ScanEdge *
+gimp_scan_convert_get_edges (GimpScanConvert *sc,
+                             gdouble          off_x,
+                             gdouble          off_y,
+                             gint            *n_edges)
+{
+  const cairo_path_data_t *data   = (cairo_path_data_t *) sc->path_data->data;
+  gint                     n_data = sc->path_data->len;
+  GArray                  *edges;
+  GimpVector2              start  = { 0.0, 0.0 };
+  GimpVector2              cur    = { 0.0, 0.0 };
+  gint                     i;
+
+  edges = g_array_new (FALSE, FALSE, sizeof (ScanEdge));
+
+  for (i = 0; i < n_data; i += data[i].header.length)
+    {
+      const cairo_path_data_t *point = &data[i + 1];
+
+      switch (data[i].header.type)
+        {
+        case CAIRO_PATH_MOVE_TO:
+          gimp_scan_convert_add_edge (edges, cur.x, cur.y, start.x, start.y);
+
+          gimp_vector2_set (&start,
+                            point[0].point.x - off_x,
+                            point[0].point.y - off_y);
+          cur = start;
+          break;
+
+        case CAIRO_PATH_LINE_TO:
+          {
+            GimpVector2 p;
+
+            gimp_vector2_set (&p,
+                              point[0].point.x - off_x,
+                              point[0].point.y - off_y);
+
+            gimp_scan_convert_add_edge (edges, cur.x, cur.y, p.x, p.y);
+            cur = p;
+          }
+          break;
+
+        case CAIRO_PATH_CURVE_TO:
+          {
+            GimpVector2 p1, p2, p3;
+
+            gimp_vector2_set (&p1,
+                              point[0].point.x - off_x,
+                              point[0].point.y - off_y);
+            gimp_vector2_set (&p2,
+                              point[1].point.x - off_x,
+                              point[1].point.y - off_y);
+            gimp_vector2_set (&p3,
+                              point[2].point.x - off_x,
+                              point[2].point.y - off_y);
+
+            gimp_scan_convert_flatten_curve (edges, &cur, &p1, &p2, &p3, 16);
+            cur = p3;
+          }
+          break;
+
+        case CAIRO_PATH_CLOSE_PATH:
+          gimp_scan_convert_add_edge (edges, cur.x, cur.y, start.x, start.y);
+          cur = start;
+          break;
+        }
+    }
+
+  gimp_scan_convert_add_edge (edges, cur.x, cur.y, start.x, start.y);
+
+  g_array_sort (edges, (GCompareFunc) gimp_scan_convert_edge_cmp);
+
+  *n_edges = edges->len;
+
+  return (ScanEdge *) g_array_free (edges, FALSE);
+}
+
+static gint
+gimp_scan_convert_edge_cmp (const ScanEdge *edge1,
+                            const ScanEdge *edge2)
+{
+  if (edge1->y0 < edge2->y0)
+    return -1;
+  else if (edge1->y0 > edge2->y0)
+    return 1;
+
+  return 0;
+}
+
+/*  adds the part of the span [x1, x2) which lies inside [0, width) to
+ *  a row of coverage, the partially covered pixels are added to
+ *  @coverage directly, the fully covered ones as a difference in @cover
+ */
+static inline void
+gimp_scan_convert_add_span (gfloat  *coverage,
+                            gfloat  *cover,
+                            gint     width,
+                            gdouble  x1,
+                            gdouble  x2,
+                            gfloat   weight)
+{
+  gint ix1, ix2;
+
+  x1 = CLAMP (x1, 0.0, width);
+  x2 = CLAMP (x2, 0.0, width);
+
+  if (x1 >= x2)
+    return;
+
+  ix1 = floor (x1);
+  ix2 = floor (x2);
+
+  if (ix1 == ix2)
+    {
+      coverage[ix1] += (x2 - x1) * weight;
+    }
+  else
+    {
+      coverage[ix1] += (ix1 + 1 - x1) * weight;
+
+      cover[ix1 + 1] += weight;
+      cover[ix2]     -= weight;
+
+      if (ix2 < width)
+        coverage[ix2] += (x2 - ix2) * weight;
+    }
+}
+
+static void
+gimp_scan_convert_fill_area (const GeglRectangle *area,
+                             ScanRenderContext   *context)
+{
+  const ScanEdge *edges      = context->edges;
+  gint            n_edges    = context->n_edges;
+  ScanActiveEdge *active;
+  gint            n_active   = 0;
+  gint            max_active = 16;
+  gint            next_edge  = 0;
+  gint            n_samples;
+  gfloat          weight;
+  gfloat          value      = context->value;
+  gfloat         *coverage;
+  gfloat         *cover;
+  gint            band_height;
+  gint            band_y;
+
+  n_samples = context->antialias ? SCAN_CONVERT_SUBSAMPLES : 1;
+  weight    = 1.0 / n_samples;
+
+  band_height = CLAMP (SCAN_CONVERT_BAND_SIZE / area->width, 1, area->height);
+
+  coverage = g_new (gfloat, area->width * band_height);
+  cover    = g_new (gfloat, area->width + 1);
+  active   = g_new (ScanActiveEdge, max_active);
+
+  for (band_y = area->y;
+       band_y < area->y + area->height;
+       band_y += band_height)
+    {
+      GeglRectangle       band;
+      GeglBufferIterator *iter;
+      gint                y;
+
+      band.x      = area->x;
+      band.y      = band_y;
+      band.width  = area->width;
+      band.height = MIN (band_height, area->y + area->height - band_y);
+
+      /*  accumulate the coverage of the band's rows  */
+      for (y = 0; y < band.height; y++)
+        {
+          gfloat *row = coverage + y * band.width;
+          gfloat  sum = 0.0;
+          gint    s;
+          gint    x;
+
+          memset (row,   0, sizeof (gfloat) * band.width);
+          memset (cover, 0, sizeof (gfloat) * (band.width + 1));
+
+          for (s = 0; s < n_samples; s++)
+            {
+              gdouble sy = band.y + y + (s + 0.5) / n_samples;
+              gint    i, j;
+
+              /*  add the edges starting above the sub-scanline  */
+              while (next_edge < n_edges && edges[next_edge].y0 <= sy)
+                {
+                  if (edges[next_edge].y1 > sy)
+                    {
+                      if (n_active == max_active)
+                        {
+                          max_active *= 2;
+                          active = g_renew (ScanActiveEdge, active,
+                                            max_active);
+                        }
+
+                      active[n_active++].edge = &edges[next_edge];
+                    }
+
+                  next_edge++;
+                }
+
+              /*  drop the finished ones, and find the crossings  */
+              for (i = 0, j = 0; i < n_active; i++)
+                {
+                  const ScanEdge *edge = active[i].edge;
+
+                  if (edge->y1 > sy)
+                    {
+                      active[j].edge = edge;
+                      active[j].x    = (edge->x0 +
+                                        (sy - edge->y0) * edge->dxdy -
+                                        band.x);
+                      j++;
+                    }
+                }
+
+              n_active = j;
+
+              /*  the crossings move little between sub-scanlines,
+               *  so insertion sort is close to linear
+               */
+              for (i = 1; i < n_active; i++)
+                {
+                  ScanActiveEdge tmp = active[i];
+
+                  for (j = i; j > 0 && active[j - 1].x > tmp.x; j--)
+                    active[j] = active[j - 1];
+
+                  active[j] = tmp;
+                }
+
+              /*  even-odd rule  */
+              for (i = 0; i + 1 < n_active; i += 2)
+                {
+                  gdouble x1 = active[i].x;
+                  gdouble x2 = active[i + 1].x;
+
+                  if (! context->antialias)
+                    {
+                      /*  cover the pixels whose centers are inside  */
+                      x1 = ceil (x1 - 0.5);
+                      x2 = ceil (x2 - 0.5);
+                    }
+
+                  gimp_scan_convert_add_span (row, cover, band.width,
+                                              x1, x2, weight);
+                }
+            }
+
+          for (x = 0; x < band.width; x++)
+            {
+              sum    += cover[x];
+              row[x] += sum;
+            }
+        }
+
+      /*  and write it to the buffer  */
+      iter = gegl_buffer_iterator_new (context->buffer, &band, 0,
+                                       babl_format ("Y float"),
+                                       context->replace ?
+                                       GEGL_ACCESS_WRITE :
+                                       GEGL_ACCESS_READWRITE,
+                                       GEGL_ABYSS_NONE);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          const GeglRectangle *roi  = &iter->roi[0];
+          gfloat              *data = iter->data[0];
+
+          for (y = 0; y < roi->height; y++)
+            {
+              const gfloat *src = (coverage                            +
+                                   (roi->y - band.y + y) * band.width +
+                                   (roi->x - band.x));
+              gint          x;
+
+              if (context->replace)
+                {
+                  for (x = 0; x < roi->width; x++)
+                    data[x] = CLAMP (src[x], 0.0, 1.0) * value;
+                }
+              else
+                {
+                  for (x = 0; x < roi->width; x++)
+                    {
+                      gfloat c = CLAMP (src[x], 0.0, 1.0);
+
+                      data[x] = c * value + (1.0 - c) * data[x];
+                    }
+                }
+
+              data += roi->width;
+            }
+        }
+    }
+
+  g_free (active);
+  g_free (cover);
+  g_free (coverage);
+}
+
+static void
+gimp_scan_convert_stroke_area (const GeglRectangle *area,
+                               ScanRenderContext   *context)
+{
+  GimpScanConvert    *sc = context->sc;
+  const Babl         *format;
+  GeglBufferIterator *iter;
+  GeglRectangle      *roi;
+  cairo_path_t        path;
+  guchar             *tmp_buf      = NULL;
+  gsize               tmp_buf_size = 0;
+  gint                bpp;
+
   path.status   = CAIRO_STATUS_SUCCESS;
   path.data     = (cairo_path_data_t *) sc->path_data->data;
   path.num_data = sc->path_data->len;
@@ -481,16 +1045,26 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
   format = babl_format ("Y u8");
   bpp    = babl_format_get_bytes_per_pixel (format);
 
-  iter = gegl_buffer_iterator_new (buffer, NULL, 0, format,
+  iter = gegl_buffer_iterator_new (context->buffer, area, 0, format,
                                    GEGL_ACCESS_READWRITE, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
   while (gegl_buffer_iterator_next (iter))
     {
-      guchar     *data    = iter->data[0];
-      guchar     *tmp_buf = NULL;
-      const gint  stride  = cairo_format_stride_for_width (CAIRO_FORMAT_A8,
-                                                           roi->width);
+      guchar          *data    = iter->data[0];
+      gboolean         use_tmp = FALSE;
+      cairo_surface_t *surface;
+      cairo_t         *cr;
+      const gint       stride  = cairo_format_stride_for_width (CAIRO_FORMAT_A8,
+                                                                roi->width);
+
+      if (! gegl_rectangle_intersect (NULL, roi, &context->extents))
+        {
+          if (context->replace)
+            memset (data, 0, roi->width * roi->height * bpp);
+
+          continue;
+        }
 
       /*  cairo rowstrides are always multiples of 4, whereas
        *  maskPR.rowstride can be anything, so to be able to create an
@@ -499,9 +1073,15 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
        */
       if (roi->width * bpp != stride)
         {
-          tmp_buf = g_alloca (stride * roi->height);
+          use_tmp = TRUE;
+
+          if (tmp_buf_size < (gsize) (stride * roi->height))
+            {
+              tmp_buf_size = stride * roi->height;
+              tmp_buf      = g_realloc (tmp_buf, tmp_buf_size);
+            }
 
-          if (! replace)
+          if (! context->replace)
             {
               const guchar *src  = data;
               guchar       *dest = tmp_buf;
@@ -517,63 +1097,37 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
             }
         }
 
-      surface = cairo_image_surface_create_for_data (tmp_buf ?
+      surface = cairo_image_surface_create_for_data (use_tmp ?
                                                      tmp_buf : data,
                                                      CAIRO_FORMAT_A8,
                                                      roi->width, roi->height,
                                                      stride);
 
       cairo_surface_set_device_offset (surface,
-                                       -off_x - roi->x,
-                                       -off_y - roi->y);
+                                       -context->off_x - roi->x,
+                                       -context->off_y - roi->y);
       cr = cairo_create (surface);
       cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
 
-      if (replace)
+      if (context->replace)
         {
           cairo_set_source_rgba (cr, 0, 0, 0, 0);
           cairo_paint (cr);
         }
 
-      cairo_set_source_rgba (cr, 0, 0, 0, value);
+      cairo_set_source_rgba (cr, 0, 0, 0, context->value);
       cairo_append_path (cr, &path);
 
-      cairo_set_antialias (cr, antialias ?
+      cairo_set_antialias (cr, context->antialias ?
                            CAIRO_ANTIALIAS_GRAY : CAIRO_ANTIALIAS_NONE);
-      cairo_set_miter_limit (cr, sc->miter);
 
-      if (sc->do_stroke)
-        {
-          cairo_set_line_cap (cr,
-                              sc->cap == GIMP_CAP_BUTT ? CAIRO_LINE_CAP_BUTT :
-                              sc->cap == GIMP_CAP_ROUND ? CAIRO_LINE_CAP_ROUND :
-                              CAIRO_LINE_CAP_SQUARE);
-          cairo_set_line_join (cr,
-                               sc->join == GIMP_JOIN_MITER ? CAIRO_LINE_JOIN_MITER :
-                               sc->join == GIMP_JOIN_ROUND ? CAIRO_LINE_JOIN_ROUND :
-                               CAIRO_LINE_JOIN_BEVEL);
-
-          cairo_set_line_width (cr, sc->width);
-
-          if (sc->dash_info)
-            cairo_set_dash (cr,
-                            (double *) sc->dash_info->data,
-                            sc->dash_info->len,
-                            sc->dash_offset);
-
-          cairo_scale (cr, 1.0, sc->ratio_xy);
-          cairo_stroke (cr);
-        }
-      else
-        {
-          cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
-          cairo_fill (cr);
-        }
+      gimp_scan_convert_setup_stroke (sc, cr);
+      cairo_stroke (cr);
 
       cairo_destroy (cr);
       cairo_surface_destroy (surface);
 
-      if (tmp_buf)
+      if (use_tmp)
         {
           const guchar *src  = tmp_buf;
           guchar       *dest = data;
@@ -588,4 +1142,6 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
             }
         }
     }
+
+  g_free (tmp_buf);
 }
@@ -33,6 +33,7 @@
 #include "core/gimpdrawable.h"
 #include "core/gimpimage.h"
 #include "core/gimppickable.h"
+#include "core/gimpprojection.h"
 #ifdef USE_NODE_BLIT
 #include "core/gimpprojectable.h"
 #endif
@@ -50,6 +51,99 @@
 /* #define GIMP_DISPLAY_RENDER_ENABLE_SCALING 1 */
 
 
+static gdouble   gimp_display_shell_render_get_scale (GimpDisplayShell *shell,
+                                                      gdouble          *scale_x,
+                                                      gdouble          *scale_y);
+
+
+/*  public functions  */
+
+/**
+ * gimp_display_shell_render_get_level:
+ * @shell: a #GimpDisplayShell
+ *
+ * Return value: the mipmap level of the image's projection which
+ *               gimp_display_shell_render() reads from at the shell's
+ *               current scale, including the window's scale factor.
+ **/
+gint
+gimp_display_shell_render_get_level (GimpDisplayShell *shell)
+{
+  GimpImage *image;
+  gdouble    buffer_scale;
+
+  g_return_val_if_fail (GIMP_IS_DISPLAY_SHELL (shell), 0);
+
+  image = gimp_display_get_image (shell->display);
+
+  if (! image)
+    return 0;
+
+  buffer_scale = gimp_display_shell_render_get_scale (shell, NULL, NULL);
+
+  return gimp_projection_get_level (gimp_image_get_projection (image),
+                                    buffer_scale, buffer_scale);
+}
+
+/**
+ * gimp_display_shell_render_update_level:
+ * @shell: a #GimpDisplayShell
+ *
+ * Tells the projection of the shell's image which mipmap level the
+ * shell reads from, so the projection renders updates into it, and
+ * withdraws the level previously set, if any.  Call this whenever the
+ * level returned by gimp_display_shell_render_get_level() may have
+ * changed, and gimp_display_shell_render_release_level() when the
+ * shell stops showing the image.
+ **/
+void
+gimp_display_shell_render_update_level (GimpDisplayShell *shell)
+{
+  GimpImage      *image;
+  GimpProjection *projection = NULL;
+  gint            level      = 0;
+
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  image = gimp_display_get_image (shell->display);
+
+  if (image)
+    {
+      projection = gimp_image_get_projection (image);
+      level      = gimp_display_shell_render_get_level (shell);
+    }
+
+  if (projection == shell->render_projection &&
+      level      == shell->render_level)
+    return;
+
+  gimp_display_shell_render_release_level (shell);
+
+  if (projection)
+    {
+      shell->render_projection = g_object_ref (projection);
+      shell->render_level      = level;
+
+      gimp_projection_add_priority_level (projection, level);
+    }
+}
+
+void
+gimp_display_shell_render_release_level (GimpDisplayShell *shell)
+{
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  if (shell->render_projection)
+    {
+      gimp_projection_remove_priority_level (shell->render_projection,
+                                             shell->render_level);
+
+      g_object_unref (shell->render_projection);
+      shell->render_projection = NULL;
+      shell->render_level      = 0;
+    }
+}
+
 void
 gimp_display_shell_render (GimpDisplayShell *shell,
                            cairo_t          *cr,
@@ -59,6 +153,7 @@ gimp_display_shell_render (GimpDisplayShell *shell,
                            gint              h)
 {
   GimpImage       *image;
+  GimpProjection  *projection;
   GeglBuffer      *buffer;
 #ifdef USE_NODE_BLIT
   GeglNode        *node;
@@ -66,6 +161,8 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   gdouble          scale_x       = 1.0;
   gdouble          scale_y       = 1.0;
   gdouble          buffer_scale  = 1.0;
+  gdouble          level_scale;
+  gint             level;
   gint             viewport_offset_x;
   gint             viewport_offset_y;
   gint             viewport_width;
@@ -87,36 +184,22 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   g_return_if_fail (cr != NULL);
   g_return_if_fail (w > 0 && h > 0);
 
-  image  = gimp_display_get_image (shell->display);
-  buffer = gimp_pickable_get_buffer (GIMP_PICKABLE (image));
+  image      = gimp_display_get_image (shell->display);
+  projection = gimp_image_get_projection (image);
 #ifdef USE_NODE_BLIT
   node   = gimp_projectable_get_graph (GIMP_PROJECTABLE (image));
 #endif
 
-#ifdef GIMP_DISPLAY_RENDER_ENABLE_SCALING
-  /* if we had this future API, things would look pretty on hires (retina) */
-  scale_x = gdk_window_get_scale_factor (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
-#endif
-
-  scale_x = MIN (scale_x, GIMP_DISPLAY_RENDER_MAX_SCALE);
-  scale_y = scale_x;
-
-  if (shell->scale_x > shell->scale_y)
-    {
-      scale_y *= (shell->scale_x / shell->scale_y);
+  buffer_scale = gimp_display_shell_render_get_scale (shell,
+                                                      &scale_x, &scale_y);
 
-      buffer_scale = shell->scale_y * scale_y;
-    }
-  else if (shell->scale_y > shell->scale_x)
-    {
-      scale_x *= (shell->scale_y / shell->scale_x);
-
-      buffer_scale = shell->scale_x * scale_x;
-    }
-  else
-    {
-      buffer_scale = shell->scale_x * scale_x;
-    }
+  /*  when zoomed out, read from the matching mipmap level of the
+   *  projection, which is rendered at reduced resolution
+   */
+  level       = gimp_projection_get_level (projection,
+                                           buffer_scale, buffer_scale);
+  buffer      = gimp_projection_get_level_buffer (projection, level);
+  level_scale = buffer_scale * (1 << level);
 
   gimp_display_shell_scroll_get_scaled_viewport (shell,
                                                  &viewport_offset_x,
@@ -203,7 +286,7 @@ gimp_display_shell_render (GimpDisplayShell *shell,
           gegl_buffer_get (buffer,
                            GEGL_RECTANGLE (scaled_x, scaled_y,
                                            scaled_width, scaled_height),
-                           buffer_scale,
+                           level_scale,
                            shell->profile_src_format,
                            shell->profile_data, shell->profile_stride,
                            GEGL_ABYSS_CLAMP);
@@ -257,7 +340,7 @@ gimp_display_shell_render (GimpDisplayShell *shell,
           gegl_buffer_get (buffer,
                            GEGL_RECTANGLE (scaled_x, scaled_y,
                                            scaled_width, scaled_height),
-                           buffer_scale,
+                           level_scale,
                            shell->filter_format,
                            shell->filter_data, shell->filter_stride,
                            GEGL_ABYSS_CLAMP);
@@ -306,7 +389,7 @@ gimp_display_shell_render (GimpDisplayShell *shell,
       gegl_buffer_get (buffer,
                        GEGL_RECTANGLE (scaled_x, scaled_y,
                                        scaled_width, scaled_height),
-                       buffer_scale,
+                       level_scale,
                        babl_format ("cairo-ARGB32"),
                        cairo_data, cairo_stride,
                        GEGL_ABYSS_CLAMP);
@@ -407,3 +490,50 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 
   cairo_restore (cr);
 }
+
+
+/*  private functions  */
+
+/* Returns the scale the projection is read at, and in @scale_x and
+ * @scale_y the factors from display coordinates to the pixels of the
+ * transfer surface, which include the window's scale factor.
+ */
+static gdouble
+gimp_display_shell_render_get_scale (GimpDisplayShell *shell,
+                                     gdouble          *scale_x,
+                                     gdouble          *scale_y)
+{
+  gdouble window_scale_x = 1.0;
+  gdouble window_scale_y;
+  gdouble buffer_scale;
+
+#ifdef GIMP_DISPLAY_RENDER_ENABLE_SCALING
+  /* if we had this future API, things would look pretty on hires (retina) */
+  window_scale_x = gdk_window_get_scale_factor (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
+#endif
+
+  window_scale_x = MIN (window_scale_x, GIMP_DISPLAY_RENDER_MAX_SCALE);
+  window_scale_y = window_scale_x;
+
+  if (shell->scale_x > shell->scale_y)
+    {
+      window_scale_y *= (shell->scale_x / shell->scale_y);
+
+      buffer_scale = shell->scale_y * window_scale_y;
+    }
+  else if (shell->scale_y > shell->scale_x)
+    {
+      window_scale_x *= (shell->scale_y / shell->scale_x);
+
+      buffer_scale = shell->scale_x * window_scale_x;
+    }
+  else
+    {
+      buffer_scale = shell->scale_x * window_scale_x;
+    }
+
+  if (scale_x) *scale_x = window_scale_x;
+  if (scale_y) *scale_y = window_scale_y;
+
+  return buffer_scale;
+}
@@ -18,11 +18,15 @@
 #ifndef __GIMP_DISPLAY_SHELL_RENDER_H__
 #define __GIMP_DISPLAY_SHELL_RENDER_H__
 
-void  gimp_display_shell_render (GimpDisplayShell *shell,
-                                 cairo_t          *cr,
-                                 gint              x,
-                                 gint              y,
-                                 gint              w,
-                                 gint              h);
+gint  gimp_display_shell_render_get_level     (GimpDisplayShell *shell);
+void  gimp_display_shell_render_update_level  (GimpDisplayShell *shell);
+void  gimp_display_shell_render_release_level (GimpDisplayShell *shell);
+
+void  gimp_display_shell_render               (GimpDisplayShell *shell,
+                                               cairo_t          *cr,
+                                               gint              x,
+                                               gint              y,
+                                               gint              w,
+                                               gint              h);
 
 #endif  /*  __GIMP_DISPLAY_SHELL_RENDER_H__  */
@@ -17,9 +17,13 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gegl.h>
 #include <gtk/gtk.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "display-types.h"
 
 #include "config/gimpdisplayconfig.h"
@@ -39,6 +43,17 @@
 #include "gimpdisplayshell-transform.h"
 
 
+/*  size of the window tiles the inner boundary is bucketed into  */
+#define SELECTION_TILE_SIZE 128
+
+
+typedef struct
+{
+  GimpSegment      *segs;             /*  segments touching the tile        */
+  gint              n_segs;
+  cairo_pattern_t  *mask;             /*  the rendered segments, or NULL    */
+} SelectionTile;
+
 struct _Selection
 {
   GimpDisplayShell *shell;            /*  shell that owns the selection     */
@@ -54,7 +69,12 @@ struct _Selection
   gboolean          shell_visible;    /*  visility of the display shell     */
   gboolean          show_selection;   /*  is the selection visible?         */
   guint             timeout;          /*  timer for successive draws        */
-  cairo_pattern_t  *segs_in_mask;     /*  cache for rendered segments       */
+
+  SelectionTile    *tiles;            /*  segs_in, bucketed by window tile  */
+  gint              n_tile_cols;
+  gint              n_tile_rows;
+  gboolean          tiles_rotated;    /*  tiles_transform is valid          */
+  cairo_matrix_t    tiles_transform;  /*  rotation the tiles were made for  */
 };
 
 
@@ -66,7 +86,12 @@ static void      selection_stop           (Selection          *selection);
 static void      selection_draw           (Selection          *selection);
 static void      selection_undraw         (Selection          *selection);
 
-static void      selection_render_mask    (Selection          *selection);
+static void      selection_update_tiles   (Selection          *selection);
+static void      selection_render_tile    (Selection          *selection,
+                                           SelectionTile      *tile,
+                                           gint                x,
+                                           gint                y);
+static void      selection_free_tiles     (Selection          *selection);
 
 static void      selection_zoom_segs      (Selection          *selection,
                                            const GimpBoundSeg *src_segs,
@@ -132,6 +157,7 @@ gimp_display_shell_selection_free (GimpDisplayShell *shell)
                                         selection);
 
   selection_free_segs (selection);
+  selection_free_tiles (selection);
 
   g_slice_free (Selection, selection);
 
@@ -152,6 +178,7 @@ gimp_display_shell_selection_undraw (GimpDisplayShell *shell)
     {
       selection_stop (shell->selection);
       selection_free_segs (shell->selection);
+      selection_free_tiles (shell->selection);
     }
 }
 
@@ -251,12 +278,30 @@ selection_draw (Selection *selection)
   if (selection->segs_in)
     {
       cairo_t *cr;
+      gint     x, y;
 
       cr = gdk_cairo_create (gtk_widget_get_window (selection->shell->canvas));
 
-      gimp_display_shell_draw_selection_in (selection->shell, cr,
-                                            selection->segs_in_mask,
-                                            selection->index % 8);
+      /*  only paint the tiles the boundary passes through  */
+      for (y = 0; y < selection->n_tile_rows; y++)
+        for (x = 0; x < selection->n_tile_cols; x++)
+          {
+            SelectionTile *tile;
+
+            tile = &selection->tiles[y * selection->n_tile_cols + x];
+
+            if (! tile->segs)
+              continue;
+
+            if (! tile->mask)
+              selection_render_tile (selection, tile,
+                                     x * SELECTION_TILE_SIZE,
+                                     y * SELECTION_TILE_SIZE);
+
+            gimp_display_shell_draw_selection_in (selection->shell, cr,
+                                                  tile->mask,
+                                                  selection->index % 8);
+          }
 
       cairo_destroy (cr);
     }
@@ -281,35 +326,184 @@ selection_undraw (Selection *selection)
 }
 
 static void
-selection_render_mask (Selection *selection)
+selection_update_tiles (Selection *selection)
+{
+  GimpDisplayShell  *shell  = selection->shell;
+  GdkWindow         *window = gtk_widget_get_window (shell->canvas);
+  GArray           **tile_segs;
+  gint               n_cols;
+  gint               n_rows;
+  gint               i;
+
+  n_cols = (gdk_window_get_width  (window) + SELECTION_TILE_SIZE - 1) /
+           SELECTION_TILE_SIZE;
+  n_rows = (gdk_window_get_height (window) + SELECTION_TILE_SIZE - 1) /
+           SELECTION_TILE_SIZE;
+
+  /*  the rendered tiles can only be reused if neither the window size
+   *  nor the rotation changed
+   */
+  if (n_cols != selection->n_tile_cols                        ||
+      n_rows != selection->n_tile_rows                        ||
+      ! shell->rotate_transform != ! selection->tiles_rotated ||
+      (shell->rotate_transform &&
+       memcmp (shell->rotate_transform, &selection->tiles_transform,
+               sizeof (cairo_matrix_t))))
+    {
+      selection_free_tiles (selection);
+
+      selection->tiles       = g_new0 (SelectionTile, n_cols * n_rows);
+      selection->n_tile_cols = n_cols;
+      selection->n_tile_rows = n_rows;
+
+      if (shell->rotate_transform)
+        {
+          selection->tiles_rotated   = TRUE;
+          selection->tiles_transform = *shell->rotate_transform;
+        }
+    }
+
+  /*  bucket the segments by the tiles their window extents touch  */
+  tile_segs = g_new0 (GArray *, n_cols * n_rows);
+
+  for (i = 0; i < selection->n_segs_in; i++)
+    {
+      const GimpSegment *seg = &selection->segs_in[i];
+      gdouble            x1  = seg->x1;
+      gdouble            y1  = seg->y1;
+      gdouble            x2  = seg->x2;
+      gdouble            y2  = seg->y2;
+      gint               tx1, ty1;
+      gint               tx2, ty2;
+      gint               tx, ty;
+
+      if (shell->rotate_transform)
+        {
+          cairo_matrix_transform_point (shell->rotate_transform, &x1, &y1);
+          cairo_matrix_transform_point (shell->rotate_transform, &x2, &y2);
+        }
+
+      /*  leave room for the line width  */
+      tx1 = floor ((MIN (x1, x2) - 1.0) / SELECTION_TILE_SIZE);
+      ty1 = floor ((MIN (y1, y2) - 1.0) / SELECTION_TILE_SIZE);
+      tx2 = floor ((MAX (x1, x2) + 2.0) / SELECTION_TILE_SIZE);
+      ty2 = floor ((MAX (y1, y2) + 2.0) / SELECTION_TILE_SIZE);
+
+      tx1 = MAX (tx1, 0);
+      ty1 = MAX (ty1, 0);
+      tx2 = MIN (tx2, n_cols - 1);
+      ty2 = MIN (ty2, n_rows - 1);
+
+      for (ty = ty1; ty <= ty2; ty++)
+        for (tx = tx1; tx <= tx2; tx++)
+          {
+            GArray **array = &tile_segs[ty * n_cols + tx];
+
+            if (! *array)
+              *array = g_array_new (FALSE, FALSE, sizeof (GimpSegment));
+
+            g_array_append_val (*array, *seg);
+          }
+    }
+
+  /*  keep the tiles whose segments didn't change, so editing the
+   *  selection only renders the touched tiles again
+   */
+  for (i = 0; i < n_cols * n_rows; i++)
+    {
+      SelectionTile *tile  = &selection->tiles[i];
+      GArray        *array = tile_segs[i];
+
+      if (array                             &&
+          tile->segs                        &&
+          (gint) array->len == tile->n_segs &&
+          ! memcmp (array->data, tile->segs,
+                    array->len * sizeof (GimpSegment)))
+        {
+          g_array_free (array, TRUE);
+          continue;
+        }
+
+      g_free (tile->segs);
+      tile->segs   = NULL;
+      tile->n_segs = 0;
+
+      if (tile->mask)
+        {
+          cairo_pattern_destroy (tile->mask);
+          tile->mask = NULL;
+        }
+
+      if (array)
+        {
+          tile->n_segs = array->len;
+          tile->segs   = (GimpSegment *) g_array_free (array, FALSE);
+        }
+    }
+
+  g_free (tile_segs);
+}
+
+static void
+selection_render_tile (Selection     *selection,
+                       SelectionTile *tile,
+                       gint           x,
+                       gint           y)
 {
   GdkWindow       *window;
   cairo_surface_t *surface;
+  cairo_matrix_t   matrix;
   cairo_t         *cr;
 
   window = gtk_widget_get_window (selection->shell->canvas);
   surface = gdk_window_create_similar_surface (window, CAIRO_CONTENT_ALPHA,
-                                               gdk_window_get_width  (window),
-                                               gdk_window_get_height (window));
+                                               SELECTION_TILE_SIZE,
+                                               SELECTION_TILE_SIZE);
   cr = cairo_create (surface);
 
   cairo_set_line_cap (cr, CAIRO_LINE_CAP_SQUARE);
   cairo_set_line_width (cr, 1.0);
 
+  cairo_translate (cr, -x, -y);
+
   if (selection->shell->rotate_transform)
     cairo_transform (cr, selection->shell->rotate_transform);
 
-  gimp_cairo_add_segments (cr,
-                           selection->segs_in,
-                           selection->n_segs_in);
+  gimp_cairo_add_segments (cr, tile->segs, tile->n_segs);
   cairo_stroke (cr);
 
-  selection->segs_in_mask = cairo_pattern_create_for_surface (surface);
+  tile->mask = cairo_pattern_create_for_surface (surface);
+
+  cairo_matrix_init_translate (&matrix, -x, -y);
+  cairo_pattern_set_matrix (tile->mask, &matrix);
 
   cairo_destroy (cr);
   cairo_surface_destroy (surface);
 }
 
+static void
+selection_free_tiles (Selection *selection)
+{
+  gint i;
+
+  for (i = 0; i < selection->n_tile_cols * selection->n_tile_rows; i++)
+    {
+      SelectionTile *tile = &selection->tiles[i];
+
+      g_free (tile->segs);
+
+      if (tile->mask)
+        cairo_pattern_destroy (tile->mask);
+    }
+
+  g_free (selection->tiles);
+
+  selection->tiles         = NULL;
+  selection->n_tile_cols   = 0;
+  selection->n_tile_rows   = 0;
+  selection->tiles_rotated = FALSE;
+}
+
 static void
 selection_zoom_segs (Selection          *selection,
                      const GimpBoundSeg *src_segs,
@@ -374,14 +568,14 @@ selection_generate_segs (Selection *selection)
       selection->segs_in = g_new (GimpSegment, selection->n_segs_in);
       selection_zoom_segs (selection, segs_in,
                            selection->segs_in, selection->n_segs_in);
-
-      selection_render_mask (selection);
     }
   else
     {
       selection->segs_in = NULL;
     }
 
+  selection_update_tiles (selection);
+
   /*  Possible secondary boundary representation  */
   if (selection->n_segs_out)
     {
@@ -411,12 +605,6 @@ selection_free_segs (Selection *selection)
       selection->segs_out   = NULL;
       selection->n_segs_out = 0;
     }
-
-  if (selection->segs_in_mask)
-    {
-      cairo_pattern_destroy (selection->segs_in_mask);
-      selection->segs_in_mask = NULL;
-    }
 }
 
 static gboolean
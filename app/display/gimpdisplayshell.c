@@ -788,6 +788,8 @@ gimp_display_shell_dispose (GObject *object)
   if (shell->display && gimp_display_get_shell (shell->display))
     gimp_display_shell_disconnect (shell);
 
+  gimp_display_shell_render_release_level (shell);
+
   shell->popup_manager = NULL;
 
   if (shell->selection)
@@ -1076,6 +1078,11 @@ gimp_display_shell_real_scaled (GimpDisplayShell *shell)
 
   gimp_display_shell_title_update (shell);
 
+  /*  let the projection render updates directly at the resolution
+   *  they are shown at, regardless of which display is active
+   */
+  gimp_display_shell_render_update_level (shell);
+
   user_context = gimp_get_user_context (shell->display->gimp);
 
   if (shell->display == gimp_context_get_display (user_context))
@@ -84,6 +84,9 @@ struct _GimpDisplayShell
 
   gdouble            other_scale;      /*  scale factor entered in Zoom->Other*/
 
+  GimpProjection    *render_projection;/*  projection render_level is set on  */
+  gint               render_level;     /*  mipmap level the shell reads from  */
+
   gint               disp_width;       /*  width of drawing area              */
   gint               disp_height;      /*  height of drawing area             */
 
@@ -36,6 +36,43 @@
 #include "gegl/gimp-gegl-utils.h"
 
 
+/*  the size of the chunks which are rendered by the render thread,
+ *  they are aligned to multiples of it, and so to the tile grid
+ */
+#define CHUNK_SIZE           256
+
+/*  how often, in microseconds, the progress is updated and, if the
+ *  operation is cancellable, pending events are processed
+ */
+#define PROGRESS_INTERVAL    (G_TIME_SPAN_SECOND / 50)
+
+
+typedef struct
+{
+  GeglNode            *dest_node;
+  const GeglRectangle *chunks;
+  gint                 n_chunks;
+
+  gint                 cancel;      /*  atomic  */
+
+  gint64               n_pixels_done;
+  gboolean             finished;
+  GMutex               mutex;
+  GCond                cond;
+} GimpGeglApplyOperationData;
+
+
+/*  local function prototypes  */
+
+static void       gimp_gegl_apply_operation_cancel (GimpProgress               *progress,
+                                                    gint                       *cancel);
+static void       gimp_gegl_apply_operation_split  (GArray                     *chunks,
+                                                    const GeglRectangle        *rect);
+static gpointer   gimp_gegl_apply_operation_thread (GimpGeglApplyOperationData *data);
+
+
+/*  public functions  */
+
 void
 gimp_gegl_apply_operation (GeglBuffer          *src_buffer,
                            GimpProgress        *progress,
@@ -53,13 +90,25 @@ gimp_gegl_apply_operation (GeglBuffer          *src_buffer,
                                     FALSE);
 }
 
-static void
-gimp_gegl_apply_operation_cancel (GimpProgress *progress,
-                                  gboolean     *cancel)
-{
-  *cancel = TRUE;
-}
-
+/**
+ * gimp_gegl_apply_cached_operation:
+ *
+ * Renders @operation into @dest_rect of @dest_buffer, skipping the
+ * @valid_rects which are copied from @cache instead.
+ *
+ * Without @progress, the area is rendered in one go on the calling
+ * thread.  With @progress, it is split into tile aligned chunks which
+ * are rendered one after the other on a single separate thread, while
+ * the calling thread updates @progress.  If @cancellable, the calling
+ * thread keeps processing events meanwhile, so the rest of the user
+ * interface stays usable, and the rendering stops when @progress is
+ * cancelled.  It's up to the caller to protect @dest_buffer from other
+ * changes during that time, to make sure nothing else processes
+ * @operation meanwhile, and to roll @dest_buffer back when this
+ * function returns %FALSE.
+ *
+ * Return value: %FALSE if the operation was cancelled.
+ **/
 gboolean
 gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
                                   GimpProgress        *progress,
@@ -72,13 +121,11 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
                                   gint                 n_valid_rects,
                                   gboolean             cancellable)
 {
-  GeglNode      *gegl;
-  GeglNode      *dest_node;
-  GeglRectangle  rect = { 0, };
-  GeglProcessor *processor        = NULL;
-  gboolean       progress_started = FALSE;
-  gdouble        value;
-  gboolean       cancel           = FALSE;
+  GeglNode                   *gegl;
+  GeglNode                   *dest_node;
+  GeglRectangle               rect = { 0, };
+  gboolean                    progress_started = FALSE;
+  GimpGeglApplyOperationData  data             = { 0, };
 
   g_return_val_if_fail (src_buffer == NULL || GEGL_IS_BUFFER (src_buffer), FALSE);
   g_return_val_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress), FALSE);
@@ -108,7 +155,7 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
       GeglNode *src_node;
 
       /* dup() because reading and writing the same buffer doesn't
-       * work with area ops when using a processor. See bug #701875.
+       * work with area ops when rendering in chunks. See bug #701875.
        */
       if (progress && (src_buffer == dest_buffer))
         src_buffer = gegl_buffer_dup (src_buffer);
@@ -136,8 +183,6 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
 
   if (progress)
     {
-      processor = gegl_node_new_processor (dest_node, &rect);
-
       if (gimp_progress_is_active (progress))
         {
           if (undo_desc)
@@ -153,24 +198,23 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
           if (cancellable)
             g_signal_connect (progress, "cancel",
                               G_CALLBACK (gimp_gegl_apply_operation_cancel),
-                              &cancel);
+                              &data.cancel);
 
           progress_started = TRUE;
         }
     }
 
-  if (cache)
+  if (cache || progress)
     {
       cairo_region_t *region;
-      gint            all_pixels;
-      gint            done_pixels = 0;
+      GArray         *chunks;
+      gint64          n_pixels;
+      gint64          n_pending = 0;
       gint            n_rects;
       gint            i;
 
       region = cairo_region_create_rectangle ((cairo_rectangle_int_t *) &rect);
 
-      all_pixels = rect.width * rect.height;
-
       for (i = 0; i < n_valid_rects; i++)
         {
           gegl_buffer_copy (cache,       valid_rects + i, GEGL_ABYSS_NONE,
@@ -179,81 +223,96 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
           cairo_region_subtract_rectangle (region,
                                            (cairo_rectangle_int_t *)
                                            valid_rects + i);
-
-          done_pixels += valid_rects[i].width * valid_rects[i].height;
-
-          if (progress)
-            gimp_progress_set_value (progress,
-                                     (gdouble) done_pixels /
-                                     (gdouble) all_pixels);
         }
 
+      chunks  = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
       n_rects = cairo_region_num_rectangles (region);
 
-      for (i = 0; ! cancel && (i < n_rects); i++)
+      for (i = 0; i < n_rects; i++)
         {
-          cairo_rectangle_int_t render_rect;
+          GeglRectangle render_rect;
 
-          cairo_region_get_rectangle (region, i, &render_rect);
+          cairo_region_get_rectangle (region, i,
+                                      (cairo_rectangle_int_t *) &render_rect);
 
           if (progress)
-            {
-              gint rect_pixels = render_rect.width * render_rect.height;
-
-#ifdef REUSE_PROCESSOR
-              gegl_processor_set_rectangle (processor,
-                                            (GeglRectangle *) &render_rect);
-#else
-              g_object_unref (processor);
-              processor = gegl_node_new_processor (dest_node,
-                                                   (GeglRectangle *) &render_rect);
-#endif
-
-              while (! cancel && gegl_processor_work (processor, &value))
-                {
-                  gimp_progress_set_value (progress,
-                                           ((gdouble) done_pixels +
-                                            value * rect_pixels) /
-                                           (gdouble) all_pixels);
-
-                  if (cancellable)
-                    while (! cancel && g_main_context_pending (NULL))
-                      g_main_context_iteration (NULL, FALSE);
-                }
-
-              done_pixels += rect_pixels;
-            }
+            gimp_gegl_apply_operation_split (chunks, &render_rect);
           else
-            {
-              gegl_node_blit (dest_node, 1.0, (GeglRectangle *) &render_rect,
-                              NULL, NULL, 0, GEGL_BLIT_DEFAULT);
-            }
+            g_array_append_val (chunks, render_rect);
         }
 
       cairo_region_destroy (region);
-    }
-  else
-    {
-      if (progress)
+
+      data.dest_node = dest_node;
+      data.chunks    = (const GeglRectangle *) chunks->data;
+      data.n_chunks  = chunks->len;
+
+      /*  the progress counts pixels, those copied from the cache are
+       *  done already
+       */
+      n_pixels = (gint64) rect.width * rect.height;
+
+      for (i = 0; i < data.n_chunks; i++)
+        n_pending += (gint64) data.chunks[i].width * data.chunks[i].height;
+
+      if (progress && data.n_chunks > 0)
         {
-          while (! cancel && gegl_processor_work (processor, &value))
+          GThread *thread;
+          gint64   n_done;
+
+          g_mutex_init (&data.mutex);
+          g_cond_init (&data.cond);
+
+          thread = g_thread_new ("apply-operation",
+                                 (GThreadFunc) gimp_gegl_apply_operation_thread,
+                                 &data);
+
+          g_mutex_lock (&data.mutex);
+
+          while (! data.finished)
             {
-              gimp_progress_set_value (progress, value);
+              g_cond_wait_until (&data.cond, &data.mutex,
+                                 g_get_monotonic_time () + PROGRESS_INTERVAL);
+
+              if (data.finished)
+                break;
+
+              n_done = n_pixels - n_pending + data.n_pixels_done;
+
+              g_mutex_unlock (&data.mutex);
+
+              gimp_progress_set_value (progress,
+                                       (gdouble) n_done / (gdouble) n_pixels);
 
               if (cancellable)
-                while (! cancel && g_main_context_pending (NULL))
+                while (! g_atomic_int_get (&data.cancel) &&
+                       g_main_context_pending (NULL))
                   g_main_context_iteration (NULL, FALSE);
+
+              g_mutex_lock (&data.mutex);
             }
+
+          g_mutex_unlock (&data.mutex);
+
+          g_thread_join (thread);
+
+          g_cond_clear (&data.cond);
+          g_mutex_clear (&data.mutex);
         }
       else
         {
-          gegl_node_blit (dest_node, 1.0, &rect,
-                          NULL, NULL, 0, GEGL_BLIT_DEFAULT);
+          for (i = 0; i < data.n_chunks; i++)
+            gegl_node_blit (dest_node, 1.0, &data.chunks[i],
+                            NULL, NULL, 0, GEGL_BLIT_DEFAULT);
         }
-    }
 
-  if (processor)
-    g_object_unref (processor);
+      g_array_free (chunks, TRUE);
+    }
+  else
+    {
+      gegl_node_blit (dest_node, 1.0, &rect,
+                      NULL, NULL, 0, GEGL_BLIT_DEFAULT);
+    }
 
   g_object_unref (gegl);
 
@@ -264,10 +323,10 @@ gimp_gegl_apply_cached_operation (GeglBuffer          *src_buffer,
       if (cancellable)
         g_signal_handlers_disconnect_by_func (progress,
                                               gimp_gegl_apply_operation_cancel,
-                                              &cancel);
+                                              &data.cancel);
     }
 
-  return ! cancel;
+  return ! g_atomic_int_get (&data.cancel);
 }
 
 void
@@ -621,3 +680,73 @@ gimp_gegl_apply_transform (GeglBuffer            *src_buffer,
                              node, dest_buffer, NULL);
   g_object_unref (node);
 }
+
+
+/*  private functions  */
+
+static void
+gimp_gegl_apply_operation_cancel (GimpProgress *progress,
+                                  gint         *cancel)
+{
+  g_atomic_int_set (cancel, TRUE);
+}
+
+static void
+gimp_gegl_apply_operation_split (GArray              *chunks,
+                                 const GeglRectangle *rect)
+{
+  gint x1 = rect->x;
+  gint y1 = rect->y;
+  gint x2 = rect->x + rect->width;
+  gint y2 = rect->y + rect->height;
+  gint x, y;
+
+  for (y = y1; y < y2; y = (y / CHUNK_SIZE + 1) * CHUNK_SIZE)
+    {
+      gint height = MIN ((y / CHUNK_SIZE + 1) * CHUNK_SIZE, y2) - y;
+
+      for (x = x1; x < x2; x = (x / CHUNK_SIZE + 1) * CHUNK_SIZE)
+        {
+          GeglRectangle chunk;
+
+          chunk.x      = x;
+          chunk.y      = y;
+          chunk.width  = MIN ((x / CHUNK_SIZE + 1) * CHUNK_SIZE, x2) - x;
+          chunk.height = height;
+
+          g_array_append_val (chunks, chunk);
+        }
+    }
+}
+
+static gpointer
+gimp_gegl_apply_operation_thread (GimpGeglApplyOperationData *data)
+{
+  gint i;
+
+  /*  GEGL 0.3 can't process a graph on several threads at once, so the
+   *  chunks are rendered serially, on this thread only.  This keeps
+   *  the calling thread responsive, it doesn't make the operation any
+   *  faster.
+   */
+  for (i = 0; i < data->n_chunks && ! g_atomic_int_get (&data->cancel); i++)
+    {
+      const GeglRectangle *chunk = &data->chunks[i];
+
+      gegl_node_blit (data->dest_node, 1.0, chunk,
+                      NULL, NULL, 0, GEGL_BLIT_DEFAULT);
+
+      g_mutex_lock (&data->mutex);
+      data->n_pixels_done += (gint64) chunk->width * chunk->height;
+      g_mutex_unlock (&data->mutex);
+    }
+
+  g_mutex_lock (&data->mutex);
+
+  data->finished = TRUE;
+  g_cond_signal (&data->cond);
+
+  g_mutex_unlock (&data->mutex);
+
+  return NULL;
+}
@@ -33,6 +33,7 @@
 
 #include "gimp-babl.h"
 #include "gimp-gegl.h"
+#include "gimp-parallel.h"
 
 
 static void  gimp_gegl_notify_tile_cache_size (GimpGeglConfig *config);
@@ -71,11 +72,21 @@ gimp_gegl_init (Gimp *gimp)
                     G_CALLBACK (gimp_gegl_notify_use_opencl),
                     NULL);
 
+  gimp_parallel_init (gimp);
+
   gimp_babl_init ();
 
   gimp_operations_init ();
 }
 
+void
+gimp_gegl_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  gimp_parallel_exit (gimp);
+}
+
 static void
 gimp_gegl_notify_tile_cache_size (GimpGeglConfig *config)
 {
@@ -0,0 +1,483 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include <gio/gio.h>
+#include <gegl.h>
+
+#include "gimp-gegl-types.h"
+
+#include "config/gimpgeglconfig.h"
+
+#include "core/gimp.h"
+
+#include "gimp-parallel.h"
+
+
+typedef struct
+{
+  GimpParallelDistributeFunc  func;
+  gint                        n;
+  gpointer                    user_data;
+
+  gint                        remaining;
+  GMutex                      mutex;
+  GCond                       cond;
+} GimpParallelDistributeTask;
+
+typedef struct
+{
+  GimpParallelDistributeTask *task;
+  gint                        i;
+} GimpParallelDistributeItem;
+
+typedef struct
+{
+  gsize                            size;
+  GimpParallelDistributeRangeFunc  func;
+  gpointer                         user_data;
+} GimpParallelDistributeRangeData;
+
+typedef struct
+{
+  GeglRectangle                    area;
+  gboolean                         vertical;
+  GimpParallelDistributeAreaFunc   func;
+  gpointer                         user_data;
+} GimpParallelDistributeAreaData;
+
+typedef struct
+{
+  GeglRectangle                    area;
+  gint                             first_row;
+  gint                             tile_height;
+  gint                             shift_y;
+  GimpParallelDistributeAreaFunc   func;
+  gpointer                         user_data;
+} GimpParallelDistributeTilesData;
+
+
+/*  local function prototypes  */
+
+static void   gimp_parallel_notify_num_processors (GimpGeglConfig *config);
+static void   gimp_parallel_set_n_threads         (gint            n_threads);
+
+static void   gimp_parallel_worker                (gpointer        data,
+                                                   gpointer        pool_data);
+
+static void   gimp_parallel_distribute_range_func (gint            i,
+                                                   gint            n,
+                                                   gpointer        user_data);
+static void   gimp_parallel_distribute_area_func  (gint            i,
+                                                   gint            n,
+                                                   gpointer        user_data);
+static void   gimp_parallel_distribute_tiles_func (gsize           offset,
+                                                   gsize           size,
+                                                   gpointer        user_data);
+
+
+/*  local variables  */
+
+static GThreadPool *gimp_parallel_pool      = NULL;
+static gint         gimp_parallel_n_threads = 1;
+
+/*  set while the current thread executes a distributed function, so
+ *  nested distribution runs serially instead of waiting on workers
+ *  which are already busy with the outer task
+ */
+static GPrivate     gimp_parallel_nested    = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+void
+gimp_parallel_init (Gimp *gimp)
+{
+  GimpGeglConfig *config;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  config = GIMP_GEGL_CONFIG (gimp->config);
+
+  g_signal_connect (config, "notify::num-processors",
+                    G_CALLBACK (gimp_parallel_notify_num_processors),
+                    NULL);
+
+  gimp_parallel_notify_num_processors (config);
+}
+
+void
+gimp_parallel_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  g_signal_handlers_disconnect_by_func (gimp->config,
+                                        gimp_parallel_notify_num_processors,
+                                        NULL);
+
+  gimp_parallel_set_n_threads (1);
+}
+
+gint
+gimp_parallel_get_n_threads (void)
+{
+  return gimp_parallel_n_threads;
+}
+
+/**
+ * gimp_parallel_distribute:
+ * @max_n:     maximal number of parts, or -1 for no limit
+ * @func:      the function to call for each part
+ * @user_data: user data for @func
+ *
+ * Calls @func @n times, concurrently, where @n is the smaller of the
+ * number of worker threads and @max_n.  Each call receives its index
+ * @i in the range [0, @n) together with @n.  The calling thread
+ * executes part 0 itself, and the function returns after all parts
+ * have finished.
+ *
+ * When called from within a distributed function, @func is called
+ * once, with @i = 0 and @n = 1.
+ **/
+void
+gimp_parallel_distribute (gint                       max_n,
+                          GimpParallelDistributeFunc func,
+                          gpointer                   user_data)
+{
+  GimpParallelDistributeTask task;
+  GimpParallelDistributeItem items[GIMP_PARALLEL_MAX_THREADS];
+  gint                       n;
+  gint                       i;
+
+  g_return_if_fail (func != NULL);
+
+  if (max_n == 0)
+    return;
+
+  n = gimp_parallel_n_threads;
+
+  if (max_n > 0)
+    n = MIN (n, max_n);
+
+  if (n == 1                         ||
+      ! gimp_parallel_pool           ||
+      g_private_get (&gimp_parallel_nested))
+    {
+      func (0, 1, user_data);
+
+      return;
+    }
+
+  task.func      = func;
+  task.n         = n;
+  task.user_data = user_data;
+  task.remaining = n - 1;
+
+  g_mutex_init (&task.mutex);
+  g_cond_init (&task.cond);
+
+  for (i = 1; i < n; i++)
+    {
+      items[i].task = &task;
+      items[i].i    = i;
+
+      g_thread_pool_push (gimp_parallel_pool, &items[i], NULL);
+    }
+
+  g_private_set (&gimp_parallel_nested, GINT_TO_POINTER (TRUE));
+
+  func (0, n, user_data);
+
+  g_private_set (&gimp_parallel_nested, NULL);
+
+  g_mutex_lock (&task.mutex);
+
+  while (task.remaining > 0)
+    g_cond_wait (&task.cond, &task.mutex);
+
+  g_mutex_unlock (&task.mutex);
+
+  g_cond_clear (&task.cond);
+  g_mutex_clear (&task.mutex);
+}
+
+/**
+ * gimp_parallel_distribute_range:
+ * @size:         the size of the range
+ * @min_sub_size: the minimal size of a sub-range, or 0
+ * @func:         the function to call for each sub-range
+ * @user_data:    user data for @func
+ *
+ * Splits the range [0, @size) into consecutive sub-ranges of at least
+ * @min_sub_size elements, and calls @func for each of them using
+ * gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_range (gsize                           size,
+                                gsize                           min_sub_size,
+                                GimpParallelDistributeRangeFunc func,
+                                gpointer                        user_data)
+{
+  GimpParallelDistributeRangeData data;
+  gint                            max_n;
+
+  g_return_if_fail (func != NULL);
+
+  if (size == 0)
+    return;
+
+  if (min_sub_size > 1)
+    max_n = MIN (size / min_sub_size, GIMP_PARALLEL_MAX_THREADS);
+  else
+    max_n = MIN (size, GIMP_PARALLEL_MAX_THREADS);
+
+  max_n = MAX (max_n, 1);
+
+  data.size      = size;
+  data.func      = func;
+  data.user_data = user_data;
+
+  gimp_parallel_distribute (max_n,
+                            gimp_parallel_distribute_range_func,
+                            &data);
+}
+
+/**
+ * gimp_parallel_distribute_area:
+ * @area:         the area to process
+ * @min_sub_area: the minimal number of pixels in a sub-area, or 0
+ * @func:         the function to call for each sub-area
+ * @user_data:    user data for @func
+ *
+ * Splits @area into strips of at least @min_sub_area pixels, along
+ * its longer side, and calls @func for each of them using
+ * gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_area (const GeglRectangle            *area,
+                               gsize                           min_sub_area,
+                               GimpParallelDistributeAreaFunc  func,
+                               gpointer                        user_data)
+{
+  GimpParallelDistributeAreaData data;
+  gsize                          n_pixels;
+  gint                           max_n;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  n_pixels = (gsize) area->width * (gsize) area->height;
+
+  data.area      = *area;
+  data.vertical  = area->width > area->height;
+  data.func      = func;
+  data.user_data = user_data;
+
+  max_n = data.vertical ? area->width : area->height;
+
+  if (min_sub_area > 1)
+    max_n = MIN (max_n, n_pixels / min_sub_area);
+
+  max_n = CLAMP (max_n, 1, GIMP_PARALLEL_MAX_THREADS);
+
+  gimp_parallel_distribute (max_n,
+                            gimp_parallel_distribute_area_func,
+                            &data);
+}
+
+/**
+ * gimp_parallel_distribute_tiles:
+ * @buffer:       the buffer @func writes to
+ * @area:         the area to process
+ * @min_sub_area: the minimal number of pixels in a sub-area, or 0
+ * @func:         the function to call for each sub-area
+ * @user_data:    user data for @func
+ *
+ * Like gimp_parallel_distribute_area(), but splits @area only between
+ * rows of @buffer's tiles, so that no tile of @buffer is shared by two
+ * sub-areas.  Use this when @func writes to @buffer.
+ **/
+void
+gimp_parallel_distribute_tiles (GeglBuffer                     *buffer,
+                                const GeglRectangle            *area,
+                                gsize                           min_sub_area,
+                                GimpParallelDistributeAreaFunc  func,
+                                gpointer                        user_data)
+{
+  GimpParallelDistributeTilesData data;
+  gint                            last_row;
+  gsize                           row_area;
+
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  g_object_get (buffer,
+                "tile-height", &data.tile_height,
+                "shift-y",     &data.shift_y,
+                NULL);
+
+  data.area      = *area;
+  data.func      = func;
+  data.user_data = user_data;
+
+  data.first_row = floor ((gdouble) (area->y + data.shift_y) /
+                          data.tile_height);
+  last_row       = floor ((gdouble) (area->y + area->height - 1 +
+                                     data.shift_y) /
+                          data.tile_height);
+
+  row_area = (gsize) area->width * (gsize) data.tile_height;
+
+  gimp_parallel_distribute_range (last_row - data.first_row + 1,
+                                  min_sub_area / row_area,
+                                  gimp_parallel_distribute_tiles_func,
+                                  &data);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_parallel_notify_num_processors (GimpGeglConfig *config)
+{
+  gimp_parallel_set_n_threads (config->num_processors);
+}
+
+static void
+gimp_parallel_set_n_threads (gint n_threads)
+{
+  n_threads = CLAMP (n_threads, 1, GIMP_PARALLEL_MAX_THREADS);
+
+  if (n_threads > 1)
+    {
+      if (! gimp_parallel_pool)
+        {
+          gimp_parallel_pool = g_thread_pool_new (gimp_parallel_worker, NULL,
+                                                  n_threads - 1, FALSE,
+                                                  NULL);
+        }
+      else
+        {
+          g_thread_pool_set_max_threads (gimp_parallel_pool,
+                                         n_threads - 1, NULL);
+        }
+    }
+  else if (gimp_parallel_pool)
+    {
+      /*  let the workers finish what they already have  */
+      g_thread_pool_free (gimp_parallel_pool, FALSE, TRUE);
+      gimp_parallel_pool = NULL;
+    }
+
+  gimp_parallel_n_threads = n_threads;
+}
+
+static void
+gimp_parallel_worker (gpointer data,
+                      gpointer pool_data)
+{
+  GimpParallelDistributeItem *item = data;
+  GimpParallelDistributeTask *task = item->task;
+
+  g_private_set (&gimp_parallel_nested, GINT_TO_POINTER (TRUE));
+
+  task->func (item->i, task->n, task->user_data);
+
+  g_private_set (&gimp_parallel_nested, NULL);
+
+  g_mutex_lock (&task->mutex);
+
+  if (--task->remaining == 0)
+    g_cond_signal (&task->cond);
+
+  g_mutex_unlock (&task->mutex);
+}
+
+static void
+gimp_parallel_distribute_range_func (gint     i,
+                                     gint     n,
+                                     gpointer user_data)
+{
+  GimpParallelDistributeRangeData *data = user_data;
+  gsize                            offset;
+  gsize                            end;
+
+  offset = (data->size * i)       / n;
+  end    = (data->size * (i + 1)) / n;
+
+  if (end > offset)
+    data->func (offset, end - offset, data->user_data);
+}
+
+static void
+gimp_parallel_distribute_area_func (gint     i,
+                                    gint     n,
+                                    gpointer user_data)
+{
+  GimpParallelDistributeAreaData *data = user_data;
+  GeglRectangle                   area = data->area;
+
+  if (data->vertical)
+    {
+      area.x     = data->area.x + (data->area.width * i) / n;
+      area.width = data->area.x + (data->area.width * (i + 1)) / n - area.x;
+    }
+  else
+    {
+      area.y      = data->area.y + (data->area.height * i) / n;
+      area.height = data->area.y + (data->area.height * (i + 1)) / n - area.y;
+    }
+
+  if (area.width > 0 && area.height > 0)
+    data->func (&area, data->user_data);
+}
+
+static void
+gimp_parallel_distribute_tiles_func (gsize    offset,
+                                     gsize    size,
+                                     gpointer user_data)
+{
+  GimpParallelDistributeTilesData *data = user_data;
+  GeglRectangle                    area = data->area;
+  gint                             y1;
+  gint                             y2;
+
+  y1 = (data->first_row + (gint) offset) * data->tile_height - data->shift_y;
+  y2 = (data->first_row + (gint) (offset + size)) * data->tile_height -
+       data->shift_y;
+
+  y1 = MAX (y1, data->area.y);
+  y2 = MIN (y2, data->area.y + data->area.height);
+
+  area.y      = y1;
+  area.height = y2 - y1;
+
+  if (area.height > 0)
+    data->func (&area, data->user_data);
+}
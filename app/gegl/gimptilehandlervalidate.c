@@ -31,7 +31,8 @@ enum
   PROP_FORMAT,
   PROP_TILE_WIDTH,
   PROP_TILE_HEIGHT,
-  PROP_WHOLE_TILE
+  PROP_WHOLE_TILE,
+  PROP_SCALE
 };
 
 
@@ -97,6 +98,12 @@ gimp_tile_handler_validate_class_init (GimpTileHandlerValidateClass *klass)
                                                          FALSE,
                                                          GIMP_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (object_class, PROP_SCALE,
+                                   g_param_spec_double ("scale", NULL, NULL,
+                                                        0.0, 1.0, 1.0,
+                                                        GIMP_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT));
 }
 
 static void
@@ -107,6 +114,8 @@ gimp_tile_handler_validate_init (GimpTileHandlerValidate *validate)
   source->command = gimp_tile_handler_validate_command;
 
   validate->dirty_region = cairo_region_create ();
+
+  g_rec_mutex_init (&validate->dirty_mutex);
 }
 
 static void
@@ -123,6 +132,8 @@ gimp_tile_handler_validate_finalize (GObject *object)
   cairo_region_destroy (validate->dirty_region);
   validate->dirty_region = NULL;
 
+  g_rec_mutex_clear (&validate->dirty_mutex);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -148,6 +159,9 @@ gimp_tile_handler_validate_set_property (GObject      *object,
     case PROP_WHOLE_TILE:
       validate->whole_tile = g_value_get_boolean (value);
       break;
+    case PROP_SCALE:
+      validate->scale = g_value_get_double (value);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -177,6 +191,9 @@ gimp_tile_handler_validate_get_property (GObject    *object,
     case PROP_WHOLE_TILE:
       g_value_set_boolean (value, validate->whole_tile);
       break;
+    case PROP_SCALE:
+      g_value_set_double (value, validate->scale);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -199,7 +216,7 @@ gimp_tile_handler_validate_real_validate (GimpTileHandlerValidate *validate,
               rect.height);
 #endif
 
-  gegl_node_blit (validate->graph, 1.0, rect, format,
+  gegl_node_blit (validate->graph, validate->scale, rect, format,
                   dest_buf, dest_stride,
                   GEGL_BLIT_DEFAULT);
 }
@@ -213,8 +230,19 @@ gimp_tile_handler_validate_validate (GeglTileSource *source,
   GimpTileHandlerValidate *validate = GIMP_TILE_HANDLER_VALIDATE (source);
   cairo_rectangle_int_t    tile_rect;
 
+  /*  tiles may be requested from several threads at once when the
+   *  projection is rendered in parallel, so the dirty region is only
+   *  accessed with the mutex held.  It is held while validating too,
+   *  so no other thread can pick up a tile that is only half done.
+   */
+  g_rec_mutex_lock (&validate->dirty_mutex);
+
   if (cairo_region_is_empty (validate->dirty_region))
-    return tile;
+    {
+      g_rec_mutex_unlock (&validate->dirty_mutex);
+
+      return tile;
+    }
 
   tile_rect.x      = x * validate->tile_width;
   tile_rect.y      = y * validate->tile_height;
@@ -308,6 +336,8 @@ gimp_tile_handler_validate_validate (GeglTileSource *source,
       cairo_region_destroy (tile_region);
     }
 
+  g_rec_mutex_unlock (&validate->dirty_mutex);
+
   return tile;
 }
 
@@ -376,6 +406,8 @@ gimp_tile_handler_validate_invalidate (GimpTileHandlerValidate *validate,
 
   g_return_if_fail (GIMP_IS_TILE_HANDLER_VALIDATE (validate));
 
+  g_rec_mutex_lock (&validate->dirty_mutex);
+
   cairo_region_union_rectangle (validate->dirty_region, &rect);
 
   if (validate->max_z > 0)
@@ -401,6 +433,8 @@ gimp_tile_handler_validate_invalidate (GimpTileHandlerValidate *validate,
               gegl_tile_source_void (source, tile_x, tile_y, tile_z);
         }
     }
+
+  g_rec_mutex_unlock (&validate->dirty_mutex);
 }
 
 void
@@ -414,5 +448,83 @@ gimp_tile_handler_validate_undo_invalidate (GimpTileHandlerValidate *validate,
 
   g_return_if_fail (GIMP_IS_TILE_HANDLER_VALIDATE (validate));
 
+  g_rec_mutex_lock (&validate->dirty_mutex);
+
   cairo_region_subtract_rectangle (validate->dirty_region, &rect);
+
+  g_rec_mutex_unlock (&validate->dirty_mutex);
+}
+
+/**
+ * gimp_tile_handler_validate_validate:
+ * @validate: a #GimpTileHandlerValidate
+ * @buffer:   the #GeglBuffer @validate is assigned to
+ * @x:        x coordinate of the area
+ * @y:        y coordinate of the area
+ * @width:    width of the area
+ * @height:   height of the area
+ *
+ * Validates all dirty tiles of @buffer which intersect the area now,
+ * instead of when they are read.
+ **/
+void
+gimp_tile_handler_validate_validate (GimpTileHandlerValidate *validate,
+                                     GeglBuffer              *buffer,
+                                     gint                     x,
+                                     gint                     y,
+                                     gint                     width,
+                                     gint                     height)
+{
+  GeglRectangle rect;
+  gint          tile_x1;
+  gint          tile_y1;
+  gint          tile_x2;
+  gint          tile_y2;
+  gint          tile_x;
+  gint          tile_y;
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_VALIDATE (validate));
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+
+  if (! gegl_rectangle_intersect (&rect,
+                                  GEGL_RECTANGLE (x, y, width, height),
+                                  gegl_buffer_get_extent (buffer)))
+    return;
+
+  tile_x1 = rect.x / validate->tile_width;
+  tile_y1 = rect.y / validate->tile_height;
+  tile_x2 = (rect.x + rect.width  - 1) / validate->tile_width  + 1;
+  tile_y2 = (rect.y + rect.height - 1) / validate->tile_height + 1;
+
+  for (tile_y = tile_y1; tile_y < tile_y2; tile_y++)
+    for (tile_x = tile_x1; tile_x < tile_x2; tile_x++)
+      {
+        cairo_rectangle_int_t tile_rect;
+        gboolean              dirty;
+
+        tile_rect.x      = tile_x * validate->tile_width;
+        tile_rect.y      = tile_y * validate->tile_height;
+        tile_rect.width  = validate->tile_width;
+        tile_rect.height = validate->tile_height;
+
+        g_rec_mutex_lock (&validate->dirty_mutex);
+
+        dirty = (cairo_region_contains_rectangle (validate->dirty_region,
+                                                  &tile_rect) !=
+                 CAIRO_REGION_OVERLAP_OUT);
+
+        g_rec_mutex_unlock (&validate->dirty_mutex);
+
+        /*  fetching the tile through the buffer validates it  */
+        if (dirty)
+          {
+            GeglTile *tile;
+
+            tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                              tile_x, tile_y, 0);
+
+            if (tile)
+              gegl_tile_unref (tile);
+          }
+      }
 }
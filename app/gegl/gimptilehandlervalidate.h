@@ -35,7 +35,6 @@ G_BEGIN_DECLS
 #define GIMP_TILE_HANDLER_VALIDATE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_HANDLER_VALIDATE, GimpTileHandlerValidateClass))
 
 
-typedef struct _GimpTileHandlerValidate      GimpTileHandlerValidate;
 typedef struct _GimpTileHandlerValidateClass GimpTileHandlerValidateClass;
 
 struct _GimpTileHandlerValidate
@@ -44,11 +43,13 @@ struct _GimpTileHandlerValidate
 
   GeglNode        *graph;
   cairo_region_t  *dirty_region;
+  GRecMutex        dirty_mutex;
   const Babl      *format;
   gint             tile_width;
   gint             tile_height;
   gint             max_z;
   gboolean         whole_tile;
+  gdouble          scale;
 };
 
 struct _GimpTileHandlerValidateClass
@@ -81,6 +82,13 @@ void         gimp_tile_handler_validate_undo_invalidate (GimpTileHandlerValidate
                                                          gint                     width,
                                                          gint                     height);
 
+void              gimp_tile_handler_validate_validate   (GimpTileHandlerValidate *validate,
+                                                         GeglBuffer              *buffer,
+                                                         gint                     x,
+                                                         gint                     y,
+                                                         gint                     width,
+                                                         gint                     height);
+
 
 G_END_DECLS
 
@@ -33,6 +33,11 @@
 /*  just a bit less than GDK_PRIORITY_REDRAW   */
 #define GIMP_PRIORITY_PROJECTION_IDLE (G_PRIORITY_HIGH_IDLE + 22)
 
+/*  just a bit less than projection construction, so the next level of
+ *  a filter preview is only started once the previous one is rendered
+ */
+#define GIMP_PRIORITY_IMAGE_MAP_PROXY_IDLE (G_PRIORITY_HIGH_IDLE + 23)
+
 /* #define G_PRIORITY_DEFAULT_IDLE 200 */
 
 #define GIMP_PRIORITY_VIEWABLE_IDLE (G_PRIORITY_LOW)
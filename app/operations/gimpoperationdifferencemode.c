@@ -21,13 +21,19 @@
 
 #include "config.h"
 
+#include <gio/gio.h>
 #include <gegl-plugin.h>
 
+#include "libgimpbase/gimpbase.h"
+
 #include "operations-types.h"
 
 #include "gimpoperationdifferencemode.h"
 
 
+GimpLayerModeFunction gimp_operation_difference_mode_process_pixels = NULL;
+
+
 static gboolean gimp_operation_difference_mode_process (GeglOperation       *operation,
                                                         void                *in_buf,
                                                         void                *aux_buf,
@@ -57,6 +63,13 @@ gimp_operation_difference_mode_class_init (GimpOperationDifferenceModeClass *kla
                                  NULL);
 
   point_class->process = gimp_operation_difference_mode_process;
+
+  gimp_operation_difference_mode_process_pixels = gimp_operation_difference_mode_process_pixels_core;
+
+#if COMPILE_SSE2_INTRINISICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    gimp_operation_difference_mode_process_pixels = gimp_operation_difference_mode_process_pixels_sse2;
+#endif /* COMPILE_SSE2_INTRINISICS */
 }
 
 static void
@@ -80,14 +93,14 @@ gimp_operation_difference_mode_process (GeglOperation       *operation,
 }
 
 gboolean
-gimp_operation_difference_mode_process_pixels (gfloat              *in,
-                                               gfloat              *layer,
-                                               gfloat              *mask,
-                                               gfloat              *out,
-                                               gfloat               opacity,
-                                               glong                samples,
-                                               const GeglRectangle *roi,
-                                               gint                 level)
+gimp_operation_difference_mode_process_pixels_core (gfloat              *in,
+                                                    gfloat              *layer,
+                                                    gfloat              *mask,
+                                                    gfloat              *out,
+                                                    gfloat               opacity,
+                                                    glong                samples,
+                                                    const GeglRectangle *roi,
+                                                    gint                 level)
 {
   const gboolean has_mask = mask != NULL;
 
@@ -49,13 +49,24 @@ struct _GimpOperationOverlayModeClass
 
 GType   gimp_operation_overlay_mode_get_type (void) G_GNUC_CONST;
 
-gboolean gimp_operation_overlay_mode_process_pixels (gfloat              *in,
-                                                     gfloat              *layer,
-                                                     gfloat              *mask,
-                                                     gfloat              *out,
-                                                     gfloat               opacity,
-                                                     glong                samples,
-                                                     const GeglRectangle *roi,
-                                                     gint                 level);
+extern GimpLayerModeFunction gimp_operation_overlay_mode_process_pixels;
+
+gboolean gimp_operation_overlay_mode_process_pixels_core (gfloat              *in,
+                                                          gfloat              *layer,
+                                                          gfloat              *mask,
+                                                          gfloat              *out,
+                                                          gfloat               opacity,
+                                                          glong                samples,
+                                                          const GeglRectangle *roi,
+                                                          gint                 level);
+
+gboolean gimp_operation_overlay_mode_process_pixels_sse2 (gfloat              *in,
+                                                          gfloat              *layer,
+                                                          gfloat              *mask,
+                                                          gfloat              *out,
+                                                          gfloat               opacity,
+                                                          glong                samples,
+                                                          const GeglRectangle *roi,
+                                                          gint                 level);
 
 #endif /* __GIMP_OPERATION_OVERLAY_MODE_H__ */
@@ -0,0 +1,331 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationpointlayermode-sse2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimpoperationadditionmode.h"
+#include "gimpoperationburnmode.h"
+#include "gimpoperationdarkenonlymode.h"
+#include "gimpoperationdifferencemode.h"
+#include "gimpoperationdividemode.h"
+#include "gimpoperationdodgemode.h"
+#include "gimpoperationgrainextractmode.h"
+#include "gimpoperationgrainmergemode.h"
+#include "gimpoperationhardlightmode.h"
+#include "gimpoperationlightenonlymode.h"
+#include "gimpoperationmultiplymode.h"
+#include "gimpoperationoverlaymode.h"
+#include "gimpoperationscreenmode.h"
+#include "gimpoperationsoftlightmode.h"
+#include "gimpoperationsubtractmode.h"
+
+#if COMPILE_SSE2_INTRINISICS
+/* SSE2 */
+#include <emmintrin.h>
+
+
+/*  The separable layer modes all share the compositing step of their
+ *  generic versions, and differ only in how the composite color is
+ *  computed from the input and layer colors.  One pixel is processed
+ *  per vector, the blend functions are applied to all four channels,
+ *  and the alpha channel of the result is taken from the input.
+ */
+
+typedef __m128 (* GimpBlendFuncSSE2) (__m128 in,
+                                      __m128 layer);
+
+
+/*  MINPS and MAXPS return their second operand if either operand is
+ *  NaN, so the operands are ordered to behave exactly like the MIN(),
+ *  MAX() and CLAMP() macros the generic versions use: CLAMP() and
+ *  "x < 0 ? 0 : x" pass NaN through, MIN (x, 1.0) turns it into 1.0.
+ */
+static inline __m128
+clamp_sse2 (__m128 x)
+{
+  return _mm_max_ps (_mm_setzero_ps (), _mm_min_ps (_mm_set1_ps (1.0f), x));
+}
+
+static inline gboolean
+process_pixels_sse2 (const gfloat      *in,
+                     const gfloat      *layer,
+                     const gfloat      *mask,
+                     gfloat            *out,
+                     gfloat             opacity,
+                     glong              samples,
+                     GimpBlendFuncSSE2  blend)
+{
+  const __m128 zero       = _mm_setzero_ps ();
+  const __m128 one        = _mm_set1_ps (1.0f);
+  const __m128 v_opacity  = _mm_set1_ps (opacity);
+  const __m128 alpha_mask = _mm_castsi128_ps (_mm_set_epi32 (-1, 0, 0, 0));
+
+  while (samples--)
+    {
+      __m128 v_in    = _mm_loadu_ps (in);
+      __m128 v_layer = _mm_loadu_ps (layer);
+      __m128 in_alpha;
+      __m128 comp_alpha;
+      __m128 new_alpha;
+      __m128 v_out;
+
+      /* expand alpha */
+      in_alpha   = _mm_shuffle_ps (v_in, v_in, _MM_SHUFFLE (3, 3, 3, 3));
+      comp_alpha = _mm_shuffle_ps (v_layer, v_layer, _MM_SHUFFLE (3, 3, 3, 3));
+
+      comp_alpha = _mm_mul_ps (_mm_min_ps (in_alpha, comp_alpha), v_opacity);
+
+      if (mask)
+        comp_alpha = _mm_mul_ps (comp_alpha, _mm_set1_ps (*mask++));
+
+      new_alpha = _mm_add_ps (in_alpha,
+                              _mm_mul_ps (_mm_sub_ps (one, in_alpha),
+                                          comp_alpha));
+
+      if (_mm_movemask_ps (_mm_and_ps (_mm_cmpneq_ps (comp_alpha, zero),
+                                       _mm_cmpneq_ps (new_alpha,  zero))) & 1)
+        {
+          __m128 ratio = _mm_div_ps (comp_alpha, new_alpha);
+          __m128 comp  = blend (v_in, v_layer);
+
+          v_out = _mm_add_ps (_mm_mul_ps (comp, ratio),
+                              _mm_mul_ps (v_in, _mm_sub_ps (one, ratio)));
+
+          /* swap in the input's alpha */
+          v_out = _mm_or_ps (_mm_andnot_ps (alpha_mask, v_out),
+                             _mm_and_ps    (alpha_mask, v_in));
+        }
+      else
+        {
+          v_out = v_in;
+        }
+
+      _mm_storeu_ps (out, v_out);
+
+      in    += 4;
+      layer += 4;
+      out   += 4;
+    }
+
+  return TRUE;
+}
+
+
+/*  blend functions  */
+
+static inline __m128
+multiply_sse2 (__m128 in,
+               __m128 layer)
+{
+  return clamp_sse2 (_mm_mul_ps (layer, in));
+}
+
+static inline __m128
+screen_sse2 (__m128 in,
+             __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+
+  return _mm_sub_ps (one, _mm_mul_ps (_mm_sub_ps (one, in),
+                                      _mm_sub_ps (one, layer)));
+}
+
+static inline __m128
+difference_sse2 (__m128 in,
+                 __m128 layer)
+{
+  const __m128 sign = _mm_set1_ps (-0.0f);
+
+  return _mm_andnot_ps (sign, _mm_sub_ps (in, layer));
+}
+
+static inline __m128
+addition_sse2 (__m128 in,
+               __m128 layer)
+{
+  return clamp_sse2 (_mm_add_ps (in, layer));
+}
+
+static inline __m128
+subtract_sse2 (__m128 in,
+               __m128 layer)
+{
+  return _mm_max_ps (_mm_setzero_ps (), _mm_sub_ps (in, layer));
+}
+
+static inline __m128
+darken_only_sse2 (__m128 in,
+                  __m128 layer)
+{
+  return _mm_min_ps (in, layer);
+}
+
+static inline __m128
+lighten_only_sse2 (__m128 in,
+                   __m128 layer)
+{
+  return _mm_max_ps (layer, in);
+}
+
+static inline __m128
+divide_sse2 (__m128 in,
+             __m128 layer)
+{
+  const __m128 scale  = _mm_set1_ps (4294967296.0f / 4294967295.0f);
+  const __m128 offset = _mm_set1_ps (1.0f / 4294967295.0f);
+
+  return clamp_sse2 (_mm_div_ps (_mm_mul_ps (scale, in),
+                                 _mm_add_ps (offset, layer)));
+}
+
+static inline __m128
+dodge_sse2 (__m128 in,
+            __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+
+  return _mm_min_ps (_mm_div_ps (in, _mm_sub_ps (one, layer)), one);
+}
+
+static inline __m128
+burn_sse2 (__m128 in,
+           __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+
+  return clamp_sse2 (_mm_sub_ps (one, _mm_div_ps (_mm_sub_ps (one, in),
+                                                  layer)));
+}
+
+static inline __m128
+hardlight_sse2 (__m128 in,
+                __m128 layer)
+{
+  const __m128 one  = _mm_set1_ps (1.0f);
+  const __m128 two  = _mm_set1_ps (2.0f);
+  const __m128 half = _mm_set1_ps (0.5f);
+  __m128       high;
+  __m128       low;
+  __m128       select;
+
+  /* layer > 0.5: 1 - (1 - in) * (1 - (layer - 0.5) * 2) */
+  high = _mm_mul_ps (_mm_sub_ps (one, in),
+                     _mm_sub_ps (one, _mm_mul_ps (_mm_sub_ps (layer, half),
+                                                  two)));
+  high = _mm_min_ps (_mm_sub_ps (one, high), one);
+
+  /* layer <= 0.5: in * (layer * 2) */
+  low = _mm_min_ps (_mm_mul_ps (in, _mm_mul_ps (layer, two)), one);
+
+  select = _mm_cmpgt_ps (layer, half);
+
+  return _mm_or_ps (_mm_and_ps (select, high), _mm_andnot_ps (select, low));
+}
+
+static inline __m128
+softlight_sse2 (__m128 in,
+                __m128 layer)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+  __m128       multiply;
+  __m128       screen;
+
+  multiply = _mm_mul_ps (in, layer);
+  screen   = _mm_sub_ps (one, _mm_mul_ps (_mm_sub_ps (one, in),
+                                          _mm_sub_ps (one, layer)));
+
+  return _mm_add_ps (_mm_mul_ps (_mm_sub_ps (one, in), multiply),
+                     _mm_mul_ps (in, screen));
+}
+
+static inline __m128
+grain_extract_sse2 (__m128 in,
+                    __m128 layer)
+{
+  return clamp_sse2 (_mm_add_ps (_mm_sub_ps (in, layer), _mm_set1_ps (0.5f)));
+}
+
+static inline __m128
+grain_merge_sse2 (__m128 in,
+                  __m128 layer)
+{
+  return clamp_sse2 (_mm_sub_ps (_mm_add_ps (in, layer), _mm_set1_ps (0.5f)));
+}
+
+static inline __m128
+overlay_sse2 (__m128 in,
+              __m128 layer)
+{
+  const __m128 one  = _mm_set1_ps (1.0f);
+  const __m128 two  = _mm_set1_ps (2.0f);
+  __m128       high;
+  __m128       low;
+  __m128       select;
+
+  /* in < 0.5: 2 * in * layer */
+  low = _mm_mul_ps (_mm_mul_ps (two, in), layer);
+
+  /* in >= 0.5: 1 - 2 * (1 - layer) * (1 - in) */
+  high = _mm_sub_ps (one, _mm_mul_ps (_mm_mul_ps (two, _mm_sub_ps (one, layer)),
+                                      _mm_sub_ps (one, in)));
+
+  select = _mm_cmplt_ps (in, _mm_set1_ps (0.5f));
+
+  return _mm_or_ps (_mm_and_ps (select, low), _mm_andnot_ps (select, high));
+}
+
+
+/*  public functions  */
+
+#define DEFINE_PROCESS_PIXELS_SSE2(mode)                                        \
+gboolean                                                                        \
+gimp_operation_##mode##_mode_process_pixels_sse2 (gfloat              *in,      \
+                                                  gfloat              *layer,   \
+                                                  gfloat              *mask,    \
+                                                  gfloat              *out,     \
+                                                  gfloat               opacity, \
+                                                  glong                samples, \
+                                                  const GeglRectangle *roi,     \
+                                                  gint                 level)   \
+{                                                                               \
+  return process_pixels_sse2 (in, layer, mask, out, opacity, samples,           \
+                              mode##_sse2);                                     \
+}
+
+DEFINE_PROCESS_PIXELS_SSE2 (multiply)
+DEFINE_PROCESS_PIXELS_SSE2 (screen)
+DEFINE_PROCESS_PIXELS_SSE2 (difference)
+DEFINE_PROCESS_PIXELS_SSE2 (addition)
+DEFINE_PROCESS_PIXELS_SSE2 (subtract)
+DEFINE_PROCESS_PIXELS_SSE2 (darken_only)
+DEFINE_PROCESS_PIXELS_SSE2 (lighten_only)
+DEFINE_PROCESS_PIXELS_SSE2 (divide)
+DEFINE_PROCESS_PIXELS_SSE2 (dodge)
+DEFINE_PROCESS_PIXELS_SSE2 (burn)
+DEFINE_PROCESS_PIXELS_SSE2 (hardlight)
+DEFINE_PROCESS_PIXELS_SSE2 (softlight)
+DEFINE_PROCESS_PIXELS_SSE2 (grain_extract)
+DEFINE_PROCESS_PIXELS_SSE2 (grain_merge)
+DEFINE_PROCESS_PIXELS_SSE2 (overlay)
+
+#endif /* COMPILE_SSE2_INTRINISICS */
@@ -239,6 +239,10 @@ gimp_mybrush_motion (GimpPaintCore    *paint_core,
 
       src = mypaint_gegl_tiled_surface_get_buffer (mybrush->private->surface);
 
+      gimp_paint_core_save_undo_area (paint_core, drawable,
+                                      rect.x, rect.y,
+                                      rect.width, rect.height);
+
       gegl_buffer_copy (src,
                         (GeglRectangle *) &rect,
                         GEGL_ABYSS_NONE,
@@ -274,28 +274,47 @@ paint_mask_to_paint_buffer (const GimpTempBuf  *paint_mask,
     }
 }
 
-void
-do_layer_blend (GeglBuffer  *src_buffer,
-                GeglBuffer  *dst_buffer,
-                GimpTempBuf *paint_buf,
-                GeglBuffer  *mask_buffer,
-                gfloat       opacity,
-                gint         x_offset,
-                gint         y_offset,
-                gint         mask_x_offset,
-                gint         mask_y_offset,
-                gboolean     linear_mode,
-                GimpLayerModeEffects paint_mode)
+/* Applies the paint mask, or the canvas mask, to the paint buffer's
+ * alpha, and blends the paint buffer onto the drawable, in a single
+ * pass: each row of the paint buffer is masked and blended while it
+ * is still in the cache, instead of walking the whole dab once per
+ * step.
+ */
+static void
+do_layer_blend_internal (const GimpTempBuf    *paint_mask,
+                         gint                  paint_mask_x_offset,
+                         gint                  paint_mask_y_offset,
+                         gfloat                paint_opacity,
+                         GeglBuffer           *canvas_buffer,
+                         gboolean              stipple,
+                         GeglBuffer           *src_buffer,
+                         GeglBuffer           *dst_buffer,
+                         GimpTempBuf          *paint_buf,
+                         GeglBuffer           *mask_buffer,
+                         gfloat                opacity,
+                         gint                  x_offset,
+                         gint                  y_offset,
+                         gint                  mask_x_offset,
+                         gint                  mask_y_offset,
+                         gboolean              linear_mode,
+                         GimpLayerModeEffects  paint_mode)
 {
   GeglRectangle       roi;
   GeglRectangle       mask_roi;
   GeglRectangle       process_roi;
   const Babl         *iterator_format;
   GeglBufferIterator *iter;
+  gint                mask_index   = -1;
+  gint                canvas_index = -1;
 
   const guint         paint_stride = gimp_temp_buf_get_width (paint_buf);
   gfloat             *paint_data   = (gfloat *) gimp_temp_buf_get_data (paint_buf);
 
+  const guint8       *paint_mask_u8    = NULL;
+  const gfloat       *paint_mask_float = NULL;
+  gint                paint_mask_stride = 0;
+  gfloat             *mask_row          = NULL;
+
   GimpLayerModeFunction apply_func = get_layer_mode_function (paint_mode, linear_mode);
 
   if (linear_mode)
@@ -315,6 +334,37 @@ do_layer_blend (GeglBuffer  *src_buffer,
 
   g_return_if_fail (gimp_temp_buf_get_format (paint_buf) == iterator_format);
 
+  if (paint_mask)
+    {
+      const Babl *paint_mask_format = gimp_temp_buf_get_format (paint_mask);
+
+      /* Validate that the paint buffer is withing the bounds of the paint mask */
+      g_return_if_fail (roi.width <= gimp_temp_buf_get_width (paint_mask) - paint_mask_x_offset);
+      g_return_if_fail (roi.height <= gimp_temp_buf_get_height (paint_mask) - paint_mask_y_offset);
+
+      paint_mask_stride = gimp_temp_buf_get_width (paint_mask);
+
+      if (paint_mask_format == babl_format ("Y u8"))
+        {
+          paint_mask_u8 = (const guint8 *) gimp_temp_buf_get_data (paint_mask);
+          paint_mask_u8 += paint_mask_y_offset * paint_mask_stride + paint_mask_x_offset;
+
+          /* u8 mask rows are converted to float rows before use */
+          mask_row = g_new (gfloat, roi.width);
+        }
+      else if (paint_mask_format == babl_format ("Y float"))
+        {
+          paint_mask_float = (const gfloat *) gimp_temp_buf_get_data (paint_mask);
+          paint_mask_float += paint_mask_y_offset * paint_mask_stride + paint_mask_x_offset;
+        }
+      else
+        {
+          g_warning ("Mask format not supported: %s",
+                     babl_get_name (paint_mask_format));
+          return;
+        }
+    }
+
   iter = gegl_buffer_iterator_new (dst_buffer, &roi, 0,
                                    iterator_format,
                                    GEGL_ACCESS_WRITE, GEGL_ABYSS_NONE);
@@ -325,46 +375,170 @@ do_layer_blend (GeglBuffer  *src_buffer,
 
   if (mask_buffer)
     {
-      gegl_buffer_iterator_add (iter, mask_buffer, &mask_roi, 0,
-                                babl_format ("Y float"),
-                                GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+      mask_index = gegl_buffer_iterator_add (iter, mask_buffer, &mask_roi, 0,
+                                             babl_format ("Y float"),
+                                             GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+    }
+
+  if (canvas_buffer)
+    {
+      canvas_index = gegl_buffer_iterator_add (iter, canvas_buffer, &roi, 0,
+                                               babl_format ("Y float"),
+                                               paint_mask ?
+                                               GEGL_ACCESS_READWRITE :
+                                               GEGL_ACCESS_READ,
+                                               GEGL_ABYSS_NONE);
     }
 
   while (gegl_buffer_iterator_next (iter))
     {
-      gfloat *out_pixel   = (gfloat *)iter->data[0];
-      gfloat *in_pixel    = (gfloat *)iter->data[1];
-      gfloat *mask_pixel  = NULL;
-      gfloat *paint_pixel = paint_data + ((iter->roi[0].y - roi.y) * paint_stride + iter->roi[0].x - roi.x) * 4;
-      int iy;
+      gfloat *out_pixel    = (gfloat *)iter->data[0];
+      gfloat *in_pixel     = (gfloat *)iter->data[1];
+      gfloat *mask_pixel   = NULL;
+      gfloat *canvas_pixel = NULL;
+      gint    row_offset   = (iter->roi[0].y - roi.y) * paint_stride + iter->roi[0].x - roi.x;
+      gfloat *paint_pixel  = paint_data + row_offset * 4;
+      gint    width        = iter->roi[0].width;
+      int iy, ix;
 
       if (mask_buffer)
-        mask_pixel  = (gfloat *)iter->data[2];
+        mask_pixel  = (gfloat *)iter->data[mask_index];
+
+      if (canvas_buffer)
+        canvas_pixel = (gfloat *)iter->data[canvas_index];
 
       process_roi.x = iter->roi[0].x;
-      process_roi.width  = iter->roi[0].width;
+      process_roi.width  = width;
       process_roi.height = 1;
 
       for (iy = 0; iy < iter->roi[0].height; iy++)
         {
+          const gfloat *paint_mask_row = NULL;
+
           process_roi.y = iter->roi[0].y + iy;
 
+          if (paint_mask_u8)
+            {
+              const guint8 *src = paint_mask_u8 +
+                                  (process_roi.y - roi.y) * paint_mask_stride +
+                                  process_roi.x - roi.x;
+
+              for (ix = 0; ix < width; ix++)
+                mask_row[ix] = src[ix] / 255.0f;
+
+              paint_mask_row = mask_row;
+            }
+          else if (paint_mask_float)
+            {
+              paint_mask_row = paint_mask_float +
+                               (process_roi.y - roi.y) * paint_mask_stride +
+                               process_roi.x - roi.x;
+            }
+
+          if (canvas_pixel && paint_mask_row)
+            {
+              /* Mix paint mask and canvas_buffer, and write the result
+               * to the paint buffer's alpha
+               */
+              if (stipple)
+                {
+                  for (ix = 0; ix < width; ix++)
+                    {
+                      canvas_pixel[ix] += (1.0 - canvas_pixel[ix]) * paint_mask_row[ix] * paint_opacity;
+                      paint_pixel[ix * 4 + 3] *= canvas_pixel[ix];
+                    }
+                }
+              else
+                {
+                  for (ix = 0; ix < width; ix++)
+                    {
+                      if (paint_opacity > canvas_pixel[ix])
+                        canvas_pixel[ix] += (paint_opacity - canvas_pixel[ix]) * paint_mask_row[ix] * paint_opacity;
+                      paint_pixel[ix * 4 + 3] *= canvas_pixel[ix];
+                    }
+                }
+            }
+          else if (canvas_pixel)
+            {
+              for (ix = 0; ix < width; ix++)
+                paint_pixel[ix * 4 + 3] *= canvas_pixel[ix];
+            }
+          else if (paint_mask_row)
+            {
+              for (ix = 0; ix < width; ix++)
+                paint_pixel[ix * 4 + 3] *= paint_mask_row[ix] * paint_opacity;
+            }
+
           (*apply_func) (in_pixel,
                          paint_pixel,
                          mask_pixel,
                          out_pixel,
                          opacity,
-                         iter->roi[0].width,
+                         width,
                          &process_roi,
                          0);
 
-          in_pixel    += iter->roi[0].width * 4;
-          out_pixel   += iter->roi[0].width * 4;
+          in_pixel    += width * 4;
+          out_pixel   += width * 4;
           if (mask_buffer)
-            mask_pixel  += iter->roi[0].width;
+            mask_pixel  += width;
+          if (canvas_buffer)
+            canvas_pixel += width;
           paint_pixel += paint_stride * 4;
         }
     }
+
+  g_free (mask_row);
+}
+
+void
+do_layer_blend (GeglBuffer  *src_buffer,
+                GeglBuffer  *dst_buffer,
+                GimpTempBuf *paint_buf,
+                GeglBuffer  *mask_buffer,
+                gfloat       opacity,
+                gint         x_offset,
+                gint         y_offset,
+                gint         mask_x_offset,
+                gint         mask_y_offset,
+                gboolean     linear_mode,
+                GimpLayerModeEffects paint_mode)
+{
+  do_layer_blend_internal (NULL, 0, 0, 1.0, NULL, FALSE,
+                           src_buffer, dst_buffer, paint_buf, mask_buffer,
+                           opacity, x_offset, y_offset,
+                           mask_x_offset, mask_y_offset,
+                           linear_mode, paint_mode);
+}
+
+void
+do_layer_blend_with_paint_mask (const GimpTempBuf *paint_mask,
+                                gint               paint_mask_x_offset,
+                                gint               paint_mask_y_offset,
+                                gfloat             paint_opacity,
+                                GeglBuffer        *canvas_buffer,
+                                gboolean           stipple,
+                                GeglBuffer        *src_buffer,
+                                GeglBuffer        *dst_buffer,
+                                GimpTempBuf       *paint_buf,
+                                GeglBuffer        *mask_buffer,
+                                gfloat             opacity,
+                                gint               x_offset,
+                                gint               y_offset,
+                                gint               mask_x_offset,
+                                gint               mask_y_offset,
+                                gboolean           linear_mode,
+                                GimpLayerModeEffects paint_mode)
+{
+  g_return_if_fail (paint_mask != NULL || canvas_buffer != NULL);
+
+  do_layer_blend_internal (paint_mask,
+                           paint_mask_x_offset, paint_mask_y_offset,
+                           paint_opacity, canvas_buffer, stipple,
+                           src_buffer, dst_buffer, paint_buf, mask_buffer,
+                           opacity, x_offset, y_offset,
+                           mask_x_offset, mask_y_offset,
+                           linear_mode, paint_mode);
 }
 
 void
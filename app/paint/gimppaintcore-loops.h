@@ -47,6 +47,24 @@ void do_layer_blend                     (GeglBuffer  *src_buffer,
                                          gboolean     linear_mode,
                                          GimpLayerModeEffects paint_mode);
 
+void do_layer_blend_with_paint_mask     (const GimpTempBuf *paint_mask,
+                                         gint               paint_mask_x_offset,
+                                         gint               paint_mask_y_offset,
+                                         gfloat             paint_opacity,
+                                         GeglBuffer        *canvas_buffer,
+                                         gboolean           stipple,
+                                         GeglBuffer        *src_buffer,
+                                         GeglBuffer        *dst_buffer,
+                                         GimpTempBuf       *paint_buf,
+                                         GeglBuffer        *mask_buffer,
+                                         gfloat             opacity,
+                                         gint               x_offset,
+                                         gint               y_offset,
+                                         gint               mask_x_offset,
+                                         gint               mask_y_offset,
+                                         gboolean           linear_mode,
+                                         GimpLayerModeEffects paint_mode);
+
 void mask_components_onto               (GeglBuffer        *src_buffer,
                                          GeglBuffer        *aux_buffer,
                                          GeglBuffer        *dst_buffer,
@@ -32,6 +32,7 @@
 #include "gegl/gimp-gegl-nodes.h"
 #include "gegl/gimp-gegl-utils.h"
 #include "gegl/gimpapplicator.h"
+#include "gegl/gimptilehandlervalidate.h"
 
 #include "core/gimp.h"
 #include "core/gimp-utils.h"
@@ -109,6 +110,13 @@ static GimpUndo* gimp_paint_core_real_push_undo      (GimpPaintCore    *core,
                                                       GimpImage        *image,
                                                       const gchar      *undo_desc);
 
+static GeglBuffer *
+               gimp_paint_core_snapshot_new          (GeglBuffer       *buffer,
+                                                      GimpTileHandlerValidate **handler);
+static void      gimp_paint_core_snapshot_free       (GeglBuffer      **buffer,
+                                                      GimpTileHandlerValidate **handler);
+static GArray  * gimp_paint_core_get_undo_rects      (GimpPaintCore    *core);
+
 
 G_DEFINE_TYPE (GimpPaintCore, gimp_paint_core, GIMP_TYPE_OBJECT)
 
@@ -281,6 +289,128 @@ gimp_paint_core_real_push_undo (GimpPaintCore *core,
                                NULL);
 }
 
+/*  Instead of copying the whole drawable (and projection) when a
+ *  stroke starts, the undo buffers are empty buffers which copy a tile
+ *  from the original the first time the tile is accessed.  Everything
+ *  which modifies the drawable calls gimp_paint_core_save_undo_area()
+ *  first, so the original is always still there when this happens.
+ */
+static GeglBuffer *
+gimp_paint_core_snapshot_new (GeglBuffer               *buffer,
+                              GimpTileHandlerValidate **handler)
+{
+  GeglBuffer *snapshot;
+  GeglNode   *source;
+  gint        width  = gegl_buffer_get_width  (buffer);
+  gint        height = gegl_buffer_get_height (buffer);
+
+  snapshot = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                              gegl_buffer_get_format (buffer));
+
+  source = gegl_node_new_child (NULL,
+                                "operation", "gegl:buffer-source",
+                                "buffer",    buffer,
+                                NULL);
+
+  *handler = GIMP_TILE_HANDLER_VALIDATE (gimp_tile_handler_validate_new (source));
+
+  g_object_unref (source);
+
+  g_object_set (*handler,
+                "whole-tile", TRUE,
+                NULL);
+
+  gimp_tile_handler_validate_assign (*handler, snapshot);
+
+  gimp_tile_handler_validate_invalidate (*handler, 0, 0, width, height);
+
+  return snapshot;
+}
+
+static void
+gimp_paint_core_snapshot_free (GeglBuffer              **buffer,
+                               GimpTileHandlerValidate **handler)
+{
+  if (*buffer)
+    {
+      if (*handler)
+        gegl_buffer_remove_handler (*buffer, *handler);
+
+      g_object_unref (*buffer);
+      *buffer = NULL;
+    }
+
+  if (*handler)
+    {
+      g_object_unref (*handler);
+      *handler = NULL;
+    }
+}
+
+/*  returns the painted tiles as rectangles, merging runs of tiles
+ *  along rows and then equal runs in the rows below
+ */
+static GArray *
+gimp_paint_core_get_undo_rects (GimpPaintCore *core)
+{
+  GArray *rects;
+  guchar *tiles;
+  gint    width       = gegl_buffer_get_width  (core->undo_buffer);
+  gint    height      = gegl_buffer_get_height (core->undo_buffer);
+  gint    tile_width  = core->undo_handler->tile_width;
+  gint    tile_height = core->undo_handler->tile_height;
+  gint    n_cols      = (width  + tile_width  - 1) / tile_width;
+  gint    n_rows      = (height + tile_height - 1) / tile_height;
+  gint    col, row;
+
+  rects = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+
+  tiles = g_memdup (core->undo_tiles, n_cols * n_rows);
+
+  for (row = 0; row < n_rows; row++)
+    {
+      for (col = 0; col < n_cols; col++)
+        {
+          GeglRectangle rect;
+          gint          col2 = col;
+          gint          row2 = row + 1;
+          gint          r, c;
+
+          if (! tiles[row * n_cols + col])
+            continue;
+
+          while (col2 < n_cols && tiles[row * n_cols + col2])
+            col2++;
+
+          for (; row2 < n_rows; row2++)
+            {
+              for (c = col; c < col2; c++)
+                if (! tiles[row2 * n_cols + c])
+                  break;
+
+              if (c < col2)
+                break;
+            }
+
+          for (r = row; r < row2; r++)
+            memset (tiles + r * n_cols + col, 0, col2 - col);
+
+          rect.x      = col * tile_width;
+          rect.y      = row * tile_height;
+          rect.width  = MIN (col2 * tile_width,  width)  - rect.x;
+          rect.height = MIN (row2 * tile_height, height) - rect.y;
+
+          g_array_append_val (rects, rect);
+
+          col = col2;
+        }
+    }
+
+  g_free (tiles);
+
+  return rects;
+}
+
 
 /*  public functions  */
 
@@ -367,23 +497,35 @@ gimp_paint_core_start (GimpPaintCore     *core,
     }
 
   /*  Allocate the undo structure  */
-  if (core->undo_buffer)
-    g_object_unref (core->undo_buffer);
+  gimp_paint_core_snapshot_free (&core->undo_buffer, &core->undo_handler);
+
+  core->undo_buffer =
+    gimp_paint_core_snapshot_new (gimp_drawable_get_buffer (drawable),
+                                  &core->undo_handler);
+
+  g_free (core->undo_tiles);
 
-  core->undo_buffer = gegl_buffer_dup (gimp_drawable_get_buffer (drawable));
+  {
+    gint tile_width  = core->undo_handler->tile_width;
+    gint tile_height = core->undo_handler->tile_height;
+    gint n_cols      = (gimp_item_get_width  (item) + tile_width  - 1) /
+                       tile_width;
+    gint n_rows      = (gimp_item_get_height (item) + tile_height - 1) /
+                       tile_height;
+
+    core->undo_tiles = g_new0 (guchar, n_cols * n_rows);
+  }
 
   /*  Allocate the saved proj structure  */
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  gimp_paint_core_snapshot_free (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
   if (core->use_saved_proj)
     {
       GeglBuffer *buffer = gimp_pickable_get_buffer (GIMP_PICKABLE (image));
 
-      core->saved_proj_buffer = gegl_buffer_dup (buffer);
+      core->saved_proj_buffer =
+        gimp_paint_core_snapshot_new (buffer, &core->saved_proj_handler);
     }
 
   /*  Allocate the canvas blocks structure  */
@@ -525,46 +667,51 @@ gimp_paint_core_finish (GimpPaintCore *core,
 
   if (push_undo)
     {
-      GeglBuffer *buffer;
-      gint        x, y, width, height;
-
-      gimp_rectangle_intersect (core->x1, core->y1,
-                                core->x2 - core->x1, core->y2 - core->y1,
-                                0, 0,
-                                gimp_item_get_width  (GIMP_ITEM (drawable)),
-                                gimp_item_get_height (GIMP_ITEM (drawable)),
-                                &x, &y, &width, &height);
+      GArray *rects;
+      gint    i;
 
       gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_PAINT,
                                    core->undo_desc);
 
       GIMP_PAINT_CORE_GET_CLASS (core)->push_undo (core, image, NULL);
 
-      buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
-                                gimp_drawable_get_format (drawable));
+      /*  push only the tiles the stroke has painted, not its bounding
+       *  box
+       */
+      rects = gimp_paint_core_get_undo_rects (core);
+
+      for (i = 0; i < rects->len; i++)
+        {
+          const GeglRectangle *rect = &g_array_index (rects, GeglRectangle, i);
+          GeglBuffer          *buffer;
 
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        GEGL_ABYSS_NONE,
-                        buffer,
-                        GEGL_RECTANGLE (0, 0, 0, 0));
+          buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                                    rect->width, rect->height),
+                                    gimp_drawable_get_format (drawable));
 
-      gimp_drawable_push_undo (drawable, NULL,
-                               buffer, x, y, width, height);
+          gegl_buffer_copy (core->undo_buffer, rect,
+                            GEGL_ABYSS_NONE,
+                            buffer,
+                            GEGL_RECTANGLE (0, 0, 0, 0));
 
-      g_object_unref (buffer);
+          gimp_drawable_push_undo (drawable, NULL, buffer,
+                                   rect->x, rect->y,
+                                   rect->width, rect->height);
+
+          g_object_unref (buffer);
+        }
+
+      g_array_free (rects, TRUE);
 
       gimp_image_undo_group_end (image);
     }
 
-  g_object_unref (core->undo_buffer);
-  core->undo_buffer = NULL;
+  gimp_paint_core_snapshot_free (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_snapshot_free (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  g_free (core->undo_tiles);
+  core->undo_tiles = NULL;
 
   gimp_viewable_preview_thaw (GIMP_VIEWABLE (drawable));
 }
@@ -594,22 +741,28 @@ gimp_paint_core_cancel (GimpPaintCore *core,
                                 gimp_item_get_height (GIMP_ITEM (drawable)),
                                 &x, &y, &width, &height))
     {
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        GEGL_ABYSS_NONE,
-                        gimp_drawable_get_buffer (drawable),
-                        GEGL_RECTANGLE (x, y, width, height));
-    }
+      GArray *rects = gimp_paint_core_get_undo_rects (core);
+      gint    i;
 
-  g_object_unref (core->undo_buffer);
-  core->undo_buffer = NULL;
+      for (i = 0; i < rects->len; i++)
+        {
+          const GeglRectangle *rect = &g_array_index (rects, GeglRectangle, i);
 
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
+          gegl_buffer_copy (core->undo_buffer, rect,
+                            GEGL_ABYSS_NONE,
+                            gimp_drawable_get_buffer (drawable), rect);
+        }
+
+      g_array_free (rects, TRUE);
     }
 
+  gimp_paint_core_snapshot_free (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_snapshot_free (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
+
+  g_free (core->undo_tiles);
+  core->undo_tiles = NULL;
+
   gimp_drawable_update (drawable, x, y, width, height);
 
   gimp_viewable_preview_thaw (GIMP_VIEWABLE (drawable));
@@ -620,17 +773,12 @@ gimp_paint_core_cleanup (GimpPaintCore *core)
 {
   g_return_if_fail (GIMP_IS_PAINT_CORE (core));
 
-  if (core->undo_buffer)
-    {
-      g_object_unref (core->undo_buffer);
-      core->undo_buffer = NULL;
-    }
+  gimp_paint_core_snapshot_free (&core->undo_buffer, &core->undo_handler);
+  gimp_paint_core_snapshot_free (&core->saved_proj_buffer,
+                                 &core->saved_proj_handler);
 
-  if (core->saved_proj_buffer)
-    {
-      g_object_unref (core->saved_proj_buffer);
-      core->saved_proj_buffer = NULL;
-    }
+  g_free (core->undo_tiles);
+  core->undo_tiles = NULL;
 
   if (core->canvas_buffer)
     {
@@ -792,6 +940,89 @@ gimp_paint_core_get_orig_proj (GimpPaintCore *core)
   return core->saved_proj_buffer;
 }
 
+/**
+ * gimp_paint_core_save_undo_area:
+ * @core:     a #GimpPaintCore
+ * @drawable: the drawable being painted on
+ * @x:        x coordinate of the area
+ * @y:        y coordinate of the area
+ * @width:    width of the area
+ * @height:   height of the area
+ *
+ * Snapshots the tiles of the original drawable and projection which
+ * intersect the area, and adds them to the stroke's undo.  Must be
+ * called before the area's pixels are modified.
+ **/
+void
+gimp_paint_core_save_undo_area (GimpPaintCore *core,
+                                GimpDrawable  *drawable,
+                                gint           x,
+                                gint           y,
+                                gint           width,
+                                gint           height)
+{
+  GimpTileHandlerValidate *handler;
+  gint                     n_cols;
+  gint                     col1, row1;
+  gint                     col2, row2;
+  gint                     col, row;
+  gint                     offset_x;
+  gint                     offset_y;
+
+  g_return_if_fail (GIMP_IS_PAINT_CORE (core));
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (core->undo_buffer != NULL);
+
+  if (! gimp_rectangle_intersect (x, y, width, height,
+                                  0, 0,
+                                  gimp_item_get_width  (GIMP_ITEM (drawable)),
+                                  gimp_item_get_height (GIMP_ITEM (drawable)),
+                                  &x, &y, &width, &height))
+    {
+      return;
+    }
+
+  handler = core->undo_handler;
+
+  n_cols = ((gimp_item_get_width (GIMP_ITEM (drawable)) +
+             handler->tile_width - 1) / handler->tile_width);
+
+  col1 = x / handler->tile_width;
+  row1 = y / handler->tile_height;
+  col2 = (x + width  - 1) / handler->tile_width  + 1;
+  row2 = (y + height - 1) / handler->tile_height + 1;
+
+  gimp_item_get_offset (GIMP_ITEM (drawable), &offset_x, &offset_y);
+
+  for (row = row1; row < row2; row++)
+    for (col = col1; col < col2; col++)
+      {
+        gint tile_x;
+        gint tile_y;
+
+        if (core->undo_tiles[row * n_cols + col])
+          continue;
+
+        core->undo_tiles[row * n_cols + col] = TRUE;
+
+        tile_x = col * handler->tile_width;
+        tile_y = row * handler->tile_height;
+
+        gimp_tile_handler_validate_validate (handler, core->undo_buffer,
+                                             tile_x, tile_y,
+                                             handler->tile_width,
+                                             handler->tile_height);
+
+        if (core->saved_proj_buffer)
+          gimp_tile_handler_validate_validate (core->saved_proj_handler,
+                                               core->saved_proj_buffer,
+                                               tile_x + offset_x,
+                                               tile_y + offset_y,
+                                               handler->tile_width,
+                                               handler->tile_height);
+      }
+}
+
 void
 gimp_paint_core_paste (GimpPaintCore            *core,
                        const GimpTempBuf        *paint_mask,
@@ -806,6 +1037,11 @@ gimp_paint_core_paste (GimpPaintCore            *core,
   gint width  = gegl_buffer_get_width  (core->paint_buffer);
   gint height = gegl_buffer_get_height (core->paint_buffer);
 
+  gimp_paint_core_save_undo_area (core, drawable,
+                                  core->paint_buffer_x,
+                                  core->paint_buffer_y,
+                                  width, height);
+
   if (core->applicator)
     {
       /*  If the mode is CONSTANT:
@@ -899,57 +1135,60 @@ gimp_paint_core_paste (GimpPaintCore            *core,
 
       if (mode == GIMP_PAINT_CONSTANT)
         {
-          /* This step is skipped by the ink tool, which writes
-           * directly to canvas_buffer
+          /* Mixing the paint mask into canvas_buffer is skipped by the
+           * ink tool, which writes directly to canvas_buffer.
+           *
+           * Mix paint mask and canvas_buffer, write canvas_buffer to
+           * paint_buf's alpha, and blend: undo buf -> paint_buf ->
+           * dest_buffer, all in one pass
            */
-          if (paint_mask != NULL)
-            {
-              /* Mix paint mask and canvas_buffer */
-              combine_paint_mask_to_canvas_mask (paint_mask,
-                                                 paint_mask_offset_x,
-                                                 paint_mask_offset_y,
-                                                 core->canvas_buffer,
-                                                 core->paint_buffer_x,
-                                                 core->paint_buffer_y,
-                                                 paint_opacity,
-                                                 GIMP_IS_AIRBRUSH (core));
-            }
-
-          /* Write canvas_buffer to paint_buf */
-          canvas_buffer_to_paint_buf_alpha (paint_buf,
-                                            core->canvas_buffer,
-                                            core->paint_buffer_x,
-                                            core->paint_buffer_y);
-
-          /* undo buf -> paint_buf -> dest_buffer */
           src_buffer = core->undo_buffer;
+
+          do_layer_blend_with_paint_mask (paint_mask,
+                                          paint_mask_offset_x,
+                                          paint_mask_offset_y,
+                                          paint_opacity,
+                                          core->canvas_buffer,
+                                          GIMP_IS_AIRBRUSH (core),
+                                          src_buffer,
+                                          dest_buffer,
+                                          paint_buf,
+                                          core->mask_buffer,
+                                          image_opacity,
+                                          core->paint_buffer_x,
+                                          core->paint_buffer_y,
+                                          core->mask_x_offset,
+                                          core->mask_y_offset,
+                                          core->linear_mode,
+                                          paint_mode);
         }
       else
         {
           g_return_if_fail (paint_mask);
 
-          /* Write paint_mask to paint_buf, does not modify canvas_buffer */
-          paint_mask_to_paint_buffer (paint_mask,
-                                      paint_mask_offset_x,
-                                      paint_mask_offset_y,
-                                      paint_buf,
-                                      paint_opacity);
-
-          /* dest_buffer -> paint_buf -> dest_buffer */
+          /* Write paint_mask to paint_buf's alpha, without modifying
+           * canvas_buffer, and blend: dest_buffer -> paint_buf ->
+           * dest_buffer, in one pass
+           */
           src_buffer = dest_buffer;
-        }
 
-      do_layer_blend (src_buffer,
-                      dest_buffer,
-                      paint_buf,
-                      core->mask_buffer,
-                      image_opacity,
-                      core->paint_buffer_x,
-                      core->paint_buffer_y,
-                      core->mask_x_offset,
-                      core->mask_y_offset,
-                      core->linear_mode,
-                      paint_mode);
+          do_layer_blend_with_paint_mask (paint_mask,
+                                          paint_mask_offset_x,
+                                          paint_mask_offset_y,
+                                          paint_opacity,
+                                          NULL, FALSE,
+                                          src_buffer,
+                                          dest_buffer,
+                                          paint_buf,
+                                          core->mask_buffer,
+                                          image_opacity,
+                                          core->paint_buffer_x,
+                                          core->paint_buffer_y,
+                                          core->mask_x_offset,
+                                          core->mask_y_offset,
+                                          core->linear_mode,
+                                          paint_mode);
+        }
 
       if (core->comp_buffer)
         {
@@ -1015,6 +1254,11 @@ gimp_paint_core_replace (GimpPaintCore            *core,
   width  = gegl_buffer_get_width  (core->paint_buffer);
   height = gegl_buffer_get_height (core->paint_buffer);
 
+  gimp_paint_core_save_undo_area (core, drawable,
+                                  core->paint_buffer_x,
+                                  core->paint_buffer_y,
+                                  width, height);
+
   if (mode == GIMP_PAINT_CONSTANT &&
 
       /* Some tools (ink) paint the mask to paint_core->canvas_buffer
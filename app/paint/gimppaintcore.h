@@ -57,6 +57,9 @@ struct _GimpPaintCore
 
   GeglBuffer  *undo_buffer;       /*  pixels which have been modified     */
   GeglBuffer  *saved_proj_buffer; /*  proj tiles which have been modified */
+  GimpTileHandlerValidate *undo_handler;       /*  snapshots undo tiles    */
+  GimpTileHandlerValidate *saved_proj_handler; /*  snapshots proj tiles    */
+  guchar      *undo_tiles;        /*  which tiles have been modified      */
   GeglBuffer  *canvas_buffer;     /*  the buffer to paint the mask to     */
   GeglBuffer  *comp_buffer;       /*  scratch buffer used when masking components */
   gboolean     linear_mode;       /*  if painting to a linear surface     */
@@ -173,6 +176,13 @@ GeglBuffer * gimp_paint_core_get_paint_buffer       (GimpPaintCore    *core,
 GeglBuffer * gimp_paint_core_get_orig_image         (GimpPaintCore    *core);
 GeglBuffer * gimp_paint_core_get_orig_proj          (GimpPaintCore    *core);
 
+void      gimp_paint_core_save_undo_area            (GimpPaintCore    *core,
+                                                     GimpDrawable     *drawable,
+                                                     gint              x,
+                                                     gint              y,
+                                                     gint              width,
+                                                     gint              height);
+
 void      gimp_paint_core_paste             (GimpPaintCore            *core,
                                              const GimpTempBuf        *paint_mask,
                                              gint                      paint_mask_offset_x,
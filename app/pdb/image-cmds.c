@@ -50,6 +50,7 @@
 #include "core/gimpparamspecs.h"
 #include "core/gimppickable.h"
 #include "core/gimpprogress.h"
+#include "core/gimpprojection.h"
 #include "core/gimpselection.h"
 #include "core/gimptempbuf.h"
 #include "core/gimpunit.h"
@@ -2732,6 +2733,57 @@ image_get_parasite_list_invoker (GimpProcedure         *procedure,
   return return_vals;
 }
 
+static GimpValueArray *
+image_get_projection_stats_invoker (GimpProcedure         *procedure,
+                                    Gimp                  *gimp,
+                                    GimpContext           *context,
+                                    GimpProgress          *progress,
+                                    const GimpValueArray  *args,
+                                    GError               **error)
+{
+  gboolean success = TRUE;
+  GimpValueArray *return_vals;
+  GimpImage *image;
+  gdouble pixels_per_second = 0.0;
+  gint32 n_chunks = 0;
+  gint32 n_overruns = 0;
+  gint32 num_bins = 0;
+  gint32 *latency_bins = NULL;
+
+  image = gimp_value_get_image (gimp_value_array_index (args, 0), gimp);
+
+  if (success)
+    {
+      GimpProjection *projection = gimp_image_get_projection (image);
+      gint            bins[GIMP_PROJECTION_N_LATENCY_BINS];
+      gint            i;
+
+      gimp_projection_get_stats (projection,
+                                 &pixels_per_second, &n_chunks, &n_overruns,
+                                 bins);
+
+      num_bins     = GIMP_PROJECTION_N_LATENCY_BINS;
+      latency_bins = g_new (gint32, num_bins);
+
+      for (i = 0; i < num_bins; i++)
+        latency_bins[i] = bins[i];
+    }
+
+  return_vals = gimp_procedure_get_return_values (procedure, success,
+                                                  error ? *error : NULL);
+
+  if (success)
+    {
+      g_value_set_double (gimp_value_array_index (return_vals, 1), pixels_per_second);
+      g_value_set_int (gimp_value_array_index (return_vals, 2), n_chunks);
+      g_value_set_int (gimp_value_array_index (return_vals, 3), n_overruns);
+      g_value_set_int (gimp_value_array_index (return_vals, 4), num_bins);
+      gimp_value_take_int32array (gimp_value_array_index (return_vals, 5), latency_bins, num_bins);
+    }
+
+  return return_vals;
+}
+
 void
 register_image_procs (GimpPDB *pdb)
 {
@@ -5418,4 +5470,56 @@ register_image_procs (GimpPDB *pdb)
                                                                  GIMP_PARAM_READWRITE));
   gimp_pdb_register_procedure (pdb, procedure);
   g_object_unref (procedure);
+
+  /*
+   * gimp-image-get-projection-stats
+   */
+  procedure = gimp_procedure_new (image_get_projection_stats_invoker);
+  gimp_object_set_static_name (GIMP_OBJECT (procedure),
+                               "gimp-image-get-projection-stats");
+  gimp_procedure_set_static_strings (procedure,
+                                     "gimp-image-get-projection-stats",
+                                     "Returns render statistics of the image's projection.",
+                                     "This procedure returns the statistics collected while rendering the image's projection: the render throughput in pixels per second, the number of rendered chunks, the number of chunk renderer iterations which exceeded the renderer's time budget, and a histogram of iteration latencies. The first bin of the histogram counts iterations taking less than 1 ms, bin i counts iterations taking between 2^(i-1) and 2^i ms, and the last bin counts all slower ones.",
+                                     "Spencer Kimball & Peter Mattis",
+                                     "Spencer Kimball & Peter Mattis",
+                                     "1995-1996",
+                                     NULL);
+  gimp_procedure_add_argument (procedure,
+                               gimp_param_spec_image_id ("image",
+                                                         "image",
+                                                         "The image",
+                                                         pdb->gimp, FALSE,
+                                                         GIMP_PARAM_READWRITE));
+  gimp_procedure_add_return_value (procedure,
+                                   g_param_spec_double ("pixels-per-second",
+                                                        "pixels per second",
+                                                        "The render throughput in pixels per second",
+                                                        -G_MAXDOUBLE, G_MAXDOUBLE, 0,
+                                                        GIMP_PARAM_READWRITE));
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_param_spec_int32 ("n-chunks",
+                                                          "n chunks",
+                                                          "The number of rendered chunks",
+                                                          G_MININT32, G_MAXINT32, 0,
+                                                          GIMP_PARAM_READWRITE));
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_param_spec_int32 ("n-overruns",
+                                                          "n overruns",
+                                                          "The number of iterations which exceeded the time budget",
+                                                          G_MININT32, G_MAXINT32, 0,
+                                                          GIMP_PARAM_READWRITE));
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_param_spec_int32 ("num-bins",
+                                                          "num bins",
+                                                          "The number of histogram bins",
+                                                          0, G_MAXINT32, 0,
+                                                          GIMP_PARAM_READWRITE));
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_param_spec_int32_array ("latency-bins",
+                                                                "latency bins",
+                                                                "The iteration latency histogram. The returned value must be freed with g_free()",
+                                                                GIMP_PARAM_READWRITE));
+  gimp_pdb_register_procedure (pdb, procedure);
+  g_object_unref (procedure);
 }
@@ -0,0 +1,331 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpplugin-buffermap.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define USE_BUFFER_MAP 1
+#endif
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <gegl.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "plug-in-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpdrawable.h"
+#include "core/gimpdrawable-shadow.h"
+
+#include "gimpplugin.h"
+#include "gimpplugin-buffermap.h"
+#include "gimppluginmanager.h"
+
+#include "gimp-log.h"
+
+
+/*  A buffer map exports the pixels of a drawable's buffer, or of its
+ *  shadow buffer, as a file which the plug-in maps into its address
+ *  space, so it can access the whole drawable without transferring
+ *  any tiles.  Modifications are written back to the buffer when the
+ *  plug-in syncs or unmaps it.
+ */
+
+typedef struct _GimpPlugInBufferMap GimpPlugInBufferMap;
+
+struct _GimpPlugInBufferMap
+{
+  gint           map_ID;
+
+  GimpDrawable  *drawable;
+  gint           drawable_ID;
+  gboolean       shadow;
+
+  const Babl    *format;
+  GeglRectangle  extent;
+
+  GFile         *file;
+  guchar        *addr;
+  gsize          size;
+};
+
+
+/*  local function prototypes  */
+
+static GimpPlugInBufferMap *
+              gimp_plug_in_buffer_map_get  (GimpPlugIn          *plug_in,
+                                            gint                 map_ID);
+static void   gimp_plug_in_buffer_map_sync (GimpPlugIn          *plug_in,
+                                            GimpPlugInBufferMap *map,
+                                            const GeglRectangle *dirty);
+static void   gimp_plug_in_buffer_map_free (GimpPlugInBufferMap *map);
+
+
+/*  public functions  */
+
+gint
+gimp_plug_in_buffer_map_add (GimpPlugIn    *plug_in,
+                             GimpDrawable  *drawable,
+                             gboolean       shadow,
+                             const Babl    *format,
+                             gchar        **path)
+{
+#ifdef USE_BUFFER_MAP
+  static gint          next_map_ID = 1;
+  GimpPlugInBufferMap *map;
+  GeglBuffer          *buffer;
+  gchar               *filename;
+  gint                 fd;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN (plug_in), -1);
+  g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), -1);
+  g_return_val_if_fail (format != NULL, -1);
+  g_return_val_if_fail (path != NULL, -1);
+
+  *path = NULL;
+
+  if (shadow)
+    buffer = gimp_drawable_get_shadow_buffer (drawable);
+  else
+    buffer = gimp_drawable_get_buffer (drawable);
+
+  map = g_slice_new0 (GimpPlugInBufferMap);
+
+  map->drawable    = drawable;
+  map->drawable_ID = gimp_item_get_ID (GIMP_ITEM (drawable));
+  map->shadow      = shadow;
+  map->format      = format;
+  map->extent      = *gegl_buffer_get_extent (buffer);
+  map->size        = ((gsize) map->extent.width * map->extent.height *
+                      babl_format_get_bytes_per_pixel (format));
+  map->file        = gimp_get_temp_file (plug_in->manager->gimp, "map");
+  map->addr        = MAP_FAILED;
+
+  filename = g_file_get_path (map->file);
+
+  fd = g_open (filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd != -1)
+    {
+      if (ftruncate (fd, map->size) != -1)
+        {
+          map->addr = mmap (NULL, map->size,
+                            PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd, 0);
+        }
+
+      close (fd);
+    }
+
+  if (map->addr == MAP_FAILED)
+    {
+      g_warning ("%s: mapping '%s' failed: %s",
+                 G_STRFUNC, gimp_filename_to_utf8 (filename),
+                 g_strerror (errno));
+
+      g_free (filename);
+      gimp_plug_in_buffer_map_free (map);
+
+      return -1;
+    }
+
+  /*  the shadow buffer's contents are undefined, so the file is left
+   *  sparse, and only the pages the plug-in writes to get allocated
+   */
+  if (! shadow)
+    {
+      gegl_buffer_get (buffer, &map->extent, 1.0, map->format,
+                       map->addr,
+                       map->extent.width *
+                       babl_format_get_bytes_per_pixel (map->format),
+                       GEGL_ABYSS_NONE);
+    }
+
+  map->map_ID = next_map_ID++;
+
+  plug_in->buffer_maps = g_list_prepend (plug_in->buffer_maps, map);
+
+  GIMP_LOG (SHM, "mapped drawable %d (shadow = %d) as %s",
+            map->drawable_ID, shadow, filename);
+
+  *path = filename;
+
+  return map->map_ID;
+
+#else
+
+  *path = NULL;
+
+  return -1;
+
+#endif
+}
+
+gboolean
+gimp_plug_in_buffer_map_remove (GimpPlugIn          *plug_in,
+                                gint                 map_ID,
+                                const GeglRectangle *dirty)
+{
+  GimpPlugInBufferMap *map;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN (plug_in), FALSE);
+
+  map = gimp_plug_in_buffer_map_get (plug_in, map_ID);
+
+  if (! map)
+    return FALSE;
+
+  plug_in->buffer_maps = g_list_remove (plug_in->buffer_maps, map);
+
+  if (dirty && dirty->width > 0 && dirty->height > 0)
+    gimp_plug_in_buffer_map_sync (plug_in, map, dirty);
+
+  gimp_plug_in_buffer_map_free (map);
+
+  return TRUE;
+}
+
+gboolean
+gimp_plug_in_buffer_map_write_back (GimpPlugIn          *plug_in,
+                                    gint                 map_ID,
+                                    const GeglRectangle *dirty)
+{
+  GimpPlugInBufferMap *map;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN (plug_in), FALSE);
+  g_return_val_if_fail (dirty != NULL, FALSE);
+
+  map = gimp_plug_in_buffer_map_get (plug_in, map_ID);
+
+  if (! map)
+    return FALSE;
+
+  if (dirty->width > 0 && dirty->height > 0)
+    gimp_plug_in_buffer_map_sync (plug_in, map, dirty);
+
+  return TRUE;
+}
+
+void
+gimp_plug_in_buffer_map_remove_all (GimpPlugIn *plug_in)
+{
+  g_return_if_fail (GIMP_IS_PLUG_IN (plug_in));
+
+  g_list_free_full (plug_in->buffer_maps,
+                    (GDestroyNotify) gimp_plug_in_buffer_map_free);
+  plug_in->buffer_maps = NULL;
+}
+
+
+/*  private functions  */
+
+static GimpPlugInBufferMap *
+gimp_plug_in_buffer_map_get (GimpPlugIn *plug_in,
+                             gint        map_ID)
+{
+  GList *list;
+
+  for (list = plug_in->buffer_maps; list; list = g_list_next (list))
+    {
+      GimpPlugInBufferMap *map = list->data;
+
+      if (map->map_ID == map_ID)
+        return map;
+    }
+
+  return NULL;
+}
+
+static void
+gimp_plug_in_buffer_map_sync (GimpPlugIn          *plug_in,
+                              GimpPlugInBufferMap *map,
+                              const GeglRectangle *dirty)
+{
+  GimpDrawable  *drawable;
+  GeglBuffer    *buffer;
+  GeglRectangle  rect;
+  gint           bpp;
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   map->drawable_ID);
+
+  if (drawable != map->drawable ||
+      gimp_item_is_removed (GIMP_ITEM (drawable)))
+    return;
+
+  if (map->shadow)
+    {
+      buffer = gimp_drawable_get_shadow_buffer (drawable);
+    }
+  else
+    {
+      if (gimp_item_is_content_locked (GIMP_ITEM (drawable)) ||
+          gimp_viewable_get_children (GIMP_VIEWABLE (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a locked drawable or group "
+                        "layer %d, changes are discarded",
+                        gimp_object_get_name (plug_in),
+                        gimp_file_get_utf8_name (plug_in->file),
+                        map->drawable_ID);
+          return;
+        }
+
+      buffer = gimp_drawable_get_buffer (drawable);
+    }
+
+  /*  the buffer was replaced while the plug-in had it mapped  */
+  if (! gegl_rectangle_equal (gegl_buffer_get_extent (buffer), &map->extent))
+    return;
+
+  if (! gegl_rectangle_intersect (&rect, dirty, &map->extent))
+    return;
+
+  bpp = babl_format_get_bytes_per_pixel (map->format);
+
+  gegl_buffer_set (buffer, &rect, 0, map->format,
+                   map->addr +
+                   ((gsize) rect.y * map->extent.width + rect.x) * bpp,
+                   map->extent.width * bpp);
+}
+
+static void
+gimp_plug_in_buffer_map_free (GimpPlugInBufferMap *map)
+{
+#ifdef USE_BUFFER_MAP
+  if (map->addr != MAP_FAILED)
+    munmap (map->addr, map->size);
+#endif
+
+  g_file_delete (map->file, NULL, NULL);
+  g_object_unref (map->file);
+
+  g_slice_free (GimpPlugInBufferMap, map);
+}
@@ -0,0 +1,38 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpplugin-buffermap.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_PLUG_IN_BUFFER_MAP_H__
+#define __GIMP_PLUG_IN_BUFFER_MAP_H__
+
+
+gint       gimp_plug_in_buffer_map_add        (GimpPlugIn          *plug_in,
+                                               GimpDrawable        *drawable,
+                                               gboolean             shadow,
+                                               const Babl          *format,
+                                               gchar              **path);
+gboolean   gimp_plug_in_buffer_map_remove     (GimpPlugIn          *plug_in,
+                                               gint                 map_ID,
+                                               const GeglRectangle *dirty);
+gboolean   gimp_plug_in_buffer_map_write_back (GimpPlugIn          *plug_in,
+                                               gint                 map_ID,
+                                               const GeglRectangle *dirty);
+void       gimp_plug_in_buffer_map_remove_all (GimpPlugIn          *plug_in);
+
+
+#endif /* __GIMP_PLUG_IN_BUFFER_MAP_H__ */
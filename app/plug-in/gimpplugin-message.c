@@ -43,6 +43,7 @@
 #include "pdb/gimppdberror.h"
 
 #include "gimpplugin.h"
+#include "gimpplugin-buffermap.h"
 #include "gimpplugin-cleanup.h"
 #include "gimpplugin-message.h"
 #include "gimppluginmanager.h"
@@ -63,6 +64,18 @@ static void gimp_plug_in_handle_tile_put         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
 static void gimp_plug_in_handle_tile_get         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
+static void gimp_plug_in_handle_tile_batch       (GimpPlugIn      *plug_in,
+                                                  GPTileBatchReq  *request);
+static void gimp_plug_in_handle_tile_batch_put   (GimpPlugIn      *plug_in,
+                                                  GPTileBatchReq  *request);
+static void gimp_plug_in_handle_tile_batch_get   (GimpPlugIn      *plug_in,
+                                                  GPTileBatchReq  *request);
+static void gimp_plug_in_handle_buffer_map       (GimpPlugIn      *plug_in,
+                                                  GPBufferMapReq  *request);
+static void gimp_plug_in_handle_buffer_sync      (GimpPlugIn      *plug_in,
+                                                  GPBufferSync    *sync);
+static void gimp_plug_in_handle_buffer_unmap     (GimpPlugIn      *plug_in,
+                                                  GPBufferUnmap   *unmap);
 static void gimp_plug_in_handle_proc_run         (GimpPlugIn      *plug_in,
                                                   GPProcRun       *proc_run);
 static void gimp_plug_in_handle_proc_return      (GimpPlugIn      *plug_in,
@@ -76,6 +89,17 @@ static void gimp_plug_in_handle_proc_uninstall   (GimpPlugIn      *plug_in,
 static void gimp_plug_in_handle_extension_ack    (GimpPlugIn      *plug_in);
 static void gimp_plug_in_handle_has_init         (GimpPlugIn      *plug_in);
 
+static GeglBuffer * gimp_plug_in_get_batch_buffer (GimpPlugIn  *plug_in,
+                                                   gint32       drawable_ID,
+                                                   gboolean     shadow,
+                                                   gboolean     write,
+                                                   guint        tile_col,
+                                                   guint        tile_row,
+                                                   guint        n_tile_cols,
+                                                   guint        n_tile_rows,
+                                                   const Babl **format,
+                                                   gsize       *length);
+
 
 /*  public functions  */
 
@@ -160,6 +184,40 @@ gimp_plug_in_handle_message (GimpPlugIn      *plug_in,
     case GP_HAS_INIT:
       gimp_plug_in_handle_has_init (plug_in);
       break;
+
+    case GP_TILE_BATCH_REQ:
+      gimp_plug_in_handle_tile_batch (plug_in, msg->data);
+      break;
+
+    case GP_TILE_BATCH_DATA:
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a TILE_BATCH_DATA message.  This should not happen.",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file));
+      gimp_plug_in_close (plug_in, TRUE);
+      break;
+
+    case GP_BUFFER_MAP_REQ:
+      gimp_plug_in_handle_buffer_map (plug_in, msg->data);
+      break;
+
+    case GP_BUFFER_MAP:
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a BUFFER_MAP message.  This should not happen.",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file));
+      gimp_plug_in_close (plug_in, TRUE);
+      break;
+
+    case GP_BUFFER_UNMAP:
+      gimp_plug_in_handle_buffer_unmap (plug_in, msg->data);
+      break;
+
+    case GP_BUFFER_SYNC:
+      gimp_plug_in_handle_buffer_sync (plug_in, msg->data);
+      break;
     }
 }
 
@@ -469,6 +527,510 @@ gimp_plug_in_handle_tile_get (GimpPlugIn *plug_in,
   gimp_wire_destroy (&msg);
 }
 
+/*  tile batches transfer a rectangle of tiles in one round trip, the
+ *  tiles are packed one after the other, each with its own rowstride
+ */
+static void
+gimp_plug_in_handle_tile_batch (GimpPlugIn     *plug_in,
+                                GPTileBatchReq *request)
+{
+  g_return_if_fail (request != NULL);
+
+  if (request->drawable_ID == -1)
+    gimp_plug_in_handle_tile_batch_put (plug_in, request);
+  else
+    gimp_plug_in_handle_tile_batch_get (plug_in, request);
+}
+
+static void
+gimp_plug_in_handle_tile_batch_put (GimpPlugIn     *plug_in,
+                                    GPTileBatchReq *request)
+{
+  GPTileBatchData  batch_data = { 0, };
+  GPTileBatchData *batch_info;
+  GimpWireMessage  msg;
+  GeglBuffer      *buffer;
+  const Babl      *format;
+  const guchar    *data;
+  gsize            length;
+  gint             n_tile_cols;
+  guint            row;
+  guint            col;
+
+  batch_data.drawable_ID = -1;
+  batch_data.use_shm     = (plug_in->manager->shm != NULL);
+
+  if (! gp_tile_batch_data_write (plug_in->my_write, &batch_data, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (msg.type != GP_TILE_BATCH_DATA)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "expected tile batch data and received: %d", msg.type);
+      gimp_wire_destroy (&msg);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  batch_info = msg.data;
+
+  buffer = gimp_plug_in_get_batch_buffer (plug_in,
+                                          batch_info->drawable_ID,
+                                          batch_info->shadow,
+                                          TRUE,
+                                          batch_info->tile_col,
+                                          batch_info->tile_row,
+                                          batch_info->n_tile_cols,
+                                          batch_info->n_tile_rows,
+                                          &format, &length);
+
+  if (! buffer)
+    {
+      gimp_wire_destroy (&msg);
+      return;
+    }
+
+  if (batch_data.use_shm)
+    {
+      data = gimp_plug_in_shm_get_addr (plug_in->manager->shm);
+    }
+  else if (batch_info->length == length)
+    {
+      data = batch_info->data;
+    }
+  else
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a tile batch of wrong size (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file));
+      gimp_wire_destroy (&msg);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer,
+                                                  GIMP_PLUG_IN_TILE_WIDTH);
+
+  for (row = 0; row < batch_info->n_tile_rows; row++)
+    for (col = 0; col < batch_info->n_tile_cols; col++)
+      {
+        GeglRectangle tile_rect;
+
+        gimp_gegl_buffer_get_tile_rect (buffer,
+                                        GIMP_PLUG_IN_TILE_WIDTH,
+                                        GIMP_PLUG_IN_TILE_HEIGHT,
+                                        (batch_info->tile_row + row) *
+                                        n_tile_cols +
+                                        batch_info->tile_col + col,
+                                        &tile_rect);
+
+        gegl_buffer_set (buffer, &tile_rect, 0, format,
+                         data, GEGL_AUTO_ROWSTRIDE);
+
+        data += (tile_rect.width * tile_rect.height *
+                 babl_format_get_bytes_per_pixel (format));
+      }
+
+  gimp_wire_destroy (&msg);
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_tile_batch_get (GimpPlugIn     *plug_in,
+                                    GPTileBatchReq *request)
+{
+  GPTileBatchData  batch_data;
+  GimpWireMessage  msg;
+  GeglBuffer      *buffer;
+  const Babl      *format;
+  guchar          *data;
+  gsize            length;
+  gint             n_tile_cols;
+  guint            row;
+  guint            col;
+  gboolean         success;
+
+  buffer = gimp_plug_in_get_batch_buffer (plug_in,
+                                          request->drawable_ID,
+                                          request->shadow,
+                                          FALSE,
+                                          request->tile_col,
+                                          request->tile_row,
+                                          request->n_tile_cols,
+                                          request->n_tile_rows,
+                                          &format, &length);
+
+  if (! buffer)
+    return;
+
+  batch_data.drawable_ID = request->drawable_ID;
+  batch_data.shadow      = request->shadow;
+  batch_data.tile_col    = request->tile_col;
+  batch_data.tile_row    = request->tile_row;
+  batch_data.n_tile_cols = request->n_tile_cols;
+  batch_data.n_tile_rows = request->n_tile_rows;
+  batch_data.bpp         = babl_format_get_bytes_per_pixel (format);
+  batch_data.use_shm     = (plug_in->manager->shm != NULL);
+  batch_data.length      = length;
+  batch_data.data        = NULL;
+
+  if (batch_data.use_shm)
+    {
+      data = gimp_plug_in_shm_get_addr (plug_in->manager->shm);
+    }
+  else
+    {
+      batch_data.data = g_malloc (length);
+
+      data = batch_data.data;
+    }
+
+  n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer,
+                                                  GIMP_PLUG_IN_TILE_WIDTH);
+
+  for (row = 0; row < request->n_tile_rows; row++)
+    for (col = 0; col < request->n_tile_cols; col++)
+      {
+        GeglRectangle tile_rect;
+
+        gimp_gegl_buffer_get_tile_rect (buffer,
+                                        GIMP_PLUG_IN_TILE_WIDTH,
+                                        GIMP_PLUG_IN_TILE_HEIGHT,
+                                        (request->tile_row + row) *
+                                        n_tile_cols +
+                                        request->tile_col + col,
+                                        &tile_rect);
+
+        gegl_buffer_get (buffer, &tile_rect, 1.0, format,
+                         data, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+        data += tile_rect.width * tile_rect.height * batch_data.bpp;
+      }
+
+  success = gp_tile_batch_data_write (plug_in->my_write, &batch_data, plug_in);
+
+  g_free (batch_data.data);
+
+  if (! success)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (msg.type != GP_TILE_ACK)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "expected tile ack and received: %d", msg.type);
+      gimp_wire_destroy (&msg);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  gimp_wire_destroy (&msg);
+}
+
+static void
+gimp_plug_in_handle_buffer_map (GimpPlugIn     *plug_in,
+                                GPBufferMapReq *request)
+{
+  GPBufferMap   buffer_map = { -1, 0, 0, 0, NULL };
+  GimpDrawable *drawable;
+  const Babl   *format;
+  gboolean      success;
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   request->drawable_ID);
+
+  if (! GIMP_IS_DRAWABLE (drawable))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried mapping invalid drawable %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    request->drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+  else if (gimp_item_is_removed (GIMP_ITEM (drawable)))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried mapping drawable %d which was removed "
+                    "from the image (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    request->drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (request->shadow)
+    gimp_plug_in_cleanup_add_shadow (plug_in, drawable);
+
+  format = gimp_drawable_get_format (drawable);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      format = gimp_babl_compat_u8_format (format);
+    }
+
+  buffer_map.map_ID = gimp_plug_in_buffer_map_add (plug_in, drawable,
+                                                   request->shadow, format,
+                                                   &buffer_map.path);
+
+  if (buffer_map.map_ID != -1)
+    {
+      buffer_map.width  = gimp_item_get_width  (GIMP_ITEM (drawable));
+      buffer_map.height = gimp_item_get_height (GIMP_ITEM (drawable));
+      buffer_map.bpp    = babl_format_get_bytes_per_pixel (format);
+    }
+
+  success = gp_buffer_map_write (plug_in->my_write, &buffer_map, plug_in);
+
+  g_free (buffer_map.path);
+
+  if (! success)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_buffer_sync (GimpPlugIn   *plug_in,
+                                 GPBufferSync *sync)
+{
+  GeglRectangle dirty;
+
+  dirty.x      = sync->dirty_x;
+  dirty.y      = sync->dirty_y;
+  dirty.width  = sync->dirty_width;
+  dirty.height = sync->dirty_height;
+
+  if (! gimp_plug_in_buffer_map_write_back (plug_in, sync->map_ID, &dirty))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried syncing invalid buffer %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    sync->map_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_buffer_unmap (GimpPlugIn    *plug_in,
+                                  GPBufferUnmap *unmap)
+{
+  GeglRectangle dirty;
+
+  dirty.x      = unmap->dirty_x;
+  dirty.y      = unmap->dirty_y;
+  dirty.width  = unmap->dirty_width;
+  dirty.height = unmap->dirty_height;
+
+  if (! gimp_plug_in_buffer_map_remove (plug_in, unmap->map_ID, &dirty))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried unmapping invalid buffer %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    unmap->map_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+/*  validates a tile batch request and returns the buffer it refers to,
+ *  or closes the plug-in and returns NULL
+ */
+static GeglBuffer *
+gimp_plug_in_get_batch_buffer (GimpPlugIn  *plug_in,
+                               gint32       drawable_ID,
+                               gboolean     shadow,
+                               gboolean     write,
+                               guint        tile_col,
+                               guint        tile_row,
+                               guint        n_tile_cols,
+                               guint        n_tile_rows,
+                               const Babl **format,
+                               gsize       *length)
+{
+  GimpDrawable *drawable;
+  GeglBuffer   *buffer;
+  gint          buffer_tile_cols;
+  gint          buffer_tile_rows;
+  guint         row;
+  guint         col;
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   drawable_ID);
+
+  if (! GIMP_IS_DRAWABLE (drawable))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing invalid drawable %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+  else if (gimp_item_is_removed (GIMP_ITEM (drawable)))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing drawable %d which was removed "
+                    "from the image (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file),
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+
+  if (shadow)
+    {
+      /*  see gimp_plug_in_handle_tile_put() for why locked drawables
+       *  and groups are not checked here
+       */
+      buffer = gimp_drawable_get_shadow_buffer (drawable);
+
+      gimp_plug_in_cleanup_add_shadow (plug_in, drawable);
+    }
+  else
+    {
+      if (write && gimp_item_is_content_locked (GIMP_ITEM (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a locked drawable %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_file_get_utf8_name (plug_in->file),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+      else if (write &&
+               gimp_viewable_get_children (GIMP_VIEWABLE (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a group layer %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_file_get_utf8_name (plug_in->file),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+
+      buffer = gimp_drawable_get_buffer (drawable);
+    }
+
+  buffer_tile_cols =
+    gimp_gegl_buffer_get_n_tile_cols (buffer, GIMP_PLUG_IN_TILE_WIDTH);
+  buffer_tile_rows =
+    gimp_gegl_buffer_get_n_tile_rows (buffer, GIMP_PLUG_IN_TILE_HEIGHT);
+
+  if (n_tile_cols < 1 || n_tile_rows < 1                          ||
+      n_tile_cols * n_tile_rows > GP_TILE_BATCH_MAX_TILES          ||
+      tile_col >= buffer_tile_cols || tile_row >= buffer_tile_rows ||
+      n_tile_cols > buffer_tile_cols - tile_col                    ||
+      n_tile_rows > buffer_tile_rows - tile_row)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "requested invalid tile batch (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_file_get_utf8_name (plug_in->file));
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+
+  *format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      *format = gimp_babl_compat_u8_format (*format);
+    }
+
+  *length = 0;
+
+  for (row = 0; row < n_tile_rows; row++)
+    for (col = 0; col < n_tile_cols; col++)
+      {
+        GeglRectangle tile_rect;
+
+        gimp_gegl_buffer_get_tile_rect (buffer,
+                                        GIMP_PLUG_IN_TILE_WIDTH,
+                                        GIMP_PLUG_IN_TILE_HEIGHT,
+                                        (tile_row + row) * buffer_tile_cols +
+                                        tile_col + col,
+                                        &tile_rect);
+
+        *length += (gsize) tile_rect.width * tile_rect.height;
+      }
+
+  *length *= babl_format_get_bytes_per_pixel (*format);
+
+  return buffer;
+}
+
 static void
 gimp_plug_in_handle_proc_error (GimpPlugIn          *plug_in,
                                 GimpPlugInProcFrame *proc_frame,
@@ -82,6 +82,7 @@
 #include "gimpenvirontable.h"
 #include "gimpinterpreterdb.h"
 #include "gimpplugin.h"
+#include "gimpplugin-buffermap.h"
 #include "gimpplugin-message.h"
 #include "gimpplugin-progress.h"
 #include "gimpplugindebug.h"
@@ -587,6 +588,9 @@ gimp_plug_in_close (GimpPlugIn *plug_in,
   while (plug_in->temp_procedures)
     gimp_plug_in_remove_temp_proc (plug_in, plug_in->temp_procedures->data);
 
+  /* Drop the buffers the plug-in did not unmap. */
+  gimp_plug_in_buffer_map_remove_all (plug_in);
+
   gimp_plug_in_manager_remove_open_plug_in (plug_in->manager, plug_in);
 }
 
@@ -69,6 +69,8 @@ struct _GimpPlugIn
   GList               *temp_proc_frames;
 
   GimpPlugInDef       *plug_in_def;     /*  Valid during query() and init()   */
+
+  GList               *buffer_maps;     /*  Buffers mapped by the plug-in     */
 };
 
 struct _GimpPlugInClass
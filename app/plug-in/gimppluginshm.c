@@ -47,6 +47,9 @@
 #include <gio/gio.h>
 #include <gegl.h>
 
+#include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpprotocol.h"
+
 #if defined(G_OS_WIN32) || defined(G_WITH_CYGWIN)
 
 #define STRICT
@@ -71,7 +74,9 @@
 #include "gimp-log.h"
 
 
-#define TILE_MAP_SIZE (GIMP_PLUG_IN_TILE_WIDTH * GIMP_PLUG_IN_TILE_HEIGHT * 32)
+/*  large enough for a full tile batch at the largest pixel size  */
+#define TILE_MAP_SIZE (GIMP_PLUG_IN_TILE_WIDTH * GIMP_PLUG_IN_TILE_HEIGHT * \
+                       32 * GP_TILE_BATCH_MAX_TILES)
 
 #define ERRMSG_SHM_DISABLE "Disabling shared memory tile transport"
 
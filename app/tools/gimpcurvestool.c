@@ -207,7 +207,7 @@ gimp_curves_tool_initialize (GimpTool     *tool,
                                       curves_menu_sensitivity, drawable, NULL);
 
   histogram = gimp_histogram_new (TRUE);
-  gimp_drawable_calculate_histogram (drawable, histogram);
+  gimp_drawable_calculate_histogram_quick (drawable, histogram);
   gimp_histogram_view_set_background (GIMP_HISTOGRAM_VIEW (c_tool->graph),
                                       histogram);
   g_object_unref (histogram);
@@ -103,12 +103,13 @@ gimp_histogram_editor_init (GimpHistogramEditor *editor)
       N_("Percentile:")
     };
 
-  editor->drawable     = NULL;
-  editor->histogram    = NULL;
-  editor->bg_histogram = NULL;
-  editor->valid        = FALSE;
-  editor->idle_id      = 0;
-  editor->box          = gimp_histogram_box_new ();
+  editor->drawable           = NULL;
+  editor->drawable_histogram = NULL;
+  editor->histogram          = NULL;
+  editor->bg_histogram       = NULL;
+  editor->valid              = FALSE;
+  editor->idle_id            = 0;
+  editor->box                = gimp_histogram_box_new ();
 
   gimp_editor_set_show_name (GIMP_EDITOR (editor), TRUE);
 
@@ -332,12 +333,23 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
       g_signal_handlers_disconnect_by_func (editor->drawable,
                                             gimp_histogram_editor_frozen_update,
                                             editor);
+
+      if (editor->drawable_histogram)
+        {
+          gimp_drawable_histogram_free (editor->drawable_histogram);
+          editor->drawable_histogram = NULL;
+        }
+
       editor->drawable = NULL;
     }
 
   if (image)
     editor->drawable = (GimpDrawable *) gimp_image_get_active_layer (image);
 
+  if (editor->drawable && editor->histogram)
+    editor->drawable_histogram =
+      gimp_drawable_histogram_new (editor->drawable, editor->histogram);
+
   gimp_histogram_editor_menu_update (editor);
 
   if (editor->drawable)
@@ -372,8 +384,8 @@ gimp_histogram_editor_validate (GimpHistogramEditor *editor)
 {
   if (! editor->valid && editor->histogram)
     {
-      if (editor->drawable)
-        gimp_drawable_calculate_histogram (editor->drawable, editor->histogram);
+      if (editor->drawable_histogram)
+        gimp_drawable_histogram_update (editor->drawable_histogram);
       else
         gimp_histogram_clear_values (editor->histogram);
 
@@ -34,18 +34,19 @@ typedef struct _GimpHistogramEditorClass GimpHistogramEditorClass;
 
 struct _GimpHistogramEditor
 {
-  GimpImageEditor       parent_instance;
+  GimpImageEditor        parent_instance;
 
-  GimpDrawable         *drawable;
-  GimpHistogram        *histogram;
-  GimpHistogram        *bg_histogram;
+  GimpDrawable          *drawable;
+  GimpDrawableHistogram *drawable_histogram;
+  GimpHistogram         *histogram;
+  GimpHistogram         *bg_histogram;
 
-  guint                 idle_id;
-  gboolean              valid;
+  guint                  idle_id;
+  gboolean               valid;
 
-  GtkWidget            *menu;
-  GtkWidget            *box;
-  GtkWidget            *labels[6];
+  GtkWidget             *menu;
+  GtkWidget             *box;
+  GtkWidget             *labels[6];
 };
 
 struct _GimpHistogramEditorClass
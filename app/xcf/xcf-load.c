@@ -32,6 +32,7 @@
 #include "config/gimpcoreconfig.h"
 
 #include "gegl/gimp-gegl-tile-compat.h"
+#include "gegl/gimp-parallel.h"
 
 #include "core/gimp.h"
 #include "core/gimpcontainer.h"
@@ -68,6 +69,7 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-seek.h"
+#include "xcf-tile-handler.h"
 
 #include "gimp-log.h"
 #include "gimp-intl.h"
@@ -77,6 +79,28 @@
 
 /* #define GIMP_XCF_PATH_DEBUG */
 
+/* the number of tiles per thread which xcf_load_level() decodes in
+ * one batch
+ */
+#define XCF_LOAD_TILES_PER_THREAD 4
+
+
+typedef struct
+{
+  GeglRectangle  rect;
+  guchar        *data;
+  gint           data_length;
+  guchar        *tile_data;
+  gboolean       success;
+} XcfLoadTile;
+
+typedef struct
+{
+  XcfCompressionType  compression;
+  gint                bpp;
+  XcfLoadTile        *tiles;
+} XcfLoadTileBatch;
+
 
 static void            xcf_load_add_masks     (GimpImage     *image);
 static gboolean        xcf_load_image_props   (XcfInfo       *info,
@@ -107,20 +131,19 @@ static gboolean        xcf_load_buffer        (XcfInfo       *info,
                                                GeglBuffer    *buffer);
 static gboolean        xcf_load_level         (XcfInfo       *info,
                                                GeglBuffer    *buffer);
-static gboolean        xcf_load_tile          (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format);
-static gboolean        xcf_load_tile_rle      (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format,
-                                               gint           data_length);
-static gboolean        xcf_load_tile_zlib     (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format,
-                                               gint           data_length);
+static gboolean        xcf_load_lazy_tiles    (void);
+static void            xcf_load_decode_tiles  (gsize          offset,
+                                               gsize          size,
+                                               gpointer       data);
+static gboolean        xcf_load_tile_rle      (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           n_pixels,
+                                               gint           bpp);
+static gboolean        xcf_load_tile_zlib     (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           tile_size);
 static GimpParasite  * xcf_load_parasite      (XcfInfo       *info);
 static gboolean        xcf_load_old_paths     (XcfInfo       *info,
                                                GimpImage     *image);
@@ -551,6 +574,47 @@ xcf_load_image (Gimp     *gimp,
   return NULL;
 }
 
+/**
+ * xcf_load_tile_data:
+ * @compression: the compression of the tile data
+ * @data:        the tile data, as stored in the XCF file
+ * @data_length: the length of @data
+ * @tile_data:   return location for the decoded pixels
+ * @n_pixels:    the number of pixels of the tile
+ * @bpp:         the number of bytes per pixel
+ *
+ * Decodes one tile of a level.  This doesn't touch any #XcfInfo and
+ * may be called from any thread.
+ *
+ * Return value: %FALSE if @data is corrupt.
+ **/
+gboolean
+xcf_load_tile_data (XcfCompressionType  compression,
+                    const guchar       *data,
+                    gint                data_length,
+                    guchar             *tile_data,
+                    gint                n_pixels,
+                    gint                bpp)
+{
+  gint tile_size = n_pixels * bpp;
+
+  switch (compression)
+    {
+    case COMPRESS_NONE:
+      memcpy (tile_data, data, MIN (data_length, tile_size));
+      return TRUE;
+
+    case COMPRESS_RLE:
+      return xcf_load_tile_rle (data, data_length, tile_data, n_pixels, bpp);
+
+    case COMPRESS_ZLIB:
+      return xcf_load_tile_zlib (data, data_length, tile_data, tile_size);
+
+    default:
+      return FALSE;
+    }
+}
+
 static void
 xcf_load_add_masks (GimpImage *image)
 {
@@ -1714,17 +1778,23 @@ static gboolean
 xcf_load_level (XcfInfo    *info,
                 GeglBuffer *buffer)
 {
-  const Babl *format;
-  gint        bpp;
-  guint32     saved_pos;
-  guint32     offset, offset2;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        width;
-  gint        height;
-  gint        i;
-  gint        fail;
+  const Babl       *format;
+  XcfLoadTileBatch  batch;
+  gint              bpp;
+  guint32           offset;
+  guint32          *offsets;
+  guint32           table_end;
+  gint              n_tile_rows;
+  gint              n_tile_cols;
+  guint             ntiles;
+  gint              width;
+  gint              height;
+  gint              max_tile_size;
+  gint              max_data_length;
+  gint              n_batch_tiles;
+  gint              i;
+  gint              j;
+  gboolean          success = TRUE;
 
   format = gegl_buffer_get_format (buffer);
   bpp    = babl_format_get_bytes_per_pixel (format);
@@ -1748,163 +1818,269 @@ xcf_load_level (XcfInfo    *info,
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
-  for (i = 0; i < ntiles; i++)
-    {
-      GeglRectangle rect;
 
-      fail = FALSE;
+  /* read in the rest of the offset table at once, the tiles are
+   * stored in order, so the next tile's offset tells us the amount
+   * of data needed for a tile
+   */
+  offsets = g_new0 (guint32, ntiles + 1);
 
-      if (offset == 0)
+  offsets[0] = offset;
+  info->cp += xcf_read_int32 (info->input, offsets + 1, ntiles);
+
+  table_end = info->cp;
+
+  for (i = 0; i < ntiles; i++)
+    {
+      if (offsets[i] == 0)
         {
           gimp_message_literal (info->gimp, G_OBJECT (info->progress),
                                 GIMP_MESSAGE_ERROR,
                                 "not enough tiles found in level");
+          g_free (offsets);
           return FALSE;
         }
+    }
 
-      /* save the current position as it is where the
-       *  next tile offset is stored.
-       */
-      saved_pos = info->cp;
+  if (offsets[ntiles] != 0)
+    {
+      gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
+                    "encountered garbage after reading level: %d",
+                    offsets[ntiles]);
+      g_free (offsets);
+      return FALSE;
+    }
 
-      /* read in the offset of the next tile so we can calculate the amount
-         of data needed for this tile*/
-      info->cp += xcf_read_int32 (info->input, &offset2, 1);
+  switch (info->compression)
+    {
+    case COMPRESS_NONE:
+    case COMPRESS_RLE:
+    case COMPRESS_ZLIB:
+      break;
+    case COMPRESS_FRACTAL:
+      g_printerr ("xcf: fractal compression unimplemented. "
+                  "Possibly corrupt XCF file.");
+      g_free (offsets);
+      return FALSE;
+    default:
+      g_printerr ("xcf: unknown compression. "
+                  "Possibly corrupt XCF file.");
+      g_free (offsets);
+      return FALSE;
+    }
+
+  /*  keep a reader on the file only if it can outlive the load, and
+   *  otherwise decode the tiles right away
+   */
+  if (xcf_load_lazy_tiles () &&
+      ! info->tile_reader    &&
+      ! info->tile_reader_failed)
+    {
+      info->tile_reader = xcf_tile_reader_new (info->gimp, info->file,
+                                               info->input);
 
-      /* if the offset is 0 then we need to read in the maximum possible
-         allowing for negative compression */
-      if (offset2 == 0)
-        offset2 = offset + XCF_TILE_WIDTH * XCF_TILE_WIDTH * bpp * 1.5;
-                                        /* 1.5 is probably more
-                                           than we need to allow */
+      if (! info->tile_reader)
+        {
+          GIMP_LOG (XCF, "can't keep file open, loading tiles eagerly");
 
-      /* seek to the tile offset */
-      if (! xcf_seek_pos (info, offset, NULL))
-        return FALSE;
+          info->tile_reader_failed = TRUE;
+        }
+    }
+
+  if (info->tile_reader)
+    {
+      GeglTileHandler *handler;
+
+      GIMP_LOG (XCF, "deferring %d tiles", ntiles);
 
-      /* get the tile from the tile manager */
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+      handler = xcf_tile_handler_new (info->tile_reader, info->compression,
+                                      offsets, ntiles, width, height,
+                                      format);
 
-      GIMP_LOG (XCF, "loading tile %d/%d", i + 1, ntiles);
+      xcf_tile_handler_assign (XCF_TILE_HANDLER (handler), buffer);
+      g_object_unref (handler);
 
-      /* read in the tile */
-      switch (info->compression)
+      g_free (offsets);
+
+      return TRUE;
+    }
+
+  /* the tile data is read in batches, which are decoded in parallel,
+   * and then stored in the buffer in order.  the data of the last
+   * tile isn't delimited by a next offset, so read the maximum
+   * possible, allowing for negative compression.  1.5 is probably
+   * more than we need to allow.
+   */
+  max_tile_size   = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+  max_data_length = max_tile_size * 1.5;
+
+  batch.compression = info->compression;
+  batch.bpp         = bpp;
+
+  n_batch_tiles = MIN (ntiles,
+                       gimp_parallel_get_n_threads () *
+                       XCF_LOAD_TILES_PER_THREAD);
+
+  batch.tiles = g_new0 (XcfLoadTile, n_batch_tiles);
+
+  for (j = 0; j < n_batch_tiles; j++)
+    {
+      batch.tiles[j].data      = g_malloc (max_data_length);
+      batch.tiles[j].tile_data = g_malloc (max_tile_size);
+    }
+
+  for (i = 0; i < ntiles && success; i += n_batch_tiles)
+    {
+      gint n_tiles = MIN (n_batch_tiles, ntiles - i);
+
+      for (j = 0; j < n_tiles; j++)
         {
-        case COMPRESS_NONE:
-          if (!xcf_load_tile (info, buffer, &rect, format))
-            fail = TRUE;
-          break;
-        case COMPRESS_RLE:
-          if (!xcf_load_tile_rle (info, buffer, &rect, format,
-                                  offset2 - offset))
-            fail = TRUE;
-          break;
-        case COMPRESS_ZLIB:
-          if (!xcf_load_tile_zlib (info, buffer, &rect, format,
-                                   offset2 - offset))
-            fail = TRUE;
-          break;
-        case COMPRESS_FRACTAL:
-          g_printerr ("xcf: fractal compression unimplemented. "
-                      "Possibly corrupt XCF file.");
-          fail = TRUE;
-          break;
-        default:
-          g_printerr ("xcf: unknown compression. "
-                      "Possibly corrupt XCF file.");
-          fail = TRUE;
-          break;
+          XcfLoadTile *tile = &batch.tiles[j];
+          gint         data_length;
+          gsize        bytes_read;
+
+          gimp_gegl_buffer_get_tile_rect (buffer,
+                                          XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                          i + j, &tile->rect);
+
+          if (info->compression == COMPRESS_NONE)
+            data_length = tile->rect.width * tile->rect.height * bpp;
+          else if (offsets[i + j + 1] != 0)
+            data_length = offsets[i + j + 1] - offsets[i + j];
+          else
+            data_length = max_data_length;
+
+          data_length = MIN (data_length, max_data_length);
+
+          tile->data_length = 0;
+
+          /* Workaround for bug #357809: avoid crashing on g_malloc()
+           * and skip this tile (without storing data) as if it did
+           * not contain any data.  It is better than failing, which
+           * would skip the whole hierarchy while there may still be
+           * some valid tiles in the file.
+           */
+          if (data_length <= 0)
+            continue;
+
+          /* seek to the tile offset */
+          if (! xcf_seek_pos (info, offsets[i + j], NULL))
+            {
+              success = FALSE;
+              break;
+            }
+
+          GIMP_LOG (XCF, "loading tile %d/%d", i + j + 1, ntiles);
+
+          /* we have to read directly instead of xcf_read_* because we
+           * may be reading past the end of the file here
+           */
+          g_input_stream_read_all (info->input, tile->data, data_length,
+                                   &bytes_read, NULL, NULL);
+
+          info->cp += bytes_read;
+
+          tile->data_length = bytes_read;
         }
 
-      if (fail)
-        return FALSE;
+      if (! success)
+        break;
 
-      GIMP_LOG (XCF, "loaded tile %d/%d", i + 1, ntiles);
+      gimp_parallel_distribute_range (n_tiles, 1,
+                                      xcf_load_decode_tiles, &batch);
 
-      /* restore the saved position so we'll be ready to
-       *  read the next offset.
-       */
-      if (!xcf_seek_pos (info, saved_pos, NULL))
-        return FALSE;
+      for (j = 0; j < n_tiles; j++)
+        {
+          XcfLoadTile *tile = &batch.tiles[j];
 
-      /* read in the offset of the next tile */
-      info->cp += xcf_read_int32 (info->input, &offset, 1);
+          if (! tile->success)
+            {
+              success = FALSE;
+              break;
+            }
+
+          if (tile->data_length > 0)
+            gegl_buffer_set (buffer, &tile->rect, 0, format, tile->tile_data,
+                             GEGL_AUTO_ROWSTRIDE);
+
+          GIMP_LOG (XCF, "loaded tile %d/%d", i + j + 1, ntiles);
+        }
     }
 
-  if (offset != 0)
+  for (j = 0; j < n_batch_tiles; j++)
     {
-      gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
-                    "encountered garbage after reading level: %d", offset);
-      return FALSE;
+      g_free (batch.tiles[j].data);
+      g_free (batch.tiles[j].tile_data);
     }
 
-  return TRUE;
+  g_free (batch.tiles);
+  g_free (offsets);
+
+  if (! success)
+    return FALSE;
+
+  /* leave the stream after the offset table, where reading the
+   * offsets one by one used to leave it
+   */
+  return xcf_seek_pos (info, table_end, NULL);
 }
 
 static gboolean
-xcf_load_tile (XcfInfo       *info,
-               GeglBuffer    *buffer,
-               GeglRectangle *tile_rect,
-               const Babl    *format)
+xcf_load_lazy_tiles (void)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-
-  info->cp += xcf_read_int8 (info->input, tile_data, tile_size);
+  static gint lazy_tiles = -1;
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
+  if (lazy_tiles < 0)
+    lazy_tiles = g_getenv ("GIMP_XCF_LAZY_LOAD") != NULL;
 
-  return TRUE;
+  return lazy_tiles;
 }
 
-static gboolean
-xcf_load_tile_rle (XcfInfo       *info,
-                   GeglBuffer    *buffer,
-                   GeglRectangle *tile_rect,
-                   const Babl    *format,
-                   gint           data_length)
+static void
+xcf_load_decode_tiles (gsize    offset,
+                       gsize    size,
+                       gpointer data)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    i;
-  gsize   nmemb_read_successfully;
-  guchar *xcfdata;
-  guchar *xcfodata;
-  guchar *xcfdatalimit;
-
-  /* Workaround for bug #357809: avoid crashing on g_malloc() and skip
-   * this tile (return TRUE without storing data) as if it did not
-   * contain any data.  It is better than returning FALSE, which would
-   * skip the whole hierarchy while there may still be some valid
-   * tiles in the file.
-   */
-  if (data_length <= 0)
-    return TRUE;
-
-  xcfdata = xcfodata = g_alloca (data_length);
+  XcfLoadTileBatch *batch = data;
+  gsize             i;
 
-  /* we have to read directly instead of xcf_read_* because we may be
-   * reading past the end of the file here
-   */
-  g_input_stream_read_all (info->input, xcfdata, data_length,
-                           &nmemb_read_successfully, NULL, NULL);
+  for (i = offset; i < offset + size; i++)
+    {
+      XcfLoadTile *tile = &batch->tiles[i];
 
-  if (nmemb_read_successfully == 0)
-    return TRUE;
+      if (tile->data_length > 0)
+        {
+          tile->success = xcf_load_tile_data (batch->compression,
+                                              tile->data,
+                                              tile->data_length,
+                                              tile->tile_data,
+                                              tile->rect.width *
+                                              tile->rect.height,
+                                              batch->bpp);
+        }
+      else
+        {
+          tile->success = TRUE;
+        }
+    }
+}
 
-  info->cp += nmemb_read_successfully;
+static gboolean
+xcf_load_tile_rle (const guchar *xcfdata,
+                   gint          data_length,
+                   guchar       *tile_data,
+                   gint          n_pixels,
+                   gint          bpp)
+{
+  const guchar *xcfdatalimit;
+  gint          i;
 
-  xcfdatalimit = &xcfodata[nmemb_read_successfully - 1];
+  xcfdatalimit = &xcfdata[data_length - 1];
 
   for (i = 0; i < bpp; i++)
     {
       guchar *data  = tile_data + i;
-      gint    size  = tile_rect->width * tile_rect->height;
+      gint    size  = n_pixels;
       gint    count = 0;
       guchar  val;
       gint    length;
@@ -1991,9 +2167,6 @@ xcf_load_tile_rle (XcfInfo       *info,
         }
     }
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
-
   return TRUE;
 
  bogus_rle:
@@ -2001,42 +2174,14 @@ xcf_load_tile_rle (XcfInfo       *info,
 }
 
 static gboolean
-xcf_load_tile_zlib (XcfInfo       *info,
-                    GeglBuffer    *buffer,
-                    GeglRectangle *tile_rect,
-                    const Babl    *format,
-                    gint           data_length)
+xcf_load_tile_zlib (const guchar *xcfdata,
+                    gint          data_length,
+                    guchar       *tile_data,
+                    gint          tile_size)
 {
   z_stream  strm;
   int       action;
   int       status;
-  gint      bpp       = babl_format_get_bytes_per_pixel (format);
-  gint      tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar   *tile_data = g_alloca (tile_size);
-  gsize     bytes_read;
-  guchar   *xcfdata;
-
-  /* Workaround for bug #357809: avoid crashing on g_malloc() and skip
-   * this tile (return TRUE without storing data) as if it did not
-   * contain any data.  It is better than returning FALSE, which would
-   * skip the whole hierarchy while there may still be some valid
-   * tiles in the file.
-   */
-  if (data_length <= 0)
-    return TRUE;
-
-  xcfdata = g_alloca (data_length);
-
-  /* we have to read directly instead of xcf_read_* because we may be
-   * reading past the end of the file here
-   */
-  g_input_stream_read_all (info->input, xcfdata, data_length,
-                           &bytes_read, NULL, NULL);
-
-  if (bytes_read == 0)
-    return TRUE;
-
-  info->cp      += bytes_read;
 
   strm.next_out  = tile_data;
   strm.avail_out = tile_size;
@@ -2044,8 +2189,8 @@ xcf_load_tile_zlib (XcfInfo       *info,
   strm.zalloc    = Z_NULL;
   strm.zfree     = Z_NULL;
   strm.opaque    = Z_NULL;
-  strm.next_in   = xcfdata;
-  strm.avail_in  = bytes_read;
+  strm.next_in   = (Bytef *) xcfdata;
+  strm.avail_in  = data_length;
 
   /* Initialize the stream decompression. */
   status = inflateInit (&strm);
@@ -2082,9 +2227,6 @@ xcf_load_tile_zlib (XcfInfo       *info,
         }
     }
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
-
   inflateEnd (&strm);
   return TRUE;
 }
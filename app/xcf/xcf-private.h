@@ -84,7 +84,8 @@ typedef enum
   XCF_GROUP_ITEM_EXPANDED      = 1
 } XcfGroupItemFlagsType;
 
-typedef struct _XcfInfo  XcfInfo;
+typedef struct _XcfInfo        XcfInfo;
+typedef struct _XcfTileReader  XcfTileReader;
 
 struct _XcfInfo
 {
@@ -103,6 +104,8 @@ struct _XcfInfo
   guint               floating_sel_offset;
   XcfCompressionType  compression;
   gint                file_version;
+  XcfTileReader      *tile_reader;
+  gboolean            tile_reader_failed;
 };
 
 
@@ -31,6 +31,7 @@
 
 #include "gegl/gimp-babl-compat.h"
 #include "gegl/gimp-gegl-tile-compat.h"
+#include "gegl/gimp-parallel.h"
 
 #include "core/gimp.h"
 #include "core/gimpcontainer.h"
@@ -69,6 +70,33 @@
 #include "gimp-intl.h"
 
 
+/* the number of tiles per thread which xcf_save_level() compresses in
+ * one batch
+ */
+#define XCF_SAVE_TILES_PER_THREAD 4
+
+
+typedef struct
+{
+  GeglRectangle  rect;
+  guchar        *tile_data;
+  guchar        *buf;
+
+  const guchar  *data;
+  gint           size;
+  gint           rle_count;
+  gboolean       success;
+} XcfSaveTile;
+
+typedef struct
+{
+  XcfCompressionType  compression;
+  gint                bpp;
+  gint                buf_size;
+  XcfSaveTile        *tiles;
+} XcfSaveTileBatch;
+
+
 static gboolean xcf_save_image_props   (XcfInfo           *info,
                                         GimpImage         *image,
                                         GError           **error);
@@ -99,22 +127,14 @@ static gboolean xcf_save_buffer        (XcfInfo           *info,
 static gboolean xcf_save_level         (XcfInfo           *info,
                                         GeglBuffer        *buffer,
                                         GError           **error);
-static gboolean xcf_save_tile          (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        GError           **error);
-static gboolean xcf_save_tile_rle      (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        guchar            *rlebuf,
-                                        GError           **error);
-static gboolean xcf_save_tile_zlib     (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        GError           **error);
+static void     xcf_save_encode_tiles  (gsize              offset,
+                                        gsize              size,
+                                        XcfSaveTileBatch  *batch);
+static gboolean xcf_save_tile_rle      (XcfSaveTile       *tile,
+                                        gint               bpp);
+static gboolean xcf_save_tile_zlib     (XcfSaveTile       *tile,
+                                        gint               bpp,
+                                        gint               buf_size);
 static gboolean xcf_save_parasite      (XcfInfo           *info,
                                         GimpParasite      *parasite,
                                         GError           **error);
@@ -1379,20 +1399,24 @@ xcf_save_level (XcfInfo     *info,
                 GeglBuffer  *buffer,
                 GError     **error)
 {
-  const Babl *format;
-  guint32    *offset_table;
-  guint32    *next_offset;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     width;
-  guint32     height;
-  gint        bpp;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        i;
-  guchar     *rlebuf    = NULL;
-  GError     *tmp_error = NULL;
+  const Babl       *format;
+  XcfSaveTileBatch  batch;
+  guint32          *offset_table;
+  guint32          *next_offset;
+  guint32           saved_pos;
+  guint32           offset;
+  guint32           width;
+  guint32           height;
+  gint              bpp;
+  gint              n_tile_rows;
+  gint              n_tile_cols;
+  guint             ntiles;
+  gint              max_tile_size;
+  gint              n_batch_tiles;
+  gint              i;
+  gint              j;
+  gboolean          success   = TRUE;
+  GError           *tmp_error = NULL;
 
   format = gegl_buffer_get_format (buffer);
 
@@ -1403,14 +1427,6 @@ xcf_save_level (XcfInfo     *info,
   xcf_write_int32_check_error (info, (guint32 *) &width, 1);
   xcf_write_int32_check_error (info, (guint32 *) &height, 1);
 
-  saved_pos = info->cp;
-
-  /* allocate a temporary buffer to store the rle data before it is
-   * written to disk
-   */
-  if (info->compression == COMPRESS_RLE)
-    rlebuf = g_alloca (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5);
-
   n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
@@ -1430,44 +1446,106 @@ xcf_save_level (XcfInfo     *info,
   /* write an empty offset table */
   xcf_write_zero_int32_check_error (info, ntiles + 1);
 
+  if (info->compression == COMPRESS_FRACTAL)
+    {
+      g_warning ("xcf: fractal compression unimplemented");
+      return FALSE;
+    }
+
   /* 'offset' is where we will write the next tile */
   offset = info->cp;
 
-  for (i = 0; i < ntiles; i++)
+  /* the tiles are compressed in batches, in parallel, and then written
+   * in order.  rle data can be up to 1.5 times as large as the tile,
+   * and the buffers are large enough for deflate() to finish in one
+   * go, which produces the same stream as finishing it in pieces.
+   */
+  max_tile_size = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+
+  batch.compression = info->compression;
+  batch.bpp         = bpp;
+  batch.buf_size    = MAX (max_tile_size * 1.5,
+                           compressBound (max_tile_size));
+
+  n_batch_tiles = MIN (ntiles,
+                       gimp_parallel_get_n_threads () *
+                       XCF_SAVE_TILES_PER_THREAD);
+
+  batch.tiles = g_new0 (XcfSaveTile, n_batch_tiles);
+
+  for (j = 0; j < n_batch_tiles; j++)
     {
-      GeglRectangle rect;
+      batch.tiles[j].tile_data = g_malloc (max_tile_size);
 
-      /* store the offset in the table and increment the next pointer */
-      *next_offset++ = offset;
+      if (info->compression != COMPRESS_NONE)
+        batch.tiles[j].buf = g_malloc (batch.buf_size);
+    }
 
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+  for (i = 0; i < ntiles && success; i += n_batch_tiles)
+    {
+      gint n_tiles = MIN (n_batch_tiles, ntiles - i);
 
-      /* write out the tile. */
-      switch (info->compression)
+      for (j = 0; j < n_tiles; j++)
         {
-        case COMPRESS_NONE:
-          xcf_check_error (xcf_save_tile (info, buffer, &rect, format,
-                                          error));
-          break;
-        case COMPRESS_RLE:
-          xcf_check_error (xcf_save_tile_rle (info, buffer, &rect, format,
-                                              rlebuf, error));
-          break;
-        case COMPRESS_ZLIB:
-          xcf_check_error (xcf_save_tile_zlib (info, buffer, &rect, format,
-                                               error));
-          break;
-        case COMPRESS_FRACTAL:
-          g_warning ("xcf: fractal compression unimplemented");
-          return FALSE;
+          XcfSaveTile *tile = &batch.tiles[j];
+
+          gimp_gegl_buffer_get_tile_rect (buffer,
+                                          XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                          i + j, &tile->rect);
+
+          gegl_buffer_get (buffer, &tile->rect, 1.0, format, tile->tile_data,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
         }
 
-      /* the next tile's offset is after the tile we just wrote */
-      offset = info->cp;
+      gimp_parallel_distribute_range (n_tiles, 1,
+                                      (GimpParallelDistributeRangeFunc)
+                                      xcf_save_encode_tiles,
+                                      &batch);
+
+      for (j = 0; j < n_tiles; j++)
+        {
+          XcfSaveTile *tile = &batch.tiles[j];
+
+          if (! tile->success)
+            {
+              success = FALSE;
+              break;
+            }
+
+          if (tile->rle_count >= 0)
+            g_message ("xcf: uh oh! xcf rle tile saving error: %d",
+                       tile->rle_count);
+
+          /* store the offset in the table and increment the next pointer */
+          *next_offset++ = offset;
+
+          /* write out the tile. */
+          info->cp += xcf_write_int8 (info->output, tile->data, tile->size,
+                                      &tmp_error);
+
+          if (tmp_error)
+            {
+              g_propagate_error (error, tmp_error);
+              success = FALSE;
+              break;
+            }
+
+          /* the next tile's offset is after the tile we just wrote */
+          offset = info->cp;
+        }
     }
 
+  for (j = 0; j < n_batch_tiles; j++)
+    {
+      g_free (batch.tiles[j].tile_data);
+      g_free (batch.tiles[j].buf);
+    }
+
+  g_free (batch.tiles);
+
+  if (! success)
+    return FALSE;
+
   /* seek back to the offset table and write it  */
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
   xcf_write_int32_check_error (info, offset_table, ntiles + 1);
@@ -1478,51 +1556,55 @@ xcf_save_level (XcfInfo     *info,
   return TRUE;
 }
 
-static gboolean
-xcf_save_tile (XcfInfo        *info,
-               GeglBuffer     *buffer,
-               GeglRectangle  *tile_rect,
-               const Babl     *format,
-               GError        **error)
+static void
+xcf_save_encode_tiles (gsize             offset,
+                       gsize             size,
+                       XcfSaveTileBatch *batch)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  GError *tmp_error = NULL;
+  gsize i;
 
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  for (i = offset; i < offset + size; i++)
+    {
+      XcfSaveTile *tile = &batch->tiles[i];
 
-  xcf_write_int8_check_error (info, tile_data, tile_size);
+      tile->rle_count = -1;
 
-  return TRUE;
+      switch (batch->compression)
+        {
+        case COMPRESS_NONE:
+          tile->data    = tile->tile_data;
+          tile->size    = tile->rect.width * tile->rect.height * batch->bpp;
+          tile->success = TRUE;
+          break;
+        case COMPRESS_RLE:
+          tile->success = xcf_save_tile_rle (tile, batch->bpp);
+          break;
+        case COMPRESS_ZLIB:
+          tile->success = xcf_save_tile_zlib (tile, batch->bpp,
+                                              batch->buf_size);
+          break;
+        default:
+          tile->success = FALSE;
+          break;
+        }
+    }
 }
 
 static gboolean
-xcf_save_tile_rle (XcfInfo        *info,
-                   GeglBuffer     *buffer,
-                   GeglRectangle  *tile_rect,
-                   const Babl     *format,
-                   guchar         *rlebuf,
-                   GError        **error)
+xcf_save_tile_rle (XcfSaveTile *tile,
+                   gint         bpp)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    len       = 0;
+  guchar *rlebuf = tile->buf;
+  gint    len    = 0;
   gint    i, j;
-  GError *tmp_error  = NULL;
-
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
   for (i = 0; i < bpp; i++)
     {
-      const guchar *data   = tile_data + i;
+      const guchar *data   = tile->tile_data + i;
       gint          state  = 0;
       gint          length = 0;
       gint          count  = 0;
-      gint          size   = tile_rect->width * tile_rect->height;
+      gint          size   = tile->rect.width * tile->rect.height;
       guint         last   = -1;
 
       while (size > 0)
@@ -1608,35 +1690,26 @@ xcf_save_tile_rle (XcfInfo        *info,
             }
         }
 
-      if (count != (tile_rect->width * tile_rect->height))
-        g_message ("xcf: uh oh! xcf rle tile saving error: %d", count);
+      if (count != (tile->rect.width * tile->rect.height))
+        tile->rle_count = count;
     }
 
-  xcf_write_int8_check_error (info, rlebuf, len);
+  tile->data = rlebuf;
+  tile->size = len;
 
   return TRUE;
 }
 
 static gboolean
-xcf_save_tile_zlib (XcfInfo        *info,
-                    GeglBuffer     *buffer,
-                    GeglRectangle  *tile_rect,
-                    const Babl     *format,
-                    GError        **error)
+xcf_save_tile_zlib (XcfSaveTile *tile,
+                    gint         bpp,
+                    gint         buf_size)
 {
-  gint      bpp       = babl_format_get_bytes_per_pixel (format);
-  gint      tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar   *tile_data = g_alloca (tile_size);
-  /* The buffer for compressed data. */
-  guchar   *buf       = g_alloca (tile_size);
-  GError   *tmp_error = NULL;
+  gint      tile_size = bpp * tile->rect.width * tile->rect.height;
   z_stream  strm;
   int       action;
   int       status;
 
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
   /* allocate deflate state */
   strm.zalloc = Z_NULL;
   strm.zfree  = Z_NULL;
@@ -1646,14 +1719,14 @@ xcf_save_tile_zlib (XcfInfo        *info,
   if (status != Z_OK)
     return FALSE;
 
-  strm.next_in   = tile_data;
+  strm.next_in   = tile->tile_data;
   strm.avail_in  = tile_size;
-  strm.next_out  = buf;
-  strm.avail_out = tile_size;
+  strm.next_out  = tile->buf;
+  strm.avail_out = buf_size;
 
   action = Z_NO_FLUSH;
 
-  while (status == Z_OK || status == Z_BUF_ERROR)
+  while (status == Z_OK)
     {
       if (strm.avail_in == 0)
         {
@@ -1663,17 +1736,7 @@ xcf_save_tile_zlib (XcfInfo        *info,
 
       status = deflate (&strm, action);
 
-      if (status == Z_STREAM_END || status == Z_BUF_ERROR)
-        {
-          size_t write_size = tile_size - strm.avail_out;
-
-          xcf_write_int8_check_error (info, buf, write_size);
-
-          /* Reset next_out and avail_out. */
-          strm.next_out  = buf;
-          strm.avail_out = tile_size;
-        }
-      else if (status != Z_OK)
+      if (status != Z_OK && status != Z_STREAM_END)
         {
           g_printerr ("xcf: tile compression failed: %s", zError (status));
           deflateEnd (&strm);
@@ -1681,6 +1744,9 @@ xcf_save_tile_zlib (XcfInfo        *info,
         }
     }
 
+  tile->data = tile->buf;
+  tile->size = buf_size - strm.avail_out;
+
   deflateEnd (&strm);
   return TRUE;
 }
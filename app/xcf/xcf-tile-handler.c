@@ -0,0 +1,745 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <cairo.h>
+#include <gegl.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+
+#include "xcf-private.h"
+#include "xcf-load.h"
+#include "xcf-tile-handler.h"
+
+#include "gimp-intl.h"
+
+
+/*  an XCF file with pending tiles, all handlers loaded from the file
+ *  at once share it.  The file is opened while it is being loaded and
+ *  kept open until its last tile is decoded, so the tiles can still be
+ *  read after the file was removed or replaced by another one.  Its
+ *  size and modification time are remembered to notice if the file was
+ *  overwritten in place.
+ */
+struct _XcfTileReader
+{
+  Gimp         *gimp;
+  GFile        *file;
+  GInputStream *input;
+  goffset       size;
+  guint64       mtime;
+  gboolean      changed;
+  GMutex        mutex;
+  GList        *handlers;
+  gint          ref_count;
+};
+
+
+static void       xcf_tile_handler_finalize   (GObject             *object);
+
+static gpointer   xcf_tile_handler_command    (GeglTileSource      *source,
+                                               GeglTileCommand      command,
+                                               gint                 x,
+                                               gint                 y,
+                                               gint                 z,
+                                               gpointer             data);
+
+static GeglTile * xcf_tile_handler_load_tile  (XcfTileHandler      *handler,
+                                               GeglTile            *tile,
+                                               gint                 x,
+                                               gint                 y);
+static void       xcf_tile_handler_load_area  (XcfTileHandler      *handler,
+                                               const GeglRectangle *area);
+static void       xcf_tile_handler_load_all   (XcfTileHandler      *handler);
+static void       xcf_tile_handler_decode     (XcfTileHandler      *handler,
+                                               const GeglRectangle *tile_rect,
+                                               guchar              *dest,
+                                               gint                 stride);
+static void       xcf_tile_handler_release    (XcfTileHandler      *handler);
+
+static gboolean        xcf_tile_reader_query  (GInputStream        *input,
+                                               goffset             *size,
+                                               guint64             *mtime);
+static gsize           xcf_tile_reader_read   (XcfTileReader       *reader,
+                                               guint32              offset,
+                                               guchar              *data,
+                                               gsize                length);
+static gboolean        xcf_tile_reader_report (XcfTileReader       *reader);
+
+
+G_DEFINE_TYPE (XcfTileHandler, xcf_tile_handler, GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class xcf_tile_handler_parent_class
+
+
+static GList  *xcf_tile_readers = NULL;
+static GMutex  xcf_tile_readers_mutex;
+
+
+static void
+xcf_tile_handler_class_init (XcfTileHandlerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = xcf_tile_handler_finalize;
+}
+
+static void
+xcf_tile_handler_init (XcfTileHandler *handler)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (handler);
+
+  source->command = xcf_tile_handler_command;
+
+  handler->pending_region = cairo_region_create ();
+
+  g_rec_mutex_init (&handler->mutex);
+}
+
+static void
+xcf_tile_handler_finalize (GObject *object)
+{
+  XcfTileHandler *handler = XCF_TILE_HANDLER (object);
+
+  xcf_tile_handler_release (handler);
+
+  g_clear_pointer (&handler->offsets, g_free);
+
+  cairo_region_destroy (handler->pending_region);
+  handler->pending_region = NULL;
+
+  g_rec_mutex_clear (&handler->mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gpointer
+xcf_tile_handler_command (GeglTileSource  *source,
+                          GeglTileCommand  command,
+                          gint             x,
+                          gint             y,
+                          gint             z,
+                          gpointer         data)
+{
+  XcfTileHandler *handler = XCF_TILE_HANDLER (source);
+  gpointer        retval;
+
+  /*  mipmap tiles are made from the level 0 tiles further down the
+   *  chain, so load the tiles they are made of first
+   */
+  if (command == GEGL_TILE_GET && z > 0)
+    {
+      GeglRectangle area;
+
+      area.x      = (x * handler->tile_width)  << z;
+      area.y      = (y * handler->tile_height) << z;
+      area.width  = handler->tile_width  << z;
+      area.height = handler->tile_height << z;
+
+      xcf_tile_handler_load_area (handler, &area);
+    }
+
+  retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
+
+  if (command == GEGL_TILE_GET && z == 0)
+    {
+      retval = xcf_tile_handler_load_tile (handler, retval, x, y);
+    }
+  else if (command == GEGL_TILE_SET && z == 0)
+    {
+      cairo_rectangle_int_t tile_rect;
+
+      /*  a whole tile was stored, there is nothing to load for it  */
+      tile_rect.x      = x * handler->tile_width;
+      tile_rect.y      = y * handler->tile_height;
+      tile_rect.width  = handler->tile_width;
+      tile_rect.height = handler->tile_height;
+
+      g_rec_mutex_lock (&handler->mutex);
+
+      cairo_region_subtract_rectangle (handler->pending_region, &tile_rect);
+
+      g_rec_mutex_unlock (&handler->mutex);
+    }
+
+  return retval;
+}
+
+static GeglTile *
+xcf_tile_handler_load_tile (XcfTileHandler *handler,
+                            GeglTile       *tile,
+                            gint            x,
+                            gint            y)
+{
+  cairo_rectangle_int_t tile_rect;
+
+  /*  tiles may be requested from several threads at once, the mutex
+   *  is held while decoding so no other thread can pick up a tile
+   *  that is only half done
+   */
+  g_rec_mutex_lock (&handler->mutex);
+
+  if (cairo_region_is_empty (handler->pending_region))
+    {
+      g_rec_mutex_unlock (&handler->mutex);
+
+      return tile;
+    }
+
+  tile_rect.x      = x * handler->tile_width;
+  tile_rect.y      = y * handler->tile_height;
+  tile_rect.width  = handler->tile_width;
+  tile_rect.height = handler->tile_height;
+
+  if (cairo_region_contains_rectangle (handler->pending_region, &tile_rect) !=
+      CAIRO_REGION_OVERLAP_OUT)
+    {
+      gint     tile_bpp;
+      gint     tile_stride;
+      gboolean new_tile = FALSE;
+
+      if (! tile)
+        {
+          tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (handler),
+                                                x, y, 0);
+          new_tile = TRUE;
+        }
+
+      cairo_region_subtract_rectangle (handler->pending_region, &tile_rect);
+
+      tile_bpp    = babl_format_get_bytes_per_pixel (handler->format);
+      tile_stride = tile_bpp * handler->tile_width;
+
+      gegl_tile_lock (tile);
+
+      if (new_tile)
+        memset (gegl_tile_get_data (tile), 0,
+                tile_stride * handler->tile_height);
+
+      xcf_tile_handler_decode (handler,
+                               GEGL_RECTANGLE (tile_rect.x,
+                                               tile_rect.y,
+                                               tile_rect.width,
+                                               tile_rect.height),
+                               gegl_tile_get_data (tile), tile_stride);
+
+      gegl_tile_unlock (tile);
+
+      /*  all tiles are loaded, the file isn't needed anymore  */
+      if (cairo_region_is_empty (handler->pending_region))
+        xcf_tile_handler_release (handler);
+    }
+
+  g_rec_mutex_unlock (&handler->mutex);
+
+  return tile;
+}
+
+static void
+xcf_tile_handler_load_area (XcfTileHandler      *handler,
+                            const GeglRectangle *area)
+{
+  cairo_rectangle_int_t rect = { area->x, area->y,
+                                 area->width, area->height };
+  gint                  x1, x2;
+  gint                  y1, y2;
+  gint                  x, y;
+
+  g_rec_mutex_lock (&handler->mutex);
+
+  if (cairo_region_contains_rectangle (handler->pending_region, &rect) ==
+      CAIRO_REGION_OVERLAP_OUT)
+    {
+      g_rec_mutex_unlock (&handler->mutex);
+
+      return;
+    }
+
+  x1 = area->x / handler->tile_width;
+  y1 = area->y / handler->tile_height;
+  x2 = (area->x + area->width  - 1) / handler->tile_width;
+  y2 = (area->y + area->height - 1) / handler->tile_height;
+
+  for (y = y1; y <= y2; y++)
+    for (x = x1; x <= x2; x++)
+      {
+        GeglTile *tile;
+
+        /*  go through the whole chain, so the tile ends up in the cache  */
+        tile = gegl_tile_source_command (GEGL_TILE_SOURCE (handler),
+                                         GEGL_TILE_GET, x, y, 0, NULL);
+
+        if (tile)
+          gegl_tile_unref (tile);
+      }
+
+  g_rec_mutex_unlock (&handler->mutex);
+}
+
+static void
+xcf_tile_handler_load_all (XcfTileHandler *handler)
+{
+  cairo_region_t *region;
+  gint            n_rects;
+  gint            i;
+
+  g_rec_mutex_lock (&handler->mutex);
+
+  region  = cairo_region_copy (handler->pending_region);
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (region, i, &rect);
+
+      xcf_tile_handler_load_area (handler,
+                                  GEGL_RECTANGLE (rect.x, rect.y,
+                                                  rect.width, rect.height));
+    }
+
+  cairo_region_destroy (region);
+
+  g_rec_mutex_unlock (&handler->mutex);
+}
+
+static void
+xcf_tile_handler_decode (XcfTileHandler      *handler,
+                         const GeglRectangle *tile_rect,
+                         guchar              *dest,
+                         gint                 stride)
+{
+  GeglRectangle area;
+  guchar       *data;
+  guchar       *tile_data;
+  gint          bpp;
+  gint          max_tile_size;
+  gint          max_data_length;
+  gint          col, row;
+
+  if (! gegl_rectangle_intersect (&area, tile_rect,
+                                  GEGL_RECTANGLE (0, 0,
+                                                  handler->width,
+                                                  handler->height)))
+    return;
+
+  /*  see xcf_load_level() for the data lengths  */
+  bpp             = babl_format_get_bytes_per_pixel (handler->format);
+  max_tile_size   = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+  max_data_length = max_tile_size * 1.5;
+
+  data      = g_malloc (max_data_length);
+  tile_data = g_malloc (max_tile_size);
+
+  for (row = area.y / XCF_TILE_HEIGHT;
+       row <= (area.y + area.height - 1) / XCF_TILE_HEIGHT;
+       row++)
+    {
+      for (col = area.x / XCF_TILE_WIDTH;
+           col <= (area.x + area.width - 1) / XCF_TILE_WIDTH;
+           col++)
+        {
+          GeglRectangle xcf_rect;
+          GeglRectangle rect;
+          gint          i = row * handler->n_tile_cols + col;
+          gint          data_length;
+          gsize         bytes_read;
+          gint          y;
+
+          xcf_rect.x      = col * XCF_TILE_WIDTH;
+          xcf_rect.y      = row * XCF_TILE_HEIGHT;
+          xcf_rect.width  = MIN (XCF_TILE_WIDTH,  handler->width  - xcf_rect.x);
+          xcf_rect.height = MIN (XCF_TILE_HEIGHT, handler->height - xcf_rect.y);
+
+          if (i >= handler->n_tiles ||
+              ! gegl_rectangle_intersect (&rect, &xcf_rect, &area))
+            continue;
+
+          if (handler->compression == COMPRESS_NONE)
+            data_length = xcf_rect.width * xcf_rect.height * bpp;
+          else if (handler->offsets[i + 1] != 0)
+            data_length = handler->offsets[i + 1] - handler->offsets[i];
+          else
+            data_length = max_data_length;
+
+          data_length = MIN (data_length, max_data_length);
+
+          if (data_length <= 0)
+            continue;
+
+          bytes_read = xcf_tile_reader_read (handler->reader,
+                                             handler->offsets[i],
+                                             data, data_length);
+
+          if (bytes_read == 0)
+            continue;
+
+          if (! xcf_load_tile_data (handler->compression,
+                                    data, bytes_read, tile_data,
+                                    xcf_rect.width * xcf_rect.height, bpp))
+            {
+              g_printerr ("xcf: failed to load tile %d. "
+                          "Possibly corrupt XCF file.", i);
+              continue;
+            }
+
+          for (y = 0; y < rect.height; y++)
+            {
+              memcpy (dest +
+                      (rect.y - tile_rect->y + y) * stride +
+                      (rect.x - tile_rect->x)     * bpp,
+                      tile_data +
+                      ((rect.y - xcf_rect.y + y) * xcf_rect.width +
+                       (rect.x - xcf_rect.x)) * bpp,
+                      rect.width * bpp);
+            }
+        }
+    }
+
+  g_free (tile_data);
+  g_free (data);
+}
+
+static void
+xcf_tile_handler_release (XcfTileHandler *handler)
+{
+  XcfTileReader *reader = handler->reader;
+
+  if (! reader)
+    return;
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  reader->handlers = g_list_remove (reader->handlers, handler);
+  handler->reader  = NULL;
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+
+  xcf_tile_reader_unref (reader);
+}
+
+static gboolean
+xcf_tile_reader_query (GInputStream *input,
+                       goffset      *size,
+                       guint64      *mtime)
+{
+  GFileInfo *info;
+
+  info = g_file_input_stream_query_info (G_FILE_INPUT_STREAM (input),
+                                         G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                         G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                         NULL, NULL);
+
+  if (! info)
+    return FALSE;
+
+  *size  = g_file_info_get_size (info);
+  *mtime = g_file_info_get_attribute_uint64 (info,
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  g_object_unref (info);
+
+  return TRUE;
+}
+
+static gsize
+xcf_tile_reader_read (XcfTileReader *reader,
+                      guint32        offset,
+                      guchar        *data,
+                      gsize          length)
+{
+  gsize bytes_read = 0;
+
+  g_mutex_lock (&reader->mutex);
+
+  if (! reader->changed)
+    {
+      goffset size;
+      guint64 mtime;
+
+      /*  the open file can't go away, but it can be overwritten in
+       *  place, after which its contents can't be trusted anymore
+       */
+      if (! xcf_tile_reader_query (reader->input, &size, &mtime) ||
+          size  != reader->size ||
+          mtime != reader->mtime)
+        {
+          reader->changed = TRUE;
+
+          /*  tiles can be read from any thread  */
+          g_idle_add ((GSourceFunc) xcf_tile_reader_report,
+                      xcf_tile_reader_ref (reader));
+        }
+    }
+
+  if (! reader->changed &&
+      g_seekable_seek (G_SEEKABLE (reader->input), offset, G_SEEK_SET,
+                       NULL, NULL))
+    {
+      /*  we may be reading past the end of the file here  */
+      g_input_stream_read_all (reader->input, data, length,
+                               &bytes_read, NULL, NULL);
+    }
+
+  g_mutex_unlock (&reader->mutex);
+
+  return bytes_read;
+}
+
+static gboolean
+xcf_tile_reader_report (XcfTileReader *reader)
+{
+  gimp_message (reader->gimp, NULL, GIMP_MESSAGE_ERROR,
+                _("'%s' was modified while parts of the image were not "
+                  "loaded from it yet.  These parts of the image are "
+                  "lost."),
+                gimp_file_get_utf8_name (reader->file));
+
+  xcf_tile_reader_unref (reader);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*  public functions  */
+
+/**
+ * xcf_tile_reader_new:
+ * @gimp:  a #Gimp
+ * @file:  the XCF file being loaded
+ * @input: the stream @file is being loaded from
+ *
+ * Opens @file a second time, for the tiles of the buffers loaded from
+ * it, which are decoded on demand.  This must be called while @file is
+ * being loaded, so the file is the same as the one read by @input.
+ *
+ * Return value: a new #XcfTileReader, or %NULL if the file can't be
+ *               kept open for later, and has to be loaded eagerly.
+ **/
+XcfTileReader *
+xcf_tile_reader_new (Gimp         *gimp,
+                     GFile        *file,
+                     GInputStream *input)
+{
+  XcfTileReader *reader;
+  GInputStream  *tile_input;
+  goffset        size;
+  guint64        mtime;
+  goffset        tile_size;
+  guint64        tile_mtime;
+
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (input), NULL);
+
+#ifdef G_OS_WIN32
+  /*  open files can neither be removed nor replaced on windows, keeping
+   *  it open would break saving over the file, or deleting temporary
+   *  files after loading them
+   */
+  return NULL;
+#else
+
+  if (! G_IS_FILE_INPUT_STREAM (input) ||
+      ! xcf_tile_reader_query (input, &size, &mtime))
+    return NULL;
+
+  tile_input = G_INPUT_STREAM (g_file_read (file, NULL, NULL));
+
+  if (! tile_input)
+    return NULL;
+
+  /*  make sure we opened the very file that is being loaded  */
+  if (! g_seekable_can_seek (G_SEEKABLE (tile_input))              ||
+      ! xcf_tile_reader_query (tile_input, &tile_size, &tile_mtime) ||
+      tile_size  != size                                            ||
+      tile_mtime != mtime)
+    {
+      g_object_unref (tile_input);
+
+      return NULL;
+    }
+
+  reader = g_slice_new0 (XcfTileReader);
+
+  reader->gimp      = gimp;
+  reader->file      = g_object_ref (file);
+  reader->input     = tile_input;
+  reader->size      = size;
+  reader->mtime     = mtime;
+  reader->ref_count = 1;
+
+  g_mutex_init (&reader->mutex);
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  xcf_tile_readers = g_list_prepend (xcf_tile_readers, reader);
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+
+  return reader;
+#endif
+}
+
+XcfTileReader *
+xcf_tile_reader_ref (XcfTileReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  reader->ref_count++;
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+
+  return reader;
+}
+
+void
+xcf_tile_reader_unref (XcfTileReader *reader)
+{
+  g_return_if_fail (reader != NULL);
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  if (--reader->ref_count == 0)
+    {
+      xcf_tile_readers = g_list_remove (xcf_tile_readers, reader);
+
+      g_object_unref (reader->input);
+      g_object_unref (reader->file);
+
+      g_mutex_clear (&reader->mutex);
+
+      g_slice_free (XcfTileReader, reader);
+    }
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+}
+
+GeglTileHandler *
+xcf_tile_handler_new (XcfTileReader      *reader,
+                      XcfCompressionType  compression,
+                      const guint32      *offsets,
+                      gint                n_tiles,
+                      gint                width,
+                      gint                height,
+                      const Babl         *format)
+{
+  XcfTileHandler *handler;
+
+  g_return_val_if_fail (reader != NULL, NULL);
+  g_return_val_if_fail (offsets != NULL, NULL);
+  g_return_val_if_fail (n_tiles > 0, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  handler = g_object_new (XCF_TYPE_TILE_HANDLER, NULL);
+
+  handler->compression = compression;
+  handler->offsets     = g_memdup (offsets, (n_tiles + 1) * sizeof (guint32));
+  handler->n_tiles     = n_tiles;
+  handler->n_tile_cols = (width + XCF_TILE_WIDTH - 1) / XCF_TILE_WIDTH;
+  handler->width       = width;
+  handler->height      = height;
+  handler->format      = format;
+
+  handler->reader = xcf_tile_reader_ref (reader);
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  handler->reader->handlers = g_list_prepend (handler->reader->handlers,
+                                              handler);
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+
+  return GEGL_TILE_HANDLER (handler);
+}
+
+void
+xcf_tile_handler_assign (XcfTileHandler *handler,
+                         GeglBuffer     *buffer)
+{
+  cairo_rectangle_int_t rect = { 0, 0, };
+
+  g_return_if_fail (XCF_IS_TILE_HANDLER (handler));
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+
+  gegl_buffer_add_handler (buffer, handler);
+
+  g_object_get (buffer,
+                "tile-width",  &handler->tile_width,
+                "tile-height", &handler->tile_height,
+                NULL);
+
+  rect.width  = handler->width;
+  rect.height = handler->height;
+
+  g_rec_mutex_lock (&handler->mutex);
+
+  cairo_region_union_rectangle (handler->pending_region, &rect);
+
+  g_rec_mutex_unlock (&handler->mutex);
+
+  /*  the handler lives as long as the buffer  */
+  g_object_set_data_full (G_OBJECT (buffer), "xcf-tile-handler",
+                          g_object_ref (handler),
+                          (GDestroyNotify) g_object_unref);
+}
+
+/**
+ * xcf_tile_handler_load_file:
+ * @file: an XCF file
+ *
+ * Loads all pending tiles of all buffers which were lazily loaded
+ * from @file.  This must be called before @file is overwritten.
+ **/
+void
+xcf_tile_handler_load_file (GFile *file)
+{
+  GList *handlers = NULL;
+  GList *list;
+
+  g_return_if_fail (G_IS_FILE (file));
+
+  g_mutex_lock (&xcf_tile_readers_mutex);
+
+  for (list = xcf_tile_readers; list; list = g_list_next (list))
+    {
+      XcfTileReader *reader = list->data;
+
+      if (g_file_equal (reader->file, file))
+        handlers = g_list_concat (handlers,
+                                  g_list_copy_deep (reader->handlers,
+                                                    (GCopyFunc) g_object_ref,
+                                                    NULL));
+    }
+
+  g_mutex_unlock (&xcf_tile_readers_mutex);
+
+  for (list = handlers; list; list = g_list_next (list))
+    xcf_tile_handler_load_all (list->data);
+
+  g_list_free_full (handlers, (GDestroyNotify) g_object_unref);
+}
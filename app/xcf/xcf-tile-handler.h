@@ -0,0 +1,89 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __XCF_TILE_HANDLER_H__
+#define __XCF_TILE_HANDLER_H__
+
+#include <gegl-buffer-backend.h>
+
+/***
+ * XcfTileHandler is a GeglTileHandler that decodes the tiles of a
+ * buffer from an XCF file when they are accessed for the first time.
+ */
+
+G_BEGIN_DECLS
+
+#define XCF_TYPE_TILE_HANDLER            (xcf_tile_handler_get_type ())
+#define XCF_TILE_HANDLER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), XCF_TYPE_TILE_HANDLER, XcfTileHandler))
+#define XCF_TILE_HANDLER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  XCF_TYPE_TILE_HANDLER, XcfTileHandlerClass))
+#define XCF_IS_TILE_HANDLER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), XCF_TYPE_TILE_HANDLER))
+#define XCF_IS_TILE_HANDLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  XCF_TYPE_TILE_HANDLER))
+#define XCF_TILE_HANDLER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  XCF_TYPE_TILE_HANDLER, XcfTileHandlerClass))
+
+
+typedef struct _XcfTileHandler      XcfTileHandler;
+typedef struct _XcfTileHandlerClass XcfTileHandlerClass;
+
+struct _XcfTileHandler
+{
+  GeglTileHandler     parent_instance;
+
+  XcfTileReader      *reader;
+  XcfCompressionType  compression;
+  guint32            *offsets;
+  gint                n_tiles;
+  gint                n_tile_cols;
+  gint                width;
+  gint                height;
+  const Babl         *format;
+  gint                tile_width;
+  gint                tile_height;
+  cairo_region_t     *pending_region;
+  GRecMutex           mutex;
+};
+
+struct _XcfTileHandlerClass
+{
+  GeglTileHandlerClass  parent_class;
+};
+
+
+GType             xcf_tile_handler_get_type  (void) G_GNUC_CONST;
+
+XcfTileReader   * xcf_tile_reader_new        (Gimp               *gimp,
+                                              GFile              *file,
+                                              GInputStream       *input);
+XcfTileReader   * xcf_tile_reader_ref        (XcfTileReader      *reader);
+void              xcf_tile_reader_unref      (XcfTileReader      *reader);
+
+GeglTileHandler * xcf_tile_handler_new       (XcfTileReader      *reader,
+                                              XcfCompressionType  compression,
+                                              const guint32      *offsets,
+                                              gint                n_tiles,
+                                              gint                width,
+                                              gint                height,
+                                              const Babl         *format);
+
+void              xcf_tile_handler_assign    (XcfTileHandler     *handler,
+                                              GeglBuffer         *buffer);
+
+void              xcf_tile_handler_load_file (GFile              *file);
+
+
+G_END_DECLS
+
+#endif /* __XCF_TILE_HANDLER_H__ */
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <cairo.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib/gstdio.h>
 #include <gegl.h>
@@ -42,6 +43,7 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-save.h"
+#include "xcf-tile-handler.h"
 
 #include "gimp-intl.h"
 
@@ -319,6 +321,10 @@ xcf_load_invoker (GimpProcedure         *procedure,
             }
         }
 
+      /*  the buffers with pending tiles hold their own reference  */
+      if (info.tile_reader)
+        xcf_tile_reader_unref (info.tile_reader);
+
       g_object_unref (info.input);
 
       if (progress)
@@ -366,6 +372,9 @@ xcf_save_invoker (GimpProcedure         *procedure,
   uri   = g_value_get_string (gimp_value_array_index (args, 3));
   file  = g_file_new_for_uri (uri);
 
+  /* buffers which were lazily loaded from the file still need it  */
+  xcf_tile_handler_load_file (file);
+
   info.output = G_OUTPUT_STREAM (g_file_replace (file,
                                                  NULL, FALSE, G_FILE_CREATE_NONE,
                                                  NULL, &my_error));
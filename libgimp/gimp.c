@@ -119,7 +119,8 @@
  **/
 
 
-#define TILE_MAP_SIZE (_tile_width * _tile_height * 32)
+#define TILE_MAP_SIZE (_tile_width * _tile_height * 32 * \
+                       GP_TILE_BATCH_MAX_TILES)
 
 #define ERRMSG_SHM_FAILED "Could not attach to gimp shared memory segment"
 
@@ -138,8 +139,9 @@ typedef enum
 
 #define WRITE_BUFFER_SIZE  1024
 
-void gimp_read_expect_msg   (GimpWireMessage *msg,
-                             gint             type);
+void gimp_read_expect_msg        (GimpWireMessage *msg,
+                                  gint             type);
+void _gimp_drawable_sync_buffers (void);
 
 
 static void       gimp_close                   (void);
@@ -1080,6 +1082,8 @@ gimp_run_procedure2 (const gchar     *name,
   proc_run.nparams = n_params;
   proc_run.params  = (GPParam *) params;
 
+  _gimp_drawable_sync_buffers ();
+
   if (! gp_proc_run_write (_writechannel, &proc_run, NULL))
     gimp_quit ();
 
@@ -1951,9 +1955,18 @@ gimp_loop (void)
         case GP_TILE_REQ:
         case GP_TILE_ACK:
         case GP_TILE_DATA:
+        case GP_TILE_BATCH_REQ:
+        case GP_TILE_BATCH_DATA:
           g_warning ("unexpected tile message received (should not happen)");
           break;
 
+        case GP_BUFFER_MAP_REQ:
+        case GP_BUFFER_MAP:
+        case GP_BUFFER_UNMAP:
+        case GP_BUFFER_SYNC:
+          g_warning ("unexpected buffer map message received (should not happen)");
+          break;
+
         case GP_PROC_RUN:
           gimp_proc_run (msg.data);
           gimp_wire_destroy (&msg);
@@ -2187,8 +2200,16 @@ gimp_process_message (GimpWireMessage *msg)
     case GP_TILE_REQ:
     case GP_TILE_ACK:
     case GP_TILE_DATA:
+    case GP_TILE_BATCH_REQ:
+    case GP_TILE_BATCH_DATA:
       g_warning ("unexpected tile message received (should not happen)");
       break;
+    case GP_BUFFER_MAP_REQ:
+    case GP_BUFFER_MAP:
+    case GP_BUFFER_UNMAP:
+    case GP_BUFFER_SYNC:
+      g_warning ("unexpected buffer map message received (should not happen)");
+      break;
     case GP_PROC_RUN:
       g_warning ("unexpected proc run message received (should not happen)");
       break;
@@ -20,8 +20,24 @@
 
 #include "config.h"
 
+#include <fcntl.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined (HAVE_MMAP) && defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define USE_BUFFER_MAP 1
+#endif
+
+#include <glib/gstdio.h>
+
 #define GIMP_DISABLE_DEPRECATION_WARNINGS
 
+#include "libgimpbase/gimpprotocol.h"
+#include "libgimpbase/gimpwire.h"
+
 #include "gimp.h"
 
 #include "gimptilebackendplugin.h"
@@ -31,6 +47,37 @@
 #define TILE_HEIGHT gimp_tile_height()
 
 
+typedef struct
+{
+  gint32         map_ID;
+  guchar        *addr;
+  gsize          size;
+  GeglRectangle  extent;
+  GeglRectangle  dirty;
+} GimpDrawableBufferMap;
+
+
+void          gimp_read_expect_msg         (GimpWireMessage       *msg,
+                                            gint                   type);
+void          _gimp_drawable_sync_buffers  (void);
+
+static gboolean
+              gimp_drawable_use_buffer_map (void);
+static GeglBuffer *
+              gimp_drawable_map_buffer     (gint32                 drawable_ID);
+static void   gimp_drawable_unmap_buffer   (GimpDrawableBufferMap *map);
+static void   gimp_drawable_buffer_changed (GeglBuffer            *buffer,
+                                            const GeglRectangle   *rect,
+                                            GimpDrawableBufferMap *map);
+
+
+/*  the live buffer maps, and their dirty rectangles, which the
+ *  "changed" signal updates from whatever thread GEGL runs in
+ */
+static GList  *buffer_maps = NULL;
+static GMutex  buffer_maps_mutex;
+
+
 /**
  * gimp_drawable_get:
  * @drawable_ID: the ID of the drawable
@@ -117,31 +164,10 @@ gimp_drawable_detach (GimpDrawable *drawable)
 void
 gimp_drawable_flush (GimpDrawable *drawable)
 {
-  GimpTile *tiles;
-  gint      n_tiles;
-  gint      i;
-
   g_return_if_fail (drawable != NULL);
 
-  if (drawable->tiles)
-    {
-      tiles   = drawable->tiles;
-      n_tiles = drawable->ntile_rows * drawable->ntile_cols;
-
-      for (i = 0; i < n_tiles; i++)
-        if ((tiles[i].ref_count > 0) && tiles[i].dirty)
-          gimp_tile_flush (&tiles[i]);
-    }
-
-  if (drawable->shadow_tiles)
-    {
-      tiles   = drawable->shadow_tiles;
-      n_tiles = drawable->ntile_rows * drawable->ntile_cols;
-
-      for (i = 0; i < n_tiles; i++)
-        if ((tiles[i].ref_count > 0) && tiles[i].dirty)
-          gimp_tile_flush (&tiles[i]);
-    }
+  _gimp_tile_flush_dirty (drawable, FALSE);
+  _gimp_tile_flush_dirty (drawable, TRUE);
 
   /*  nuke all references to this drawable from the cache  */
   _gimp_tile_cache_flush_drawable (drawable);
@@ -658,6 +684,13 @@ gimp_drawable_attach_new_parasite (gint32          drawable_ID,
  * drawable when the buffer gets destroyed, or when gegl_buffer_flush()
  * is called.
  *
+ * If the GIMP_MAP_DRAWABLE_BUFFERS environment variable is set, the
+ * buffer is backed by a memory mapping of the drawable's pixels which
+ * the core provides, instead of by tiles which are transferred on
+ * demand. Its data is then synced back when the buffer gets destroyed,
+ * and before each procedure call, so the core sees the changes as
+ * soon as the plug-in talks to it.
+ *
  * Return value: The #GeglBuffer.
  *
  * See Also: gimp_drawable_get_shadow_buffer()
@@ -672,13 +705,18 @@ gimp_drawable_get_buffer (gint32 drawable_ID)
   if (gimp_item_is_valid (drawable_ID))
     {
       GimpDrawable *drawable;
+      GeglBuffer   *buffer;
+
+      buffer = gimp_drawable_map_buffer (drawable_ID);
+
+      if (buffer)
+        return buffer;
 
       drawable = gimp_drawable_get (drawable_ID);
 
       if (drawable)
         {
           GeglTileBackend *backend;
-          GeglBuffer      *buffer;
 
           backend = _gimp_tile_backend_plugin_new (drawable, FALSE);
           buffer = gegl_buffer_new_for_backend (NULL, backend);
@@ -700,6 +738,10 @@ gimp_drawable_get_buffer (gint32 drawable_ID)
  * synced back with the core drawable's shadow tiles when the buffer
  * gets destroyed, or when gegl_buffer_flush() is called.
  *
+ * Shadow buffers are never mapped, see gimp_drawable_get_buffer(), so
+ * that gegl_buffer_flush() always writes them back before
+ * gimp_drawable_merge_shadow() is called.
+ *
  * Return value: The #GeglBuffer.
  *
  * See Also: gimp_drawable_get_shadow_buffer()
@@ -710,6 +752,7 @@ GeglBuffer *
 gimp_drawable_get_shadow_buffer (gint32 drawable_ID)
 {
   GimpDrawable *drawable;
+  GeglBuffer   *buffer;
 
   gimp_plugin_enable_precision ();
 
@@ -718,7 +761,6 @@ gimp_drawable_get_shadow_buffer (gint32 drawable_ID)
   if (drawable)
     {
       GeglTileBackend *backend;
-      GeglBuffer      *buffer;
 
       backend = _gimp_tile_backend_plugin_new (drawable, TRUE);
       buffer = gegl_buffer_new_for_backend (NULL, backend);
@@ -799,3 +841,226 @@ gimp_drawable_get_format (gint32 drawable_ID)
 
   return format;
 }
+
+/*  writes back what the plug-in changed in its mapped buffers, this
+ *  is called before each procedure call, so that the core never works
+ *  on stale pixels of a mapped drawable
+ */
+void
+_gimp_drawable_sync_buffers (void)
+{
+#ifdef USE_BUFFER_MAP
+  extern GIOChannel *_writechannel;
+
+  GArray *syncs;
+  GList  *list;
+  guint   i;
+
+  /*  maps are only added and removed by the thread that talks to the
+   *  core, which is the one calling this
+   */
+  if (! buffer_maps)
+    return;
+
+  syncs = g_array_new (FALSE, FALSE, sizeof (GPBufferSync));
+
+  g_mutex_lock (&buffer_maps_mutex);
+
+  for (list = buffer_maps; list; list = g_list_next (list))
+    {
+      GimpDrawableBufferMap *map = list->data;
+
+      if (map->dirty.width > 0 && map->dirty.height > 0)
+        {
+          GPBufferSync sync;
+
+          sync.map_ID       = map->map_ID;
+          sync.dirty_x      = map->dirty.x;
+          sync.dirty_y      = map->dirty.y;
+          sync.dirty_width  = map->dirty.width;
+          sync.dirty_height = map->dirty.height;
+
+          g_array_append_val (syncs, sync);
+
+          map->dirty.width  = 0;
+          map->dirty.height = 0;
+        }
+    }
+
+  g_mutex_unlock (&buffer_maps_mutex);
+
+  for (i = 0; i < syncs->len; i++)
+    {
+      GimpWireMessage msg;
+
+      if (! gp_buffer_sync_write (_writechannel,
+                                  &g_array_index (syncs, GPBufferSync, i),
+                                  NULL))
+        gimp_quit ();
+
+      gimp_read_expect_msg (&msg, GP_TILE_ACK);
+      gimp_wire_destroy (&msg);
+    }
+
+  g_array_free (syncs, TRUE);
+#endif
+}
+
+
+/*  private functions  */
+
+static gboolean
+gimp_drawable_use_buffer_map (void)
+{
+  static gint use_buffer_map = -1;
+
+  if (G_UNLIKELY (use_buffer_map == -1))
+    use_buffer_map = (g_getenv ("GIMP_MAP_DRAWABLE_BUFFERS") != NULL);
+
+  return use_buffer_map;
+}
+
+/*  asks the core to export the drawable's pixels as a file, and wraps
+ *  a shared mapping of it in a linear buffer, so that neither side
+ *  keeps another copy of the whole drawable.  returns NULL if the
+ *  core can't do that, the caller falls back to tile transfers then.
+ */
+static GeglBuffer *
+gimp_drawable_map_buffer (gint32 drawable_ID)
+{
+#ifdef USE_BUFFER_MAP
+  extern GIOChannel *_writechannel;
+
+  GPBufferMapReq         request;
+  GPBufferMap           *reply;
+  GimpWireMessage        msg;
+  GimpDrawableBufferMap *map    = NULL;
+  GeglBuffer            *buffer = NULL;
+  const Babl            *format;
+
+  if (! gimp_drawable_use_buffer_map () || ! gimp_item_is_valid (drawable_ID))
+    return NULL;
+
+  format = gimp_drawable_get_format (drawable_ID);
+
+  request.drawable_ID = drawable_ID;
+  request.shadow      = FALSE;
+
+  if (! gp_buffer_map_req_write (_writechannel, &request, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_BUFFER_MAP);
+
+  reply = msg.data;
+
+  if (reply->map_ID == -1)
+    {
+      gimp_wire_destroy (&msg);
+
+      return NULL;
+    }
+
+  map = g_slice_new0 (GimpDrawableBufferMap);
+
+  map->map_ID = reply->map_ID;
+  map->size   = (gsize) reply->width * reply->height * reply->bpp;
+  map->addr   = MAP_FAILED;
+
+  map->extent.width  = reply->width;
+  map->extent.height = reply->height;
+
+  if (reply->path && reply->bpp == babl_format_get_bytes_per_pixel (format))
+    {
+      gint fd = g_open (reply->path, O_RDWR, 0);
+
+      if (fd != -1)
+        {
+          map->addr = mmap (NULL, map->size,
+                            PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd, 0);
+
+          close (fd);
+        }
+    }
+
+  if (map->addr != MAP_FAILED)
+    {
+      buffer = gegl_buffer_linear_new_from_data (map->addr, format,
+                                                 &map->extent,
+                                                 reply->width * reply->bpp,
+                                                 (GDestroyNotify)
+                                                 gimp_drawable_unmap_buffer,
+                                                 map);
+
+      gegl_buffer_signal_connect (buffer, "changed",
+                                  G_CALLBACK (gimp_drawable_buffer_changed),
+                                  map);
+
+      g_mutex_lock (&buffer_maps_mutex);
+      buffer_maps = g_list_prepend (buffer_maps, map);
+      g_mutex_unlock (&buffer_maps_mutex);
+    }
+
+  gimp_wire_destroy (&msg);
+
+  /*  give the mapping back if we couldn't use it  */
+  if (! buffer)
+    gimp_drawable_unmap_buffer (map);
+
+  return buffer;
+
+#else
+
+  return NULL;
+
+#endif
+}
+
+static void
+gimp_drawable_unmap_buffer (GimpDrawableBufferMap *map)
+{
+#ifdef USE_BUFFER_MAP
+  extern GIOChannel *_writechannel;
+
+  GPBufferUnmap   unmap;
+  GimpWireMessage msg;
+
+  g_mutex_lock (&buffer_maps_mutex);
+
+  buffer_maps = g_list_remove (buffer_maps, map);
+
+  unmap.map_ID       = map->map_ID;
+  unmap.dirty_x      = map->dirty.x;
+  unmap.dirty_y      = map->dirty.y;
+  unmap.dirty_width  = map->dirty.width;
+  unmap.dirty_height = map->dirty.height;
+
+  g_mutex_unlock (&buffer_maps_mutex);
+
+  if (map->addr != MAP_FAILED)
+    munmap (map->addr, map->size);
+
+  if (! gp_buffer_unmap_write (_writechannel, &unmap, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+
+  g_slice_free (GimpDrawableBufferMap, map);
+#endif
+}
+
+static void
+gimp_drawable_buffer_changed (GeglBuffer            *buffer,
+                              const GeglRectangle   *rect,
+                              GimpDrawableBufferMap *map)
+{
+  g_mutex_lock (&buffer_maps_mutex);
+
+  if (map->dirty.width > 0 && map->dirty.height > 0)
+    gegl_rectangle_bounding_box (&map->dirty, &map->dirty, rect);
+  else
+    map->dirty = *rect;
+
+  g_mutex_unlock (&buffer_maps_mutex);
+}
@@ -2933,3 +2933,68 @@ gimp_image_get_parasite_list (gint32  image_ID,
 
   return parasites;
 }
+
+/**
+ * gimp_image_get_projection_stats:
+ * @image_ID: The image.
+ * @pixels_per_second: The render throughput in pixels per second.
+ * @n_chunks: The number of rendered chunks.
+ * @n_overruns: The number of iterations which exceeded the time budget.
+ * @num_bins: The number of histogram bins.
+ * @latency_bins: The iteration latency histogram. The returned value must be freed with g_free().
+ *
+ * Returns render statistics of the image's projection.
+ *
+ * This procedure returns the statistics collected while rendering the
+ * image's projection: the render throughput in pixels per second, the
+ * number of rendered chunks, the number of chunk renderer iterations
+ * which exceeded the renderer's time budget, and a histogram of
+ * iteration latencies. The first bin of the histogram counts
+ * iterations taking less than 1 ms, bin i counts iterations taking
+ * between 2^(i-1) and 2^i ms, and the last bin counts all slower ones.
+ *
+ * Returns: TRUE on success.
+ *
+ * Since: 2.10
+ **/
+gboolean
+gimp_image_get_projection_stats (gint32    image_ID,
+                                 gdouble  *pixels_per_second,
+                                 gint     *n_chunks,
+                                 gint     *n_overruns,
+                                 gint     *num_bins,
+                                 gint32  **latency_bins)
+{
+  GimpParam *return_vals;
+  gint nreturn_vals;
+  gboolean success = TRUE;
+
+  return_vals = gimp_run_procedure ("gimp-image-get-projection-stats",
+                                    &nreturn_vals,
+                                    GIMP_PDB_IMAGE, image_ID,
+                                    GIMP_PDB_END);
+
+  *pixels_per_second = 0.0;
+  *n_chunks = 0;
+  *n_overruns = 0;
+  *num_bins = 0;
+  *latency_bins = NULL;
+
+  success = return_vals[0].data.d_status == GIMP_PDB_SUCCESS;
+
+  if (success)
+    {
+      *pixels_per_second = return_vals[1].data.d_float;
+      *n_chunks = return_vals[2].data.d_int32;
+      *n_overruns = return_vals[3].data.d_int32;
+      *num_bins = return_vals[4].data.d_int32;
+      *latency_bins = g_new (gint32, *num_bins);
+      memcpy (*latency_bins,
+              return_vals[5].data.d_int32array,
+              *num_bins * sizeof (gint32));
+    }
+
+  gimp_destroy_params (return_vals, nreturn_vals);
+
+  return success;
+}
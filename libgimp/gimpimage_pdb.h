@@ -198,6 +198,12 @@ GimpParasite*            gimp_image_get_parasite             (gint32
                                                               const gchar         *name);
 gchar**                  gimp_image_get_parasite_list        (gint32               image_ID,
                                                               gint                *num_parasites);
+gboolean                 gimp_image_get_projection_stats     (gint32               image_ID,
+                                                              gdouble             *pixels_per_second,
+                                                              gint                *n_chunks,
+                                                              gint                *n_overruns,
+                                                              gint                *num_bins,
+                                                              gint32             **latency_bins);
 
 
 G_END_DECLS
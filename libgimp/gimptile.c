@@ -54,6 +54,18 @@ void         gimp_read_expect_msg   (GimpWireMessage *msg,
 
 static void  gimp_tile_get          (GimpTile        *tile);
 static void  gimp_tile_put          (GimpTile        *tile);
+static void  gimp_tile_get_batch    (GimpDrawable    *drawable,
+                                     gboolean         shadow,
+                                     gint             col,
+                                     gint             row,
+                                     gint             n_cols,
+                                     gint             n_rows);
+static void  gimp_tile_put_batch    (GimpDrawable    *drawable,
+                                     gboolean         shadow,
+                                     gint             col,
+                                     gint             row,
+                                     gint             n_cols,
+                                     gint             n_rows);
 static void  gimp_tile_cache_insert (GimpTile        *tile);
 static void  gimp_tile_cache_flush  (GimpTile        *tile);
 
@@ -79,7 +91,10 @@ gimp_tile_ref (GimpTile *tile)
 
   if (tile->ref_count == 1)
     {
-      gimp_tile_get (tile);
+      /*  the data may already have been fetched by a tile batch  */
+      if (! tile->data)
+        gimp_tile_get (tile);
+
       tile->dirty = FALSE;
     }
 
@@ -184,6 +199,155 @@ _gimp_tile_cache_flush_drawable (GimpDrawable *drawable)
     }
 }
 
+/*  references all tiles in the given rectangle, fetching the ones
+ *  which are not referenced yet with as few round trips as possible
+ */
+void
+_gimp_tile_ref_batch (GimpDrawable *drawable,
+                      gboolean      shadow,
+                      gint          col,
+                      gint          row,
+                      gint          n_cols,
+                      gint          n_rows)
+{
+  gint cols_step;
+  gint rows_step;
+  gint r, c;
+
+  g_return_if_fail (drawable != NULL);
+
+  n_cols = MIN (n_cols, (gint) drawable->ntile_cols - col);
+  n_rows = MIN (n_rows, (gint) drawable->ntile_rows - row);
+
+  if (n_cols <= 0 || n_rows <= 0)
+    return;
+
+  cols_step = MIN (n_cols, GP_TILE_BATCH_MAX_TILES);
+  rows_step = MAX (GP_TILE_BATCH_MAX_TILES / cols_step, 1);
+
+  for (r = row; r < row + n_rows; r += rows_step)
+    for (c = col; c < col + n_cols; c += cols_step)
+      {
+        gint     batch_rows = MIN (rows_step, row + n_rows - r);
+        gint     batch_cols = MIN (cols_step, col + n_cols - c);
+        gboolean missing    = FALSE;
+        gint     i, j;
+
+        for (i = 0; i < batch_rows && ! missing; i++)
+          for (j = 0; j < batch_cols && ! missing; j++)
+            {
+              GimpTile *tile = gimp_drawable_get_tile (drawable, shadow,
+                                                       r + i, c + j);
+
+              missing = (tile->ref_count == 0);
+            }
+
+        if (missing)
+          gimp_tile_get_batch (drawable, shadow,
+                               c, r, batch_cols, batch_rows);
+
+        for (i = 0; i < batch_rows; i++)
+          for (j = 0; j < batch_cols; j++)
+            gimp_tile_ref (gimp_drawable_get_tile (drawable, shadow,
+                                                   r + i, c + j));
+      }
+}
+
+/*  unreferences all tiles in the given rectangle, if @dirty is TRUE
+ *  their data is transferred to the core in as few round trips as
+ *  possible first
+ */
+void
+_gimp_tile_unref_batch (GimpDrawable *drawable,
+                        gboolean      shadow,
+                        gint          col,
+                        gint          row,
+                        gint          n_cols,
+                        gint          n_rows,
+                        gboolean      dirty)
+{
+  gint cols_step;
+  gint rows_step;
+  gint r, c;
+
+  g_return_if_fail (drawable != NULL);
+
+  n_cols = MIN (n_cols, (gint) drawable->ntile_cols - col);
+  n_rows = MIN (n_rows, (gint) drawable->ntile_rows - row);
+
+  if (n_cols <= 0 || n_rows <= 0)
+    return;
+
+  cols_step = MIN (n_cols, GP_TILE_BATCH_MAX_TILES);
+  rows_step = MAX (GP_TILE_BATCH_MAX_TILES / cols_step, 1);
+
+  for (r = row; r < row + n_rows; r += rows_step)
+    for (c = col; c < col + n_cols; c += cols_step)
+      {
+        gint batch_rows = MIN (rows_step, row + n_rows - r);
+        gint batch_cols = MIN (cols_step, col + n_cols - c);
+        gint i, j;
+
+        if (dirty)
+          gimp_tile_put_batch (drawable, shadow,
+                               c, r, batch_cols, batch_rows);
+
+        for (i = 0; i < batch_rows; i++)
+          for (j = 0; j < batch_cols; j++)
+            gimp_tile_unref (gimp_drawable_get_tile (drawable, shadow,
+                                                     r + i, c + j),
+                             FALSE);
+      }
+}
+
+/*  transfers all dirty tiles of @drawable to the core, batching
+ *  adjacent tiles of each tile row
+ */
+void
+_gimp_tile_flush_dirty (GimpDrawable *drawable,
+                        gboolean      shadow)
+{
+  GimpTile *tiles;
+  gint      row;
+
+  g_return_if_fail (drawable != NULL);
+
+  tiles = shadow ? drawable->shadow_tiles : drawable->tiles;
+
+  if (! tiles)
+    return;
+
+  for (row = 0; row < drawable->ntile_rows; row++)
+    {
+      GimpTile *row_tiles = tiles + row * drawable->ntile_cols;
+      gint      col       = 0;
+
+      while (col < drawable->ntile_cols)
+        {
+          gint n = 0;
+
+          while (col + n < drawable->ntile_cols &&
+                 n < GP_TILE_BATCH_MAX_TILES    &&
+                 row_tiles[col + n].ref_count > 0 &&
+                 row_tiles[col + n].dirty)
+            {
+              n++;
+            }
+
+          if (n > 0)
+            {
+              gimp_tile_put_batch (drawable, shadow, col, row, n, 1);
+
+              col += n;
+            }
+          else
+            {
+              col++;
+            }
+        }
+    }
+}
+
 
 /*  private functions  */
 
@@ -283,6 +447,172 @@ gimp_tile_put (GimpTile *tile)
   gimp_wire_destroy (&msg);
 }
 
+/*  fetches the tiles in the given rectangle which are not referenced
+ *  yet, the rectangle must not contain more than
+ *  GP_TILE_BATCH_MAX_TILES tiles
+ */
+static void
+gimp_tile_get_batch (GimpDrawable *drawable,
+                     gboolean      shadow,
+                     gint          col,
+                     gint          row,
+                     gint          n_cols,
+                     gint          n_rows)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileBatchReq   batch_req;
+  GPTileBatchData *batch_data;
+  GimpWireMessage  msg;
+  const guchar    *src;
+  gsize            length = 0;
+  gint             i, j;
+
+  batch_req.drawable_ID = drawable->drawable_id;
+  batch_req.shadow      = shadow;
+  batch_req.tile_col    = col;
+  batch_req.tile_row    = row;
+  batch_req.n_tile_cols = n_cols;
+  batch_req.n_tile_rows = n_rows;
+
+  if (! gp_tile_batch_req_write (_writechannel, &batch_req, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_BATCH_DATA);
+
+  for (i = 0; i < n_rows; i++)
+    for (j = 0; j < n_cols; j++)
+      {
+        GimpTile *tile = gimp_drawable_get_tile (drawable, shadow,
+                                                 row + i, col + j);
+
+        length += tile->ewidth * tile->eheight * tile->bpp;
+      }
+
+  batch_data = msg.data;
+  if (batch_data->drawable_ID != drawable->drawable_id ||
+      batch_data->shadow      != shadow                ||
+      batch_data->tile_col    != col                   ||
+      batch_data->tile_row    != row                   ||
+      batch_data->n_tile_cols != n_cols                ||
+      batch_data->n_tile_rows != n_rows                ||
+      batch_data->bpp         != drawable->bpp         ||
+      batch_data->length      != length)
+    {
+      g_message ("received tile batch info did not match computed tile info");
+      gimp_quit ();
+    }
+
+  if (batch_data->use_shm)
+    src = gimp_shm_addr ();
+  else
+    src = batch_data->data;
+
+  for (i = 0; i < n_rows; i++)
+    for (j = 0; j < n_cols; j++)
+      {
+        GimpTile *tile = gimp_drawable_get_tile (drawable, shadow,
+                                                 row + i, col + j);
+        gsize     size = tile->ewidth * tile->eheight * tile->bpp;
+
+        /*  referenced tiles keep their own, possibly modified, data  */
+        if (tile->ref_count == 0 && ! tile->data)
+          tile->data = g_memdup (src, size);
+
+        src += size;
+      }
+
+  if (! gp_tile_ack_write (_writechannel, NULL))
+    gimp_quit ();
+
+  gimp_wire_destroy (&msg);
+}
+
+/*  transfers the data of the tiles in the given rectangle to the core,
+ *  all of them must be referenced, and the rectangle must not contain
+ *  more than GP_TILE_BATCH_MAX_TILES tiles
+ */
+static void
+gimp_tile_put_batch (GimpDrawable *drawable,
+                     gboolean      shadow,
+                     gint          col,
+                     gint          row,
+                     gint          n_cols,
+                     gint          n_rows)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileBatchReq   batch_req  = { 0, };
+  GPTileBatchData  batch_data = { 0, };
+  GPTileBatchData *batch_info;
+  GimpWireMessage  msg;
+  guchar          *dest;
+  gsize            length = 0;
+  gint             i, j;
+
+  batch_req.drawable_ID = -1;
+
+  if (! gp_tile_batch_req_write (_writechannel, &batch_req, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_BATCH_DATA);
+
+  batch_info = msg.data;
+
+  for (i = 0; i < n_rows; i++)
+    for (j = 0; j < n_cols; j++)
+      {
+        GimpTile *tile = gimp_drawable_get_tile (drawable, shadow,
+                                                 row + i, col + j);
+
+        length += tile->ewidth * tile->eheight * tile->bpp;
+      }
+
+  batch_data.drawable_ID = drawable->drawable_id;
+  batch_data.shadow      = shadow;
+  batch_data.tile_col    = col;
+  batch_data.tile_row    = row;
+  batch_data.n_tile_cols = n_cols;
+  batch_data.n_tile_rows = n_rows;
+  batch_data.bpp         = drawable->bpp;
+  batch_data.use_shm     = batch_info->use_shm;
+  batch_data.length      = length;
+
+  if (batch_info->use_shm)
+    {
+      dest = gimp_shm_addr ();
+    }
+  else
+    {
+      batch_data.data = g_malloc (length);
+
+      dest = batch_data.data;
+    }
+
+  for (i = 0; i < n_rows; i++)
+    for (j = 0; j < n_cols; j++)
+      {
+        GimpTile *tile = gimp_drawable_get_tile (drawable, shadow,
+                                                 row + i, col + j);
+        gsize     size = tile->ewidth * tile->eheight * tile->bpp;
+
+        memcpy (dest, tile->data, size);
+        dest += size;
+
+        tile->dirty = FALSE;
+      }
+
+  if (! gp_tile_batch_data_write (_writechannel, &batch_data, NULL))
+    gimp_quit ();
+
+  g_free (batch_data.data);
+
+  gimp_wire_destroy (&msg);
+
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+}
+
 /* This function is nearly identical to the function 'tile_cache_insert'
  *  in the file 'tile_cache.c' which is part of the main gimp application.
  */
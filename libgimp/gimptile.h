@@ -64,6 +64,22 @@ void    gimp_tile_cache_ntiles (gulong     ntiles);
 
 G_GNUC_INTERNAL void _gimp_tile_cache_flush_drawable (GimpDrawable *drawable);
 
+G_GNUC_INTERNAL void _gimp_tile_ref_batch            (GimpDrawable *drawable,
+                                                      gboolean      shadow,
+                                                      gint          col,
+                                                      gint          row,
+                                                      gint          n_cols,
+                                                      gint          n_rows);
+G_GNUC_INTERNAL void _gimp_tile_unref_batch          (GimpDrawable *drawable,
+                                                      gboolean      shadow,
+                                                      gint          col,
+                                                      gint          row,
+                                                      gint          n_cols,
+                                                      gint          n_rows,
+                                                      gboolean      dirty);
+G_GNUC_INTERNAL void _gimp_tile_flush_dirty          (GimpDrawable *drawable,
+                                                      gboolean      shadow);
+
 
 G_END_DECLS
 
@@ -170,6 +170,8 @@ gimp_tile_read_mul (GimpTileBackendPlugin *backend_plugin,
   tile       = gegl_tile_new (tile_size);
   tile_data  = gegl_tile_get_data (tile);
 
+  _gimp_tile_ref_batch (priv->drawable, priv->shadow, x, y, mul, mul);
+
   for (u = 0; u < mul; u++)
     {
       for (v = 0; v < mul; v++)
@@ -183,7 +185,6 @@ gimp_tile_read_mul (GimpTileBackendPlugin *backend_plugin,
           gimp_tile = gimp_drawable_get_tile (priv->drawable,
                                               priv->shadow,
                                               y + v, x + u);
-          gimp_tile_ref (gimp_tile);
 
           {
             gint ewidth           = gimp_tile->ewidth;
@@ -201,11 +202,11 @@ gimp_tile_read_mul (GimpTileBackendPlugin *backend_plugin,
                         gimp_tile_stride);
               }
           }
-
-          gimp_tile_unref (gimp_tile, FALSE);
         }
     }
 
+  _gimp_tile_unref_batch (priv->drawable, priv->shadow, x, y, mul, mul, FALSE);
+
   return tile;
 }
 
@@ -232,10 +233,11 @@ gimp_tile_write_mul (GimpTileBackendPlugin *backend_plugin,
               y + v >= priv->drawable->ntile_rows)
             continue;
 
+          /*  the tile is overwritten completely, no need to fetch it  */
           gimp_tile = gimp_drawable_get_tile (priv->drawable,
                                               priv->shadow,
                                               y+v, x+u);
-          gimp_tile_ref (gimp_tile);
+          gimp_tile_ref_zero (gimp_tile);
 
           {
             gint ewidth           = gimp_tile->ewidth;
@@ -251,10 +253,10 @@ gimp_tile_write_mul (GimpTileBackendPlugin *backend_plugin,
                       tile_stride + u * TILE_WIDTH * bpp,
                       gimp_tile_stride);
           }
-
-          gimp_tile_unref (gimp_tile, TRUE);
         }
     }
+
+  _gimp_tile_unref_batch (priv->drawable, priv->shadow, x, y, mul, mul, TRUE);
 }
 
 GeglTileBackend *
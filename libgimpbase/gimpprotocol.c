@@ -140,6 +140,54 @@ static void _gp_has_init_write           (GIOChannel       *channel,
                                           gpointer          user_data);
 static void _gp_has_init_destroy         (GimpWireMessage  *msg);
 
+static void _gp_tile_batch_req_read      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_req_write     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_req_destroy   (GimpWireMessage  *msg);
+
+static void _gp_tile_batch_data_read     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_data_write    (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_data_destroy  (GimpWireMessage  *msg);
+
+static void _gp_buffer_map_req_read      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_map_req_write     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_map_req_destroy   (GimpWireMessage  *msg);
+
+static void _gp_buffer_map_read          (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_map_write         (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_map_destroy       (GimpWireMessage  *msg);
+
+static void _gp_buffer_unmap_read        (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_unmap_write       (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_unmap_destroy     (GimpWireMessage  *msg);
+
+static void _gp_buffer_sync_read         (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_sync_write        (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_buffer_sync_destroy      (GimpWireMessage  *msg);
+
 
 
 void
@@ -197,6 +245,30 @@ gp_init (void)
                       _gp_has_init_read,
                       _gp_has_init_write,
                       _gp_has_init_destroy);
+  gimp_wire_register (GP_TILE_BATCH_REQ,
+                      _gp_tile_batch_req_read,
+                      _gp_tile_batch_req_write,
+                      _gp_tile_batch_req_destroy);
+  gimp_wire_register (GP_TILE_BATCH_DATA,
+                      _gp_tile_batch_data_read,
+                      _gp_tile_batch_data_write,
+                      _gp_tile_batch_data_destroy);
+  gimp_wire_register (GP_BUFFER_MAP_REQ,
+                      _gp_buffer_map_req_read,
+                      _gp_buffer_map_req_write,
+                      _gp_buffer_map_req_destroy);
+  gimp_wire_register (GP_BUFFER_MAP,
+                      _gp_buffer_map_read,
+                      _gp_buffer_map_write,
+                      _gp_buffer_map_destroy);
+  gimp_wire_register (GP_BUFFER_UNMAP,
+                      _gp_buffer_unmap_read,
+                      _gp_buffer_unmap_write,
+                      _gp_buffer_unmap_destroy);
+  gimp_wire_register (GP_BUFFER_SYNC,
+                      _gp_buffer_sync_read,
+                      _gp_buffer_sync_write,
+                      _gp_buffer_sync_destroy);
 }
 
 gboolean
@@ -352,7 +424,7 @@ gp_temp_proc_run_write (GIOChannel *channel,
 gboolean
 gp_temp_proc_return_write (GIOChannel   *channel,
                            GPProcReturn *proc_return,
-                           gpointer      user_data)
+                           gpointer       user_data)
 {
   GimpWireMessage msg;
 
@@ -442,6 +514,120 @@ gp_has_init_write (GIOChannel *channel,
   return TRUE;
 }
 
+gboolean
+gp_tile_batch_req_write (GIOChannel     *channel,
+                         GPTileBatchReq *tile_batch_req,
+                         gpointer        user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_BATCH_REQ;
+  msg.data = tile_batch_req;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_batch_data_write (GIOChannel      *channel,
+                          GPTileBatchData *tile_batch_data,
+                          gpointer         user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_BATCH_DATA;
+  msg.data = tile_batch_data;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_buffer_map_req_write (GIOChannel     *channel,
+                         GPBufferMapReq *buffer_map_req,
+                         gpointer        user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_BUFFER_MAP_REQ;
+  msg.data = buffer_map_req;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_buffer_map_write (GIOChannel  *channel,
+                     GPBufferMap *buffer_map,
+                     gpointer     user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_BUFFER_MAP;
+  msg.data = buffer_map;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_buffer_unmap_write (GIOChannel    *channel,
+                       GPBufferUnmap *buffer_unmap,
+                       gpointer       user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_BUFFER_UNMAP;
+  msg.data = buffer_unmap;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_buffer_sync_write (GIOChannel   *channel,
+                      GPBufferSync *buffer_sync,
+                      gpointer      user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_BUFFER_SYNC;
+  msg.data = buffer_sync;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
 /*  quit  */
 
 static void
@@ -1868,3 +2054,471 @@ static void
 _gp_has_init_destroy (GimpWireMessage *msg)
 {
 }
+
+/*  tile_batch_req  */
+
+static void
+_gp_tile_batch_req_read (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPTileBatchReq *tile_batch_req = g_slice_new0 (GPTileBatchReq);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &tile_batch_req->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_req->shadow, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_req->tile_col, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_req->tile_row, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_req->n_tile_cols, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_req->n_tile_rows, 1, user_data))
+    goto cleanup;
+
+  msg->data = tile_batch_req;
+  return;
+
+ cleanup:
+  g_slice_free (GPTileBatchReq, tile_batch_req);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_batch_req_write (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPTileBatchReq *tile_batch_req = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &tile_batch_req->drawable_ID,
+                                1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_req->shadow, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_req->tile_col, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_req->tile_row, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_req->n_tile_cols, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_req->n_tile_rows, 1, user_data))
+    return;
+}
+
+static void
+_gp_tile_batch_req_destroy (GimpWireMessage *msg)
+{
+  GPTileBatchReq *tile_batch_req = msg->data;
+
+  if (tile_batch_req)
+    g_slice_free (GPTileBatchReq, tile_batch_req);
+}
+
+/*  tile_batch_data  */
+
+static void
+_gp_tile_batch_data_read (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPTileBatchData *tile_batch_data = g_slice_new0 (GPTileBatchData);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &tile_batch_data->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->shadow, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->tile_col, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->tile_row, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->n_tile_cols, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->n_tile_rows, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->bpp, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->use_shm, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &tile_batch_data->length, 1, user_data))
+    goto cleanup;
+
+  if (! tile_batch_data->use_shm && tile_batch_data->length > 0)
+    {
+      tile_batch_data->data = g_try_malloc (tile_batch_data->length);
+
+      if (! tile_batch_data->data)
+        goto cleanup;
+
+      if (! _gimp_wire_read_int8 (channel,
+                                  (guint8 *) tile_batch_data->data,
+                                  tile_batch_data->length,
+                                  user_data))
+        goto cleanup;
+    }
+
+  msg->data = tile_batch_data;
+  return;
+
+ cleanup:
+  g_free (tile_batch_data->data);
+  g_slice_free (GPTileBatchData, tile_batch_data);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_batch_data_write (GIOChannel      *channel,
+                           GimpWireMessage *msg,
+                           gpointer         user_data)
+{
+  GPTileBatchData *tile_batch_data = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &tile_batch_data->drawable_ID,
+                                1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->shadow, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->tile_col, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->tile_row, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->n_tile_cols, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->n_tile_rows, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->bpp, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->use_shm, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &tile_batch_data->length, 1, user_data))
+    return;
+
+  if (! tile_batch_data->use_shm && tile_batch_data->length > 0)
+    {
+      if (! _gimp_wire_write_int8 (channel,
+                                   (const guint8 *) tile_batch_data->data,
+                                   tile_batch_data->length,
+                                   user_data))
+        return;
+    }
+}
+
+static void
+_gp_tile_batch_data_destroy (GimpWireMessage *msg)
+{
+  GPTileBatchData *tile_batch_data = msg->data;
+
+  if (tile_batch_data)
+    {
+      g_free (tile_batch_data->data);
+
+      g_slice_free (GPTileBatchData, tile_batch_data);
+    }
+}
+
+/*  buffer_map_req  */
+
+static void
+_gp_buffer_map_req_read (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPBufferMapReq *buffer_map_req = g_slice_new0 (GPBufferMapReq);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_map_req->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &buffer_map_req->shadow, 1, user_data))
+    goto cleanup;
+
+  msg->data = buffer_map_req;
+  return;
+
+ cleanup:
+  g_slice_free (GPBufferMapReq, buffer_map_req);
+  msg->data = NULL;
+}
+
+static void
+_gp_buffer_map_req_write (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPBufferMapReq *buffer_map_req = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_map_req->drawable_ID,
+                                1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &buffer_map_req->shadow, 1, user_data))
+    return;
+}
+
+static void
+_gp_buffer_map_req_destroy (GimpWireMessage *msg)
+{
+  GPBufferMapReq *buffer_map_req = msg->data;
+
+  if (buffer_map_req)
+    g_slice_free (GPBufferMapReq, buffer_map_req);
+}
+
+/*  buffer_map  */
+
+static void
+_gp_buffer_map_read (GIOChannel      *channel,
+                     GimpWireMessage *msg,
+                     gpointer         user_data)
+{
+  GPBufferMap *buffer_map = g_slice_new0 (GPBufferMap);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_map->map_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &buffer_map->width, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &buffer_map->height, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &buffer_map->bpp, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_string (channel,
+                                &buffer_map->path, 1, user_data))
+    goto cleanup;
+
+  msg->data = buffer_map;
+  return;
+
+ cleanup:
+  g_slice_free (GPBufferMap, buffer_map);
+  msg->data = NULL;
+}
+
+static void
+_gp_buffer_map_write (GIOChannel      *channel,
+                      GimpWireMessage *msg,
+                      gpointer         user_data)
+{
+  GPBufferMap *buffer_map = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_map->map_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &buffer_map->width, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &buffer_map->height, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &buffer_map->bpp, 1, user_data))
+    return;
+  if (! _gimp_wire_write_string (channel,
+                                 &buffer_map->path, 1, user_data))
+    return;
+}
+
+static void
+_gp_buffer_map_destroy (GimpWireMessage *msg)
+{
+  GPBufferMap *buffer_map = msg->data;
+
+  if (buffer_map)
+    {
+      g_free (buffer_map->path);
+
+      g_slice_free (GPBufferMap, buffer_map);
+    }
+}
+
+/*  buffer_unmap  */
+
+static void
+_gp_buffer_unmap_read (GIOChannel      *channel,
+                       GimpWireMessage *msg,
+                       gpointer         user_data)
+{
+  GPBufferUnmap *buffer_unmap = g_slice_new0 (GPBufferUnmap);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_unmap->map_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_unmap->dirty_x, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_unmap->dirty_y, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_unmap->dirty_width, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_unmap->dirty_height, 1,
+                               user_data))
+    goto cleanup;
+
+  msg->data = buffer_unmap;
+  return;
+
+ cleanup:
+  g_slice_free (GPBufferUnmap, buffer_unmap);
+  msg->data = NULL;
+}
+
+static void
+_gp_buffer_unmap_write (GIOChannel      *channel,
+                        GimpWireMessage *msg,
+                        gpointer         user_data)
+{
+  GPBufferUnmap *buffer_unmap = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_unmap->map_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_unmap->dirty_x, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_unmap->dirty_y, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_unmap->dirty_width, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_unmap->dirty_height, 1,
+                                user_data))
+    return;
+}
+
+static void
+_gp_buffer_unmap_destroy (GimpWireMessage *msg)
+{
+  GPBufferUnmap *buffer_unmap = msg->data;
+
+  if (buffer_unmap)
+    g_slice_free (GPBufferUnmap, buffer_unmap);
+}
+
+/*  buffer_sync  */
+
+static void
+_gp_buffer_sync_read (GIOChannel      *channel,
+                      GimpWireMessage *msg,
+                      gpointer         user_data)
+{
+  GPBufferSync *buffer_sync = g_slice_new0 (GPBufferSync);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_sync->map_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_sync->dirty_x, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_sync->dirty_y, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_sync->dirty_width, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &buffer_sync->dirty_height, 1,
+                               user_data))
+    goto cleanup;
+
+  msg->data = buffer_sync;
+  return;
+
+ cleanup:
+  g_slice_free (GPBufferSync, buffer_sync);
+  msg->data = NULL;
+}
+
+static void
+_gp_buffer_sync_write (GIOChannel      *channel,
+                       GimpWireMessage *msg,
+                       gpointer         user_data)
+{
+  GPBufferSync *buffer_sync = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_sync->map_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_sync->dirty_x, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_sync->dirty_y, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_sync->dirty_width, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &buffer_sync->dirty_height, 1,
+                                user_data))
+    return;
+}
+
+static void
+_gp_buffer_sync_destroy (GimpWireMessage *msg)
+{
+  GPBufferSync *buffer_sync = msg->data;
+
+  if (buffer_sync)
+    g_slice_free (GPBufferSync, buffer_sync);
+}
@@ -26,7 +26,7 @@ G_BEGIN_DECLS
 
 /* Increment every time the protocol changes
  */
-#define GIMP_PROTOCOL_VERSION  0x0015
+#define GIMP_PROTOCOL_VERSION  0x0017
 
 
 enum
@@ -43,14 +43,32 @@ enum
   GP_PROC_INSTALL,
   GP_PROC_UNINSTALL,
   GP_EXTENSION_ACK,
-  GP_HAS_INIT
+  GP_HAS_INIT,
+  GP_TILE_BATCH_REQ,
+  GP_TILE_BATCH_DATA,
+  GP_BUFFER_MAP_REQ,
+  GP_BUFFER_MAP,
+  GP_BUFFER_UNMAP,
+  GP_BUFFER_SYNC
 };
 
 
+/* The maximal number of tiles transferred by one GP_TILE_BATCH_REQ,
+ * the shared memory segment is large enough to hold that many tiles
+ */
+#define GP_TILE_BATCH_MAX_TILES  64
+
+
 typedef struct _GPConfig        GPConfig;
 typedef struct _GPTileReq       GPTileReq;
 typedef struct _GPTileAck       GPTileAck;
 typedef struct _GPTileData      GPTileData;
+typedef struct _GPTileBatchReq  GPTileBatchReq;
+typedef struct _GPTileBatchData GPTileBatchData;
+typedef struct _GPBufferMapReq  GPBufferMapReq;
+typedef struct _GPBufferMap     GPBufferMap;
+typedef struct _GPBufferUnmap   GPBufferUnmap;
+typedef struct _GPBufferSync    GPBufferSync;
 typedef struct _GPParam         GPParam;
 typedef struct _GPParamDef      GPParamDef;
 typedef struct _GPProcRun       GPProcRun;
@@ -103,6 +121,74 @@ struct _GPTileData
   guchar  *data;
 };
 
+struct _GPTileBatchReq
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  guint32  tile_col;
+  guint32  tile_row;
+  guint32  n_tile_cols;
+  guint32  n_tile_rows;
+};
+
+/* The tiles of a batch are stored one after the other, row by row,
+ * each one packed with a rowstride of its own width times bpp
+ */
+struct _GPTileBatchData
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  guint32  tile_col;
+  guint32  tile_row;
+  guint32  n_tile_cols;
+  guint32  n_tile_rows;
+  guint32  bpp;
+  guint32  use_shm;
+  guint32  length;
+  guchar  *data;
+};
+
+struct _GPBufferMapReq
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+};
+
+/* The pixels of a mapped buffer are stored in the file at path,
+ * row by row, with a rowstride of width times bpp.  map_ID is -1
+ * if the core could not map the buffer.
+ */
+struct _GPBufferMap
+{
+  gint32   map_ID;
+  guint32  width;
+  guint32  height;
+  guint32  bpp;
+  gchar   *path;
+};
+
+/* The dirty rectangle is empty if the buffer was not modified
+ */
+struct _GPBufferUnmap
+{
+  gint32   map_ID;
+  gint32   dirty_x;
+  gint32   dirty_y;
+  gint32   dirty_width;
+  gint32   dirty_height;
+};
+
+/* Writes the dirty rectangle of a buffer back without unmapping it
+ */
+struct _GPBufferSync
+{
+  gint32   map_ID;
+  gint32   dirty_x;
+  gint32   dirty_y;
+  gint32   dirty_width;
+  gint32   dirty_height;
+};
+
 struct _GPParam
 {
   guint32 type;
@@ -224,6 +310,24 @@ gboolean  gp_extension_ack_write    (GIOChannel      *channel,
                                      gpointer         user_data);
 gboolean  gp_has_init_write         (GIOChannel      *channel,
                                      gpointer         user_data);
+gboolean  gp_tile_batch_req_write   (GIOChannel      *channel,
+                                     GPTileBatchReq  *tile_batch_req,
+                                     gpointer         user_data);
+gboolean  gp_tile_batch_data_write  (GIOChannel      *channel,
+                                     GPTileBatchData *tile_batch_data,
+                                     gpointer         user_data);
+gboolean  gp_buffer_map_req_write   (GIOChannel      *channel,
+                                     GPBufferMapReq  *buffer_map_req,
+                                     gpointer         user_data);
+gboolean  gp_buffer_map_write       (GIOChannel      *channel,
+                                     GPBufferMap     *buffer_map,
+                                     gpointer         user_data);
+gboolean  gp_buffer_unmap_write     (GIOChannel      *channel,
+                                     GPBufferUnmap   *buffer_unmap,
+                                     gpointer         user_data);
+gboolean  gp_buffer_sync_write      (GIOChannel      *channel,
+                                     GPBufferSync    *buffer_sync,
+                                     gpointer         user_data);
 
 void      gp_params_destroy         (GPParam         *params,
                                      gint             nparams);